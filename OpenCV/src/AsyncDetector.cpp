@@ -0,0 +1,189 @@
+﻿#include "AsyncDetector.h"
+#include "FrameTracer.h"
+#include "ModelCache.h"
+#include "StageMetrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+// Пределы доли ядра для adaptive
+const double kMinLoad = 0.05;
+const double kMaxLoad = 1.0;
+
+cv::Scalar trackColor(int id) {
+    // Устойчивый цвет по номеру трека
+    uint32_t hash = static_cast<uint32_t>(id) * 2654435761u;
+    return cv::Scalar(64 + (hash & 0x7F), 64 + ((hash >> 8) & 0x7F), 64 + ((hash >> 16) & 0x7F));
+}
+}
+
+AsyncDetector::AsyncDetector(std::unique_ptr<YoloDetector> detector, const Options& options)
+    : m_detector(std::move(detector)), m_options(options), m_tracker(options.tracker) {
+    m_options.intervalMs = std::max(0.0, m_options.intervalMs);
+    m_options.targetLoad = std::min(kMaxLoad, std::max(kMinLoad, m_options.targetLoad));
+    m_stats.intervalMs = m_options.intervalMs;
+}
+
+AsyncDetector::~AsyncDetector() {
+    stop();
+}
+
+void AsyncDetector::start() {
+    if (m_running) {
+        return;
+    }
+    m_stop = false;
+    m_running = true;
+    m_nextTicks = 0;
+    // Поток сети откроет приём кадров после загрузки модели
+    m_idle = false;
+    m_thread = std::thread(&AsyncDetector::workerLoop, this);
+}
+
+void AsyncDetector::stop() {
+    if (!m_running) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_slotMutex);
+        m_stop = true;
+    }
+    m_slotReady.notify_all();
+    m_thread.join();
+    m_running = false;
+    m_ready = false;
+    m_idle = false;
+}
+
+bool AsyncDetector::submit(const cv::Mat& frame, uint64_t frameId, int64 captureTicks,
+    const std::vector<cv::Rect>& regions) {
+    ++m_offered;
+    // Поток сети занят или интервал не прошёл - кадр только показывается
+    if (!m_idle.load(std::memory_order_acquire) || cv::getTickCount() < m_nextTicks.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    // Из нескольких обработчиков кадр отдаёт один
+    bool idle = true;
+    if (!m_idle.compare_exchange_strong(idle, false, std::memory_order_acq_rel)) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_slotMutex);
+        frame.copyTo(m_slot);
+        m_slotFrameId = frameId;
+        m_slotTicks = captureTicks;
+        m_slotRegions.assign(regions.begin(), regions.end());
+        m_slotFull = true;
+    }
+    m_slotReady.notify_one();
+    return true;
+}
+
+void AsyncDetector::tracks(int64 captureTicks, std::vector<TrackedObject>& out) const {
+    {
+        std::lock_guard<std::mutex> lock(m_trackerMutex);
+        m_tracker.predict(captureTicks, out);
+    }
+    if (StageMetrics::instance().enabled()) {
+        double staleMs = 0.0;
+        for (const TrackedObject& object : out) {
+            staleMs = std::max(staleMs, object.staleMs);
+        }
+        if (!out.empty()) {
+            StageMetrics::instance().record(METRIC_DNN_STALENESS, static_cast<uint64_t>(staleMs * 1e6));
+        }
+    }
+}
+
+void AsyncDetector::draw(cv::Mat& frame, const std::vector<TrackedObject>& tracks) const {
+    for (const TrackedObject& object : tracks) {
+        cv::Rect box(cvRound(object.box.x), cvRound(object.box.y), cvRound(object.box.width), cvRound(object.box.height));
+        cv::Scalar color = trackColor(object.id);
+        cv::rectangle(frame, box, color, 2);
+
+        char label[96];
+        std::snprintf(label, sizeof(label), "#%d %s %.0f%%", object.id, m_detector->className(object.classId).c_str(),
+            object.confidence * 100.0f);
+        int baseline = 0;
+        cv::Size textSize = cv::getTextSize(label, cv::FONT_HERSHEY_SIMPLEX, 0.5, 1, &baseline);
+        int top = std::max(box.y, textSize.height + baseline);
+        cv::rectangle(frame, cv::Point(box.x, top - textSize.height - baseline),
+            cv::Point(box.x + textSize.width, top), color, cv::FILLED);
+        cv::putText(frame, label, cv::Point(box.x, top - baseline), cv::FONT_HERSHEY_SIMPLEX,
+            0.5, cv::Scalar(0, 0, 0), 1);
+    }
+}
+
+AsyncDetector::Stats AsyncDetector::stats() const {
+    std::lock_guard<std::mutex> lock(m_trackerMutex);
+    Stats stats = m_stats;
+    stats.offered = m_offered;
+    stats.tracks = static_cast<int>(m_tracker.trackCount());
+    return stats;
+}
+
+
+
+void AsyncDetector::workerLoop() {
+    FrameTracer::setThreadName("detector");
+    const double tickMs = 1e3 / cv::getTickFrequency();
+    if (!m_detector->loaded() && !m_detector->load()) {
+        std::cerr << "Async detector: model not loaded, detection disabled" << std::endl;
+        return;
+    }
+    m_ready.store(true, std::memory_order_release);
+    m_idle.store(true, std::memory_order_release);
+
+    while (true) {
+        uint64_t frameId = 0;
+        int64 captureTicks = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_slotMutex);
+            m_slotReady.wait(lock, [this] { return m_slotFull || m_stop; });
+            if (m_stop) {
+                return;
+            }
+            // Обмен буферами: копия следующего кадра пойдёт в освободившийся
+            cv::swap(m_slot, m_working);
+            m_slotRegions.swap(m_workingRegions);
+            m_slotFull = false;
+            frameId = m_slotFrameId;
+            captureTicks = m_slotTicks;
+        }
+
+        int64 startTicks = cv::getTickCount();
+        FrameTracer::setCurrentFrame(frameId);
+        const std::vector<Detection>* detections = nullptr;
+        {
+            TraceScope trace("detect");
+            detections = &m_detector->detectRegions(m_working, m_workingRegions);
+        }
+        int64 endTicks = cv::getTickCount();
+        StartupTimer::instance().markFirstDetection();
+        double inferenceMs = (endTicks - startTicks) * tickMs;
+        double latencyMs = (endTicks - captureTicks) * tickMs;
+        if (StageMetrics::instance().enabled()) {
+            StageMetrics::instance().record(METRIC_DNN_LATENCY, static_cast<uint64_t>(latencyMs * 1e6));
+        }
+
+        // Пауза после прохода: при adaptive сеть занимает не больше targetLoad ядра
+        double intervalMs = m_options.intervalMs;
+        if (m_options.adaptive) {
+            intervalMs = std::max(intervalMs, inferenceMs / m_options.targetLoad);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_trackerMutex);
+            m_tracker.update(*detections, captureTicks);
+            ++m_stats.completed;
+            m_stats.lastLatencyMs = latencyMs;
+            m_stats.latencySumMs += latencyMs;
+            m_stats.latencyMaxMs = std::max(m_stats.latencyMaxMs, latencyMs);
+            m_stats.lastInferenceMs = inferenceMs;
+            m_stats.intervalMs = intervalMs;
+        }
+
+        m_nextTicks.store(startTicks + static_cast<int64>(intervalMs / tickMs), std::memory_order_relaxed);
+        m_idle.store(true, std::memory_order_release);
+    }
+}
@@ -0,0 +1,98 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ObjectTracker.h"
+#include "yolo.h"
+
+// Асинхронная детекция объектов: YoloDetector работает в своём потоке и
+// берёт самый свежий кадр, как только освободится (и прошёл интервал
+// детекции); остальные кадры показываются без ожидания сети. Между
+// детекциями рамки переносятся трекером (IoU + Калман) на время захвата
+// показываемого кадра, у каждого объекта - номер трека.
+// Интервал задаётся явно или подстраивается: при adaptive поток детекции
+// занимает не больше targetLoad одного ядра (пауза после прохода сети
+// пропорциональна его времени).
+// Незагруженный детектор загружается в потоке сети при start(): кадры
+// показываются сразу, детекция начинается, как только модель готова.
+// submit() и tracks() можно вызывать из любого числа обработчиков.
+class AsyncDetector {
+public:
+    struct Options {
+        double intervalMs = 0.0;        // Наименьший интервал между запусками сети
+        bool adaptive = false;          // Интервал по времени прохода и targetLoad
+        double targetLoad = 0.5;        // Доля ядра для потока детекции (adaptive)
+        ObjectTracker::Options tracker;
+    };
+
+    struct Stats {
+        uint64_t offered = 0;           // Кадров передано в submit()
+        uint64_t completed = 0;         // Из них прошло через сеть
+        double lastLatencyMs = 0.0;     // Захват кадра -> рамки готовы (последняя детекция)
+        double latencySumMs = 0.0;
+        double latencyMaxMs = 0.0;
+        double lastInferenceMs = 0.0;   // Весь detect(): предобработка, сеть, разбор
+        double intervalMs = 0.0;        // Текущий интервал
+        int tracks = 0;
+    };
+
+    AsyncDetector(std::unique_ptr<YoloDetector> detector, const Options& options);
+    ~AsyncDetector();
+
+    void start();
+    void stop();
+    // Модель загружена и поток сети принимает кадры
+    bool ready() const { return m_ready.load(std::memory_order_acquire); }
+
+    // Кадр для детекции; копируется, только если поток сети свободен и
+    // интервал прошёл. regions - кропы для detectRegions (пусто - весь кадр).
+    // true - кадр взят
+    bool submit(const cv::Mat& frame, uint64_t frameId, int64 captureTicks,
+        const std::vector<cv::Rect>& regions = std::vector<cv::Rect>());
+    // Треки на момент захвата показываемого кадра
+    void tracks(int64 captureTicks, std::vector<TrackedObject>& out) const;
+    // Рамки с номерами треков и подписями классов
+    void draw(cv::Mat& frame, const std::vector<TrackedObject>& tracks) const;
+
+    Stats stats() const;
+    const YoloDetector& detector() const { return *m_detector; }
+    const Options& options() const { return m_options; }
+
+private:
+    std::unique_ptr<YoloDetector> m_detector;
+    Options m_options;
+
+    std::thread m_thread;
+    std::atomic<bool> m_stop{ false };
+    std::atomic<bool> m_running{ false };
+    std::atomic<bool> m_ready{ false };
+
+    // Поток сети готов принять кадр и момент, раньше которого кадр не берётся
+    std::atomic<bool> m_idle{ false };
+    std::atomic<int64> m_nextTicks{ 0 };
+
+    // Слот кадра: обработчик пишет, поток сети забирает обменом
+    mutable std::mutex m_slotMutex;
+    std::condition_variable m_slotReady;
+    cv::Mat m_slot;
+    bool m_slotFull = false;
+    uint64_t m_slotFrameId = 0;
+    int64 m_slotTicks = 0;
+    std::vector<cv::Rect> m_slotRegions;
+    cv::Mat m_working;
+    std::vector<cv::Rect> m_workingRegions;
+
+    // Трекер и статистика
+    mutable std::mutex m_trackerMutex;
+    ObjectTracker m_tracker;
+    Stats m_stats;
+    std::atomic<uint64_t> m_offered{ 0 };
+
+    void workerLoop();
+};
@@ -1,4 +1,5 @@
 #include "BitGrid.h"
+#include "StageMetrics.h"
 #include <fstream>
 #include <iostream>
 #include <cmath>
@@ -8,6 +9,29 @@
 
 using namespace std;
 
+namespace {
+// 8    byte        ;   - 
+inline uint64_t loadWord(const uint8_t* data, size_t size, size_t byte) {
+    uint64_t word = 0;
+    size_t count = min<size_t>(8, size - byte);
+    for (size_t i = 0; i < count; ++i) {
+        word |= static_cast<uint64_t>(data[byte + i]) << (8 * i);
+    }
+    return word;
+}
+
+inline int popcount64(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(value);
+#else
+    value = value - ((value >> 1) & 0x5555555555555555ULL);
+    value = (value & 0x3333333333333333ULL) + ((value >> 2) & 0x3333333333333333ULL);
+    value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<int>((value * 0x0101010101010101ULL) >> 56);
+#endif
+}
+}
+
 //   LZ4- 
 namespace LZ4Simple {
     vector<uint8_t> compress(const vector<uint8_t>& input) {
@@ -288,6 +312,7 @@ BitGrid::BitGrid(int width, int height)
 }
 
 BitGrid::BitGrid(const cv::Mat& edgeImage) {
+    ScopedStageTimer timer(METRIC_PACK);
     if (edgeImage.empty()) {
         m_width = 0;
         m_height = 0;
@@ -336,20 +361,35 @@ void BitGrid::clear() {
     fill(m_data.begin(), m_data.end(), 0);
 }
 
-cv::Mat BitGrid::toImage() const {
-    cv::Mat image(m_height, m_width, CV_8UC1, cv::Scalar(0));
+void BitGrid::setRegion(const cv::Mat& binary, const cv::Rect& roi) {
+    cv::Rect area = roi & cv::Rect(0, 0, min(m_width, binary.cols), min(m_height, binary.rows));
 
-    for (int y = 0; y < m_height; ++y) {
-        for (int x = 0; x < m_width; ++x) {
-            if (get(x, y)) {
-                image.at<uint8_t>(y, x) = 255;
-            }
+    for (int y = area.y; y < area.y + area.height; ++y) {
+        const uint8_t* row = binary.ptr<uint8_t>(y);
+        for (int x = area.x; x < area.x + area.width; ++x) {
+            setInternal(y * m_width + x, row[x] > 127);
         }
     }
+}
 
+cv::Mat BitGrid::toImage() const {
+    cv::Mat image;
+    toImage(image);
     return image;
 }
 
+void BitGrid::toImage(cv::Mat& image) const {
+    image.create(m_height, m_width, CV_8UC1);
+
+    for (int y = 0; y < m_height; ++y) {
+        uint8_t* row = image.ptr<uint8_t>(y);
+        int index = y * m_width;
+        for (int x = 0; x < m_width; ++x, ++index) {
+            row[x] = getInternal(index) ? 255 : 0;
+        }
+    }
+}
+
 vector<uint8_t> BitGrid::toBytes() const {
     vector<uint8_t> result;
 
@@ -444,6 +484,25 @@ BitGrid BitGrid::operator~() const {
     return result;
 }
 
+BitGrid BitGrid::upsampled(int factor, int width, int height) const {
+    BitGrid result(width, height);
+    if (m_width == 0 || m_height == 0 || factor <= 0) {
+        return result;
+    }
+
+    for (int y = 0; y < height; ++y) {
+        int srcRow = min(y / factor, m_height - 1) * m_width;
+        int dstRow = y * width;
+        for (int x = 0; x < width; ++x) {
+            if (getInternal(srcRow + min(x / factor, m_width - 1))) {
+                result.setInternal(dstRow + x, true);
+            }
+        }
+    }
+
+    return result;
+}
+
 int BitGrid::countTrue() const {
     int count = 0;
 
@@ -456,6 +515,34 @@ int BitGrid::countTrue() const {
     return count;
 }
 
+int BitGrid::countDifferent(const BitGrid& other, const cv::Rect& region) const {
+    if (m_width != other.m_width || m_height != other.m_height) {
+        return 0;
+    }
+    cv::Rect area = region & cv::Rect(0, 0, m_width, m_height);
+    const uint8_t* a = m_data.data();
+    const uint8_t* b = other.m_data.data();
+    const size_t bytes = m_data.size();
+
+    //   -   :   64   
+    //  (   - ),   
+    int count = 0;
+    for (int y = area.y; y < area.y + area.height; ++y) {
+        size_t bit = static_cast<size_t>(y) * m_width + area.x;
+        const size_t end = bit + area.width;
+        while (bit < end) {
+            size_t byte = bit >> 3;
+            int shift = static_cast<int>(bit & 7);
+            uint64_t word = loadWord(a, bytes, byte) ^ loadWord(b, bytes, byte);
+            int take = static_cast<int>(min<size_t>(64 - shift, end - bit));
+            uint64_t mask = take == 64 ? ~uint64_t(0) : (uint64_t(1) << take) - 1;
+            count += popcount64((word >> shift) & mask);
+            bit += take;
+        }
+    }
+    return count;
+}
+
 float BitGrid::density() const {
     if (size() == 0) {
         return 0.0f;
@@ -464,6 +551,7 @@ float BitGrid::density() const {
 }
 
 vector<uint8_t> BitGrid::compress(CompressionMethod method) const {
+    ScopedStageTimer timer(METRIC_COMPRESS);
     switch (method) {
     case COMPRESSION_RLE:
         return compressRLE();
@@ -476,7 +564,20 @@ vector<uint8_t> BitGrid::compress(CompressionMethod method) const {
     }
 }
 
+void BitGrid::compress(CompressionMethod method, vector<uint8_t>& out) const {
+    if (method != COMPRESSION_RLE) {
+        //       
+        vector<uint8_t> result = compress(method);
+        out.assign(result.begin(), result.end());
+        return;
+    }
+    ScopedStageTimer timer(METRIC_COMPRESS);
+    out.clear();
+    compressRLE(out);
+}
+
 bool BitGrid::decompress(const vector<uint8_t>& compressedData) {
+    ScopedStageTimer timer(METRIC_DECOMPRESS);
     if (compressedData.size() < 1) {
         return false;
     }
@@ -504,7 +605,11 @@ bool BitGrid::decompress(const vector<uint8_t>& compressedData) {
 
 vector<uint8_t> BitGrid::compressRLE() const {
     vector<uint8_t> result;
+    compressRLE(result);
+    return result;
+}
 
+void BitGrid::compressRLE(vector<uint8_t>& result) const {
     result.push_back(COMPRESSION_RLE);
 
     result.push_back((m_width >> 0) & 0xFF);
@@ -534,8 +639,6 @@ vector<uint8_t> BitGrid::compressRLE() const {
 
         i += count;
     }
-
-    return result;
 }
 
 bool BitGrid::decompressRLE(const vector<uint8_t>& data) {
@@ -24,9 +24,13 @@ public:
     bool get(int x, int y) const;
     void set(int x, int y, bool value);
     void clear();
+    //    roi      ,   
+    void setRegion(const cv::Mat& binary, const cv::Rect& roi);
 
     // 
     cv::Mat toImage() const;
+    //      (     )
+    void toImage(cv::Mat& image) const;
     std::vector<uint8_t> toBytes() const;
     void fromBytes(const std::vector<uint8_t>& data, int width, int height);
 
@@ -41,10 +45,14 @@ public:
     BitGrid operator&(const BitGrid& other) const;
     BitGrid operator|(const BitGrid& other) const;
     BitGrid operator~() const;
+    //   :     factor x factor
+    BitGrid upsampled(int factor, int width, int height) const;
 
     // 
     int countTrue() const;
     float density() const;
+    //          region (XOR + popcount  64 )
+    int countDifferent(const BitGrid& other, const cv::Rect& region) const;
 
     // 
     void save(const std::string& filename, CompressionMethod method = COMPRESSION_RLE) const;
@@ -52,6 +60,8 @@ public:
 
     //  
     std::vector<uint8_t> compress(CompressionMethod method = COMPRESSION_RLE) const;
+    //     :  RLE      
+    void compress(CompressionMethod method, std::vector<uint8_t>& out) const;
     bool decompress(const std::vector<uint8_t>& compressedData);
 
     //   
@@ -71,6 +81,7 @@ private:
 
     //   ( )
     std::vector<uint8_t> compressRLE() const;
+    void compressRLE(std::vector<uint8_t>& result) const;
     std::vector<uint8_t> compressLZ4() const;
     std::vector<uint8_t> compressHuffman() const;
 
@@ -0,0 +1,99 @@
+﻿#include "DetectionGate.h"
+#include "StageMetrics.h"
+#include <algorithm>
+
+namespace {
+// Наименьшая сторона тайла: меньшие тайлы реагируют на шум границ
+const int kMinTileSize = 8;
+}
+
+DetectionGate::DetectionGate(const Options& options) : m_options(options) {
+    m_options.tileSize = std::max(kMinTileSize, m_options.tileSize);
+    m_options.tileThreshold = std::min(1.0f, std::max(0.0f, m_options.tileThreshold));
+    m_options.minChangedTiles = std::max(1, m_options.minChangedTiles);
+    m_options.maxIntervalMs = std::max(0.0, m_options.maxIntervalMs);
+}
+
+GateDecision DetectionGate::check(const BitGrid& grid, int64 ticks) {
+    ScopedStageTimer timer(METRIC_DNN_GATE);
+    GateDecision decision = GATE_SKIP;
+
+    if (!m_hasReference || grid.width() != m_reference.width() || grid.height() != m_reference.height()) {
+        decision = GATE_FIRST;
+        m_stats.lastChangedTiles = 0;
+    }
+    else {
+        m_stats.lastChangedTiles = countChangedTiles(grid, m_options.minChangedTiles);
+        double elapsedMs = (ticks - m_referenceTicks) * 1e3 / cv::getTickFrequency();
+        if (m_stats.lastChangedTiles >= m_options.minChangedTiles) {
+            decision = GATE_ACTIVITY;
+        }
+        else if (m_options.maxIntervalMs > 0.0 && elapsedMs >= m_options.maxIntervalMs) {
+            decision = GATE_INTERVAL;
+        }
+    }
+    timer.stop();
+
+    ++m_stats.decisions;
+    MetricCounter counter = COUNTER_GATE_SKIP;
+    switch (decision) {
+    case GATE_FIRST:
+    case GATE_ACTIVITY:
+        ++m_stats.activity;
+        counter = COUNTER_GATE_ACTIVITY;
+        break;
+    case GATE_INTERVAL:
+        ++m_stats.interval;
+        counter = COUNTER_GATE_INTERVAL;
+        break;
+    default:
+        ++m_stats.skipped;
+        break;
+    }
+    if (StageMetrics::instance().enabled()) {
+        StageMetrics::instance().count(counter);
+    }
+    return decision;
+}
+
+void DetectionGate::accept(const BitGrid& grid, int64 ticks) {
+    // Копия в тот же буфер: при неизменном размере память не выделяется
+    m_reference = grid;
+    m_referenceTicks = ticks;
+    m_hasReference = true;
+    int tilesX = (grid.width() + m_options.tileSize - 1) / m_options.tileSize;
+    int tilesY = (grid.height() + m_options.tileSize - 1) / m_options.tileSize;
+    m_stats.tileCount = tilesX * tilesY;
+}
+
+void DetectionGate::invalidate() {
+    m_hasReference = false;
+}
+
+const char* DetectionGate::decisionName(GateDecision decision) {
+    switch (decision) {
+    case GATE_SKIP: return "skip";
+    case GATE_FIRST: return "first";
+    case GATE_ACTIVITY: return "activity";
+    case GATE_INTERVAL: return "interval";
+    default: return "unknown";
+    }
+}
+
+
+
+int DetectionGate::countChangedTiles(const BitGrid& grid, int limit) const {
+    const int tile = m_options.tileSize;
+    int changed = 0;
+    for (int y = 0; y < grid.height(); y += tile) {
+        for (int x = 0; x < grid.width(); x += tile) {
+            cv::Rect region(x, y, std::min(tile, grid.width() - x), std::min(tile, grid.height() - y));
+            // Порог в битах от площади тайла (краевые тайлы меньше); хотя бы один бит
+            int threshold = std::max(1, static_cast<int>(m_options.tileThreshold * region.area()));
+            if (grid.countDifferent(m_reference, region) >= threshold && ++changed >= limit) {
+                return changed;
+            }
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include "BitGrid.h"
+
+// Решение ворот детекции для кадра
+enum GateDecision {
+    GATE_SKIP = 0,      // Сцена не изменилась: остаются рамки прошлой детекции
+    GATE_FIRST = 1,     // Нет опорной сетки (первый кадр, смена размера или сброс)
+    GATE_ACTIVITY = 2,  // Изменилось достаточно тайлов сетки границ
+    GATE_INTERVAL = 3   // Сцена стоит, но истёк наибольший интервал между детекциями
+};
+
+// Ворота детекции по активности границ: сетка границ кадра сравнивается с
+// сеткой кадра последней детекции по тайлам (XOR + popcount по 64 бита).
+// Тайл изменён, если в нём различается больше tileThreshold битов; сеть
+// запускается, когда изменённых тайлов не меньше minChangedTiles, или раз в
+// maxIntervalMs для статичной сцены. Сравнение останавливается, как только
+// набрано minChangedTiles тайлов, поэтому в активной сцене оно почти бесплатно.
+// check() только решает; опорная сетка меняется в accept(), когда сеть
+// действительно взяла кадр (асинхронный детектор может быть занят).
+// Время - в тиках cv::getTickCount. Не потокобезопасен.
+class DetectionGate {
+public:
+    struct Options {
+        int tileSize = 32;              // Сторона тайла в битах сетки
+        float tileThreshold = 0.02f;    // Доля различающихся битов, с которой тайл изменён
+        int minChangedTiles = 2;        // Изменённых тайлов для запуска сети
+        double maxIntervalMs = 2000.0;  // Наибольший интервал между детекциями (0 - без ограничения)
+    };
+
+    struct Stats {
+        uint64_t decisions = 0;
+        uint64_t activity = 0;          // Запуски по изменению сцены (и первые кадры)
+        uint64_t interval = 0;          // Запуски по интервалу
+        uint64_t skipped = 0;
+        int lastChangedTiles = 0;       // Изменённых тайлов в последнем сравнении (не больше minChangedTiles)
+        int tileCount = 0;
+
+        double skipRate() const { return decisions ? static_cast<double>(skipped) / decisions : 0.0; }
+    };
+
+    explicit DetectionGate(const Options& options);
+
+    // Нужна ли детекция для кадра с сеткой grid, снятого в момент ticks
+    GateDecision check(const BitGrid& grid, int64 ticks);
+    // Сеть взяла кадр: его сетка становится опорной
+    void accept(const BitGrid& grid, int64 ticks);
+    // Следующий кадр пойдёт в сеть (например, после смены режима)
+    void invalidate();
+
+    const Stats& stats() const { return m_stats; }
+    const Options& options() const { return m_options; }
+    static const char* decisionName(GateDecision decision);
+    static bool runs(GateDecision decision) { return decision != GATE_SKIP; }
+
+private:
+    Options m_options;
+    Stats m_stats;
+    BitGrid m_reference;
+    bool m_hasReference = false;
+    int64 m_referenceTicks = 0;
+
+    int countChangedTiles(const BitGrid& grid, int limit) const;
+};
@@ -0,0 +1,171 @@
+﻿#include "DetectorSelector.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+// Пробный кадр: шум размера HD (разбор выхода зависит от числа кандидатов)
+const cv::Size kProbeSize(1280, 720);
+
+double percentile95(std::vector<double>& values) {
+    size_t rank = (values.size() * 95 + 99) / 100 - 1;
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank];
+}
+}
+
+DetectorSelector::DetectorSelector(const Options& options) : m_options(options) {
+    m_options.window = std::max(1, m_options.window);
+    m_options.minSamples = std::min(m_options.window, std::max(1, m_options.minSamples));
+    m_options.upgradeMargin = std::min(1.0, std::max(0.1, m_options.upgradeMargin));
+    m_options.upgradeFrames = std::max(1, m_options.upgradeFrames);
+    m_options.probeRuns = std::max(1, m_options.probeRuns);
+}
+
+bool DetectorSelector::load() {
+    if (m_options.candidates.empty()) {
+        std::cerr << "Budget: no candidate models" << std::endl;
+        return false;
+    }
+    if (!m_options.logPath.empty()) {
+        m_log.open(m_options.logPath, std::ios::app);
+        if (!m_log) {
+            std::cerr << "Budget: could not open log " << m_options.logPath << std::endl;
+        }
+    }
+
+    cv::Mat probe(kProbeSize, CV_8UC3);
+    cv::randu(probe, cv::Scalar::all(0), cv::Scalar::all(255));
+    std::vector<double> runs;
+    for (const Candidate& candidate : m_options.candidates) {
+        m_detectors.emplace_back(new YoloDetector(candidate.options));
+        YoloDetector& detector = *m_detectors.back();
+        if (!detector.load()) {
+            return false;
+        }
+        // Первый прогон - прогрев, затем базовый p95 полного detect()
+        detector.detect(probe);
+        runs.clear();
+        for (int run = 0; run < m_options.probeRuns; ++run) {
+            int64 startTicks = cv::getTickCount();
+            detector.detect(probe);
+            runs.push_back((cv::getTickCount() - startTicks) * 1e3 / cv::getTickFrequency());
+        }
+        m_baselineMs.push_back(percentile95(runs));
+        std::cout << "Budget: " << candidate.name << " baseline p95 " << m_baselineMs.back() << " ms" << std::endl;
+    }
+
+    m_startTicks = cv::getTickCount();
+    m_active = 0;
+    int initial = bestFitting(m_options.budgetMs * m_options.upgradeMargin, size() - 1);
+    char reason[160];
+    std::snprintf(reason, sizeof(reason), "initial: most accurate baseline within %.0f%% of budget %.1f ms",
+        m_options.upgradeMargin * 100.0, m_options.budgetMs);
+    switchTo(std::max(0, initial), 0.0, initial < 0 ? "initial: nothing fits the budget, fastest" : reason);
+    return true;
+}
+
+void DetectorSelector::record(double latencyMs) {
+    if (m_detectors.empty()) {
+        return;
+    }
+    if (m_window.size() < static_cast<size_t>(m_options.window)) {
+        m_window.push_back(latencyMs);
+    }
+    else {
+        m_window[m_windowNext] = latencyMs;
+    }
+    m_windowNext = (m_windowNext + 1) % m_options.window;
+    if (++m_samples < m_options.minSamples) {
+        return;
+    }
+
+    double p95 = activeP95();
+    m_loadFactor = p95 / std::max(1e-3, m_baselineMs[m_active]);
+    char reason[192];
+
+    // Вниз: сразу, на самую точную из укладывающихся (или самую быструю)
+    if (p95 > m_options.budgetMs) {
+        m_headroomFrames = 0;
+        if (m_active == 0) {
+            return;
+        }
+        int target = std::max(0, bestFitting(m_options.budgetMs, m_active - 1));
+        std::snprintf(reason, sizeof(reason), "p95 %.1f ms over budget %.1f ms (load x%.2f)",
+            p95, m_options.budgetMs, m_loadFactor);
+        switchTo(target, p95, reason);
+        return;
+    }
+
+    // Вверх: с запасом, устойчиво и не чаще cooldownMs
+    int target = bestFitting(m_options.budgetMs * m_options.upgradeMargin, size() - 1);
+    if (target <= m_active) {
+        m_headroomFrames = 0;
+        return;
+    }
+    if (++m_headroomFrames < m_options.upgradeFrames || secondsSince(m_switchTicks) * 1e3 < m_options.cooldownMs) {
+        return;
+    }
+    std::snprintf(reason, sizeof(reason), "headroom for %d frames: p95 %.1f ms, load x%.2f, within %.0f%% of budget %.1f ms",
+        m_headroomFrames, p95, m_loadFactor, m_options.upgradeMargin * 100.0, m_options.budgetMs);
+    switchTo(target, p95, reason);
+}
+
+double DetectorSelector::activeP95() const {
+    if (m_samples < m_options.minSamples || m_window.empty()) {
+        return 0.0;
+    }
+    m_sorted.assign(m_window.begin(), m_window.end());
+    return percentile95(m_sorted);
+}
+
+std::string DetectorSelector::describe() const {
+    std::string text = "budget " + std::to_string(cvRound(m_options.budgetMs)) + " ms over";
+    for (int i = 0; i < size(); ++i) {
+        text += (i ? ", " : " ") + m_options.candidates[i].name;
+    }
+    return text + "; active " + m_options.candidates[m_active].name + " (" + active().describe() + ")";
+}
+
+
+
+double DetectorSelector::secondsSince(int64 ticks) const {
+    return (cv::getTickCount() - ticks) / cv::getTickFrequency();
+}
+
+int DetectorSelector::bestFitting(double limitMs, int last) const {
+    for (int i = std::min(last, size() - 1); i >= 0; --i) {
+        if (m_baselineMs[i] * m_loadFactor <= limitMs) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void DetectorSelector::switchTo(int index, double p95Ms, const std::string& reason) {
+    Switch entry;
+    entry.timeSec = secondsSince(m_startTicks);
+    entry.from = m_switches.empty() ? -1 : m_active;
+    entry.to = index;
+    entry.p95Ms = p95Ms;
+    entry.estimateMs = m_baselineMs[index] * m_loadFactor;
+    entry.reason = reason;
+    m_switches.push_back(entry);
+
+    char line[320];
+    std::snprintf(line, sizeof(line), "Budget %.1f s: %s -> %s (estimated %.1f ms): %s", entry.timeSec,
+        entry.from < 0 ? "none" : m_options.candidates[entry.from].name.c_str(),
+        m_options.candidates[index].name.c_str(), entry.estimateMs, reason.c_str());
+    std::cout << line << std::endl;
+    if (m_log) {
+        m_log << line << std::endl;
+    }
+
+    // Окно новой конфигурации набирается заново
+    m_active = index;
+    m_window.clear();
+    m_windowNext = 0;
+    m_samples = 0;
+    m_headroomFrames = 0;
+    m_switchTicks = cv::getTickCount();
+}
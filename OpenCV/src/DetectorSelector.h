@@ -0,0 +1,99 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "yolo.h"
+
+// Выбор модели и размера входа под бюджет задержки кадра.
+// Пул загруженных конфигураций (модель x размер входа) упорядочен по
+// точности: от самой быстрой к самой точной. При загрузке каждая
+// конфигурация замеряется на пробном кадре (базовый p95). Во время работы
+// скользящий p95 активной конфигурации, отнесённый к её базовому, даёт
+// коэффициент загрузки машины; оценка любой конфигурации - её базовый p95,
+// умноженный на этот коэффициент. Активной становится самая точная
+// конфигурация, оценка которой укладывается в бюджет:
+// - вниз - сразу, как только p95 активной (не меньше minSamples замеров
+//   после переключения) превысил бюджет;
+// - вверх - только если оценка более точной конфигурации не больше
+//   upgradeMargin бюджета upgradeFrames кадров подряд и с прошлого
+//   переключения прошло cooldownMs (гистерезис против колебаний).
+// Каждое переключение записывается с причиной в журнал (stdout и logPath).
+// Не потокобезопасен: у каждого обработчика свой.
+class DetectorSelector {
+public:
+    struct Candidate {
+        std::string name;               // Для журнала, например "v8n@640"
+        YoloDetector::Options options;
+    };
+
+    struct Options {
+        std::vector<Candidate> candidates;  // По возрастанию точности
+        double budgetMs = 33.0;         // Бюджет детекции на кадр (p95)
+        int window = 30;                // Замеров в скользящем окне
+        int minSamples = 10;            // Замеров после переключения до решений
+        double upgradeMargin = 0.8;     // Доля бюджета для переключения вверх
+        int upgradeFrames = 30;         // Кадров подряд с запасом для переключения вверх
+        double cooldownMs = 2000.0;     // Наименьший интервал между переключениями вверх
+        int probeRuns = 5;              // Пробных прогонов на конфигурацию при загрузке
+        std::string logPath;            // Журнал переключений (дозапись), пусто - только stdout
+    };
+
+    // Запись журнала
+    struct Switch {
+        double timeSec = 0.0;           // От загрузки
+        int from = -1;                  // -1 - начальный выбор
+        int to = 0;
+        double p95Ms = 0.0;             // p95 активной конфигурации в момент решения
+        double estimateMs = 0.0;        // Оценка новой конфигурации
+        std::string reason;
+    };
+
+    explicit DetectorSelector(const Options& options);
+
+    // Загрузка пула, базовые замеры и начальный выбор
+    bool load();
+
+    YoloDetector& active() { return *m_detectors[m_active]; }
+    const YoloDetector& active() const { return *m_detectors[m_active]; }
+    // Время детекции кадра активной конфигурацией; может сменить активную
+    void record(double latencyMs);
+
+    int activeIndex() const { return m_active; }
+    int size() const { return static_cast<int>(m_detectors.size()); }
+    const Candidate& candidate(int index) const { return m_options.candidates[index]; }
+    double baselineMs(int index) const { return m_baselineMs[index]; }
+    // Скользящий p95 активной конфигурации (0 - мало замеров)
+    double activeP95() const;
+    double loadFactor() const { return m_loadFactor; }
+    const std::vector<Switch>& switches() const { return m_switches; }
+    const Options& options() const { return m_options; }
+    std::string describe() const;
+
+private:
+    Options m_options;
+    std::vector<std::unique_ptr<YoloDetector>> m_detectors;
+    std::vector<double> m_baselineMs;
+    int m_active = 0;
+
+    // Скользящее окно замеров активной конфигурации
+    std::vector<double> m_window;
+    size_t m_windowNext = 0;
+    mutable std::vector<double> m_sorted;
+    int m_samples = 0;                  // С последнего переключения
+    int m_headroomFrames = 0;
+    double m_loadFactor = 1.0;
+
+    int64 m_startTicks = 0;
+    int64 m_switchTicks = 0;
+    std::vector<Switch> m_switches;
+    std::ofstream m_log;
+
+    double secondsSince(int64 ticks) const;
+    // Самая точная конфигурация с оценкой не больше limitMs среди [0, last]; -1 - нет
+    int bestFitting(double limitMs, int last) const;
+    void switchTo(int index, double p95Ms, const std::string& reason);
+};
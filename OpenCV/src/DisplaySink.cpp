@@ -0,0 +1,42 @@
+﻿#include "DisplaySink.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+std::unique_ptr<DisplaySink> DisplaySink::create(bool headless, const std::string& title) {
+    if (headless) {
+        return std::unique_ptr<DisplaySink>(new NullSink());
+    }
+    return std::unique_ptr<DisplaySink>(new WindowSink(title));
+}
+
+
+
+WindowSink::WindowSink(const std::string& title)
+    : m_title(title) {
+    cv::namedWindow(m_title, cv::WINDOW_AUTOSIZE);
+}
+
+WindowSink::~WindowSink() {
+    cv::destroyAllWindows();
+}
+
+void WindowSink::show(const cv::Mat& frame) {
+    cv::imshow(m_title, frame);
+}
+
+int WindowSink::pollKey(int delayMs) {
+    return cv::waitKey(std::max(1, delayMs));
+}
+
+bool WindowSink::closed() const {
+    return cv::getWindowProperty(m_title, cv::WND_PROP_VISIBLE) < 1;
+}
+
+
+
+int NullSink::pollKey(int delayMs) {
+    // Без окна клавиш нет; короткая пауза, чтобы не занимать ядро обработчиков
+    std::this_thread::sleep_for(std::chrono::microseconds(100 * std::max(1, delayMs)));
+    return -1;
+}
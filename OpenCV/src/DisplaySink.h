@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <string>
+
+// Приёмник обработанных кадров в потоке отображения.
+// WindowSink показывает кадры окном HighGUI, NullSink ничего не рисует и
+// позволяет гонять конвейер на машинах без дисплея
+class DisplaySink {
+public:
+    virtual ~DisplaySink() = default;
+
+    static std::unique_ptr<DisplaySink> create(bool headless, const std::string& title);
+
+    virtual void show(const cv::Mat& frame) = 0;
+    // Нажатая клавиша или -1; ожидает не дольше delayMs
+    virtual int pollKey(int delayMs) = 0;
+    // Пользователь закрыл окно
+    virtual bool closed() const = 0;
+    // Рисовать ли HUD отображения (FPS, потери) поверх кадра
+    virtual bool visible() const = 0;
+};
+
+class WindowSink : public DisplaySink {
+public:
+    explicit WindowSink(const std::string& title);
+    ~WindowSink() override;
+
+    void show(const cv::Mat& frame) override;
+    int pollKey(int delayMs) override;
+    bool closed() const override;
+    bool visible() const override { return true; }
+
+private:
+    std::string m_title;
+};
+
+class NullSink : public DisplaySink {
+public:
+    void show(const cv::Mat&) override {}
+    int pollKey(int delayMs) override;
+    bool closed() const override { return false; }
+    bool visible() const override { return false; }
+};
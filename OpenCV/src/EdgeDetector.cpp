@@ -1,163 +1,5 @@
 #include "EdgeDetector.h"
 
 
-void CannyEdgeDetector::detectAndDraw(cv::Mat& frame) {
-    cv::Mat gray, blurred, edges;
-
-    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-    cv::GaussianBlur(gray, blurred, cv::Size(5, 5), 1.5);
-
-    cv::Canny(blurred, edges,
-        threshold1, threshold2,
-        apertureSize, useL2Gradient);
-
-    //     
-    cv::Mat result;
-    cv::cvtColor(edges, result, cv::COLOR_GRAY2BGR);
-
-    frame = result.clone();
-
-    cv::putText(frame, "Edge map", cv::Point(10, 30),
-        cv::FONT_HERSHEY_SIMPLEX, 0.7,
-        cv::Scalar(255, 255, 255), 2);
-}
-
-
-void CannyEdgeDetector::detectOnlyEdges(cv::Mat& frame) {
-    cv::Mat gray, blurred, edges;
-
-    // Convert to grayscale
-    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-
-    // Blur to reduce noise
-    cv::GaussianBlur(gray, blurred, cv::Size(5, 5), 1.5);
-
-    // Canny edge detection
-    cv::Canny(blurred, edges, threshold1, threshold2,
-        apertureSize, useL2Gradient);
-
-    // Convert to BGR for display
-    cv::cvtColor(edges, frame, cv::COLOR_GRAY2BGR);
-}
-
-BitGrid CannyEdgeDetector::getEdgeBitGrid(const cv::Mat& frame) {
-    cv::Mat gray, blurred, edges;
-
-    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-    cv::GaussianBlur(gray, blurred, cv::Size(5, 5), 1.5);
-
-    cv::Canny(blurred, edges,
-        threshold1, threshold2,
-        apertureSize, useL2Gradient);
-
-    //      
-    return BitGrid(edges);
-}
-
-
-
-void CombinedEdgeDetector::detectAndDraw(cv::Mat& frame) {
-    cv::Mat gray, edges, dilated, filled, eroded, result;
-
-    // 1.   -
-    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-
-    // 2.    
-    cv::GaussianBlur(gray, gray, cv::Size(5, 5), 1.5);
-    cv::Canny(gray, edges, cannyThreshold1, cannyThreshold2, 3);
-
-    // 3.  () 
-    cv::Mat dilateKernel = cv::getStructuringElement(cv::MORPH_RECT,
-        cv::Size(2 * dilationSize + 1, 2 * dilationSize + 1));
-    cv::dilate(edges, dilated, dilateKernel);
-
-    // 4.     (  + )
-    cv::Mat closed;
-    cv::morphologyEx(dilated, closed, cv::MORPH_CLOSE,
-        cv::getStructuringElement(cv::MORPH_RECT, cv::Size(15, 15)));
-
-    //       
-    cv::Mat mask = cv::Mat::zeros(closed.rows + 2, closed.cols + 2, CV_8UC1);
-    cv::floodFill(closed, mask, cv::Point(0, 0), cv::Scalar(255));
-    cv::bitwise_not(mask(cv::Rect(1, 1, frame.cols, frame.rows)), filled);
-
-    // 5.   
-    cv::Mat erodeKernel = cv::getStructuringElement(cv::MORPH_RECT,
-        cv::Size(2 * erosionSize + 1, 2 * erosionSize + 1));
-    cv::erode(filled, eroded, erodeKernel);
-
-    // 6. : filled - eroded ( )
-    cv::subtract(filled, eroded, result);
-
-    //       
-    cv::Mat resultColor;
-    cv::cvtColor(result, resultColor, cv::COLOR_GRAY2BGR);
-
-    //      ()
-    cv::addWeighted(frame, 0.7, resultColor, 0.3, 0, frame);
-
-    //   
-    cv::putText(frame, "  ( + )", cv::Point(10, 30),
-        cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 0), 2);
-    cv::putText(frame, " : " + std::to_string((int)cannyThreshold1) +
-        ", " + std::to_string((int)cannyThreshold2), cv::Point(10, 60),
-        cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 200, 255), 1);
-    cv::putText(frame, ": " + std::to_string(dilationSize) +
-        ", : " + std::to_string(erosionSize), cv::Point(10, 80),
-        cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 200, 255), 1);
-}
-
-void CombinedEdgeDetector::detectOnlyEdges(cv::Mat& frame) {
-    cv::Mat gray, edges, dilated, filled, eroded, result;
-    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-    cv::GaussianBlur(gray, gray, cv::Size(5, 5), 1.5);
-    cv::Canny(gray, edges, cannyThreshold1, cannyThreshold2, 3);
-
-    cv::Mat dilateKernel = cv::getStructuringElement(cv::MORPH_RECT,
-        cv::Size(2 * dilationSize + 1, 2 * dilationSize + 1));
-    cv::dilate(edges, dilated, dilateKernel);
-
-    cv::Mat closed;
-    cv::morphologyEx(dilated, closed, cv::MORPH_CLOSE,
-        cv::getStructuringElement(cv::MORPH_RECT, cv::Size(15, 15)));
-
-    cv::Mat mask = cv::Mat::zeros(closed.rows + 2, closed.cols + 2, CV_8UC1);
-    cv::floodFill(closed, mask, cv::Point(0, 0), cv::Scalar(255));
-    cv::bitwise_not(mask(cv::Rect(1, 1, frame.cols, frame.rows)), filled);
-
-    cv::Mat erodeKernel = cv::getStructuringElement(cv::MORPH_RECT,
-        cv::Size(2 * erosionSize + 1, 2 * erosionSize + 1));
-    cv::erode(filled, eroded, erodeKernel);
-
-    cv::subtract(filled, eroded, result);
-    cv::cvtColor(result, frame, cv::COLOR_GRAY2BGR);
-}
-
-BitGrid CombinedEdgeDetector::getEdgeBitGrid(const cv::Mat& frame) {
-    cv::Mat gray, edges, dilated, filled, eroded, result;
-
-    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-    cv::GaussianBlur(gray, gray, cv::Size(5, 5), 1.5);
-    cv::Canny(gray, edges, cannyThreshold1, cannyThreshold2, 3);
-
-    cv::Mat dilateKernel = cv::getStructuringElement(cv::MORPH_RECT,
-        cv::Size(2 * dilationSize + 1, 2 * dilationSize + 1));
-    cv::dilate(edges, dilated, dilateKernel);
-
-    cv::Mat closed;
-    cv::morphologyEx(dilated, closed, cv::MORPH_CLOSE,
-        cv::getStructuringElement(cv::MORPH_RECT, cv::Size(15, 15)));
-
-    cv::Mat mask = cv::Mat::zeros(closed.rows + 2, closed.cols + 2, CV_8UC1);
-    cv::floodFill(closed, mask, cv::Point(0, 0), cv::Scalar(255));
-    cv::bitwise_not(mask(cv::Rect(1, 1, frame.cols, frame.rows)), filled);
-
-    cv::Mat erodeKernel = cv::getStructuringElement(cv::MORPH_RECT,
-        cv::Size(2 * erosionSize + 1, 2 * erosionSize + 1));
-    cv::erode(filled, eroded, erodeKernel);
-
-    cv::subtract(filled, eroded, result);
-
-    //      
-    return BitGrid(result);
-}
\ No newline at end of file
+template class EdgePipeline<CannyStage<5>, PackStage>;
+template class EdgePipeline<CannyStage<5>, OutlineStage<15>, PackStage>;
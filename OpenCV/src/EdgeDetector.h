@@ -1,49 +1,23 @@
 #pragma once
 
 #include <opencv2/opencv.hpp>
-#include "bitGrid.h"
-
-class CannyEdgeDetector {
-public:
-    CannyEdgeDetector(double thresh1 = 100.0, double thresh2 = 200.0,
-        int aperture = 3, bool useL2 = false)
-        : threshold1(thresh1), threshold2(thresh2),
-        apertureSize(aperture), useL2Gradient(useL2) {
-    }
-
-    void detectAndDraw(cv::Mat& frame);
-    void detectOnlyEdges(cv::Mat& frame);
-    BitGrid getEdgeBitGrid(const cv::Mat& frame);
-
-private:
-    double threshold1;
-    double threshold2;
-    int apertureSize;
-    bool useL2Gradient;
-};
-
-
-
-class CombinedEdgeDetector {
-public:
-    CombinedEdgeDetector(double thresh1 = 50.0, double thresh2 = 150.0, 
-                         int dilateSize = 2, int erodeSize = 2)
-        : cannyThreshold1(thresh1), cannyThreshold2(thresh2),
-          dilationSize(dilateSize), erosionSize(erodeSize) {}
-
-    //     https://engjournal.bmstu.ru/articles/920/920.pdf
-    // 1.    
-    // 2.   
-    // 3.    
-    // 4.   
-    // 5.    3  4
-    void detectAndDraw(cv::Mat& frame);
-    void detectOnlyEdges(cv::Mat& frame);
-    BitGrid getEdgeBitGrid(const cv::Mat& frame);
-
-private:
-    double cannyThreshold1;
-    double cannyThreshold2;
-    int dilationSize;
-    int erosionSize;
-};
\ No newline at end of file
+#include "BitGrid.h"
+#include "EdgePipeline.h"
+
+//     EdgePipeline.   
+// : setThresholds, setAperture, setL2Gradient, setMorphology  . .
+
+//  +  5x5 + ,   BitGrid
+using CannyEdgeDetector = EdgePipeline<CannyStage<5>, PackStage>;
+
+//     https://engjournal.bmstu.ru/articles/920/920.pdf
+// 1.    
+// 2.   
+// 3.    
+// 4.   
+// 5.    3  4
+using CombinedEdgeDetector = EdgePipeline<CannyStage<5>, OutlineStage<15>, PackStage>;
+
+//       EdgeDetector.cpp
+extern template class EdgePipeline<CannyStage<5>, PackStage>;
+extern template class EdgePipeline<CannyStage<5>, OutlineStage<15>, PackStage>;
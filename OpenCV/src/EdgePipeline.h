@@ -0,0 +1,270 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <tuple>
+#include "BitGrid.h"
+#include "EdgeStages.h"
+#include "TileChangeTracker.h"
+#include "PyramidEdges.h"
+
+// Число ведущих стадий с конечным запасом - их можно считать по тайлам
+template <class... Stages>
+constexpr size_t localStageCount() {
+    const bool local[] = { (Stages::kOutput != STAGE_GRID && Stages::kHalo != kGlobalHalo)... };
+    size_t count = 0;
+    while (count < sizeof...(Stages) && local[count]) {
+        ++count;
+    }
+    return count;
+}
+
+// Суммарный запас локальных стадий
+template <class... Stages>
+constexpr int localStageHalo() {
+    const int halos[] = { Stages::kHalo... };
+    const size_t count = localStageCount<Stages...>();
+    int halo = 0;
+    for (size_t i = 0; i < count; ++i) {
+        halo += halos[i];
+    }
+    return halo;
+}
+
+// Конвейер границ, собираемый из стадий на этапе компиляции.
+// Стадии вызываются напрямую (без виртуальных функций), промежуточные буферы
+// переиспользуются между кадрами, последняя стадия пишет сразу в выход.
+// Параметры стадий доступны через конвейер: он наследует все стадии.
+// Инкрементальный режим считает по тайлам ведущие локальные стадии
+// (запас - сумма их kHalo), остальные пересчитываются целиком, если изменился
+// хотя бы один тайл. Уровень пирамиды > 0 выполняет все стадии на уменьшенном
+// кадре, уточнение использует только первую стадию.
+template <class... Stages>
+class EdgePipeline : public Stages... {
+    template <size_t I>
+    using StageAt = typename std::tuple_element<I, std::tuple<Stages...>>::type;
+
+public:
+    static constexpr size_t kStageCount = sizeof...(Stages);
+    // Стадии, работающие с картами (все, кроме упаковки)
+    static constexpr size_t kImageStages = ((Stages::kOutput != STAGE_GRID ? 1 : 0) + ...);
+    static constexpr size_t kLocalStages = localStageCount<Stages...>();
+    static constexpr int kHalo = localStageHalo<Stages...>();
+    static constexpr bool kProducesGrid = StageAt<kStageCount - 1>::kOutput == STAGE_GRID;
+
+    static_assert(StageAt<0>::kOutput == STAGE_EDGES, "first stage must produce edges from a frame");
+    static_assert(kImageStages + (kProducesGrid ? 1 : 0) == kStageCount, "PackStage must be the last stage");
+
+    EdgePipeline()
+        : m_cache(64, kLocalStages > 0 ? kHalo : IncrementalEdgeCache::kHalo) {
+    }
+
+    void detectAndDraw(cv::Mat& frame) { detectAndDraw(frame, frame); }
+    void detectOnlyEdges(cv::Mat& frame) { detectOnlyEdges(frame, frame); }
+    // Кадр не изменяется, результат рисуется в output (буфер нужного размера
+    // переиспользуется без выделения памяти)
+    void detectAndDraw(const cv::Mat& input, cv::Mat& output);
+    // Подписи стадий выводятся в слой HUD вызывающего (begin/compose - его забота).
+    // grid - необязательная сетка того же прохода (конвейеры с PackStage)
+    void detectAndDraw(const cv::Mat& input, cv::Mat& output, HudLayer& hud, BitGrid* grid = nullptr);
+    void detectOnlyEdges(const cv::Mat& input, cv::Mat& output, BitGrid* grid = nullptr);
+    // Доступна только конвейерам с PackStage
+    template <bool Packed = kProducesGrid>
+    BitGrid getEdgeBitGrid(const cv::Mat& frame);
+
+    // Полный проход: итоговая карта и (при наличии PackStage) BitGrid
+    void run(const cv::Mat& frame, cv::Mat& result, BitGrid* grid = nullptr);
+
+    // Инкрементальный режим: пересчёт только изменившихся тайлов кадра
+    void setIncremental(bool enabled);
+    bool incremental() const { return m_useIncremental; }
+    float recomputedFraction() const {
+        return m_useIncremental ? m_cache.recomputedFraction() : 1.0f;
+    }
+
+    // Детекция на уровне пирамиды (0 - полное разрешение, 1 - 1/2, 2 - 1/4)
+    // с увеличением BitGrid повторением битов и необязательным уточнением
+    void setPyramidLevel(int level) { m_pyramid.setLevel(level); }
+    void setPyramidRefinement(bool enabled) { m_pyramid.setRefinement(enabled); }
+    const PyramidEdgeRunner& pyramidRunner() const { return m_pyramid; }
+
+private:
+    bool m_useIncremental = false;
+    IncrementalEdgeCache m_cache;
+    PyramidEdgeRunner m_pyramid;
+
+    // Итоговая карта для отображения
+    cv::Mat m_result;
+    // Слой подписей для detectAndDraw без внешнего HUD
+    HudLayer m_hud;
+
+    // Выход нелокальных стадий в инкрементальном режиме
+    cv::Mat m_cachedResult;
+    BitGrid m_cachedGrid;
+    bool m_cachedGridValid = false;
+
+    unsigned m_localRevision = 0;
+    unsigned m_globalRevision = 0;
+
+    // Буферы между стадиями; выход последней стадии пишется сразу в результат
+    cv::Mat m_buffers[kImageStages];
+
+    template <size_t I, size_t End>
+    void runStages(const cv::Mat& in, int level, cv::Mat& out);
+    template <size_t I>
+    void describeStages(HudLayer& hud, int y) const;
+
+    void runIncremental(const cv::Mat& frame, cv::Mat& result, BitGrid* grid);
+    void syncRevisions();
+};
+
+template <class... Stages>
+template <size_t I, size_t End>
+void EdgePipeline<Stages...>::runStages(const cv::Mat& in, int level, cv::Mat& out) {
+    if constexpr (I + 1 == End) {
+        StageAt<I>::process(in, level, out);
+    }
+    else {
+        StageAt<I>::process(in, level, m_buffers[I]);
+        runStages<I + 1, End>(m_buffers[I], level, out);
+    }
+}
+
+template <class... Stages>
+template <size_t I>
+void EdgePipeline<Stages...>::describeStages(HudLayer& hud, int y) const {
+    if constexpr (I < kImageStages) {
+        StageAt<I>::describe(hud, y);
+        describeStages<I + 1>(hud, y + 20);
+    }
+}
+
+template <class... Stages>
+void EdgePipeline<Stages...>::syncRevisions() {
+    unsigned local = 0, global = 0;
+    size_t index = 0;
+    (((index++ < kLocalStages ? local : global) += Stages::revision()), ...);
+
+    // Изменились параметры локальных стадий - тайлы пересчитываются заново,
+    // нелокальных - только выход последних стадий
+    if (local != m_localRevision) {
+        m_cache.invalidate();
+        m_localRevision = local;
+    }
+    if (global != m_globalRevision) {
+        m_cachedResult.release();
+        m_globalRevision = global;
+    }
+}
+
+template <class... Stages>
+void EdgePipeline<Stages...>::setIncremental(bool enabled) {
+    if (enabled != m_useIncremental) {
+        m_cache.invalidate();
+    }
+    m_useIncremental = enabled;
+}
+
+template <class... Stages>
+void EdgePipeline<Stages...>::run(const cv::Mat& frame, cv::Mat& result, BitGrid* grid) {
+    TraceScope trace("edges");
+    if (!kProducesGrid) {
+        grid = nullptr;
+    }
+
+    // Автопороги и прочая подготовка стадий
+    (Stages::beginFrame(frame), ...);
+    syncRevisions();
+
+    // После инкрементального режима result может ссылаться на кэш - его нельзя перезаписывать
+    if (!result.empty() && (result.data == m_cache.edges().data || result.data == m_cachedResult.data)) {
+        result.release();
+    }
+
+    if (kLocalStages > 0 && m_useIncremental && m_pyramid.level() == 0) {
+        runIncremental(frame, result, grid);
+    }
+    else {
+        // Уровень 0 - полноразмерный путь, 1 и 2 - весь конвейер на уровне пирамиды
+        auto detect = [this](const cv::Mat& part, int level, cv::Mat& out) {
+            runStages<0, kImageStages>(part, level, out);
+        };
+        auto refine = [this](const cv::Mat& part, cv::Mat& out) {
+            runStages<0, 1>(part, 0, out);
+        };
+        m_pyramid.run(frame, detect, refine, &result, grid);
+    }
+
+    (Stages::endFrame(result), ...);
+}
+
+template <class... Stages>
+void EdgePipeline<Stages...>::runIncremental(const cv::Mat& frame, cv::Mat& result, BitGrid* grid) {
+    if constexpr (kLocalStages > 0) {
+        // Локальные стадии - только по изменившимся тайлам, остальное берётся из кэша
+        m_cache.update(frame, [this](const cv::Mat& part, cv::Mat& out) {
+            runStages<0, kLocalStages>(part, 0, out);
+        });
+
+        if constexpr (kLocalStages == kImageStages) {
+            result = m_cache.edges();
+            if (grid) {
+                *grid = m_cache.grid();
+            }
+        }
+        else {
+            // Без изменившихся тайлов нелокальные стадии и упаковка не пересчитываются
+            if (m_cache.recomputedFraction() > 0.0f || m_cachedResult.size() != frame.size()) {
+                runStages<kLocalStages, kImageStages>(m_cache.edges(), 0, m_cachedResult);
+                m_cachedGridValid = false;
+            }
+            result = m_cachedResult;
+
+            if (grid) {
+                if (!m_cachedGridValid) {
+                    m_cachedGrid = BitGrid(result);
+                    m_cachedGridValid = true;
+                }
+                *grid = m_cachedGrid;
+            }
+        }
+    }
+}
+
+template <class... Stages>
+void EdgePipeline<Stages...>::detectAndDraw(const cv::Mat& input, cv::Mat& output) {
+    m_hud.begin(input.size());
+    detectAndDraw(input, output, m_hud);
+    m_hud.compose(output);
+}
+
+template <class... Stages>
+void EdgePipeline<Stages...>::detectAndDraw(const cv::Mat& input, cv::Mat& output, HudLayer& hud, BitGrid* grid) {
+    run(input, m_result, grid);
+
+    // Отображение задаёт последняя стадия карты, параметры выводят все стадии
+    StageAt<kImageStages - 1>::render(m_result, input, output, hud);
+    if constexpr (kImageStages > 1) {
+        describeStages<0>(hud, 60);
+    }
+}
+
+template <class... Stages>
+void EdgePipeline<Stages...>::detectOnlyEdges(const cv::Mat& input, cv::Mat& output, BitGrid* grid) {
+    run(input, m_result, grid);
+    cv::cvtColor(m_result, output, cv::COLOR_GRAY2BGR);
+}
+
+template <class... Stages>
+template <bool Packed>
+BitGrid EdgePipeline<Stages...>::getEdgeBitGrid(const cv::Mat& frame) {
+    static_assert(Packed, "getEdgeBitGrid requires PackStage");
+
+    cv::Mat result;
+    BitGrid grid;
+
+    // Сетка упаковывается из полной карты, берётся из кэша инкрементального режима
+    // или увеличивается повторением битов с уровня пирамиды
+    run(frame, result, &grid);
+    return grid;
+}
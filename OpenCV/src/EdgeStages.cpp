@@ -0,0 +1,168 @@
+﻿#include "EdgeStages.h"
+#include <string>
+
+void CannyStageBase::setThresholds(double thresh1, double thresh2) {
+    if (thresh1 != m_threshold1 || thresh2 != m_threshold2) {
+        ++m_revision;
+    }
+    m_threshold1 = thresh1;
+    m_threshold2 = thresh2;
+}
+
+void CannyStageBase::setAperture(int aperture) {
+    if (aperture != m_aperture) {
+        ++m_revision;
+    }
+    m_aperture = aperture;
+}
+
+void CannyStageBase::setL2Gradient(bool enabled) {
+    if (enabled != m_useL2) {
+        ++m_revision;
+    }
+    m_useL2 = enabled;
+}
+
+void CannyStageBase::setFastFrontEnd(bool enabled) {
+    if (enabled != m_useFastFrontEnd) {
+        // Фронтенды дают немного разные границы, кэш нужно пересчитать
+        ++m_revision;
+    }
+    m_useFastFrontEnd = enabled;
+}
+
+void CannyStageBase::beginFrame(const cv::Mat& frame) {
+    double thresh1 = m_threshold1, thresh2 = m_threshold2;
+    if (m_autoThreshold.update(frame, thresh1, thresh2)) {
+        setThresholds(thresh1, thresh2);
+    }
+}
+
+void CannyStageBase::endFrame(const cv::Mat& result) {
+    // Плотность считается по итоговой карте конвейера, которая упаковывается в BitGrid
+    if (m_autoThreshold.mode() == ThresholdController::ADAPTIVE_DENSITY && !result.empty()) {
+        m_autoThreshold.observeDensity(static_cast<float>(cv::countNonZero(result)) / result.total());
+    }
+}
+
+void CannyStageBase::detectFast(const cv::Mat& frame, cv::Mat& edges) {
+    // Градиент уже посчитан фронтендом, Canny выполняет только подавление и гистерезис
+    {
+        ScopedStageTimer timer(METRIC_BLUR);
+        m_frontEnd.process(frame, m_gradX, m_gradY);
+    }
+    ScopedStageTimer timer(METRIC_CANNY);
+    cv::Canny(m_gradX, m_gradY, edges, m_threshold1, m_threshold2, m_useL2);
+}
+
+void CannyStageBase::detectBlurred(const cv::Mat& blurred, cv::Mat& edges) {
+    ScopedStageTimer timer(METRIC_CANNY);
+    cv::Canny(blurred, edges,
+        m_threshold1, m_threshold2,
+        m_aperture, m_useL2);
+}
+
+void CannyStageBase::render(const cv::Mat& result, const cv::Mat&, cv::Mat& output, HudLayer& hud) {
+    // Белые границы на чёрном фоне
+    cv::cvtColor(result, output, cv::COLOR_GRAY2BGR);
+
+    hud.text("Edge map", cv::Point(10, 30), 0.7, cv::Scalar(255, 255, 255), 2);
+}
+
+void CannyStageBase::describe(HudLayer& hud, int y) const {
+    hud.format(cv::Point(10, y), 0.5, cv::Scalar(0, 200, 255), 1,
+        "Пороги Канни: %d, %d", (int)m_threshold1, (int)m_threshold2);
+}
+
+
+
+void OutlineStageBase::setMorphology(int dilateSize, int erodeSize) {
+    if (dilateSize != m_dilationSize || erodeSize != m_erosionSize) {
+        ++m_revision;
+    }
+    m_dilationSize = dilateSize;
+    m_erosionSize = erodeSize;
+}
+
+void OutlineStageBase::prepareKernels(int closeSize) {
+    for (int level = 0; level <= PyramidEdgeRunner::kMaxLevel; ++level) {
+        int dilateRadius = PyramidEdgeRunner::scaleRadius(m_dilationSize, level);
+        int erodeRadius = PyramidEdgeRunner::scaleRadius(m_erosionSize, level);
+        int levelClose = PyramidEdgeRunner::scaleKernel(closeSize, level);
+
+        m_dilateKernels[level] = cv::getStructuringElement(cv::MORPH_RECT,
+            cv::Size(2 * dilateRadius + 1, 2 * dilateRadius + 1));
+        m_erodeKernels[level] = cv::getStructuringElement(cv::MORPH_RECT,
+            cv::Size(2 * erodeRadius + 1, 2 * erodeRadius + 1));
+        m_closeKernels[level] = cv::getStructuringElement(cv::MORPH_RECT,
+            cv::Size(levelClose, levelClose));
+    }
+    m_kernelRevision = m_revision;
+}
+
+void OutlineStageBase::buildOutline(const cv::Mat& edges, int closeSize, int level, cv::Mat& result) {
+    if (m_kernelRevision != m_revision) {
+        prepareKernels(closeSize);
+    }
+    ScopedStageTimer morphology(METRIC_MORPHOLOGY);
+
+    // 3. Дилатация (расширение) границ
+    cv::dilate(edges, m_dilated, m_dilateKernels[level]);
+
+    // 4. Заполнение областей внутри границ (морфологическое закрытие + заливка)
+    cv::morphologyEx(m_dilated, m_closed, cv::MORPH_CLOSE, m_closeKernels[level]);
+
+    // Заливка фона для получения маски внутренних областей
+    ScopedStageTimer fill(METRIC_FLOODFILL);
+    m_mask.create(m_closed.rows + 2, m_closed.cols + 2, CV_8UC1);
+    m_mask.setTo(0);
+    cv::floodFill(m_closed, m_mask, cv::Point(0, 0), cv::Scalar(255));
+    cv::bitwise_not(m_mask(cv::Rect(1, 1, edges.cols, edges.rows)), m_filled);
+    morphology.exclude(fill.stop());
+
+    // 5. Эрозия заполненного изображения
+    cv::erode(m_filled, m_eroded, m_erodeKernels[level]);
+
+    // 6. Вычитание: filled - eroded (внешние границы)
+    cv::subtract(m_filled, m_eroded, result);
+}
+
+void OutlineStageBase::regionBoxes(cv::Size frameSize, int minArea, std::vector<cv::Rect>& boxes) {
+    boxes.clear();
+    if (m_filled.empty()) {
+        return;
+    }
+    int count = cv::connectedComponentsWithStats(m_filled, m_labels, m_regionStats, m_centroids, 8, CV_32S);
+    const double scaleX = frameSize.width / static_cast<double>(m_filled.cols);
+    const double scaleY = frameSize.height / static_cast<double>(m_filled.rows);
+    const cv::Rect frameRect(cv::Point(0, 0), frameSize);
+    // Метка 0 - фон (область, залитая от угла)
+    for (int i = 1; i < count; ++i) {
+        const int* stats = m_regionStats.ptr<int>(i);
+        int left = cvFloor(stats[cv::CC_STAT_LEFT] * scaleX);
+        int top = cvFloor(stats[cv::CC_STAT_TOP] * scaleY);
+        int right = cvCeil((stats[cv::CC_STAT_LEFT] + stats[cv::CC_STAT_WIDTH]) * scaleX);
+        int bottom = cvCeil((stats[cv::CC_STAT_TOP] + stats[cv::CC_STAT_HEIGHT]) * scaleY);
+        cv::Rect box = cv::Rect(left, top, right - left, bottom - top) & frameRect;
+        if (box.area() >= minArea) {
+            boxes.push_back(box);
+        }
+    }
+}
+
+void OutlineStageBase::render(const cv::Mat& result, const cv::Mat& input, cv::Mat& output, HudLayer& hud) {
+    // Преобразование результата в цветное изображение для наложения
+    cv::cvtColor(result, m_resultColor, cv::COLOR_GRAY2BGR);
+
+    // Наложение границ на оригинальное изображение (полупрозрачное)
+    cv::addWeighted(input, 0.7, m_resultColor, 0.3, 0, output);
+
+    // Добавление информационного текста
+    hud.text("Комбинированный метод (Канни + морфология)", cv::Point(10, 30),
+        0.7, cv::Scalar(0, 255, 0), 2);
+}
+
+void OutlineStageBase::describe(HudLayer& hud, int y) const {
+    hud.format(cv::Point(10, y), 0.5, cv::Scalar(0, 200, 255), 1,
+        "Дилатация: %d, Эрозия: %d", m_dilationSize, m_erosionSize);
+}
@@ -0,0 +1,184 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include "FastFrontEnd.h"
+#include "ThresholdController.h"
+#include "PyramidEdges.h"
+#include "HudLayer.h"
+#include "StageMetrics.h"
+
+// Стадии конвейера границ EdgePipeline<Stages...>.
+// Каждая стадия объявляет:
+//   kHalo   - запас контекста вокруг фрагмента в пикселях (kGlobalHalo - нужен весь кадр);
+//   kOutput - тип выхода;
+//   process(in, level, out) - обработка на уровне пирамиды level;
+//   beginFrame(frame) / endFrame(result) - до и после кадра (автопороги, статистика);
+//   revision() - счётчик изменений параметров, по нему конвейер сбрасывает кэши;
+//   render(result, input, output, hud) / describe(hud, y) - отображение (кроме PackStage),
+//   подписи выводятся в кэшированный слой HUD.
+// Размеры ядер, влияющие на запас, - параметры шаблона.
+
+// Тип выхода стадии
+enum StageOutput {
+    STAGE_EDGES = 0,    // Карта границ CV_8UC1 из кадра BGR
+    STAGE_OUTLINE = 1,  // Карта CV_8UC1 из карты предыдущей стадии
+    STAGE_GRID = 2      // Упаковка итоговой карты в BitGrid (только последняя стадия)
+};
+
+// Запас стадии, которой нужен весь кадр (заливка и т. п.)
+const int kGlobalHalo = -1;
+
+// Общая часть стадии Канни, не зависящая от размера ядра размытия
+class CannyStageBase {
+public:
+    // Изменение порогов без пересоздания детектора
+    void setThresholds(double thresh1, double thresh2);
+    double lowThreshold() const { return m_threshold1; }
+    double highThreshold() const { return m_threshold2; }
+    ThresholdController& thresholdController() { return m_autoThreshold; }
+
+    void setAperture(int aperture);
+    int aperture() const { return m_aperture; }
+    void setL2Gradient(bool enabled);
+    bool l2Gradient() const { return m_useL2; }
+
+    // Совмещённый SIMD-фронтенд (серый + размытие 5x5 + Собель за один проход).
+    // Используется только при размытии 5x5 и апертуре 3
+    void setFastFrontEnd(bool enabled);
+    bool fastFrontEnd() const { return m_useFastFrontEnd; }
+    FastFrontEnd& frontEnd() { return m_frontEnd; }
+
+protected:
+    void beginFrame(const cv::Mat& frame);
+    void endFrame(const cv::Mat& result);
+    unsigned revision() const { return m_revision; }
+
+    void render(const cv::Mat& result, const cv::Mat& input, cv::Mat& output, HudLayer& hud);
+    void describe(HudLayer& hud, int y) const;
+
+    // Канни по градиенту совмещённого фронтенда
+    void detectFast(const cv::Mat& frame, cv::Mat& edges);
+    // Канни по размытому серому кадру
+    void detectBlurred(const cv::Mat& blurred, cv::Mat& edges);
+
+    cv::Mat m_gray;
+
+private:
+    double m_threshold1 = 100.0;
+    double m_threshold2 = 200.0;
+    int m_aperture = 3;
+    bool m_useL2 = false;
+    unsigned m_revision = 0;
+
+    bool m_useFastFrontEnd = false;
+    FastFrontEnd m_frontEnd;
+    cv::Mat m_gradX, m_gradY;
+
+    ThresholdController m_autoThreshold;
+};
+
+// Серый + размытие BlurSize x BlurSize + Канни
+template <int BlurSize = 5>
+class CannyStage : public CannyStageBase {
+public:
+    static_assert(BlurSize >= 3 && BlurSize % 2 == 1, "BlurSize must be odd");
+
+    // Размытие + Собель 3x3 + подавление немаксимумов + запас на гистерезис
+    static constexpr int kHalo = BlurSize / 2 + 2 + 4;
+    static constexpr StageOutput kOutput = STAGE_EDGES;
+
+protected:
+    void process(const cv::Mat& frame, int, cv::Mat& edges) {
+        // Ядро фронтенда фиксировано, для других размеров ветка не собирается
+        if constexpr (BlurSize == 5) {
+            if (fastFrontEnd() && aperture() == 3) {
+                detectFast(frame, edges);
+                return;
+            }
+        }
+
+        {
+            ScopedStageTimer timer(METRIC_COLOR);
+            cv::cvtColor(frame, m_gray, cv::COLOR_BGR2GRAY);
+        }
+        {
+            ScopedStageTimer timer(METRIC_BLUR);
+            cv::GaussianBlur(m_gray, m_gray, cv::Size(BlurSize, BlurSize), 1.5);
+        }
+        detectBlurred(m_gray, edges);
+    }
+};
+
+// Общая часть морфологической стадии комбинированного метода
+class OutlineStageBase {
+public:
+    // Изменение параметров без пересоздания детектора
+    void setMorphology(int dilateSize, int erodeSize);
+    int dilation() const { return m_dilationSize; }
+    int erosion() const { return m_erosionSize; }
+
+    // Рамки заполненных областей последнего кадра (шаг 4) в координатах кадра
+    // размера frameSize (карта могла строиться на уровне пирамиды).
+    // Области меньше minArea пикселей кадра пропускаются
+    void regionBoxes(cv::Size frameSize, int minArea, std::vector<cv::Rect>& boxes);
+
+protected:
+    void beginFrame(const cv::Mat&) {}
+    void endFrame(const cv::Mat&) {}
+    unsigned revision() const { return m_revision; }
+
+    void render(const cv::Mat& result, const cv::Mat& input, cv::Mat& output, HudLayer& hud);
+    void describe(HudLayer& hud, int y) const;
+
+    // Шаги 3-6 комбинированного метода, ядра уменьшаются вместе с уровнем пирамиды
+    void buildOutline(const cv::Mat& edges, int closeSize, int level, cv::Mat& result);
+
+private:
+    int m_dilationSize = 2;
+    int m_erosionSize = 2;
+    unsigned m_revision = 0;
+
+    // Структурные элементы по уровням пирамиды, строятся при смене параметров
+    unsigned m_kernelRevision = ~0u;
+    cv::Mat m_dilateKernels[PyramidEdgeRunner::kMaxLevel + 1];
+    cv::Mat m_erodeKernels[PyramidEdgeRunner::kMaxLevel + 1];
+    cv::Mat m_closeKernels[PyramidEdgeRunner::kMaxLevel + 1];
+
+    cv::Mat m_dilated, m_closed, m_mask, m_filled, m_eroded;
+    cv::Mat m_resultColor;
+    cv::Mat m_labels, m_regionStats, m_centroids;
+
+    void prepareKernels(int closeSize);
+};
+
+// Комбинированный метод по статье https://engjournal.bmstu.ru/articles/920/920.pdf
+// 3. Дилатация выделенных границ
+// 4. Заполнение областей внутри границ (закрытие CloseSize x CloseSize + заливка)
+// 5. Эрозия полученного изображения
+// 6. Вычитание результатов шагов 4 и 5
+// Заливка глобальна, поэтому стадия не делится на тайлы
+template <int CloseSize = 15>
+class OutlineStage : public OutlineStageBase {
+public:
+    static_assert(CloseSize >= 3 && CloseSize % 2 == 1, "CloseSize must be odd");
+
+    static constexpr int kHalo = kGlobalHalo;
+    static constexpr StageOutput kOutput = STAGE_OUTLINE;
+
+protected:
+    void process(const cv::Mat& edges, int level, cv::Mat& result) {
+        buildOutline(edges, CloseSize, level, result);
+    }
+};
+
+// Упаковка итоговой карты в BitGrid. Без этой стадии конвейер не строит сетку
+class PackStage {
+public:
+    static constexpr int kHalo = 0;
+    static constexpr StageOutput kOutput = STAGE_GRID;
+
+protected:
+    void beginFrame(const cv::Mat&) {}
+    void endFrame(const cv::Mat&) {}
+    unsigned revision() const { return 0; }
+};
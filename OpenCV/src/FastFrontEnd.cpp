@@ -0,0 +1,487 @@
+﻿#include "FastFrontEnd.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FFE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC/Clang требуют явно разрешить набор инструкций для отдельной функции,
+// MSVC допускает любые интринсики без флагов компиляции
+#if defined(FFE_X86) && (defined(__GNUC__) || defined(__clang__))
+#define FFE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FFE_TARGET(isa)
+#endif
+
+namespace {
+
+// Коэффициенты cvtColor(BGR2GRAY) для 8U: 14-битная фиксированная точка OpenCV
+const int kGrayB = 1868;
+const int kGrayG = 9617;
+const int kGrayR = 4899;
+const int kGrayShift = 14;
+
+// Отступы строк в рабочих буферах: 2 пикселя для размытия, 1 для Собеля
+const int kBlurPad = 2;
+const int kSobelPad = 1;
+
+inline int reflect101(int i, int n) {
+    if (n == 1) return 0;
+    if (i < 0) i = -i;
+    if (i >= n) i = 2 * n - 2 - i;
+    return std::min(std::max(i, 0), n - 1);
+}
+
+// Указатели на строковые ядра выбранного уровня SIMD
+struct RowKernels {
+    // src[-2 .. width + 1] доступны; dst = g[-2] + 4g[-1] + 6g[0] + 4g[1] + g[2]
+    void (*hblur)(const uint8_t* src, uint16_t* dst, int width);
+    // Вертикальная свёртка 1 4 6 4 1 с нормировкой на 256
+    void (*vblur)(const uint16_t* r0, const uint16_t* r1, const uint16_t* r2,
+        const uint16_t* r3, const uint16_t* r4, uint8_t* dst, int width);
+    // Собель 3x3, r0..r2[-1 .. width] доступны
+    void (*sobel)(const uint8_t* r0, const uint8_t* r1, const uint8_t* r2,
+        int16_t* dx, int16_t* dy, int width);
+};
+
+// === Скалярные ядра (также обрабатывают хвосты строк SIMD-версий) ===
+
+void hblurScalar(const uint8_t* src, uint16_t* dst, int width) {
+    for (int x = 0; x < width; ++x) {
+        dst[x] = static_cast<uint16_t>(src[x - 2] + src[x + 2] +
+            4 * (src[x - 1] + src[x + 1]) + 6 * src[x]);
+    }
+}
+
+void vblurScalar(const uint16_t* r0, const uint16_t* r1, const uint16_t* r2,
+    const uint16_t* r3, const uint16_t* r4, uint8_t* dst, int width) {
+    for (int x = 0; x < width; ++x) {
+        int sum = r0[x] + r4[x] + 4 * (r1[x] + r3[x]) + 6 * r2[x];
+        dst[x] = static_cast<uint8_t>((sum + 128) >> 8);
+    }
+}
+
+void sobelScalar(const uint8_t* r0, const uint8_t* r1, const uint8_t* r2,
+    int16_t* dx, int16_t* dy, int width) {
+    for (int x = 0; x < width; ++x) {
+        dx[x] = static_cast<int16_t>((r0[x + 1] - r0[x - 1]) +
+            2 * (r1[x + 1] - r1[x - 1]) + (r2[x + 1] - r2[x - 1]));
+        dy[x] = static_cast<int16_t>((r2[x - 1] + 2 * r2[x] + r2[x + 1]) -
+            (r0[x - 1] + 2 * r0[x] + r0[x + 1]));
+    }
+}
+
+#ifdef FFE_X86
+
+// === SSE4.1: 8 пикселей за итерацию ===
+
+FFE_TARGET("sse4.1")
+void hblurSSE41(const uint8_t* src, uint16_t* dst, int width) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x - 2)));
+        __m128i b = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x - 1)));
+        __m128i c = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x)));
+        __m128i d = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x + 1)));
+        __m128i e = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x + 2)));
+        __m128i sum = _mm_add_epi16(_mm_add_epi16(a, e), _mm_slli_epi16(_mm_add_epi16(b, d), 2));
+        sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_slli_epi16(c, 2), _mm_slli_epi16(c, 1)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), sum);
+    }
+    hblurScalar(src + x, dst + x, width - x);
+}
+
+FFE_TARGET("sse4.1")
+void vblurSSE41(const uint16_t* r0, const uint16_t* r1, const uint16_t* r2,
+    const uint16_t* r3, const uint16_t* r4, uint8_t* dst, int width) {
+    const __m128i round = _mm_set1_epi16(128);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r2 + x));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r3 + x));
+        __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r4 + x));
+        // Максимум суммы 255 * 256 + 128 помещается в uint16
+        __m128i sum = _mm_add_epi16(_mm_add_epi16(a, e), _mm_slli_epi16(_mm_add_epi16(b, d), 2));
+        sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_slli_epi16(c, 2), _mm_slli_epi16(c, 1)));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 8);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(sum, sum));
+    }
+    vblurScalar(r0 + x, r1 + x, r2 + x, r3 + x, r4 + x, dst + x, width - x);
+}
+
+FFE_TARGET("sse4.1")
+void sobelSSE41(const uint8_t* r0, const uint8_t* r1, const uint8_t* r2,
+    int16_t* dx, int16_t* dy, int width) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i t0 = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(r0 + x - 1)));
+        __m128i t1 = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(r0 + x)));
+        __m128i t2 = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(r0 + x + 1)));
+        __m128i m0 = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(r1 + x - 1)));
+        __m128i m2 = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(r1 + x + 1)));
+        __m128i b0 = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(r2 + x - 1)));
+        __m128i b1 = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(r2 + x)));
+        __m128i b2 = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(r2 + x + 1)));
+
+        __m128i gx = _mm_add_epi16(_mm_sub_epi16(t2, t0), _mm_sub_epi16(b2, b0));
+        gx = _mm_add_epi16(gx, _mm_slli_epi16(_mm_sub_epi16(m2, m0), 1));
+        __m128i gy = _mm_sub_epi16(_mm_add_epi16(b0, b2), _mm_add_epi16(t0, t2));
+        gy = _mm_add_epi16(gy, _mm_slli_epi16(_mm_sub_epi16(b1, t1), 1));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dx + x), gx);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dy + x), gy);
+    }
+    sobelScalar(r0 + x, r1 + x, r2 + x, dx + x, dy + x, width - x);
+}
+
+// === AVX2: 16 пикселей за итерацию ===
+
+FFE_TARGET("avx2")
+void hblurAVX2(const uint8_t* src, uint16_t* dst, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x - 2)));
+        __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x - 1)));
+        __m256i c = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x)));
+        __m256i d = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x + 1)));
+        __m256i e = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x + 2)));
+        __m256i sum = _mm256_add_epi16(_mm256_add_epi16(a, e), _mm256_slli_epi16(_mm256_add_epi16(b, d), 2));
+        sum = _mm256_add_epi16(sum, _mm256_add_epi16(_mm256_slli_epi16(c, 2), _mm256_slli_epi16(c, 1)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), sum);
+    }
+    hblurScalar(src + x, dst + x, width - x);
+}
+
+FFE_TARGET("avx2")
+void vblurAVX2(const uint16_t* r0, const uint16_t* r1, const uint16_t* r2,
+    const uint16_t* r3, const uint16_t* r4, uint8_t* dst, int width) {
+    const __m256i round = _mm256_set1_epi16(128);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r0 + x));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r1 + x));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r2 + x));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r3 + x));
+        __m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r4 + x));
+        __m256i sum = _mm256_add_epi16(_mm256_add_epi16(a, e), _mm256_slli_epi16(_mm256_add_epi16(b, d), 2));
+        sum = _mm256_add_epi16(sum, _mm256_add_epi16(_mm256_slli_epi16(c, 2), _mm256_slli_epi16(c, 1)));
+        sum = _mm256_srli_epi16(_mm256_add_epi16(sum, round), 8);
+        // packus работает внутри 128-битных половин: собираем qword 0 и 2
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm256_castsi256_si128(packed));
+    }
+    vblurScalar(r0 + x, r1 + x, r2 + x, r3 + x, r4 + x, dst + x, width - x);
+}
+
+FFE_TARGET("avx2")
+void sobelAVX2(const uint8_t* r0, const uint8_t* r1, const uint8_t* r2,
+    int16_t* dx, int16_t* dy, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i t0 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x - 1)));
+        __m256i t1 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x)));
+        __m256i t2 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x + 1)));
+        __m256i m0 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x - 1)));
+        __m256i m2 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x + 1)));
+        __m256i b0 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r2 + x - 1)));
+        __m256i b1 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r2 + x)));
+        __m256i b2 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r2 + x + 1)));
+
+        __m256i gx = _mm256_add_epi16(_mm256_sub_epi16(t2, t0), _mm256_sub_epi16(b2, b0));
+        gx = _mm256_add_epi16(gx, _mm256_slli_epi16(_mm256_sub_epi16(m2, m0), 1));
+        __m256i gy = _mm256_sub_epi16(_mm256_add_epi16(b0, b2), _mm256_add_epi16(t0, t2));
+        gy = _mm256_add_epi16(gy, _mm256_slli_epi16(_mm256_sub_epi16(b1, t1), 1));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dx + x), gx);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dy + x), gy);
+    }
+    sobelScalar(r0 + x, r1 + x, r2 + x, dx + x, dy + x, width - x);
+}
+
+// === AVX-512BW: 32 пикселя за итерацию ===
+
+FFE_TARGET("avx512f,avx512bw")
+void hblurAVX512(const uint8_t* src, uint16_t* dst, int width) {
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m512i a = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x - 2)));
+        __m512i b = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x - 1)));
+        __m512i c = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x)));
+        __m512i d = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x + 1)));
+        __m512i e = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x + 2)));
+        __m512i sum = _mm512_add_epi16(_mm512_add_epi16(a, e), _mm512_slli_epi16(_mm512_add_epi16(b, d), 2));
+        sum = _mm512_add_epi16(sum, _mm512_add_epi16(_mm512_slli_epi16(c, 2), _mm512_slli_epi16(c, 1)));
+        _mm512_storeu_si512(reinterpret_cast<void*>(dst + x), sum);
+    }
+    hblurScalar(src + x, dst + x, width - x);
+}
+
+FFE_TARGET("avx512f,avx512bw")
+void vblurAVX512(const uint16_t* r0, const uint16_t* r1, const uint16_t* r2,
+    const uint16_t* r3, const uint16_t* r4, uint8_t* dst, int width) {
+    const __m512i round = _mm512_set1_epi16(128);
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m512i a = _mm512_loadu_si512(reinterpret_cast<const void*>(r0 + x));
+        __m512i b = _mm512_loadu_si512(reinterpret_cast<const void*>(r1 + x));
+        __m512i c = _mm512_loadu_si512(reinterpret_cast<const void*>(r2 + x));
+        __m512i d = _mm512_loadu_si512(reinterpret_cast<const void*>(r3 + x));
+        __m512i e = _mm512_loadu_si512(reinterpret_cast<const void*>(r4 + x));
+        __m512i sum = _mm512_add_epi16(_mm512_add_epi16(a, e), _mm512_slli_epi16(_mm512_add_epi16(b, d), 2));
+        sum = _mm512_add_epi16(sum, _mm512_add_epi16(_mm512_slli_epi16(c, 2), _mm512_slli_epi16(c, 1)));
+        sum = _mm512_srli_epi16(_mm512_add_epi16(sum, round), 8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), _mm512_cvtepi16_epi8(sum));
+    }
+    vblurScalar(r0 + x, r1 + x, r2 + x, r3 + x, r4 + x, dst + x, width - x);
+}
+
+FFE_TARGET("avx512f,avx512bw")
+void sobelAVX512(const uint8_t* r0, const uint8_t* r1, const uint8_t* r2,
+    int16_t* dx, int16_t* dy, int width) {
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m512i t0 = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(r0 + x - 1)));
+        __m512i t1 = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(r0 + x)));
+        __m512i t2 = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(r0 + x + 1)));
+        __m512i m0 = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(r1 + x - 1)));
+        __m512i m2 = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(r1 + x + 1)));
+        __m512i b0 = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(r2 + x - 1)));
+        __m512i b1 = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(r2 + x)));
+        __m512i b2 = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(r2 + x + 1)));
+
+        __m512i gx = _mm512_add_epi16(_mm512_sub_epi16(t2, t0), _mm512_sub_epi16(b2, b0));
+        gx = _mm512_add_epi16(gx, _mm512_slli_epi16(_mm512_sub_epi16(m2, m0), 1));
+        __m512i gy = _mm512_sub_epi16(_mm512_add_epi16(b0, b2), _mm512_add_epi16(t0, t2));
+        gy = _mm512_add_epi16(gy, _mm512_slli_epi16(_mm512_sub_epi16(b1, t1), 1));
+
+        _mm512_storeu_si512(reinterpret_cast<void*>(dx + x), gx);
+        _mm512_storeu_si512(reinterpret_cast<void*>(dy + x), gy);
+    }
+    sobelScalar(r0 + x, r1 + x, r2 + x, dx + x, dy + x, width - x);
+}
+
+#endif // FFE_X86
+
+RowKernels kernelsFor(SimdLevel level) {
+#ifdef FFE_X86
+    switch (level) {
+    case SIMD_AVX512: return { hblurAVX512, vblurAVX512, sobelAVX512 };
+    case SIMD_AVX2: return { hblurAVX2, vblurAVX2, sobelAVX2 };
+    case SIMD_SSE41: return { hblurSSE41, vblurSSE41, sobelSSE41 };
+    default: break;
+    }
+#endif
+    (void)level;
+    return { hblurScalar, vblurScalar, sobelScalar };
+}
+
+// Серый для одной строки с отражёнными (reflect101) краями по 2 пикселя
+void grayRow(const uint8_t* src, int channels, uint8_t* dst, int width) {
+    if (channels == 1) {
+        std::copy(src, src + width, dst);
+    }
+    else {
+        for (int x = 0; x < width; ++x) {
+            const uint8_t* p = src + x * channels;
+            dst[x] = static_cast<uint8_t>((p[0] * kGrayB + p[1] * kGrayG + p[2] * kGrayR +
+                (1 << (kGrayShift - 1))) >> kGrayShift);
+        }
+    }
+    for (int i = 1; i <= kBlurPad; ++i) {
+        dst[-i] = dst[reflect101(-i, width)];
+        dst[width - 1 + i] = dst[reflect101(width - 1 + i, width)];
+    }
+}
+
+// Рабочие буферы полосы: у каждого потока свои, растут только при первом кадре
+struct StripScratch {
+    std::vector<uint8_t> grayLine;
+    std::vector<uint16_t> hblur;
+    std::vector<uint8_t> blurred;
+};
+
+class StripBody : public cv::ParallelLoopBody {
+public:
+    StripBody(const cv::Mat& src, cv::Mat& dx, cv::Mat& dy, cv::Mat* gray,
+        const RowKernels& kernels, int stripRows)
+        : m_src(src), m_dx(dx), m_dy(dy), m_gray(gray),
+        m_kernels(kernels), m_stripRows(stripRows) {}
+
+    void operator()(const cv::Range& range) const override {
+        thread_local StripScratch scratch;
+        for (int s = range.start; s < range.end; ++s) {
+            int y0 = s * m_stripRows;
+            int y1 = std::min(y0 + m_stripRows, m_src.rows);
+            processStrip(y0, y1, scratch);
+        }
+    }
+
+private:
+    const cv::Mat& m_src;
+    cv::Mat& m_dx;
+    cv::Mat& m_dy;
+    cv::Mat* m_gray;
+    RowKernels m_kernels;
+    int m_stripRows;
+
+    void processStrip(int y0, int y1, StripScratch& scratch) const {
+        const int width = m_src.cols;
+        const int height = m_src.rows;
+        const int channels = m_src.channels();
+
+        // Размытые строки нужны с запасом 1 (Собель, BORDER_REPLICATE),
+        // горизонтально размытые - ещё с запасом 2 (Гаусс, BORDER_REFLECT_101)
+        int b0 = std::max(0, y0 - kSobelPad);
+        int b1 = std::min(height - 1, y1 - 1 + kSobelPad);
+        int h0 = std::max(0, b0 - kBlurPad);
+        int h1 = std::min(height - 1, b1 + kBlurPad);
+
+        const int blurStride = width + 2 * kSobelPad;
+        scratch.grayLine.resize(width + 2 * kBlurPad);
+        scratch.hblur.resize(static_cast<size_t>(h1 - h0 + 1) * width);
+        scratch.blurred.resize(static_cast<size_t>(b1 - b0 + 1) * blurStride);
+
+        // 1. Серый + горизонтальное размытие, строка за строкой
+        uint8_t* line = scratch.grayLine.data() + kBlurPad;
+        for (int y = h0; y <= h1; ++y) {
+            grayRow(m_src.ptr<uint8_t>(y), channels, line, width);
+            if (m_gray && y >= y0 && y < y1) {
+                std::copy(line, line + width, m_gray->ptr<uint8_t>(y));
+            }
+            m_kernels.hblur(line, scratch.hblur.data() + static_cast<size_t>(y - h0) * width, width);
+        }
+
+        // 2. Вертикальное размытие
+        auto hrow = [&](int y) {
+            return scratch.hblur.data() + static_cast<size_t>(reflect101(y, height) - h0) * width;
+        };
+        for (int y = b0; y <= b1; ++y) {
+            uint8_t* dst = scratch.blurred.data() + static_cast<size_t>(y - b0) * blurStride + kSobelPad;
+            m_kernels.vblur(hrow(y - 2), hrow(y - 1), hrow(y), hrow(y + 1), hrow(y + 2), dst, width);
+            dst[-1] = dst[0];
+            dst[width] = dst[width - 1];
+        }
+
+        // 3. Собель
+        auto brow = [&](int y) {
+            int clamped = std::min(std::max(y, 0), height - 1);
+            return scratch.blurred.data() + static_cast<size_t>(clamped - b0) * blurStride + kSobelPad;
+        };
+        for (int y = y0; y < y1; ++y) {
+            m_kernels.sobel(brow(y - 1), brow(y), brow(y + 1),
+                m_dx.ptr<int16_t>(y), m_dy.ptr<int16_t>(y), width);
+        }
+    }
+};
+
+} // namespace
+
+FastFrontEnd::FastFrontEnd()
+    : m_level(detectSimdLevel()), m_l2Bytes(256 * 1024) {}
+
+SimdLevel FastFrontEnd::detectSimdLevel() {
+#if defined(FFE_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!sse41) return SIMD_SCALAR;
+    if (!osxsave || maxLeaf < 7) return SIMD_SSE41;
+
+    // ОС должна сохранять регистры YMM (и ZMM для AVX-512)
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+    bool avx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0 &&
+        (xcr0 & 0xE6) == 0xE6;
+    if (avx512) return SIMD_AVX512;
+    if (avx2) return SIMD_AVX2;
+    return SIMD_SSE41;
+#elif defined(FFE_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return SIMD_SSE41;
+    return SIMD_SCALAR;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+const char* FastFrontEnd::simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SIMD_SSE41: return "SSE4.1";
+    case SIMD_AVX2: return "AVX2";
+    case SIMD_AVX512: return "AVX-512";
+    default: return "SCALAR";
+    }
+}
+
+void FastFrontEnd::setSimdLevel(SimdLevel level) {
+    m_level = std::min(level, detectSimdLevel());
+}
+
+int FastFrontEnd::stripRows(int width) const {
+    // На строку полосы: BGR-вход, uint16 после горизонтального размытия,
+    // размытая строка и две строки int16 на выходе
+    size_t bytesPerRow = static_cast<size_t>(width) * (3 + 2 + 1 + 4);
+    size_t rows = (m_l2Bytes / 2) / std::max<size_t>(bytesPerRow, 1);
+    return static_cast<int>(std::min<size_t>(std::max<size_t>(rows, 8), 256));
+}
+
+void FastFrontEnd::process(const cv::Mat& frame, cv::Mat& dx, cv::Mat& dy, cv::Mat* gray) {
+    cv::Mat src = frame;
+    if (frame.type() == CV_8UC4) {
+        cv::cvtColor(frame, src, cv::COLOR_BGRA2GRAY);
+    }
+    CV_Assert(src.type() == CV_8UC1 || src.type() == CV_8UC3);
+
+    // create() не перевыделяет память, если размер и тип совпадают
+    dx.create(src.size(), CV_16SC1);
+    dy.create(src.size(), CV_16SC1);
+    if (gray) {
+        gray->create(src.size(), CV_8UC1);
+    }
+    if (src.empty()) {
+        return;
+    }
+
+    int rows = stripRows(src.cols);
+    int strips = (src.rows + rows - 1) / rows;
+    StripBody body(src, dx, dy, gray, kernelsFor(m_level), rows);
+    cv::parallel_for_(cv::Range(0, strips), body);
+}
+
+void FastFrontEnd::processReference(const cv::Mat& frame, cv::Mat& dx, cv::Mat& dy) {
+    cv::Mat gray, blurred;
+    if (frame.channels() == 3) {
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    }
+    else {
+        gray = frame;
+    }
+    cv::GaussianBlur(gray, blurred, cv::Size(5, 5), 0);
+    // cv::Canny считает градиент с BORDER_REPLICATE
+    cv::Sobel(blurred, dx, CV_16S, 1, 0, 3, 1, 0, cv::BORDER_REPLICATE);
+    cv::Sobel(blurred, dy, CV_16S, 0, 1, 3, 1, 0, cv::BORDER_REPLICATE);
+}
+
+int FastFrontEnd::compareWithReference(const cv::Mat& frame) {
+    cv::Mat dx, dy, refDx, refDy;
+    process(frame, dx, dy);
+    processReference(frame, refDx, refDy);
+
+    double maxDx = cv::norm(dx, refDx, cv::NORM_INF);
+    double maxDy = cv::norm(dy, refDy, cv::NORM_INF);
+    return static_cast<int>(std::max(maxDx, maxDy));
+}
@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+
+// Уровни SIMD, между которыми выбирает диспетчер во время выполнения
+enum SimdLevel {
+    SIMD_SCALAR = 0,    // Переносимая скалярная версия
+    SIMD_SSE41 = 1,     // 8 пикселей за итерацию
+    SIMD_AVX2 = 2,      // 16 пикселей за итерацию
+    SIMD_AVX512 = 3     // 32 пикселя за итерацию (AVX-512BW)
+};
+
+// Совмещённый фронтенд детекторов границ.
+// За один проход по памяти выполняет BGR -> серый, биномиальное размытие 5x5
+// и оператор Собеля 3x3 в целочисленной арифметике (uint16/int16).
+// Кадр обрабатывается полосами строк, рабочий набор которых помещается в L2,
+// полосы распределяются по потокам через cv::parallel_for_.
+// Результат dx/dy (CV_16SC1) подаётся напрямую в cv::Canny(dx, dy, ...).
+class FastFrontEnd {
+public:
+    FastFrontEnd();
+
+    // frame - CV_8UC3 (BGR) или CV_8UC1; gray - необязательный выход серого кадра
+    void process(const cv::Mat& frame, cv::Mat& dx, cv::Mat& dy, cv::Mat* gray = nullptr);
+
+    // Эталонный путь OpenCV: cvtColor + GaussianBlur(5x5, sigma = 0) + Sobel 3x3
+    static void processReference(const cv::Mat& frame, cv::Mat& dx, cv::Mat& dy);
+
+    // Максимальное отклонение |dx|, |dy| от эталонного пути.
+    // Допуск: размытое значение может отличаться на 1 из-за округления,
+    // сумма модулей весов Собеля равна 8.
+    static const int kMaxGradientDeviation = 8;
+    int compareWithReference(const cv::Mat& frame);
+
+    // Выбор уровня SIMD (ограничивается возможностями процессора)
+    SimdLevel simdLevel() const { return m_level; }
+    void setSimdLevel(SimdLevel level);
+
+    // Размер L2-кэша, под который подбирается высота полосы
+    void setL2CacheSize(size_t bytes) { m_l2Bytes = bytes; }
+    int stripRows(int width) const;
+
+    static SimdLevel detectSimdLevel();
+    static const char* simdLevelName(SimdLevel level);
+
+private:
+    SimdLevel m_level;
+    size_t m_l2Bytes;
+};
@@ -0,0 +1,269 @@
+﻿#include "FramePipeline.h"
+#include "FrameTracer.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+namespace {
+// Ожидание при пустой (полной) очереди
+void idle() {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+}
+
+FramePipeline::FramePipeline()
+    : FramePipeline(Options()) {
+}
+
+FramePipeline::FramePipeline(const Options& options)
+    : m_options(options) {
+    m_options.workers = std::max(1, m_options.workers);
+    m_options.queueCapacity = std::max<size_t>(1, m_options.queueCapacity);
+}
+
+FramePipeline::~FramePipeline() {
+    stop();
+}
+
+const char* FramePipeline::policyName(DropPolicy policy) {
+    switch (policy) {
+    case DROP_BLOCK: return "BLOCK";
+    case DROP_NEWEST: return "DROP_NEWEST";
+    case DROP_LATEST_ONLY: return "LATEST_ONLY";
+    default: return "UNKNOWN";
+    }
+}
+
+void FramePipeline::start(CaptureFn capture, ProcessFn process, CommandFn command) {
+    stop();
+
+    m_capture = std::move(capture);
+    m_process = std::move(process);
+    m_command = std::move(command);
+    m_stop = false;
+    m_captureDone = false;
+    m_hasDisplayed = false;
+
+    m_workers.clear();
+    for (int i = 0; i < m_options.workers; ++i) {
+        m_workers.emplace_back(new Worker(m_options.queueCapacity));
+    }
+    for (int i = 0; i < m_options.workers; ++i) {
+        m_workers[i]->thread = std::thread(&FramePipeline::workerLoop, this, i);
+    }
+    m_captureThread = std::thread(&FramePipeline::captureLoop, this);
+}
+
+void FramePipeline::stop() {
+    m_stop = true;
+    if (m_captureThread.joinable()) {
+        m_captureThread.join();
+    }
+    for (auto& worker : m_workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+bool FramePipeline::finished() const {
+    if (!m_captureDone) {
+        return false;
+    }
+    for (const auto& worker : m_workers) {
+        if (!worker->done || worker->output.size() > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+FramePipeline::Counters FramePipeline::counters() const {
+    Counters counters;
+    counters.captured = m_captured;
+    counters.processed = m_processed;
+    counters.displayed = m_displayed;
+    counters.droppedInput = m_droppedInput;
+    counters.droppedOutput = m_droppedOutput;
+    counters.droppedLate = m_droppedLate;
+    return counters;
+}
+
+bool FramePipeline::push(SpscRing<FramePacket>& ring, FramePacket& packet, DropPolicy policy,
+    std::atomic<uint64_t>& dropped) {
+    if (policy == DROP_BLOCK) {
+        while (!ring.tryPush(std::move(packet))) {
+            if (m_stop) {
+                return false;
+            }
+            idle();
+        }
+        return true;
+    }
+
+    // DROP_NEWEST и DROP_LATEST_ONLY: писатель никогда не ждёт
+    if (!ring.tryPush(std::move(packet))) {
+        ++dropped;
+        return false;
+    }
+    return true;
+}
+
+bool FramePipeline::pop(SpscRing<FramePacket>& ring, FramePacket& packet, DropPolicy policy,
+    std::atomic<uint64_t>& dropped) {
+    if (!ring.tryPop(packet)) {
+        return false;
+    }
+
+    // Устаревшие кадры пропускаются, остаётся самый свежий
+    if (policy == DROP_LATEST_ONLY) {
+        while (ring.tryPop(packet)) {
+            ++dropped;
+        }
+    }
+    return true;
+}
+
+void FramePipeline::captureLoop() {
+    uint64_t nextId = 0;
+    const size_t workerCount = m_workers.size();
+    cv::Size frameSize;
+    int frameType = 0;
+    FrameTracer::setThreadName("capture");
+
+    while (!m_stop) {
+        FrameTracer::setCurrentFrame(nextId);
+        FramePacket packet;
+        cv::Mat target;
+        if (frameSize.area() > 0) {
+            packet.frame = m_pool.acquire(frameSize, frameType);
+            target = packet.frame.writable();
+        }
+        if (!m_capture(target)) {
+            break;
+        }
+
+        // Первый кадр или смена разрешения: источник выделил свой буфер
+        if (target.data != packet.frame.data()) {
+            frameSize = target.size();
+            frameType = target.type();
+            packet.frame = m_pool.copyOf(target);
+        }
+
+        packet.id = nextId++;
+        packet.captureTicks = cv::getTickCount();
+        ++m_captured;
+
+        Worker& worker = *m_workers[packet.id % workerCount];
+        push(worker.input, packet, m_options.inputPolicy, m_droppedInput);
+    }
+
+    m_captureDone = true;
+}
+
+void FramePipeline::workerLoop(int index) {
+    Worker& worker = *m_workers[index];
+    FrameTracer::setThreadName("worker " + std::to_string(index));
+
+    while (!m_stop) {
+        FramePacket packet;
+        if (!pop(worker.input, packet, m_options.inputPolicy, m_droppedInput)) {
+            // Источник закончился и очередь пуста - обработчик завершается
+            if (m_captureDone && worker.input.size() == 0) {
+                break;
+            }
+            idle();
+            continue;
+        }
+
+        FrameTracer::setCurrentFrame(packet.id);
+        {
+            TraceScope trace("process");
+            m_process(index, packet);
+        }
+        ++m_processed;
+
+        int command;
+        while (worker.commands.tryPop(command)) {
+            if (m_command) {
+                m_command(index, command, packet);
+            }
+        }
+
+        push(worker.output, packet, m_options.outputPolicy, m_droppedOutput);
+    }
+
+    worker.done = true;
+}
+
+void FramePipeline::dropLate(SpscRing<FramePacket>& ring) {
+    FramePacket* head = ring.front();
+    while (head && m_hasDisplayed && head->id <= m_lastDisplayed) {
+        FramePacket late;
+        ring.tryPop(late);
+        ++m_droppedLate;
+        head = ring.front();
+    }
+}
+
+bool FramePipeline::nextOutput(FramePacket& packet) {
+    Worker* best = nullptr;
+
+    if (m_options.outputPolicy == DROP_LATEST_ONLY) {
+        // Из каждой очереди остаётся только последний кадр, показывается самый новый
+        for (auto& worker : m_workers) {
+            FramePacket* head = worker->output.front();
+            while (head && worker->output.size() > 1) {
+                FramePacket stale;
+                worker->output.tryPop(stale);
+                ++m_droppedOutput;
+                head = worker->output.front();
+            }
+            dropLate(worker->output);
+            head = worker->output.front();
+            if (head && (!best || head->id > best->output.front()->id)) {
+                best = worker.get();
+            }
+        }
+    }
+    else if (m_options.inputPolicy == DROP_BLOCK && m_options.outputPolicy == DROP_BLOCK) {
+        // Без потерь: ждём строго следующий номер у обработчика, которому он достался
+        uint64_t expected = m_hasDisplayed ? m_lastDisplayed + 1 : 0;
+        Worker* worker = m_workers[expected % m_workers.size()].get();
+        FramePacket* head = worker->output.front();
+        if (head && head->id == expected) {
+            best = worker;
+        }
+    }
+    else {
+        // Кадры выдаются в порядке номеров
+        for (auto& worker : m_workers) {
+            dropLate(worker->output);
+            FramePacket* head = worker->output.front();
+            if (head && (!best || head->id < best->output.front()->id)) {
+                best = worker.get();
+            }
+        }
+    }
+
+    if (!best || !best->output.tryPop(packet)) {
+        return false;
+    }
+
+    m_hasDisplayed = true;
+    m_lastDisplayed = packet.id;
+    ++m_displayed;
+    return true;
+}
+
+void FramePipeline::broadcast(int command) {
+    for (auto& worker : m_workers) {
+        // Команды не теряются: очередь команд разгружается после каждого кадра
+        while (!worker->commands.tryPush(std::move(command))) {
+            if (m_stop || worker->done) {
+                break;
+            }
+            idle();
+        }
+    }
+}
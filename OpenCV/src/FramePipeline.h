@@ -0,0 +1,134 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "FramePool.h"
+#include "SpscRing.h"
+
+// Поведение очереди между стадиями при переполнении
+enum DropPolicy {
+    DROP_BLOCK = 0,         // Писатель ждёт свободного места (без потерь)
+    DROP_NEWEST = 1,        // При заполнении новый кадр отбрасывается
+    DROP_LATEST_ONLY = 2    // Читатель забирает только самый свежий кадр
+};
+
+// Кадр, проходящий через конвейер. Буферы берутся из пула конвейера
+// и возвращаются в него, когда уничтожена последняя ссылка
+struct FramePacket {
+    uint64_t id = 0;            // Номер кадра источника
+    int64 captureTicks = 0;     // cv::getTickCount() в момент захвата
+    FrameHandle frame;          // Кадр источника (после захвата не изменяется)
+    FrameHandle output;         // Результат обработки для отображения
+};
+
+// Многопоточный конвейер захват -> обработка -> отображение.
+// Поток захвата раздаёт кадры обработчикам по кругу (id % workers), каждый
+// обработчик связан с захватом и отображением своими SPSC-очередями.
+// Отображение вызывает nextOutput() из своего потока (обычно главного, где
+// работает HighGUI) и получает кадры в порядке номеров; кадр, пришедший после
+// более нового, отбрасывается. При DROP_BLOCK на обеих очередях потерь нет и
+// кадры выдаются строго друг за другом. Пропускная способность ограничена самой
+// медленной стадией, а не суммой времени всех стадий.
+// Каждый обработчик работает со своим состоянием (детекторами), поэтому
+// при нескольких обработчиках инкрементальный режим и автопороги ведутся
+// по подпоследовательности кадров своего обработчика.
+class FramePipeline {
+public:
+    // Захват очередного кадра, false - источник закончился.
+    // frame указывает на буфер пула размера предыдущего кадра: источник,
+    // пишущий в готовый буфер (VideoCapture::read), не выделяет память
+    using CaptureFn = std::function<bool(cv::Mat& frame)>;
+    // Обработка кадра обработчиком worker
+    using ProcessFn = std::function<void(int worker, FramePacket& packet)>;
+    // Команда отображения (клавиша), применяется после обработки очередного кадра
+    using CommandFn = std::function<void(int worker, int command, FramePacket& packet)>;
+
+    struct Options {
+        int workers = 1;
+        size_t queueCapacity = 4;
+        DropPolicy inputPolicy = DROP_LATEST_ONLY;      // Захват -> обработка
+        DropPolicy outputPolicy = DROP_LATEST_ONLY;     // Обработка -> отображение
+    };
+
+    struct Counters {
+        uint64_t captured = 0;
+        uint64_t processed = 0;
+        uint64_t displayed = 0;
+        uint64_t droppedInput = 0;      // Не попали к обработчику
+        uint64_t droppedOutput = 0;     // Обработаны, но не показаны
+        uint64_t droppedLate = 0;       // Пришли к отображению после более нового кадра
+    };
+
+    FramePipeline();
+    explicit FramePipeline(const Options& options);
+    ~FramePipeline();
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    void start(CaptureFn capture, ProcessFn process, CommandFn command = CommandFn());
+    void stop();
+
+    // Источник закончился, все кадры обработаны и выданы
+    bool finished() const;
+
+    // Следующий обработанный кадр (поток отображения), false - пока нет
+    bool nextOutput(FramePacket& packet);
+    // Команда всем обработчикам (поток отображения)
+    void broadcast(int command);
+
+    const Options& options() const { return m_options; }
+    // Пул буферов кадров (общий для захвата, обработчиков и отображения)
+    FramePool& pool() { return m_pool; }
+    Counters counters() const;
+    static const char* policyName(DropPolicy policy);
+
+private:
+    struct Worker {
+        explicit Worker(size_t capacity)
+            : input(capacity), output(capacity), commands(64) {}
+
+        SpscRing<FramePacket> input;
+        SpscRing<FramePacket> output;
+        SpscRing<int> commands;
+        std::thread thread;
+        std::atomic<bool> done{ false };
+    };
+
+    Options m_options;
+    // Пул объявлен раньше очередей: кадры в очередях возвращаются в него при уничтожении
+    FramePool m_pool;
+    CaptureFn m_capture;
+    ProcessFn m_process;
+    CommandFn m_command;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::thread m_captureThread;
+    std::atomic<bool> m_stop{ false };
+    std::atomic<bool> m_captureDone{ false };
+
+    // Последний выданный кадр (только поток отображения)
+    bool m_hasDisplayed = false;
+    uint64_t m_lastDisplayed = 0;
+
+    std::atomic<uint64_t> m_captured{ 0 };
+    std::atomic<uint64_t> m_processed{ 0 };
+    std::atomic<uint64_t> m_displayed{ 0 };
+    std::atomic<uint64_t> m_droppedInput{ 0 };
+    std::atomic<uint64_t> m_droppedOutput{ 0 };
+    std::atomic<uint64_t> m_droppedLate{ 0 };
+
+    void captureLoop();
+    void workerLoop(int index);
+
+    bool push(SpscRing<FramePacket>& ring, FramePacket& packet, DropPolicy policy,
+        std::atomic<uint64_t>& dropped);
+    bool pop(SpscRing<FramePacket>& ring, FramePacket& packet, DropPolicy policy,
+        std::atomic<uint64_t>& dropped);
+    void dropLate(SpscRing<FramePacket>& ring);
+};
@@ -0,0 +1,164 @@
+﻿#include "FramePool.h"
+#include <algorithm>
+
+struct FrameHandle::Buffer {
+    FramePool* pool = nullptr;
+    std::atomic<int> refs{ 0 };
+    void* memory = nullptr;
+    cv::Mat mat;
+};
+
+FrameHandle::FrameHandle(Buffer* buffer)
+    : m_buffer(buffer) {
+    if (m_buffer) {
+        m_buffer->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+FrameHandle::FrameHandle(const FrameHandle& other)
+    : FrameHandle(other.m_buffer) {
+}
+
+FrameHandle::FrameHandle(FrameHandle&& other) noexcept
+    : m_buffer(other.m_buffer) {
+    other.m_buffer = nullptr;
+}
+
+FrameHandle& FrameHandle::operator=(const FrameHandle& other) {
+    if (m_buffer != other.m_buffer) {
+        release();
+        m_buffer = other.m_buffer;
+        if (m_buffer) {
+            m_buffer->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return *this;
+}
+
+FrameHandle& FrameHandle::operator=(FrameHandle&& other) noexcept {
+    if (this != &other) {
+        release();
+        m_buffer = other.m_buffer;
+        other.m_buffer = nullptr;
+    }
+    return *this;
+}
+
+FrameHandle::~FrameHandle() {
+    release();
+}
+
+void FrameHandle::release() {
+    if (!m_buffer) {
+        return;
+    }
+    // Последний владелец возвращает буфер в пул
+    if (m_buffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_buffer->pool->recycle(m_buffer);
+    }
+    m_buffer = nullptr;
+}
+
+const cv::Mat& FrameHandle::mat() const {
+    static const cv::Mat empty;
+    return m_buffer ? m_buffer->mat : empty;
+}
+
+cv::Mat& FrameHandle::writable() {
+    CV_Assert(m_buffer != nullptr);
+    if (m_buffer->refs.load(std::memory_order_acquire) > 1) {
+        // Данные видят другие владельцы - пишем в собственную копию
+        FrameHandle copy = m_buffer->pool->copyOf(m_buffer->mat);
+        *this = std::move(copy);
+    }
+    return m_buffer->mat;
+}
+
+int FrameHandle::useCount() const {
+    return m_buffer ? m_buffer->refs.load(std::memory_order_relaxed) : 0;
+}
+
+const uint8_t* FrameHandle::data() const {
+    return m_buffer ? m_buffer->mat.data : nullptr;
+}
+
+
+
+FramePool::~FramePool() {
+    // Все ссылки на кадры должны быть уничтожены раньше пула
+    for (FrameHandle::Buffer* buffer : m_all) {
+        cv::fastFree(buffer->memory);
+        delete buffer;
+    }
+}
+
+void FramePool::reserve(cv::Size size, int type, int count) {
+    std::vector<FrameHandle::Buffer*> buffers;
+    for (int i = 0; i < count; ++i) {
+        buffers.push_back(allocate(size, type));
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_free.insert(m_free.end(), buffers.begin(), buffers.end());
+}
+
+FrameHandle FramePool::acquire(cv::Size size, int type) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = m_free.size(); i-- > 0;) {
+            FrameHandle::Buffer* buffer = m_free[i];
+            if (buffer->mat.size() == size && buffer->mat.type() == type) {
+                m_free.erase(m_free.begin() + i);
+                return FrameHandle(buffer);
+            }
+        }
+    }
+    return FrameHandle(allocate(size, type));
+}
+
+FrameHandle FramePool::copyOf(const cv::Mat& image) {
+    FrameHandle handle = acquire(image.size(), image.type());
+    image.copyTo(handle.m_buffer->mat);
+    return handle;
+}
+
+size_t FramePool::bufferCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_all.size();
+}
+
+size_t FramePool::freeCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_free.size();
+}
+
+FrameHandle::Buffer* FramePool::allocate(cv::Size size, int type) {
+    // Строки идут подряд (кадр непрерывный), выровнено начало буфера
+    size_t bytes = static_cast<size_t>(size.width) * size.height * CV_ELEM_SIZE(type);
+
+    FrameHandle::Buffer* buffer = new FrameHandle::Buffer();
+    buffer->pool = this;
+    buffer->memory = cv::fastMalloc(bytes + kAlignment);
+    uint8_t* aligned = cv::alignPtr(static_cast<uint8_t*>(buffer->memory), static_cast<int>(kAlignment));
+    buffer->mat = cv::Mat(size, type, aligned);
+    ++m_allocations;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Буферы устаревшего размера (после смены разрешения) освобождаются
+    for (size_t i = m_free.size(); i-- > 0;) {
+        FrameHandle::Buffer* stale = m_free[i];
+        if (stale->mat.size() != size || stale->mat.type() != type) {
+            m_free.erase(m_free.begin() + i);
+            m_all.erase(std::find(m_all.begin(), m_all.end(), stale));
+            cv::fastFree(stale->memory);
+            delete stale;
+        }
+    }
+    m_all.push_back(buffer);
+    return buffer;
+}
+
+void FramePool::recycle(FrameHandle::Buffer* buffer) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_free.push_back(buffer);
+}
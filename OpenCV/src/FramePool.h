@@ -0,0 +1,84 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class FramePool;
+
+// Ссылка на кадр из пула со счётчиком ссылок.
+// Копирование дешёвое (снимок): данные общие, пока кто-то не попросит запись.
+// writable() при нескольких владельцах копирует кадр в новый буфер пула
+// (копирование при записи), поэтому снимок для сохранения никогда не
+// меняется под читателем. Когда последняя ссылка уничтожена, буфер
+// возвращается в пул без освобождения памяти.
+class FrameHandle {
+public:
+    FrameHandle() = default;
+    FrameHandle(const FrameHandle& other);
+    FrameHandle(FrameHandle&& other) noexcept;
+    FrameHandle& operator=(const FrameHandle& other);
+    FrameHandle& operator=(FrameHandle&& other) noexcept;
+    ~FrameHandle();
+
+    bool empty() const { return m_buffer == nullptr; }
+    void release();
+
+    // Только чтение: заголовок cv::Mat над буфером пула (без копирования)
+    const cv::Mat& mat() const;
+    // Запись: при общих данных кадр сначала копируется
+    cv::Mat& writable();
+
+    int useCount() const;
+    const uint8_t* data() const;
+
+private:
+    friend class FramePool;
+    struct Buffer;
+
+    explicit FrameHandle(Buffer* buffer);
+
+    Buffer* m_buffer = nullptr;
+};
+
+// Пул заранее выделенных выровненных буферов кадров.
+// Буферы одного размера и типа переиспользуются по кругу; если все заняты,
+// выделяется новый (и учитывается в allocations()), после прогрева конвейера
+// новых выделений в главном цикле нет.
+class FramePool {
+public:
+    static const size_t kAlignment = 64;
+
+    FramePool() = default;
+    ~FramePool();
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    // Заранее выделить count буферов
+    void reserve(cv::Size size, int type, int count);
+
+    // Свободный буфер нужного размера и типа (содержимое не определено)
+    FrameHandle acquire(cv::Size size, int type);
+    // Буфер с копией изображения
+    FrameHandle copyOf(const cv::Mat& image);
+
+    // Число выделений памяти за всё время и буферов в пуле
+    uint64_t allocations() const { return m_allocations; }
+    size_t bufferCount() const;
+    size_t freeCount() const;
+
+private:
+    friend class FrameHandle;
+
+    mutable std::mutex m_mutex;
+    std::vector<FrameHandle::Buffer*> m_all;
+    std::vector<FrameHandle::Buffer*> m_free;
+    std::atomic<uint64_t> m_allocations{ 0 };
+
+    FrameHandle::Buffer* allocate(cv::Size size, int type);
+    void recycle(FrameHandle::Buffer* buffer);
+};
@@ -0,0 +1,280 @@
+﻿#include "FrameSource.h"
+#include "StageMetrics.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+namespace {
+bool startsWith(const std::string& text, const char* prefix) {
+    return text.compare(0, std::char_traits<char>::length(prefix), prefix) == 0;
+}
+
+bool isVideoFile(const std::string& path) {
+    static const char* extensions[] = { ".avi", ".mp4", ".mkv", ".mov", ".webm", ".m4v" };
+    std::string lower = path;
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+        [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    for (const char* extension : extensions) {
+        size_t length = std::char_traits<char>::length(extension);
+        if (lower.size() > length && lower.compare(lower.size() - length, length, extension) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Число шагов шума: шум повторяется с этим периодом, чтобы не генерировать его каждый кадр
+const int kNoisePhases = 8;
+}
+
+FrameSource::FrameSource(const Options& options)
+    : m_options(options) {
+}
+
+const char* FrameSource::pacingName(SourcePacing pacing) {
+    switch (pacing) {
+    case PACING_NATIVE: return "NATIVE";
+    case PACING_FIXED: return "FIXED";
+    case PACING_UNLIMITED: return "UNLIMITED";
+    default: return "UNKNOWN";
+    }
+}
+
+std::unique_ptr<FrameSource> FrameSource::create(const std::string& spec, const Options& options) {
+    if (spec.empty() || spec == "camera" || startsWith(spec, "camera:")) {
+        int index = spec.size() > 7 ? std::atoi(spec.c_str() + 7) : 0;
+        std::unique_ptr<CameraSource> source(new CameraSource(index, options));
+        return source->isOpened() ? std::move(source) : nullptr;
+    }
+    if (spec == "synthetic" || startsWith(spec, "synthetic:")) {
+        uint64_t seed = spec.size() > 10 ? std::strtoull(spec.c_str() + 10, nullptr, 10) : 1;
+        return std::unique_ptr<FrameSource>(new SyntheticSource(seed, options));
+    }
+    if (startsWith(spec, "images:")) {
+        std::unique_ptr<ImageSequenceSource> source(new ImageSequenceSource(spec.substr(7), options));
+        return source->isOpened() ? std::move(source) : nullptr;
+    }
+    if (startsWith(spec, "video:") || isVideoFile(spec)) {
+        std::string path = startsWith(spec, "video:") ? spec.substr(6) : spec;
+        std::unique_ptr<VideoFileSource> source(new VideoFileSource(path, options));
+        return source->isOpened() ? std::move(source) : nullptr;
+    }
+    // Маска без префикса
+    if (spec.find('*') != std::string::npos) {
+        std::unique_ptr<ImageSequenceSource> source(new ImageSequenceSource(spec, options));
+        return source->isOpened() ? std::move(source) : nullptr;
+    }
+    return nullptr;
+}
+
+bool FrameSource::read(cv::Mat& frame) {
+    if (m_options.maxFrames > 0 && m_framesRead >= m_options.maxFrames) {
+        return false;
+    }
+
+    pace();
+
+    ScopedStageTimer timer(METRIC_CAPTURE);
+    if (!grab(frame)) {
+        // Конец файла: при зацикливании начинаем сначала
+        if (!m_options.loop || m_framesRead == 0 || !rewind() || !grab(frame)) {
+            return false;
+        }
+    }
+    ++m_framesRead;
+    return true;
+}
+
+void FrameSource::pace() {
+    double fps = 0.0;
+    if (m_options.pacing == PACING_FIXED) {
+        fps = m_options.fps;
+    }
+    else if (m_options.pacing == PACING_NATIVE) {
+        fps = nativeFps();
+    }
+    if (fps <= 0.0) {
+        return;
+    }
+
+    auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps));
+    Clock::time_point now = Clock::now();
+    if (!m_started) {
+        m_started = true;
+        m_nextFrame = now;
+    }
+
+    if (m_nextFrame > now) {
+        std::this_thread::sleep_until(m_nextFrame);
+    }
+    else if (now - m_nextFrame > period) {
+        // Отставание больше периода (медленный конвейер) не нагоняется пачкой кадров
+        m_nextFrame = now;
+    }
+    m_nextFrame += period;
+}
+
+
+
+CameraSource::CameraSource(int index, const Options& options)
+    : FrameSource(options), m_index(index), m_capture(index) {
+    if (m_capture.isOpened()) {
+        m_capture.set(cv::CAP_PROP_FRAME_WIDTH, m_options.size.width);
+        m_capture.set(cv::CAP_PROP_FRAME_HEIGHT, m_options.size.height);
+        m_capture.set(cv::CAP_PROP_FPS, m_options.fps);
+    }
+}
+
+std::string CameraSource::describe() const {
+    return "camera " + std::to_string(m_index);
+}
+
+bool CameraSource::grab(cv::Mat& frame) {
+    if (!m_capture.read(frame)) {
+        std::cerr << "Failed to grab frame!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+
+VideoFileSource::VideoFileSource(const std::string& path, const Options& options)
+    : FrameSource(options), m_path(path), m_capture(path) {
+    if (m_capture.isOpened()) {
+        m_fps = m_capture.get(cv::CAP_PROP_FPS);
+    }
+}
+
+std::string VideoFileSource::describe() const {
+    return "video " + m_path;
+}
+
+bool VideoFileSource::grab(cv::Mat& frame) {
+    return m_capture.read(frame);
+}
+
+bool VideoFileSource::rewind() {
+    return m_capture.set(cv::CAP_PROP_POS_FRAMES, 0);
+}
+
+
+
+ImageSequenceSource::ImageSequenceSource(const std::string& pattern, const Options& options)
+    : FrameSource(options), m_pattern(pattern) {
+    cv::glob(pattern, m_files, false);
+    std::sort(m_files.begin(), m_files.end());
+}
+
+std::string ImageSequenceSource::describe() const {
+    return "images " + m_pattern + " (" + std::to_string(m_files.size()) + " files)";
+}
+
+bool ImageSequenceSource::grab(cv::Mat& frame) {
+    while (m_next < m_files.size()) {
+        cv::Mat image = cv::imread(m_files[m_next++], cv::IMREAD_COLOR);
+        if (!image.empty()) {
+            // Копия в готовый буфер конвейера (при совпадении размера без выделения)
+            image.copyTo(frame);
+            return true;
+        }
+        std::cerr << "Skipping unreadable image: " << m_files[m_next - 1] << std::endl;
+    }
+    return false;
+}
+
+bool ImageSequenceSource::rewind() {
+    m_next = 0;
+    return true;
+}
+
+
+
+SyntheticSource::SyntheticSource(uint64_t seed, const Options& options)
+    : FrameSource(options), m_seed(seed) {
+    const cv::Size size = m_options.size;
+    cv::RNG rng(seed);
+
+    // Диагональный градиент: плавный фон без границ
+    m_background.create(size, CV_8UC3);
+    for (int y = 0; y < size.height; ++y) {
+        uchar* row = m_background.ptr<uchar>(y);
+        for (int x = 0; x < size.width; ++x) {
+            row[3 * x + 0] = static_cast<uchar>(64 + 96 * x / std::max(1, size.width));
+            row[3 * x + 1] = static_cast<uchar>(48 + 96 * y / std::max(1, size.height));
+            row[3 * x + 2] = static_cast<uchar>(80);
+        }
+    }
+
+    // Статичные прямоугольники: неизменные тайлы для инкрементального режима
+    for (int i = 0; i < 6; ++i) {
+        cv::Point corner(rng.uniform(0, size.width), rng.uniform(0, size.height));
+        cv::Size extent(rng.uniform(20, std::max(21, size.width / 5)), rng.uniform(20, std::max(21, size.height / 5)));
+        cv::rectangle(m_background, cv::Rect(corner, extent),
+            cv::Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256)), cv::FILLED);
+    }
+
+    // Движущиеся фигуры
+    for (int i = 0; i < 5; ++i) {
+        Shape shape;
+        shape.start = cv::Point2f(rng.uniform(0.0f, static_cast<float>(size.width)),
+            rng.uniform(0.0f, static_cast<float>(size.height)));
+        shape.velocity = cv::Point2f(rng.uniform(-4.0f, 4.0f), rng.uniform(-3.0f, 3.0f));
+        shape.radius = rng.uniform(12, std::max(13, size.height / 8));
+        shape.color = cv::Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+        shape.circle = (i % 2) == 0;
+        m_shapes.push_back(shape);
+    }
+
+    // Несколько кадров шума сенсора, выбираются по номеру кадра
+    m_noise.create(size.height * kNoisePhases, size.width, CV_8UC3);
+    rng.fill(m_noise, cv::RNG::UNIFORM, 0, 6);
+}
+
+std::string SyntheticSource::describe() const {
+    return "synthetic " + std::to_string(m_options.size.width) + "x" +
+        std::to_string(m_options.size.height) + " seed " + std::to_string(m_seed);
+}
+
+bool SyntheticSource::grab(cv::Mat& frame) {
+    const cv::Size size = m_options.size;
+    frame.create(size, CV_8UC3);
+    m_background.copyTo(frame);
+
+    // Позиция фигуры - функция номера кадра с отражением от краёв
+    auto bounce = [](float position, float extent) {
+        float period = 2.0f * extent;
+        float wrapped = std::fmod(position, period);
+        if (wrapped < 0.0f) {
+            wrapped += period;
+        }
+        return wrapped < extent ? wrapped : period - wrapped;
+    };
+
+    const float t = static_cast<float>(m_index);
+    for (const Shape& shape : m_shapes) {
+        cv::Point center(cvRound(bounce(shape.start.x + shape.velocity.x * t, static_cast<float>(size.width))),
+            cvRound(bounce(shape.start.y + shape.velocity.y * t, static_cast<float>(size.height))));
+        if (shape.circle) {
+            cv::circle(frame, center, shape.radius, shape.color, cv::FILLED, cv::LINE_AA);
+        }
+        else {
+            cv::Rect box(center.x - shape.radius, center.y - shape.radius, 2 * shape.radius, 2 * shape.radius);
+            cv::rectangle(frame, box, shape.color, cv::FILLED);
+        }
+    }
+
+    int phase = static_cast<int>(m_index % kNoisePhases);
+    cv::add(frame, m_noise.rowRange(phase * size.height, (phase + 1) * size.height), frame);
+
+    ++m_index;
+    return true;
+}
+
+bool SyntheticSource::rewind() {
+    m_index = 0;
+    return true;
+}
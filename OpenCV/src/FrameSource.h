@@ -0,0 +1,158 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Темп выдачи кадров источником
+enum SourcePacing {
+    PACING_NATIVE = 0,      // Собственный темп: камера - как отдаёт драйвер, файл - его FPS
+    PACING_FIXED = 1,       // Не чаще Options::fps кадров в секунду
+    PACING_UNLIMITED = 2    // Так быстро, как читает конвейер (бенчмарки)
+};
+
+// Источник кадров для конвейера: камера, видеофайл, последовательность
+// изображений или детерминированный синтетический генератор.
+// Базовый класс отвечает за общее поведение - темп, зацикливание и
+// ограничение числа кадров; наследники только читают очередной кадр.
+// Источник создаётся по строке описания (см. create()), поэтому один и тот же
+// конвейер запускается и с камерой, и без неё на машинах CI.
+class FrameSource {
+public:
+    struct Options {
+        cv::Size size = cv::Size(640, 480);     // Камера и синтетический генератор
+        double fps = 30.0;                      // Для PACING_FIXED и синтетического источника
+        SourcePacing pacing = PACING_NATIVE;
+        bool loop = false;                      // Файл и последовательность начинаются заново
+        uint64_t maxFrames = 0;                 // 0 - без ограничения
+    };
+
+    virtual ~FrameSource() = default;
+
+    // Описание источника:
+    //   camera[:N]                 - камера N (по умолчанию 0)
+    //   video:путь или путь.avi... - видеофайл
+    //   images:шаблон              - изображения по маске (cv::glob), например frames/*.png
+    //   synthetic[:seed]           - синтетическая сцена
+    // Возвращает nullptr, если источник не открылся
+    static std::unique_ptr<FrameSource> create(const std::string& spec, const Options& options);
+
+    // Очередной кадр с учётом темпа. frame может быть готовым буфером
+    // нужного размера - тогда он заполняется без выделения памяти.
+    // false - источник закончился (или ошибка чтения)
+    bool read(cv::Mat& frame);
+
+    // Сколько кадров выдано
+    uint64_t framesRead() const { return m_framesRead; }
+    const Options& options() const { return m_options; }
+    virtual std::string describe() const = 0;
+
+    static const char* pacingName(SourcePacing pacing);
+
+protected:
+    explicit FrameSource(const Options& options);
+
+    // Чтение следующего кадра без учёта темпа
+    virtual bool grab(cv::Mat& frame) = 0;
+    // Возврат к началу для зацикливания, false - не поддерживается
+    virtual bool rewind() { return false; }
+    // Собственный темп источника (кадров в секунду), 0 - источник задаёт его сам
+    virtual double nativeFps() const { return 0.0; }
+
+    Options m_options;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    uint64_t m_framesRead = 0;
+    bool m_started = false;
+    Clock::time_point m_nextFrame;
+
+    void pace();
+};
+
+// Камера через cv::VideoCapture
+class CameraSource : public FrameSource {
+public:
+    CameraSource(int index, const Options& options);
+
+    bool isOpened() const { return m_capture.isOpened(); }
+    std::string describe() const override;
+
+protected:
+    bool grab(cv::Mat& frame) override;
+
+private:
+    int m_index;
+    cv::VideoCapture m_capture;
+};
+
+// Видеофайл; при зацикливании перематывается на первый кадр
+class VideoFileSource : public FrameSource {
+public:
+    VideoFileSource(const std::string& path, const Options& options);
+
+    bool isOpened() const { return m_capture.isOpened(); }
+    std::string describe() const override;
+
+protected:
+    bool grab(cv::Mat& frame) override;
+    bool rewind() override;
+    double nativeFps() const override { return m_fps; }
+
+private:
+    std::string m_path;
+    cv::VideoCapture m_capture;
+    double m_fps = 0.0;
+};
+
+// Изображения по маске, в порядке имён файлов
+class ImageSequenceSource : public FrameSource {
+public:
+    ImageSequenceSource(const std::string& pattern, const Options& options);
+
+    bool isOpened() const { return !m_files.empty(); }
+    std::string describe() const override;
+
+protected:
+    bool grab(cv::Mat& frame) override;
+    bool rewind() override;
+    double nativeFps() const override { return m_options.fps; }
+
+private:
+    std::string m_pattern;
+    std::vector<cv::String> m_files;
+    size_t m_next = 0;
+};
+
+// Детерминированная синтетическая сцена: фон-градиент, движущиеся фигуры и
+// шум, зависящие только от номера кадра и seed. Повторные запуски дают
+// одинаковые кадры, часть тайлов меняется от кадра к кадру, часть - нет
+class SyntheticSource : public FrameSource {
+public:
+    SyntheticSource(uint64_t seed, const Options& options);
+
+    std::string describe() const override;
+
+protected:
+    bool grab(cv::Mat& frame) override;
+    bool rewind() override;
+    double nativeFps() const override { return m_options.fps; }
+
+private:
+    struct Shape {
+        cv::Point2f start;
+        cv::Point2f velocity;
+        int radius;
+        cv::Scalar color;
+        bool circle;
+    };
+
+    uint64_t m_seed;
+    uint64_t m_index = 0;
+    cv::Mat m_background;
+    cv::Mat m_noise;
+    std::vector<Shape> m_shapes;
+};
@@ -0,0 +1,182 @@
+﻿#include "FrameTracer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+
+namespace {
+// Состояние потока: номер буфера (kNoBuffer - буферов не хватило) и текущий кадр
+const int kNoBuffer = -2;
+thread_local int t_bufferIndex = -1;
+thread_local uint64_t t_frameId = FrameTracer::kNoFrame;
+thread_local char t_threadName[32] = {};
+
+// JSON-строка из литерала имени (кавычки и обратные косые черты экранируются)
+void writeJsonString(std::ostream& out, const char* text) {
+    out << '"';
+    for (const char* c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out << '\\';
+        }
+        out << *c;
+    }
+    out << '"';
+}
+}
+
+FrameTracer& FrameTracer::instance() {
+    static FrameTracer tracer;
+    return tracer;
+}
+
+void FrameTracer::start(size_t eventsPerThread, int threads) {
+    stop();
+    eventsPerThread = std::max<size_t>(eventsPerThread, 64);
+    if (!m_threads) {
+        if (threads <= 0) {
+            // Пул по ядрам, захват и служебные потоки
+            threads = 2 * static_cast<int>(std::thread::hardware_concurrency()) + 8;
+        }
+        m_maxThreads = std::max(threads, static_cast<int>(kMinThreads));
+        m_threads.reset(new ThreadBuffer[m_maxThreads]);
+    }
+    for (int i = 0; i < m_maxThreads; ++i) {
+        ThreadBuffer& buffer = m_threads[i];
+        if (buffer.capacity != eventsPerThread) {
+            buffer.events.reset(new Event[eventsPerThread]);
+            buffer.capacity = eventsPerThread;
+        }
+        buffer.count.store(0, std::memory_order_relaxed);
+    }
+    m_startNs = nowNs();
+    m_enabled.store(true, std::memory_order_seq_cst);
+}
+
+void FrameTracer::stop() {
+    m_enabled.store(false, std::memory_order_seq_cst);
+    // Поток мог проверить флаг до выключения - ждём окончания его записи
+    int threads = usedThreads();
+    for (int i = 0; i < threads; ++i) {
+        while (m_threads[i].writing.load(std::memory_order_seq_cst)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+FrameTracer::ThreadBuffer* FrameTracer::threadBuffer() {
+    if (t_bufferIndex == kNoBuffer || !m_threads) {
+        return nullptr;
+    }
+    if (t_bufferIndex < 0) {
+        // Номер буфера закрепляется за потоком на всё время работы программы,
+        // поток без буфера учитывается один раз
+        int index = m_threadCount.load();
+        do {
+            if (index >= m_maxThreads) {
+                t_bufferIndex = kNoBuffer;
+                ++m_droppedThreads;
+                return nullptr;
+            }
+        } while (!m_threadCount.compare_exchange_weak(index, index + 1));
+        t_bufferIndex = index;
+        std::memcpy(m_threads[index].name, t_threadName, sizeof(t_threadName));
+    }
+    return &m_threads[t_bufferIndex];
+}
+
+void FrameTracer::record(const char* name, uint64_t startNs, uint64_t durationNs) {
+    ThreadBuffer* buffer = threadBuffer();
+    if (!buffer) {
+        return;
+    }
+
+    buffer->writing.store(true, std::memory_order_seq_cst);
+    if (m_enabled.load(std::memory_order_seq_cst) && buffer->capacity > 0) {
+        uint64_t count = buffer->count.load(std::memory_order_relaxed);
+        Event& event = buffer->events[count % buffer->capacity];
+        event.name = name;
+        event.startNs = startNs;
+        event.durationNs = durationNs;
+        event.frameId = t_frameId;
+        buffer->count.store(count + 1, std::memory_order_release);
+    }
+    buffer->writing.store(false, std::memory_order_release);
+}
+
+void FrameTracer::setThreadName(const std::string& name) {
+    std::snprintf(t_threadName, sizeof(t_threadName), "%s", name.c_str());
+    if (t_bufferIndex >= 0) {
+        std::memcpy(instance().m_threads[t_bufferIndex].name, t_threadName, sizeof(t_threadName));
+    }
+}
+
+void FrameTracer::setCurrentFrame(uint64_t frameId) {
+    t_frameId = frameId;
+}
+
+uint64_t FrameTracer::currentFrame() {
+    return t_frameId;
+}
+
+uint64_t FrameTracer::overwritten() const {
+    uint64_t total = 0;
+    int threads = usedThreads();
+    for (int i = 0; i < threads; ++i) {
+        uint64_t count = m_threads[i].count.load(std::memory_order_acquire);
+        if (count > m_threads[i].capacity) {
+            total += count - m_threads[i].capacity;
+        }
+    }
+    return total;
+}
+
+size_t FrameTracer::write(const std::string& path) const {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        return 0;
+    }
+
+    size_t written = 0;
+    int threads = usedThreads();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+    bool first = true;
+    for (int tid = 0; tid < threads; ++tid) {
+        const ThreadBuffer& buffer = m_threads[tid];
+        uint64_t count = buffer.count.load(std::memory_order_acquire);
+        if (count == 0) {
+            continue;
+        }
+
+        // Имя потока - метаданные трассы
+        out << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid
+            << ", \"args\": {\"name\": ";
+        writeJsonString(out, buffer.name[0] ? buffer.name : "thread");
+        out << "}}";
+        first = false;
+
+        uint64_t begin = count > buffer.capacity ? count - buffer.capacity : 0;
+        for (uint64_t i = begin; i < count; ++i) {
+            const Event& event = buffer.events[i % buffer.capacity];
+            if (event.startNs < m_startNs) {
+                continue;
+            }
+            // Завершённое событие "X": начало и длительность в микросекундах
+            out << ",\n{\"name\": ";
+            writeJsonString(out, event.name);
+            out << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+                << ", \"ts\": " << (event.startNs - m_startNs) * 1e-3
+                << ", \"dur\": " << event.durationNs * 1e-3;
+            if (event.frameId != kNoFrame) {
+                out << ", \"args\": {\"frame\": " << event.frameId << "}";
+            }
+            out << "}";
+            ++written;
+        }
+    }
+    out << "\n]}\n";
+    return written;
+}
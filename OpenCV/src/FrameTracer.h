@@ -0,0 +1,105 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Запись временной шкалы обработки в формате Chrome trace_event
+// (открывается в Perfetto или chrome://tracing).
+// У каждого потока свой кольцевой буфер фиксированного размера: буферы
+// выделяются в start() на заданное число потоков, запись события - копирование 32 байт без блокировок
+// и выделений памяти. При переполнении кольца старые события затираются.
+// Событие несёт номер кадра текущего потока (setCurrentFrame), поэтому на
+// шкале видно, какой кадр обрабатывал каждый поток и где кадры перекрываются.
+class FrameTracer {
+public:
+    static const int kMinThreads = 16;
+    static const size_t kDefaultEventsPerThread = 16384;
+    static const uint64_t kNoFrame = ~uint64_t(0);
+
+    static FrameTracer& instance();
+
+    // Выделяет буферы (только здесь) и начинает запись. threads - сколько
+    // потоков может писать события (0 - по числу ядер с запасом). Число
+    // буферов задаётся первым вызовом: номера уже закреплены за потоками
+    void start(size_t eventsPerThread = kDefaultEventsPerThread, int threads = 0);
+    // Прекращает запись, дожидаясь событий, которые пишутся в этот момент
+    void stop();
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // Записанные события в JSON (после stop()). Возвращает число событий
+    size_t write(const std::string& path) const;
+    // Событий, затёртых при переполнении колец
+    uint64_t overwritten() const;
+    // Потоков, которым не хватило буфера: их события в трассу не попали
+    uint64_t droppedThreads() const { return m_droppedThreads.load(std::memory_order_relaxed); }
+
+    // Завершённый интервал [startNs, startNs + durationNs) потока
+    void record(const char* name, uint64_t startNs, uint64_t durationNs);
+
+    // Имя текущего потока на шкале (копируется, до 31 символа)
+    static void setThreadName(const std::string& name);
+    // Номер кадра, который обрабатывает текущий поток
+    static void setCurrentFrame(uint64_t frameId);
+    static uint64_t currentFrame();
+
+    static uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    struct Event {
+        const char* name;       // Строковый литерал
+        uint64_t startNs;
+        uint64_t durationNs;
+        uint64_t frameId;
+    };
+
+    struct ThreadBuffer {
+        std::unique_ptr<Event[]> events;
+        size_t capacity = 0;
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<bool> writing{ false };
+        char name[32] = {};
+    };
+
+    FrameTracer() = default;
+
+    std::atomic<bool> m_enabled{ false };
+    std::atomic<int> m_threadCount{ 0 };
+    std::atomic<uint64_t> m_droppedThreads{ 0 };
+    uint64_t m_startNs = 0;
+    std::unique_ptr<ThreadBuffer[]> m_threads;
+    int m_maxThreads = 0;
+
+    ThreadBuffer* threadBuffer();
+    int usedThreads() const { return std::min(m_threadCount.load(), m_maxThreads); }
+};
+
+// Интервал области видимости на шкале
+class TraceScope {
+public:
+    explicit TraceScope(const char* name)
+        : m_name(name), m_active(FrameTracer::instance().enabled()) {
+        if (m_active) {
+            m_start = FrameTracer::nowNs();
+        }
+    }
+    ~TraceScope() {
+        if (m_active) {
+            FrameTracer::instance().record(m_name, m_start, FrameTracer::nowNs() - m_start);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_name;
+    bool m_active;
+    uint64_t m_start = 0;
+};
@@ -0,0 +1,278 @@
+﻿#include "GridRecorder.h"
+#include "FrameTracer.h"
+#include "SnapshotWriter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+// Буфер файлового вывода потока записи: сброс пишет много мелких полей
+const size_t kIoBufferBytes = 1u << 20;
+
+// Буфер сжатия потока-обработчика: после прогрева не растёт
+thread_local std::vector<uint8_t> t_compressed;
+
+template <class T>
+bool writeValue(std::FILE* file, T value) {
+    return std::fwrite(&value, sizeof(value), 1, file) == 1;
+}
+}
+
+GridRecorder::GridRecorder(const Options& options) : m_options(options) {
+    m_options.arenaBytes = std::max<size_t>(m_options.arenaBytes, 4096);
+    m_options.maxFrames = std::max(2, m_options.maxFrames);
+    m_options.flushIntervalMs = std::max(10, m_options.flushIntervalMs);
+
+    // Вся память регистратора выделяется здесь
+    m_arena.reset(new uint8_t[m_options.arenaBytes]);
+    m_entries.reset(new Entry[m_options.maxFrames]);
+    m_flushArena.reset(new uint8_t[m_options.arenaBytes]);
+    m_flushEntries.reset(new Entry[m_options.maxFrames]);
+}
+
+GridRecorder::~GridRecorder() {
+    stop();
+}
+
+void GridRecorder::start() {
+    if (m_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = false;
+        if (m_options.continuous && m_recordingPath.empty()) {
+            m_recordingPath = SnapshotWriter::timestampedName(m_options.directory, "recording",
+                m_fileSequence++, ".bgrs");
+        }
+    }
+    m_thread = std::thread(&GridRecorder::flushLoop, this);
+}
+
+void GridRecorder::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void GridRecorder::record(const BitGrid& grid, CompressionMethod method, uint64_t frameId, uint64_t timestampNs) {
+    grid.compress(method, t_compressed);
+    record(t_compressed.data(), t_compressed.size(), frameId, timestampNs);
+}
+
+void GridRecorder::record(const uint8_t* data, size_t size, uint64_t frameId, uint64_t timestampNs) {
+    if (size == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (size > m_options.arenaBytes) {
+        ++m_stats.oversized;
+        return;
+    }
+    if (m_count == m_options.maxFrames) {
+        evictOldest();
+    }
+    reserve(size);
+
+    Entry& entry = m_entries[(m_first + m_count) % m_options.maxFrames];
+    entry.offset = m_head;
+    entry.size = static_cast<uint32_t>(size);
+    entry.frameId = frameId;
+    entry.timestampNs = timestampNs;
+    entry.sequence = m_sequence++;
+    std::memcpy(m_arena.get() + m_head, data, size);
+    m_head += size;
+    m_used += size;
+    ++m_count;
+    ++m_stats.recorded;
+
+    // Кадры старше окна вытесняются, даже если арена не заполнена
+    uint64_t windowNs = static_cast<uint64_t>(m_options.seconds * 1e9);
+    while (m_count > 1 && oldest().timestampNs + windowNs < timestampNs) {
+        evictOldest();
+    }
+}
+
+void GridRecorder::evictOldest() {
+    m_used -= oldest().size;
+    m_first = (m_first + 1) % m_options.maxFrames;
+    --m_count;
+    ++m_stats.evicted;
+}
+
+void GridRecorder::reserve(size_t size) {
+    // Данные лежат в арене по кругу от самой старой записи до m_head;
+    // новый кадр занимает непрерывный участок, при нехватке места
+    // вытесняются самые старые кадры
+    size_t capacity = m_options.arenaBytes;
+    while (true) {
+        if (m_count == 0) {
+            m_head = 0;
+            return;
+        }
+        size_t tail = oldest().offset;
+        if (tail < m_head) {
+            if (capacity - m_head >= size) {
+                return;
+            }
+            if (tail >= size) {
+                m_head = 0;
+                return;
+            }
+        }
+        else if (tail - m_head >= size) {
+            return;
+        }
+        evictOldest();
+    }
+}
+
+std::string GridRecorder::trigger() {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_thread.joinable() || m_stop || m_count == 0) {
+            return path;
+        }
+        path = SnapshotWriter::timestampedName(m_options.directory, "prerecord", m_fileSequence++, ".bgrs");
+        m_triggers.push_back(path);
+    }
+    m_wake.notify_one();
+    return path;
+}
+
+GridRecorder::Stats GridRecorder::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats = m_stats;
+    stats.frames = m_count;
+    stats.usedBytes = m_used;
+    stats.memoryBytes = 2 * (m_options.arenaBytes + m_options.maxFrames * sizeof(Entry)) + kIoBufferBytes;
+    if (m_count > 1) {
+        const Entry& newest = m_entries[(m_first + m_count - 1) % m_options.maxFrames];
+        if (newest.timestampNs > oldest().timestampNs) {
+            stats.seconds = (newest.timestampNs - oldest().timestampNs) * 1e-9;
+        }
+    }
+    return stats;
+}
+
+
+
+int GridRecorder::copyWindow(uint64_t fromSequence) {
+    // Вызывается под блокировкой: записи окна плотно копируются в буфер сброса
+    int copied = 0;
+    size_t offset = 0;
+    for (int i = 0; i < m_count; ++i) {
+        const Entry& entry = m_entries[(m_first + i) % m_options.maxFrames];
+        if (entry.sequence < fromSequence) {
+            continue;
+        }
+        Entry& target = m_flushEntries[copied++];
+        target = entry;
+        target.offset = offset;
+        std::memcpy(m_flushArena.get() + offset, m_arena.get() + entry.offset, entry.size);
+        offset += entry.size;
+    }
+    return copied;
+}
+
+bool GridRecorder::writeFlush(const std::string& path, int count, bool append, std::vector<char>& ioBuffer) {
+    // Снимок окна пишется во временный файл, файл записи дописывается на месте
+    std::string target = append ? path : path + ".part";
+    std::FILE* file = std::fopen(target.c_str(), append ? "ab" : "wb");
+    if (!file) {
+        return false;
+    }
+    std::setvbuf(file, ioBuffer.data(), _IOFBF, ioBuffer.size());
+
+    bool ok = true;
+    std::fseek(file, 0, SEEK_END);
+    if (std::ftell(file) == 0) {
+        ok = std::fwrite("BGRS", 1, 4, file) == 4 && writeValue(file, kFileVersion);
+    }
+    for (int i = 0; i < count && ok; ++i) {
+        const Entry& entry = m_flushEntries[i];
+        ok = writeValue(file, entry.frameId) && writeValue(file, entry.timestampNs) &&
+            writeValue(file, entry.size) &&
+            std::fwrite(m_flushArena.get() + entry.offset, 1, entry.size, file) == entry.size;
+    }
+    ok = std::fclose(file) == 0 && ok;
+
+    if (!append) {
+        if (ok) {
+            ok = std::rename(target.c_str(), path.c_str()) == 0;
+        }
+        if (!ok) {
+            std::remove(target.c_str());
+        }
+    }
+    return ok;
+}
+
+void GridRecorder::flushLoop() {
+    FrameTracer::setThreadName("recorder");
+    std::vector<char> ioBuffer(kIoBufferBytes);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        auto ready = [this] { return m_stop || !m_triggers.empty(); };
+        if (m_options.continuous) {
+            m_wake.wait_for(lock, std::chrono::milliseconds(m_options.flushIntervalMs), ready);
+        }
+        else {
+            m_wake.wait(lock, ready);
+        }
+        bool stopping = m_stop;
+
+        std::string path;
+        bool append = false;
+        int count = 0;
+        if (!m_triggers.empty()) {
+            path = m_triggers.front();
+            m_triggers.pop_front();
+            count = copyWindow(0);
+        }
+        else if (m_options.continuous) {
+            path = m_recordingPath;
+            append = true;
+            count = copyWindow(m_flushedSequence);
+            m_flushedSequence = m_sequence;
+        }
+
+        if (count > 0) {
+            size_t bytes = 0;
+            for (int i = 0; i < count; ++i) {
+                bytes += m_flushEntries[i].size;
+            }
+
+            lock.unlock();
+            bool ok = writeFlush(path, count, append, ioBuffer);
+            if (!ok) {
+                std::cerr << "Grid recorder: failed to write " << path << std::endl;
+            }
+            lock.lock();
+
+            if (ok) {
+                ++m_stats.flushes;
+                m_stats.flushedFrames += count;
+                m_stats.flushedBytes += bytes;
+            }
+            else {
+                ++m_stats.failed;
+            }
+        }
+
+        bool drained = m_triggers.empty() && (!m_options.continuous || m_flushedSequence == m_sequence);
+        if (stopping && drained) {
+            break;
+        }
+    }
+}
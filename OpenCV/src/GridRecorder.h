@@ -0,0 +1,109 @@
+﻿#pragma once
+
+#include "BitGrid.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Кольцевой регистратор сжатых BitGrid за последние N секунд (предзапись).
+// Сжатые кадры копируются в одну арену, выделенную в конструкторе: при
+// записи кадра память не выделяется, самые старые кадры вытесняются новыми
+// по объёму арены, числу записей и окну времени. По trigger() всё окно
+// сбрасывается в файл фоновым потоком; в непрерывном режиме новые кадры
+// дописываются в файл записи раз в flushIntervalMs. Кадр копируется в буфер
+// сброса под блокировкой, запись на диск идёт без неё.
+// Формат файла: "BGRS", uint32 версия, затем записи
+// [uint64 кадр][uint64 время захвата, нс][uint32 размер][данные BitGrid::compress()]
+class GridRecorder {
+public:
+    static const uint32_t kFileVersion = 1;
+
+    struct Options {
+        double seconds = 30.0;              // Окно предзаписи
+        size_t arenaBytes = 32u << 20;      // Арена сжатых кадров
+        int maxFrames = 4096;               // Записей в кольце
+        bool continuous = false;            // Непрерывная запись в файл
+        int flushIntervalMs = 1000;
+        std::string directory;              // Каталог файлов (пусто - текущий)
+    };
+
+    struct Stats {
+        int frames = 0;             // Кадров в окне
+        double seconds = 0.0;       // Длительность окна по времени захвата
+        size_t usedBytes = 0;       // Сжатых данных в арене
+        size_t memoryBytes = 0;     // Вся память регистратора (арены, кольца записей, буфер вывода)
+        uint64_t recorded = 0;
+        uint64_t evicted = 0;
+        uint64_t oversized = 0;     // Кадры больше арены (не записаны)
+        uint64_t flushes = 0;
+        uint64_t flushedFrames = 0;
+        uint64_t flushedBytes = 0;
+        uint64_t failed = 0;        // Ошибки записи файлов
+    };
+
+    explicit GridRecorder(const Options& options);
+    ~GridRecorder();
+
+    GridRecorder(const GridRecorder&) = delete;
+    GridRecorder& operator=(const GridRecorder&) = delete;
+
+    void start();
+    // Дописывает запрошенные сбросы и останавливает поток
+    void stop();
+
+    // Сжать сетку методом method (в буфер потока) и добавить в окно
+    void record(const BitGrid& grid, CompressionMethod method, uint64_t frameId, uint64_t timestampNs);
+    // Добавить уже сжатые данные BitGrid::compress()
+    void record(const uint8_t* data, size_t size, uint64_t frameId, uint64_t timestampNs);
+
+    // Сбросить текущее окно в файл. Возвращает имя файла (пусто, если окно пустое)
+    std::string trigger();
+
+    Stats stats() const;
+    const Options& options() const { return m_options; }
+
+private:
+    struct Entry {
+        size_t offset;
+        uint32_t size;
+        uint64_t frameId;
+        uint64_t timestampNs;
+        uint64_t sequence;      // Порядковый номер записи (для непрерывного режима)
+    };
+
+    Options m_options;
+
+    // Окно: арена байтов и кольцо записей в порядке добавления
+    mutable std::mutex m_mutex;
+    std::unique_ptr<uint8_t[]> m_arena;
+    std::unique_ptr<Entry[]> m_entries;
+    int m_first = 0;
+    int m_count = 0;
+    size_t m_head = 0;
+    size_t m_used = 0;
+    uint64_t m_sequence = 0;
+    Stats m_stats;
+
+    // Поток сброса и его буферы того же размера, что и окно
+    std::thread m_thread;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+    std::deque<std::string> m_triggers;
+    std::unique_ptr<uint8_t[]> m_flushArena;
+    std::unique_ptr<Entry[]> m_flushEntries;
+    uint64_t m_flushedSequence = 0;
+    std::string m_recordingPath;
+    unsigned m_fileSequence = 0;
+
+    const Entry& oldest() const { return m_entries[m_first]; }
+    void evictOldest();
+    void reserve(size_t size);
+    int copyWindow(uint64_t fromSequence);
+    bool writeFlush(const std::string& path, int count, bool append, std::vector<char>& ioBuffer);
+    void flushLoop();
+};
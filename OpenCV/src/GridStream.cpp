@@ -0,0 +1,640 @@
+﻿#include "GridStream.h"
+#include "FrameTracer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace {
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+const SocketHandle kNoSocket = INVALID_SOCKET;
+
+// Winsock инициализируется один раз на процесс
+struct WinsockInit {
+    WinsockInit() {
+        WSADATA data;
+        WSAStartup(MAKEWORD(2, 2), &data);
+    }
+    ~WinsockInit() { WSACleanup(); }
+};
+
+void initSockets() {
+    static WinsockInit init;
+}
+
+void closeHandle(SocketHandle socket) {
+    closesocket(socket);
+}
+#else
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+using SocketHandle = int;
+const SocketHandle kNoSocket = -1;
+
+void initSockets() {
+}
+
+void closeHandle(SocketHandle socket) {
+    ::close(socket);
+}
+#endif
+
+const uint32_t kTcpMagic = 0x31534742;     // "BGS1"
+const uint32_t kUdpMagic = 0x31554742;     // "BGU1"
+const size_t kTcpHeaderSize = 24;
+const size_t kUdpHeaderSize = 36;
+const uint32_t kMaxFrameBytes = 64u << 20;
+const int kSocketBufferBytes = 4 << 20;
+// Начатый кадр TCP дочитывается не меньше этого времени, даже при коротком
+// опросе: большой кадр не рвёт соединение, зависший отправитель - рвёт
+const int kFrameStallMs = 1000;
+
+SocketHandle handle(std::intptr_t socket) {
+    return static_cast<SocketHandle>(socket);
+}
+
+void put16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+void put32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+}
+
+void put64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+        p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+}
+
+uint16_t get16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t get32(const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; --i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+uint64_t get64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+struct Chunk {
+    const uint8_t* data;
+    size_t size;
+};
+
+// Сборная отправка буферов одним системным вызовом. Для TCP (address == nullptr)
+// частичная запись досылается, датаграмма UDP уходит целиком или не уходит
+bool sendChunks(SocketHandle socket, Chunk* chunks, int count, const std::vector<uint8_t>* address) {
+    int first = 0;
+    while (first < count) {
+#ifdef _WIN32
+        WSABUF buffers[4];
+        for (int i = first; i < count; ++i) {
+            buffers[i - first].buf = reinterpret_cast<char*>(const_cast<uint8_t*>(chunks[i].data));
+            buffers[i - first].len = static_cast<ULONG>(chunks[i].size);
+        }
+        DWORD sent = 0;
+        int rc = address ?
+            WSASendTo(socket, buffers, count - first, &sent, 0,
+                reinterpret_cast<const sockaddr*>(address->data()), static_cast<int>(address->size()), nullptr, nullptr) :
+            WSASend(socket, buffers, count - first, &sent, 0, nullptr, nullptr);
+        if (rc != 0) {
+            return false;
+        }
+        size_t written = sent;
+#else
+        iovec vectors[4];
+        for (int i = first; i < count; ++i) {
+            vectors[i - first].iov_base = const_cast<uint8_t*>(chunks[i].data);
+            vectors[i - first].iov_len = chunks[i].size;
+        }
+        msghdr message = {};
+        message.msg_iov = vectors;
+        message.msg_iovlen = count - first;
+        if (address) {
+            message.msg_name = const_cast<uint8_t*>(address->data());
+            message.msg_namelen = static_cast<socklen_t>(address->size());
+        }
+        ssize_t sent = ::sendmsg(socket, &message, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        size_t written = static_cast<size_t>(sent);
+#endif
+        if (address) {
+            return true;
+        }
+        // Продвижение по буферам после частичной записи
+        while (first < count && written >= chunks[first].size) {
+            written -= chunks[first].size;
+            ++first;
+        }
+        if (first < count) {
+            chunks[first].data += written;
+            chunks[first].size -= written;
+        }
+    }
+    return true;
+}
+
+bool waitReadable(SocketHandle socket, int timeoutMs) {
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(socket, &set);
+    timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+    return ::select(static_cast<int>(socket) + 1, &set, nullptr, nullptr, &timeout) > 0;
+}
+
+// false - разрыв, ошибка или deadline истёк раньше, чем пришли все данные
+bool receiveAll(SocketHandle socket, uint8_t* data, size_t size, std::chrono::steady_clock::time_point deadline) {
+    while (size > 0) {
+        int remaining = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count());
+        if (remaining < 0 || !waitReadable(socket, remaining)) {
+            return false;
+        }
+        int chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+        auto received = ::recv(socket, reinterpret_cast<char*>(data), chunk, 0);
+        if (received <= 0) {
+#ifndef _WIN32
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+#endif
+            return false;
+        }
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+// Адрес IPv4 для host:port (имя разрешается через getaddrinfo)
+bool resolve(const StreamEndpoint& endpoint, bool passive, std::vector<uint8_t>& address) {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = endpoint.udp ? SOCK_DGRAM : SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+    addrinfo* result = nullptr;
+    std::string port = std::to_string(endpoint.port);
+    const char* host = endpoint.host.empty() || endpoint.host == "*" ? nullptr : endpoint.host.c_str();
+    if (::getaddrinfo(host, port.c_str(), &hints, &result) != 0 || !result) {
+        return false;
+    }
+    const uint8_t* begin = reinterpret_cast<const uint8_t*>(result->ai_addr);
+    address.assign(begin, begin + result->ai_addrlen);
+    ::freeaddrinfo(result);
+    return true;
+}
+
+void setOption(SocketHandle socket, int level, int option, int value) {
+    ::setsockopt(socket, level, option, reinterpret_cast<const char*>(&value), sizeof(value));
+}
+}
+
+bool StreamEndpoint::parse(const std::string& url, StreamEndpoint& endpoint) {
+    std::string rest;
+    if (url.compare(0, 6, "tcp://") == 0) {
+        endpoint.udp = false;
+        rest = url.substr(6);
+    }
+    else if (url.compare(0, 6, "udp://") == 0) {
+        endpoint.udp = true;
+        rest = url.substr(6);
+    }
+    else {
+        return false;
+    }
+
+    size_t colon = rest.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    endpoint.host = rest.substr(0, colon);
+    endpoint.port = std::atoi(rest.c_str() + colon + 1);
+    return endpoint.port > 0 && endpoint.port < 65536;
+}
+
+std::string StreamEndpoint::describe() const {
+    return std::string(udp ? "udp://" : "tcp://") + (host.empty() ? "*" : host) + ":" + std::to_string(port);
+}
+
+
+
+GridStreamSender::GridStreamSender(const Options& options) : m_options(options) {
+    m_options.mtu = std::max(static_cast<int>(kUdpHeaderSize) + 64, std::min(m_options.mtu, 65507));
+    initSockets();
+}
+
+GridStreamSender::~GridStreamSender() {
+    stop();
+}
+
+uint64_t GridStreamSender::wallClockNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool GridStreamSender::start() {
+    if (m_thread.joinable()) {
+        return true;
+    }
+    if (!resolve(m_options.endpoint, false, m_address)) {
+        std::cerr << "Stream: cannot resolve " << m_options.endpoint.describe() << std::endl;
+        return false;
+    }
+    if (m_options.endpoint.udp && !connect()) {
+        return false;
+    }
+    m_stop = false;
+    m_thread = std::thread(&GridStreamSender::sendLoop, this);
+    return true;
+}
+
+void GridStreamSender::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    closeSocket();
+}
+
+void GridStreamSender::submit(std::vector<uint8_t>& data, uint64_t frameId, uint64_t captureWallNs) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending) {
+            ++m_stats.dropped;
+        }
+        m_slot.swap(data);
+        m_slotFrame = frameId;
+        m_slotTimestamp = captureWallNs;
+        m_pending = true;
+    }
+    m_wake.notify_one();
+}
+
+GridStreamSender::Stats GridStreamSender::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats = m_stats;
+    stats.connected = m_socket != -1;
+    return stats;
+}
+
+bool GridStreamSender::connect() {
+    SocketHandle socket = ::socket(AF_INET, m_options.endpoint.udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+    if (socket == kNoSocket) {
+        return false;
+    }
+    setOption(socket, SOL_SOCKET, SO_SNDBUF, kSocketBufferBytes);
+
+    if (!m_options.endpoint.udp) {
+        if (::connect(socket, reinterpret_cast<const sockaddr*>(m_address.data()),
+            static_cast<int>(m_address.size())) != 0) {
+            closeHandle(socket);
+            return false;
+        }
+        // Кадр уходит сразу, без ожидания алгоритма Нейгла
+        setOption(socket, IPPROTO_TCP, TCP_NODELAY, 1);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_socket = static_cast<std::intptr_t>(socket);
+    return true;
+}
+
+void GridStreamSender::closeSocket() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_socket != -1) {
+        closeHandle(handle(m_socket));
+        m_socket = -1;
+    }
+}
+
+bool GridStreamSender::sendFrame(const std::vector<uint8_t>& data, uint64_t frameId, uint64_t timestamp,
+    uint64_t& datagrams) {
+    SocketHandle socket = handle(m_socket);
+
+    if (!m_options.endpoint.udp) {
+        uint8_t header[kTcpHeaderSize];
+        put32(header, kTcpMagic);
+        put32(header + 4, static_cast<uint32_t>(data.size()));
+        put64(header + 8, frameId);
+        put64(header + 16, timestamp);
+        Chunk chunks[2] = { { header, sizeof(header) }, { data.data(), data.size() } };
+        return sendChunks(socket, chunks, 2, nullptr);
+    }
+
+    size_t payload = m_options.mtu - kUdpHeaderSize;
+    size_t fragments = std::max<size_t>(1, (data.size() + payload - 1) / payload);
+    if (fragments > 0xFFFF) {
+        return false;
+    }
+
+    uint32_t sequence = m_sequence++;
+    uint8_t header[kUdpHeaderSize];
+    put32(header, kUdpMagic);
+    put32(header + 4, sequence);
+    put16(header + 10, static_cast<uint16_t>(fragments));
+    put32(header + 12, static_cast<uint32_t>(data.size()));
+    put64(header + 20, frameId);
+    put64(header + 28, timestamp);
+
+    for (size_t i = 0; i < fragments; ++i) {
+        size_t offset = i * payload;
+        size_t size = std::min(payload, data.size() - offset);
+        put16(header + 8, static_cast<uint16_t>(i));
+        put32(header + 16, static_cast<uint32_t>(offset));
+        Chunk chunks[2] = { { header, sizeof(header) }, { data.data() + offset, size } };
+        if (!sendChunks(socket, chunks, 2, &m_address)) {
+            return false;
+        }
+        ++datagrams;
+    }
+    return true;
+}
+
+void GridStreamSender::sendLoop() {
+    FrameTracer::setThreadName("stream");
+    std::vector<uint8_t> sending;
+
+    while (true) {
+        uint64_t frameId, timestamp;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stop || m_pending; });
+            if (m_stop) {
+                break;
+            }
+            // Буферы меняются местами: освободившийся вернётся обработчику
+            sending.swap(m_slot);
+            frameId = m_slotFrame;
+            timestamp = m_slotTimestamp;
+            m_pending = false;
+        }
+
+        // TCP: переподключение не чаще раза в reconnectMs
+        if (m_socket == -1) {
+            uint64_t now = FrameTracer::nowNs();
+            bool connected = false;
+            if (now - m_lastAttemptNs >= static_cast<uint64_t>(m_options.reconnectMs) * 1000000) {
+                m_lastAttemptNs = now;
+                connected = connect();
+            }
+            if (!connected) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_stats.failed;
+                continue;
+            }
+        }
+
+        uint64_t datagrams = 0;
+        bool ok;
+        {
+            TraceScope trace("send");
+            ok = sendFrame(sending, frameId, timestamp, datagrams);
+        }
+        if (!ok && !m_options.endpoint.udp) {
+            closeSocket();
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (ok) {
+            ++m_stats.sent;
+            m_stats.datagrams += datagrams;
+            m_stats.bytes += sending.size() +
+                (m_options.endpoint.udp ? datagrams * kUdpHeaderSize : kTcpHeaderSize);
+        }
+        else {
+            ++m_stats.failed;
+        }
+    }
+}
+
+
+
+GridStreamReceiver::GridStreamReceiver(const StreamEndpoint& endpoint) : m_endpoint(endpoint) {
+    initSockets();
+}
+
+GridStreamReceiver::~GridStreamReceiver() {
+    close();
+}
+
+bool GridStreamReceiver::open() {
+    std::vector<uint8_t> address;
+    if (!resolve(m_endpoint, true, address)) {
+        return false;
+    }
+    SocketHandle socket = ::socket(AF_INET, m_endpoint.udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+    if (socket == kNoSocket) {
+        return false;
+    }
+    setOption(socket, SOL_SOCKET, SO_REUSEADDR, 1);
+    setOption(socket, SOL_SOCKET, SO_RCVBUF, kSocketBufferBytes);
+
+    if (::bind(socket, reinterpret_cast<const sockaddr*>(address.data()), static_cast<int>(address.size())) != 0 ||
+        (!m_endpoint.udp && ::listen(socket, 1) != 0)) {
+        closeHandle(socket);
+        return false;
+    }
+    m_socket = static_cast<std::intptr_t>(socket);
+    m_datagram.resize(65536);
+    return true;
+}
+
+void GridStreamReceiver::close() {
+    if (m_client != -1) {
+        closeHandle(handle(m_client));
+        m_client = -1;
+    }
+    if (m_socket != -1) {
+        closeHandle(handle(m_socket));
+        m_socket = -1;
+    }
+}
+
+bool GridStreamReceiver::receive(Frame& frame, int timeoutMs) {
+    if (m_socket == -1) {
+        return false;
+    }
+    return m_endpoint.udp ? receiveUdp(frame, timeoutMs) : receiveTcp(frame, timeoutMs);
+}
+
+bool GridStreamReceiver::receiveTcp(Frame& frame, int timeoutMs) {
+    if (m_client == -1) {
+        if (!waitReadable(handle(m_socket), timeoutMs)) {
+            return false;
+        }
+        SocketHandle client = ::accept(handle(m_socket), nullptr, nullptr);
+        if (client == kNoSocket) {
+            return false;
+        }
+        setOption(client, SOL_SOCKET, SO_RCVBUF, kSocketBufferBytes);
+        m_client = static_cast<std::intptr_t>(client);
+        ++m_stats.connections;
+    }
+
+    SocketHandle client = handle(m_client);
+    auto callDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    if (!waitReadable(client, timeoutMs)) {
+        return false;
+    }
+
+    // Заголовок, затем данные в буфер кадра (ёмкость переиспользуется).
+    // Кадр начался - он должен прийти целиком до срока
+    auto deadline = std::max(callDeadline, std::chrono::steady_clock::now() + std::chrono::milliseconds(kFrameStallMs));
+    uint8_t header[kTcpHeaderSize];
+    bool ok = receiveAll(client, header, sizeof(header), deadline) && get32(header) == kTcpMagic &&
+        get32(header + 4) <= kMaxFrameBytes;
+    if (ok) {
+        frame.data.resize(get32(header + 4));
+        ok = receiveAll(client, frame.data.data(), frame.data.size(), deadline);
+    }
+    if (!ok) {
+        // Разрыв, рассинхронизация или отправитель застрял посреди кадра:
+        // соединение закрывается, ждём нового отправителя
+        ++m_stats.errors;
+        closeHandle(client);
+        m_client = -1;
+        return false;
+    }
+
+    frame.frameId = get64(header + 8);
+    frame.timestampNs = get64(header + 16);
+    frame.receivedNs = GridStreamSender::wallClockNs();
+    ++m_stats.frames;
+    m_stats.bytes += sizeof(header) + frame.data.size();
+    return true;
+}
+
+bool GridStreamReceiver::receiveUdp(Frame& frame, int timeoutMs) {
+    SocketHandle socket = handle(m_socket);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    while (true) {
+        int remaining = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count());
+        if (remaining < 0 || !waitReadable(socket, remaining)) {
+            return false;
+        }
+        auto received = ::recv(socket, reinterpret_cast<char*>(m_datagram.data()), static_cast<int>(m_datagram.size()), 0);
+        if (received < static_cast<int>(kUdpHeaderSize) || get32(m_datagram.data()) != kUdpMagic) {
+            ++m_stats.errors;
+            continue;
+        }
+        m_stats.bytes += received;
+
+        const uint8_t* header = m_datagram.data();
+        uint32_t sequence = get32(header + 4);
+        int fragment = get16(header + 8);
+        int fragments = get16(header + 10);
+        uint32_t total = get32(header + 12);
+        uint32_t offset = get32(header + 16);
+        size_t size = received - kUdpHeaderSize;
+        if (fragments == 0 || fragment >= fragments || total > kMaxFrameBytes || offset + size > total) {
+            ++m_stats.errors;
+            continue;
+        }
+
+        if (!m_assembling || sequence != m_sequence) {
+            // Фрагменты старых кадров отбрасываются
+            if (m_haveSequence && static_cast<int32_t>(sequence - m_sequence) <= 0) {
+                continue;
+            }
+            // Незавершённый кадр и пропуски номеров - потери
+            if (m_assembling) {
+                ++m_stats.lost;
+            }
+            if (m_haveSequence) {
+                m_stats.lost += sequence - m_sequence - 1;
+            }
+            m_haveSequence = true;
+            m_assembling = true;
+            m_sequence = sequence;
+            m_assembly.resize(total);
+            m_fragmentSeen.assign(fragments, 0);
+            m_fragmentsLeft = fragments;
+            m_fragmentPayload = 0;
+            m_assemblyFrame = get64(header + 20);
+            m_assemblyTimestamp = get64(header + 28);
+        }
+
+        // Фрагмент должен подходить к собираемому кадру: то же число фрагментов
+        // и размер, смещение - номер на шаг фрагмента (все, кроме последнего,
+        // полные). Иначе это повреждённая или чужая датаграмма с тем же номером
+        const bool last = fragment == fragments - 1;
+        size_t payload = m_fragmentPayload;
+        if (payload == 0) {
+            payload = last && fragment > 0 ? offset / fragment : size;
+        }
+        if (static_cast<size_t>(fragments) != m_fragmentSeen.size() || static_cast<size_t>(fragment) >= m_fragmentSeen.size() ||
+            m_assembly.size() != total || offset != fragment * payload ||
+            (last ? offset + size != total : size == 0 || size != payload)) {
+            ++m_stats.errors;
+            continue;
+        }
+        if (!last || fragment > 0) {
+            m_fragmentPayload = payload;
+        }
+        if (m_fragmentSeen[fragment]) {
+            continue;
+        }
+        m_fragmentSeen[fragment] = 1;
+        if (size > 0) {
+            std::memcpy(m_assembly.data() + offset, header + kUdpHeaderSize, size);
+        }
+        if (--m_fragmentsLeft > 0) {
+            continue;
+        }
+
+        // Кадр собран: буферы меняются местами, сборка переиспользует старый буфер кадра
+        m_assembling = false;
+        frame.data.swap(m_assembly);
+        frame.frameId = m_assemblyFrame;
+        frame.timestampNs = m_assemblyTimestamp;
+        frame.receivedNs = GridStreamSender::wallClockNs();
+        ++m_stats.frames;
+        return true;
+    }
+}
@@ -0,0 +1,145 @@
+﻿#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Передача сжатых BitGrid (вывод BitGrid::compress) по сети.
+// TCP: кадр = заголовок 24 байта ["BGS1", uint32 размер, uint64 кадр,
+// uint64 время захвата] + данные. UDP: кадр режется на датаграммы не больше
+// mtu, у каждой заголовок 36 байт ["BGU1", uint32 номер кадра в потоке,
+// uint16 фрагмент, uint16 число фрагментов, uint32 размер кадра, uint32
+// смещение, uint64 кадр, uint64 время захвата]. Числа - little-endian,
+// время - наносекунды системных часов (задержку можно мерить между машинами
+// с синхронизированными часами, на loopback - точно).
+// Заголовок и данные уходят одним вызовом sendmsg/WSASend из двух буферов,
+// данные не копируются.
+
+// Адрес вида tcp://host:port или udp://host:port
+struct StreamEndpoint {
+    bool udp = false;
+    std::string host;
+    int port = 0;
+
+    static bool parse(const std::string& url, StreamEndpoint& endpoint);
+    std::string describe() const;
+};
+
+// Отправитель: кадры передаются потоку отправки обменом буферов, поток
+// отправки не задерживает обработчики. Если сеть не успевает, неотправленный
+// кадр заменяется новым (учитывается в dropped). TCP переподключается сам
+class GridStreamSender {
+public:
+    struct Options {
+        StreamEndpoint endpoint;
+        int mtu = 1472;             // Размер датаграммы UDP (заголовок + данные)
+        int reconnectMs = 1000;     // Пауза между попытками подключения TCP
+    };
+
+    struct Stats {
+        uint64_t sent = 0;
+        uint64_t dropped = 0;       // Заменены более новым кадром до отправки
+        uint64_t failed = 0;        // Ошибки отправки и кадры без подключения
+        uint64_t bytes = 0;         // Вместе с заголовками
+        uint64_t datagrams = 0;
+        bool connected = false;
+    };
+
+    explicit GridStreamSender(const Options& options);
+    ~GridStreamSender();
+
+    GridStreamSender(const GridStreamSender&) = delete;
+    GridStreamSender& operator=(const GridStreamSender&) = delete;
+
+    bool start();
+    void stop();
+
+    // Забирает data обменом (без копирования); взамен data получает
+    // освободившийся буфер, который вызывающий переиспользует
+    void submit(std::vector<uint8_t>& data, uint64_t frameId, uint64_t captureWallNs);
+
+    Stats stats() const;
+
+    // Системное время, нс (метки кадров и задержка на приёмнике)
+    static uint64_t wallClockNs();
+
+private:
+    Options m_options;
+    std::intptr_t m_socket = -1;
+    std::vector<uint8_t> m_address;
+    uint32_t m_sequence = 0;
+    uint64_t m_lastAttemptNs = 0;
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+    bool m_pending = false;
+    std::vector<uint8_t> m_slot;
+    uint64_t m_slotFrame = 0;
+    uint64_t m_slotTimestamp = 0;
+    Stats m_stats;
+
+    bool connect();
+    void closeSocket();
+    bool sendFrame(const std::vector<uint8_t>& data, uint64_t frameId, uint64_t timestamp, uint64_t& datagrams);
+    void sendLoop();
+};
+
+// Приёмник: TCP - слушает порт и принимает одного отправителя за раз,
+// UDP - собирает кадр из фрагментов, неполные и пропущенные кадры учитывает в lost
+class GridStreamReceiver {
+public:
+    struct Frame {
+        uint64_t frameId = 0;
+        uint64_t timestampNs = 0;   // Время захвата у отправителя
+        uint64_t receivedNs = 0;    // Время приёма последнего байта
+        std::vector<uint8_t> data;
+    };
+
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t bytes = 0;         // Вместе с заголовками
+        uint64_t lost = 0;          // Пропущенные и неполные кадры (UDP)
+        uint64_t errors = 0;        // Повреждённые заголовки и разрывы соединения
+        uint64_t connections = 0;
+    };
+
+    explicit GridStreamReceiver(const StreamEndpoint& endpoint);
+    ~GridStreamReceiver();
+
+    GridStreamReceiver(const GridStreamReceiver&) = delete;
+    GridStreamReceiver& operator=(const GridStreamReceiver&) = delete;
+
+    bool open();
+    void close();
+
+    // Следующий полный кадр; false, если за timeoutMs кадра не было
+    bool receive(Frame& frame, int timeoutMs);
+
+    Stats stats() const { return m_stats; }
+
+private:
+    StreamEndpoint m_endpoint;
+    std::intptr_t m_socket = -1;        // Слушающий TCP или UDP
+    std::intptr_t m_client = -1;        // Принятое соединение TCP
+    Stats m_stats;
+
+    // Сборка кадра UDP
+    std::vector<uint8_t> m_datagram;
+    std::vector<uint8_t> m_assembly;
+    std::vector<uint8_t> m_fragmentSeen;
+    bool m_assembling = false;
+    bool m_haveSequence = false;
+    uint32_t m_sequence = 0;
+    int m_fragmentsLeft = 0;
+    size_t m_fragmentPayload = 0;       // Шаг фрагментов кадра, 0 - ещё не известен
+    uint64_t m_assemblyFrame = 0;
+    uint64_t m_assemblyTimestamp = 0;
+
+    bool receiveTcp(Frame& frame, int timeoutMs);
+    bool receiveUdp(Frame& frame, int timeoutMs);
+};
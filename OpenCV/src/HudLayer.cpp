@@ -0,0 +1,157 @@
+﻿#include "HudLayer.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+const int kFont = cv::FONT_HERSHEY_SIMPLEX;
+
+// Прямоугольник, занимаемый строкой cv::putText, с запасом на толщину линий
+cv::Rect textRect(const std::string& text, cv::Point origin, double scale, int thickness) {
+    int baseline = 0;
+    cv::Size size = cv::getTextSize(text, kFont, scale, thickness, &baseline);
+    return cv::Rect(origin.x - thickness, origin.y - size.height - thickness,
+        size.width + 2 * thickness, size.height + baseline + 2 * thickness);
+}
+
+// Наложение слоя BGRA на кадр BGR по альфа-каналу
+void blend(const cv::Mat& overlay, cv::Mat& frame) {
+    for (int y = 0; y < frame.rows; ++y) {
+        const uchar* src = overlay.ptr<uchar>(y);
+        uchar* dst = frame.ptr<uchar>(y);
+        for (int x = 0; x < frame.cols; ++x, src += 4, dst += 3) {
+            int alpha = src[3];
+            if (alpha == 255) {
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst[2] = src[2];
+            }
+            else if (alpha != 0) {
+                for (int c = 0; c < 3; ++c) {
+                    dst[c] = static_cast<uchar>((src[c] * alpha + dst[c] * (255 - alpha) + 127) / 255);
+                }
+            }
+        }
+    }
+}
+}
+
+void HudLayer::setEnabled(bool enabled) {
+    m_enabled = enabled;
+    if (!enabled) {
+        m_fields.clear();
+        m_overlay.release();
+    }
+}
+
+void HudLayer::begin(cv::Size frameSize) {
+    if (!m_enabled) {
+        return;
+    }
+    if (m_overlay.size() != frameSize) {
+        m_overlay.create(frameSize, CV_8UC4);
+        m_overlay.setTo(cv::Scalar::all(0));
+        m_fields.clear();
+    }
+    for (Field& field : m_fields) {
+        field.used = false;
+    }
+}
+
+void HudLayer::text(const std::string& text, cv::Point origin, double scale,
+    const cv::Scalar& color, int thickness) {
+    if (m_enabled) {
+        update(text.c_str(), origin, scale, color, thickness);
+    }
+}
+
+void HudLayer::format(cv::Point origin, double scale, const cv::Scalar& color, int thickness,
+    const char* pattern, ...) {
+    if (!m_enabled) {
+        return;
+    }
+    char buffer[128];
+    va_list args;
+    va_start(args, pattern);
+    std::vsnprintf(buffer, sizeof(buffer), pattern, args);
+    va_end(args);
+    update(buffer, origin, scale, color, thickness);
+}
+
+void HudLayer::update(const char* text, cv::Point origin, double scale, const cv::Scalar& color, int thickness) {
+    for (Field& field : m_fields) {
+        if (field.origin != origin) {
+            continue;
+        }
+        field.used = true;
+        if (field.text == text && field.scale == scale && field.color == color && field.thickness == thickness) {
+            return;
+        }
+        field.text = text;
+        field.scale = scale;
+        field.color = color;
+        field.thickness = thickness;
+        render(field);
+        return;
+    }
+
+    Field field;
+    field.text = text;
+    field.origin = origin;
+    field.scale = scale;
+    field.color = color;
+    field.thickness = thickness;
+    field.used = true;
+    m_fields.push_back(field);
+    render(m_fields.back());
+}
+
+void HudLayer::render(Field& field) {
+    cv::Rect bounds(cv::Point(0, 0), m_overlay.size());
+    cv::Rect previous = field.rect;
+    field.rect = textRect(field.text, field.origin, field.scale, field.thickness) & bounds;
+    ++m_renders;
+
+    erase(previous);
+    erase(field.rect);
+    cv::putText(m_overlay, field.text, field.origin, kFont, field.scale,
+        cv::Scalar(field.color[0], field.color[1], field.color[2], 255), field.thickness);
+}
+
+void HudLayer::erase(const cv::Rect& rect) {
+    if (rect.area() <= 0) {
+        return;
+    }
+    m_overlay(rect).setTo(cv::Scalar::all(0));
+
+    // Соседние поля, задетые стиранием, рисуются заново
+    for (const Field& other : m_fields) {
+        if (other.rect.area() > 0 && (other.rect & rect).area() > 0 && !(other.rect == rect)) {
+            cv::putText(m_overlay, other.text, other.origin, kFont, other.scale,
+                cv::Scalar(other.color[0], other.color[1], other.color[2], 255), other.thickness);
+        }
+    }
+}
+
+void HudLayer::compose(cv::Mat& frame) {
+    if (!m_enabled || m_overlay.empty()) {
+        return;
+    }
+    CV_Assert(frame.type() == CV_8UC3 && frame.size() == m_overlay.size());
+
+    // Поля, которые в этом кадре не выводились, исчезают
+    for (size_t i = m_fields.size(); i-- > 0;) {
+        if (!m_fields[i].used) {
+            cv::Rect rect = m_fields[i].rect;
+            m_fields.erase(m_fields.begin() + i);
+            erase(rect);
+        }
+    }
+
+    for (const Field& field : m_fields) {
+        if (field.rect.area() > 0) {
+            cv::Mat target = frame(field.rect);
+            blend(m_overlay(field.rect), target);
+        }
+    }
+}
@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Кэшированный слой HUD поверх кадра.
+// Текст рисуется не в кадр, а в прозрачный слой BGRA и перерисовывается только
+// при изменении строки, цвета или размера. Поле HUD определяется точкой
+// вывода: text() с той же точкой в следующем кадре обновляет то же поле.
+// Поля, не выведенные за кадр, стираются в compose(). На кадр накладываются
+// только прямоугольники полей, а не весь слой.
+// Цикл кадра: begin() -> text()/format() ... -> compose(frame).
+// Выключенный слой ничего не рисует и не форматирует (режим без HUD)
+class HudLayer {
+public:
+    void setEnabled(bool enabled);
+    bool enabled() const { return m_enabled; }
+
+    // Начало кадра; при смене размера слой создаётся заново
+    void begin(cv::Size frameSize);
+
+    // Строка шрифтом FONT_HERSHEY_SIMPLEX, как cv::putText
+    void text(const std::string& text, cv::Point origin, double scale,
+        const cv::Scalar& color, int thickness = 1);
+    // То же с форматированием printf в буфер на стеке (без выделения памяти,
+    // если строка не изменилась)
+    void format(cv::Point origin, double scale, const cv::Scalar& color, int thickness,
+        const char* pattern, ...);
+
+    // Стирает неиспользованные поля и смешивает прямоугольники полей с кадром BGR
+    void compose(cv::Mat& frame);
+
+    // Сколько раз поля перерисовывались в слое (для оценки кэша)
+    uint64_t renders() const { return m_renders; }
+
+private:
+    struct Field {
+        std::string text;
+        cv::Point origin;
+        double scale = 0.0;
+        cv::Scalar color;
+        int thickness = 1;
+        cv::Rect rect;
+        bool used = false;
+    };
+
+    bool m_enabled = true;
+    cv::Mat m_overlay;
+    std::vector<Field> m_fields;
+    uint64_t m_renders = 0;
+
+    void update(const char* text, cv::Point origin, double scale, const cv::Scalar& color, int thickness);
+    void render(Field& field);
+    void erase(const cv::Rect& rect);
+};
@@ -0,0 +1,360 @@
+﻿#include "Letterbox.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LBX_X86 1
+#include <immintrin.h>
+#endif
+
+// Как в FastFrontEnd: GCC/Clang разрешают AVX2 только для отдельных функций
+#if defined(LBX_X86) && (defined(__GNUC__) || defined(__clang__))
+#define LBX_TARGET(isa) __attribute__((target(isa)))
+#else
+#define LBX_TARGET(isa)
+#endif
+
+namespace {
+
+// Горизонтальные веса - 7 бит: пиксель * 128 помещается в uint16
+const int kWeightBits = 7;
+const int kWeightOne = 1 << kWeightBits;
+
+// Шаг SIMD по NHWC: 24 значения = 8 пикселей по 3 канала
+const int kPattern = 24;
+
+// Строк входа в полосе потока
+const int kBandRows = 32;
+
+size_t elementSize(TensorType type) {
+    return type == TENSOR_FLOAT32 ? sizeof(float) : sizeof(uint8_t);
+}
+
+// Вертикальная интерполяция двух горизонтально интерполированных строк,
+// нормализация и запись count значений тензора
+using VerticalFn = void (*)(const uint16_t* h0, const uint16_t* h1, float fy,
+    const float* alpha, const float* beta, uint8_t* dst, int count);
+
+template <int Type>
+inline void storeValue(uint8_t* dst, int i, float value) {
+    if (Type == TENSOR_FLOAT32) {
+        reinterpret_cast<float*>(dst)[i] = value;
+    }
+    else if (Type == TENSOR_UINT8) {
+        dst[i] = static_cast<uint8_t>(std::min(std::max(cvRound(value), 0), 255));
+    }
+    else {
+        reinterpret_cast<int8_t*>(dst)[i] = static_cast<int8_t>(std::min(std::max(cvRound(value), -128), 127));
+    }
+}
+
+template <int Type>
+void verticalScalar(const uint16_t* h0, const uint16_t* h1, float fy,
+    const float* alpha, const float* beta, uint8_t* dst, int count) {
+    for (int i = 0, k = 0; i < count; ++i) {
+        float v = h0[i] + (static_cast<int>(h1[i]) - static_cast<int>(h0[i])) * fy;
+        storeValue<Type>(dst, i, v * alpha[k] + beta[k]);
+        if (++k == kPattern) {
+            k = 0;
+        }
+    }
+}
+
+#ifdef LBX_X86
+
+template <int Type>
+LBX_TARGET("avx2") void verticalAVX2(const uint16_t* h0, const uint16_t* h1, float fy,
+    const float* alpha, const float* beta, uint8_t* dst, int count) {
+    const __m256 weight = _mm256_set1_ps(fy);
+    int i = 0;
+    for (; i + kPattern <= count; i += kPattern) {
+        for (int j = 0; j < kPattern; j += 8) {
+            __m256 top = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(h0 + i + j))));
+            __m256 bottom = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(h1 + i + j))));
+            __m256 v = _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), weight));
+            __m256 value = _mm256_add_ps(_mm256_mul_ps(v, _mm256_loadu_ps(alpha + j)), _mm256_loadu_ps(beta + j));
+
+            if (Type == TENSOR_FLOAT32) {
+                _mm256_storeu_ps(reinterpret_cast<float*>(dst) + i + j, value);
+            }
+            else {
+                // Округление к ближайшему, насыщение при упаковке 32 -> 16 -> 8 бит
+                __m256i q = _mm256_cvtps_epi32(value);
+                __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+                __m128i bytes = Type == TENSOR_UINT8 ? _mm_packus_epi16(words, words) : _mm_packs_epi16(words, words);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i + j), bytes);
+            }
+        }
+    }
+    verticalScalar<Type>(h0 + i, h1 + i, fy, alpha, beta, dst + i * elementSize(static_cast<TensorType>(Type)),
+        count - i);
+}
+
+#endif // LBX_X86
+
+VerticalFn verticalFor(SimdLevel level, TensorType type) {
+#ifdef LBX_X86
+    if (level >= SIMD_AVX2) {
+        switch (type) {
+        case TENSOR_UINT8: return verticalAVX2<TENSOR_UINT8>;
+        case TENSOR_INT8: return verticalAVX2<TENSOR_INT8>;
+        default: return verticalAVX2<TENSOR_FLOAT32>;
+        }
+    }
+#endif
+    (void)level;
+    switch (type) {
+    case TENSOR_UINT8: return verticalScalar<TENSOR_UINT8>;
+    case TENSOR_INT8: return verticalScalar<TENSOR_INT8>;
+    default: return verticalScalar<TENSOR_FLOAT32>;
+    }
+}
+
+// Горизонтальная интерполяция строки кадра BGR сразу в порядке каналов и
+// раскладке входа: NHWC - c0 c1 c2 вперемежку, NCHW - три плоскости по width
+void horizontalRow(const uint8_t* src, const int* xOffset, const int* xNext, const uint8_t* xWeight,
+    int width, bool planar, bool swapRB, uint16_t* dst) {
+    const int first = swapRB ? 2 : 0;
+    const int last = 2 - first;
+    for (int x = 0; x < width; ++x) {
+        const uint8_t* p0 = src + xOffset[x];
+        const uint8_t* p1 = src + xNext[x];
+        int w = xWeight[x], iw = kWeightOne - w;
+        uint16_t c0 = static_cast<uint16_t>(p0[first] * iw + p1[first] * w);
+        uint16_t c1 = static_cast<uint16_t>(p0[1] * iw + p1[1] * w);
+        uint16_t c2 = static_cast<uint16_t>(p0[last] * iw + p1[last] * w);
+        if (planar) {
+            dst[x] = c0;
+            dst[width + x] = c1;
+            dst[2 * width + x] = c2;
+        }
+        else {
+            dst[3 * x] = c0;
+            dst[3 * x + 1] = c1;
+            dst[3 * x + 2] = c2;
+        }
+    }
+}
+
+// Горизонтально интерполированные исходные строки полосы: две последние
+// используемые строки, соседние строки входа обычно берут те же
+struct BandScratch {
+    std::vector<uint16_t> rows[2];
+    int source[2] = { -1, -1 };
+};
+
+}
+
+LetterboxPreprocessor::LetterboxPreprocessor(const Options& options)
+    : m_options(options), m_level(FastFrontEnd::detectSimdLevel()) {
+    CV_Assert(m_options.inputSize.width > 0 && m_options.inputSize.height > 0);
+    m_geometry.inputSize = m_options.inputSize;
+    updateTransform();
+}
+
+void LetterboxPreprocessor::setQuantization(float scale, int zeroPoint) {
+    m_options.quantScale = scale > 0.0f ? scale : 1.0f;
+    m_options.quantZeroPoint = zeroPoint;
+    updateTransform();
+}
+
+void LetterboxPreprocessor::setSimdLevel(SimdLevel level) {
+    m_level = std::min(level, FastFrontEnd::detectSimdLevel());
+}
+
+size_t LetterboxPreprocessor::tensorBytes() const {
+    return static_cast<size_t>(m_options.inputSize.area()) * 3 * elementSize(m_options.type);
+}
+
+void LetterboxPreprocessor::run(const cv::Mat& frame, cv::Mat& blob) {
+    CV_Assert(m_options.type == TENSOR_FLOAT32 && m_options.layout == TENSOR_NCHW);
+    const int sizes[] = { 1, 3, m_options.inputSize.height, m_options.inputSize.width };
+    // create() не перевыделяет память, если размер и тип совпадают
+    blob.create(4, sizes, CV_32F);
+    run(frame, blob.ptr<uchar>());
+}
+
+void LetterboxPreprocessor::run(const cv::Mat& frame, void* tensor) {
+    CV_Assert(frame.type() == CV_8UC3 && tensor);
+    if (frame.size() != m_geometry.frameSize) {
+        updateGeometry(frame.size());
+    }
+
+    uint8_t* data = static_cast<uint8_t*>(tensor);
+    const int height = m_options.inputSize.height;
+    const int bands = (height + kBandRows - 1) / kBandRows;
+    cv::parallel_for_(cv::Range(0, bands), [this, &frame, data, height](const cv::Range& range) {
+        processRows(frame, data, range.start * kBandRows, std::min(height, range.end * kBandRows));
+    });
+}
+
+
+
+void LetterboxPreprocessor::updateGeometry(cv::Size frameSize) {
+    const cv::Size input = m_options.inputSize;
+    m_geometry.frameSize = frameSize;
+    m_geometry.scale = std::min(input.width / static_cast<float>(frameSize.width),
+        input.height / static_cast<float>(frameSize.height));
+    int width = std::min(input.width, std::max(1, cvRound(frameSize.width * m_geometry.scale)));
+    int height = std::min(input.height, std::max(1, cvRound(frameSize.height * m_geometry.scale)));
+    m_geometry.area = cv::Rect((input.width - width) / 2, (input.height - height) / 2, width, height);
+
+    // Отображение пикселей как в cv::resize INTER_LINEAR: центры пикселей совмещены
+    m_xOffset.resize(width);
+    m_xNext.resize(width);
+    m_xWeight.resize(width);
+    float xRatio = frameSize.width / static_cast<float>(width);
+    for (int x = 0; x < width; ++x) {
+        float sx = (x + 0.5f) * xRatio - 0.5f;
+        int x0 = static_cast<int>(std::floor(sx));
+        float fx = sx - x0;
+        if (x0 < 0) {
+            x0 = 0;
+            fx = 0.0f;
+        }
+        if (x0 >= frameSize.width - 1) {
+            x0 = frameSize.width - 1;
+            fx = 0.0f;
+        }
+        m_xOffset[x] = x0 * 3;
+        m_xNext[x] = std::min(x0 + 1, frameSize.width - 1) * 3;
+        m_xWeight[x] = static_cast<uint8_t>(cvRound(fx * kWeightOne));
+    }
+
+    m_yRow.resize(height);
+    m_yNext.resize(height);
+    m_yWeight.resize(height);
+    float yRatio = frameSize.height / static_cast<float>(height);
+    for (int y = 0; y < height; ++y) {
+        float sy = (y + 0.5f) * yRatio - 0.5f;
+        int y0 = static_cast<int>(std::floor(sy));
+        float fy = sy - y0;
+        if (y0 < 0) {
+            y0 = 0;
+            fy = 0.0f;
+        }
+        if (y0 >= frameSize.height - 1) {
+            y0 = frameSize.height - 1;
+            fy = 0.0f;
+        }
+        m_yRow[y] = y0;
+        m_yNext[y] = std::min(y0 + 1, frameSize.height - 1);
+        m_yWeight[y] = fy;
+    }
+}
+
+void LetterboxPreprocessor::updateTransform() {
+    // value = (pixel * pixelScale - mean) / std, для квантованного входа
+    // дальше q = value / quantScale + zeroPoint; pixel приходит умноженным на 128
+    bool quantized = m_options.type != TENSOR_FLOAT32;
+    float alpha[3], beta[3];
+    for (int c = 0; c < 3; ++c) {
+        double std = m_options.std[c] != 0.0 ? m_options.std[c] : 1.0;
+        double a = m_options.pixelScale / std / kWeightOne;
+        double b = -m_options.mean[c] / std;
+        if (quantized) {
+            a /= m_options.quantScale;
+            b = b / m_options.quantScale + m_options.quantZeroPoint;
+        }
+        alpha[c] = static_cast<float>(a);
+        beta[c] = static_cast<float>(b);
+    }
+    for (int i = 0; i < kPattern; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            m_alpha[c][i] = alpha[c];
+            m_beta[c][i] = beta[c];
+        }
+        m_alpha[3][i] = alpha[i % 3];
+        m_beta[3][i] = beta[i % 3];
+    }
+
+    // Строка полей в формате тензора: NHWC - пиксели вперемежку, NCHW - три строки плоскостей
+    const int width = m_options.inputSize.width;
+    const size_t element = elementSize(m_options.type);
+    m_padRow.assign(static_cast<size_t>(width) * 3 * element, 0);
+    std::vector<uint16_t> pad(static_cast<size_t>(width) * 3,
+        static_cast<uint16_t>(m_options.padValue * kWeightOne));
+    VerticalFn vertical = verticalFor(SIMD_SCALAR, m_options.type);
+    if (m_options.layout == TENSOR_NHWC) {
+        vertical(pad.data(), pad.data(), 0.0f, m_alpha[3], m_beta[3], m_padRow.data(), width * 3);
+    }
+    else {
+        for (int c = 0; c < 3; ++c) {
+            vertical(pad.data(), pad.data(), 0.0f, m_alpha[c], m_beta[c], m_padRow.data() + c * width * element, width);
+        }
+    }
+}
+
+void LetterboxPreprocessor::processRows(const cv::Mat& frame, uint8_t* tensor, int y0, int y1) const {
+    thread_local BandScratch scratch;
+    const cv::Rect& area = m_geometry.area;
+    const int inputWidth = m_options.inputSize.width;
+    const int inputHeight = m_options.inputSize.height;
+    const size_t element = elementSize(m_options.type);
+    const bool planar = m_options.layout == TENSOR_NCHW;
+    const VerticalFn vertical = verticalFor(m_level, m_options.type);
+
+    for (int s = 0; s < 2; ++s) {
+        scratch.rows[s].resize(static_cast<size_t>(area.width) * 3);
+        scratch.source[s] = -1;
+    }
+    // Горизонтальная интерполяция исходной строки, если её нет в полосе;
+    // слот со строкой keep не занимается
+    auto sourceRow = [&](int row, int keep) -> const uint16_t* {
+        for (int s = 0; s < 2; ++s) {
+            if (scratch.source[s] == row) {
+                return scratch.rows[s].data();
+            }
+        }
+        int slot = scratch.source[0] == keep ? 1 : 0;
+        horizontalRow(frame.ptr<uint8_t>(row), m_xOffset.data(), m_xNext.data(), m_xWeight.data(),
+            area.width, planar, m_options.swapRB, scratch.rows[slot].data());
+        scratch.source[slot] = row;
+        return scratch.rows[slot].data();
+    };
+
+    const size_t leftBytes = static_cast<size_t>(area.x) * element;
+    const size_t rightOffset = static_cast<size_t>(area.x + area.width) * element;
+    const size_t rightBytes = static_cast<size_t>(inputWidth - area.x - area.width) * element;
+
+    for (int y = y0; y < y1; ++y) {
+        bool inside = y >= area.y && y < area.y + area.height;
+        const uint16_t* top = nullptr;
+        const uint16_t* bottom = nullptr;
+        float fy = 0.0f;
+        if (inside) {
+            int iy = y - area.y;
+            top = sourceRow(m_yRow[iy], m_yNext[iy]);
+            bottom = sourceRow(m_yNext[iy], m_yRow[iy]);
+            fy = m_yWeight[iy];
+        }
+
+        if (!planar) {
+            uint8_t* row = tensor + static_cast<size_t>(y) * inputWidth * 3 * element;
+            if (!inside) {
+                std::memcpy(row, m_padRow.data(), m_padRow.size());
+                continue;
+            }
+            std::memcpy(row, m_padRow.data(), leftBytes * 3);
+            vertical(top, bottom, fy, m_alpha[3], m_beta[3], row + leftBytes * 3, area.width * 3);
+            std::memcpy(row + rightOffset * 3, m_padRow.data() + rightOffset * 3, rightBytes * 3);
+            continue;
+        }
+
+        for (int c = 0; c < 3; ++c) {
+            uint8_t* row = tensor + (static_cast<size_t>(c) * inputHeight + y) * inputWidth * element;
+            const uint8_t* pad = m_padRow.data() + static_cast<size_t>(c) * inputWidth * element;
+            if (!inside) {
+                std::memcpy(row, pad, static_cast<size_t>(inputWidth) * element);
+                continue;
+            }
+            std::memcpy(row, pad, leftBytes);
+            vertical(top + c * area.width, bottom + c * area.width, fy, m_alpha[c], m_beta[c],
+                row + leftBytes, area.width);
+            std::memcpy(row + rightOffset, pad + rightOffset, rightBytes);
+        }
+    }
+}
@@ -0,0 +1,101 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "FastFrontEnd.h"
+
+// Раскладка входного тензора сети
+enum TensorLayout {
+    TENSOR_NHWC = 0,    // TFLite: [1, H, W, 3], каналы рядом
+    TENSOR_NCHW = 1     // cv::dnn: [1, 3, H, W], плоскости каналов
+};
+
+// Тип элементов входного тензора
+enum TensorType {
+    TENSOR_FLOAT32 = 0,
+    TENSOR_UINT8 = 1,   // Квантованный: real = scale * (q - zeroPoint)
+    TENSOR_INT8 = 2
+};
+
+// Вписывание кадра во вход сети с сохранением пропорций: вход = кадр * scale + pad
+struct LetterboxGeometry {
+    cv::Size frameSize;
+    cv::Size inputSize;
+    float scale = 1.0f;
+    cv::Rect area;          // Область изображения во входе, вокруг - поля
+
+    // Точка входа сети -> точка кадра
+    cv::Point2f toFrame(float x, float y) const {
+        return cv::Point2f((x - area.x) / scale, (y - area.y) / scale);
+    }
+};
+
+// Совмещённая предобработка кадра для сети.
+// За один проход по кадру выполняет билинейное масштабирование (как
+// cv::resize INTER_LINEAR), заливку полей, перестановку BGR -> RGB,
+// нормализацию (pixel * scale - mean) / std, квантование и раскладку
+// NHWC/NCHW, записывая результат прямо в память тензора TFLite или блоба
+// cv::dnn - без промежуточных Mat. Горизонтальная интерполяция одной
+// исходной строки считается один раз и переиспользуется соседними строками
+// входа, вертикальная интерполяция с нормализацией и упаковкой в float32,
+// uint8 или int8 выполняется AVX2 (иначе скалярно). Строки входа делятся на
+// полосы между потоками через cv::parallel_for_.
+class LetterboxPreprocessor {
+public:
+    struct Options {
+        cv::Size inputSize = cv::Size(640, 640);
+        TensorLayout layout = TENSOR_NCHW;
+        TensorType type = TENSOR_FLOAT32;
+        bool swapRB = true;                     // Вход сети в порядке RGB
+        float pixelScale = 1.0f / 255.0f;
+        cv::Scalar mean = cv::Scalar(0, 0, 0);  // В порядке каналов входа
+        cv::Scalar std = cv::Scalar(1, 1, 1);
+        float quantScale = 1.0f / 255.0f;       // Параметры квантования тензора (uint8/int8)
+        int quantZeroPoint = 0;
+        int padValue = 114;                     // Значение пикселя в полях
+    };
+
+    explicit LetterboxPreprocessor(const Options& options);
+
+    // Параметры квантования (из тензора модели)
+    void setQuantization(float scale, int zeroPoint);
+
+    // frame - CV_8UC3 (BGR); tensor - память всего входа [1, ...] типа options().type
+    void run(const cv::Mat& frame, void* tensor);
+    // То же в блоб cv::dnn [1, 3, H, W] CV_32F (создаётся при первом вызове)
+    void run(const cv::Mat& frame, cv::Mat& blob);
+
+    const LetterboxGeometry& geometry() const { return m_geometry; }
+    const Options& options() const { return m_options; }
+    size_t tensorBytes() const;
+
+    SimdLevel simdLevel() const { return m_level; }
+    void setSimdLevel(SimdLevel level);
+
+private:
+    Options m_options;
+    SimdLevel m_level;
+    LetterboxGeometry m_geometry;
+
+    // Таблицы горизонтальной и вертикальной интерполяции (пересчитываются при смене размера кадра)
+    std::vector<int> m_xOffset;         // Смещение левого пикселя в строке кадра (байты)
+    std::vector<int> m_xNext;           // Смещение правого пикселя
+    std::vector<uint8_t> m_xWeight;     // Вес правого пикселя, 0..128
+    std::vector<int> m_yRow;
+    std::vector<int> m_yNext;
+    std::vector<float> m_yWeight;
+
+    // Преобразование value = v * alpha + beta (v - пиксель * 128) по 24 значения
+    // на шаг SIMD: [0..2] - плоскости каналов входа (NCHW), [3] - каналы
+    // вперемежку с периодом 3 (NHWC)
+    float m_alpha[4][24];
+    float m_beta[4][24];
+    // Строка входа, целиком состоящая из полей, в формате тензора
+    std::vector<uint8_t> m_padRow;
+
+    void updateGeometry(cv::Size frameSize);
+    void updateTransform();
+    void processRows(const cv::Mat& frame, uint8_t* tensor, int y0, int y1) const;
+};
@@ -0,0 +1,216 @@
+﻿#include "ModelCache.h"
+#include "FrameTracer.h"
+#include "StageMetrics.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Файл выбранных бэкендов в каталоге кэша: строки "backend target ключ"
+const char* kBackendsFile = "dnn_backends.txt";
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping) {
+        CloseHandle(static_cast<HANDLE>(m_mapping));
+    }
+    if (m_file) {
+        CloseHandle(static_cast<HANDLE>(m_file));
+    }
+#else
+    if (m_data) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+#endif
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path) {
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->m_path = path;
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    file->m_file = handle;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+        return nullptr;
+    }
+    HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        return nullptr;
+    }
+    file->m_mapping = mapping;
+    file->m_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    file->m_size = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // Отображение держит файл само, дескриптор больше не нужен
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    // Разбор весов идёт подряд: ОС читает вперёд и начинает чтение сразу.
+    // Советы madvise - значения, а не флаги, поэтому два вызова; отказ не мешает работе
+    bool advised = madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL) == 0;
+    advised = madvise(data, static_cast<size_t>(info.st_size), MADV_WILLNEED) == 0 && advised;
+    if (!advised) {
+        std::cerr << "Model cache: madvise failed for " << path << ": " << std::strerror(errno) << std::endl;
+    }
+    file->m_data = static_cast<const char*>(data);
+    file->m_size = static_cast<size_t>(info.st_size);
+#endif
+    return file->m_data ? file : nullptr;
+}
+
+ModelCache& ModelCache::instance() {
+    static ModelCache cache;
+    return cache;
+}
+
+std::shared_ptr<const MappedFile> ModelCache::map(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_files.find(path);
+    if (found != m_files.end()) {
+        ++m_stats.hits;
+        return found->second;
+    }
+    std::shared_ptr<MappedFile> file = MappedFile::open(path);
+    if (file) {
+        m_files[path] = file;
+        ++m_stats.files;
+        m_stats.bytes += file->size();
+    }
+    return file;
+}
+
+void ModelCache::setDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_directory = directory;
+    m_backends.clear();
+
+    std::ifstream file(backendsPath());
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        int backend = 0, target = 0;
+        std::string key;
+        if (fields >> backend >> target && std::getline(fields >> std::ws, key) && !key.empty()) {
+            m_backends[key] = std::make_pair(backend, target);
+        }
+    }
+}
+
+bool ModelCache::findBackend(const std::string& key, int& backend, int& target) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_backends.find(key);
+    if (found == m_backends.end()) {
+        return false;
+    }
+    backend = found->second.first;
+    target = found->second.second;
+    ++m_stats.backendHits;
+    return true;
+}
+
+void ModelCache::storeBackend(const std::string& key, int backend, int target) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_backends[key] = std::make_pair(backend, target);
+    if (m_directory.empty()) {
+        return;
+    }
+    std::ofstream file(backendsPath(), std::ios::trunc);
+    for (const auto& entry : m_backends) {
+        file << entry.second.first << " " << entry.second.second << " " << entry.first << "\n";
+    }
+    if (!file) {
+        std::cerr << "Model cache: could not write " << backendsPath() << std::endl;
+    }
+}
+
+ModelCache::Stats ModelCache::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+
+
+std::string ModelCache::backendsPath() const {
+    if (m_directory.empty()) {
+        return std::string();
+    }
+    char last = m_directory.back();
+    return m_directory + (last == '/' || last == '\\' ? "" : "/") + kBackendsFile;
+}
+
+BackgroundLoader::BackgroundLoader(std::function<bool()> job) : m_startNs(StageMetrics::nowNs()) {
+    m_thread = std::thread([this, job]() {
+        FrameTracer::setThreadName("loader");
+        m_succeeded = job();
+        m_endNs.store(StageMetrics::nowNs(), std::memory_order_relaxed);
+        m_ready.store(true, std::memory_order_release);
+    });
+}
+
+BackgroundLoader::~BackgroundLoader() {
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+double BackgroundLoader::elapsedMs() const {
+    uint64_t endNs = ready() ? m_endNs.load(std::memory_order_relaxed) : StageMetrics::nowNs();
+    return (endNs - m_startNs) * 1e-6;
+}
+
+StartupTimer& StartupTimer::instance() {
+    static StartupTimer timer;
+    return timer;
+}
+
+void StartupTimer::start() {
+    m_startNs = StageMetrics::nowNs();
+}
+
+double StartupTimer::elapsedMs() const {
+    return (StageMetrics::nowNs() - m_startNs) * 1e-6;
+}
+
+void StartupTimer::mark(std::atomic<uint64_t>& slot) {
+    if (slot.load(std::memory_order_relaxed) != 0) {
+        return;
+    }
+    uint64_t expected = 0;
+    slot.compare_exchange_strong(expected, StageMetrics::nowNs(), std::memory_order_relaxed);
+}
+
+double StartupTimer::sinceStartMs(const std::atomic<uint64_t>& slot) const {
+    uint64_t ns = slot.load(std::memory_order_relaxed);
+    return ns == 0 ? -1.0 : (ns - m_startNs) * 1e-6;
+}
@@ -0,0 +1,118 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+// Файл, отображённый в память только для чтения: страницы подгружает ОС по
+// мере обращения, копии в куче нет, повторный запуск берёт их из кэша страниц
+class MappedFile {
+public:
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // nullptr - файл не открыт или пуст
+    static std::shared_ptr<MappedFile> open(const std::string& path);
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    const std::string& path() const { return m_path; }
+
+private:
+    MappedFile() = default;
+
+    std::string m_path;
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;     // HANDLE
+    void* m_mapping = nullptr;  // HANDLE
+#endif
+};
+
+// Кэш моделей процесса: отображённые файлы весов (повторная загрузка и
+// другие обработчики не читают файл заново) и выбранные бэкенды cv::dnn,
+// сохраняемые в каталоге между запусками - перезапуск не перебирает бэкенды
+// пробными прогонами. Потокобезопасен.
+class ModelCache {
+public:
+    struct Stats {
+        int files = 0;
+        uint64_t bytes = 0;
+        uint64_t hits = 0;              // Запросов, обслуженных без отображения
+        uint64_t backendHits = 0;       // Загрузок с сохранённым бэкендом
+    };
+
+    static ModelCache& instance();
+
+    std::shared_ptr<const MappedFile> map(const std::string& path);
+
+    // Каталог для файла выбранных бэкендов (пусто - только в памяти процесса)
+    void setDirectory(const std::string& directory);
+    bool findBackend(const std::string& key, int& backend, int& target);
+    void storeBackend(const std::string& key, int backend, int target);
+
+    Stats stats() const;
+
+private:
+    ModelCache() = default;
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::shared_ptr<MappedFile>> m_files;
+    std::map<std::string, std::pair<int, int>> m_backends;
+    std::string m_directory;
+    Stats m_stats;
+
+    std::string backendsPath() const;
+};
+
+// Фоновая загрузка: job выполняется в своём потоке, пока конвейер уже
+// обрабатывает кадры. Деструктор дожидается завершения job
+class BackgroundLoader {
+public:
+    explicit BackgroundLoader(std::function<bool()> job);
+    ~BackgroundLoader();
+
+    bool ready() const { return m_ready.load(std::memory_order_acquire); }
+    // После ready(): результат job
+    bool succeeded() const { return m_succeeded; }
+    double elapsedMs() const;
+
+private:
+    std::thread m_thread;
+    std::atomic<bool> m_ready{ false };
+    bool m_succeeded = false;
+    uint64_t m_startNs = 0;
+    std::atomic<uint64_t> m_endNs{ 0 };
+};
+
+// Время запуска: от начала main до первого обработанного кадра (TTFF) и до
+// первой детекции (TTFD). Отметки ставятся из любого потока, учитывается первая
+class StartupTimer {
+public:
+    static StartupTimer& instance();
+
+    void start();
+    double elapsedMs() const;
+    void markFirstFrame() { mark(m_firstFrameNs); }
+    void markFirstDetection() { mark(m_firstDetectionNs); }
+    // -1 - события ещё не было
+    double firstFrameMs() const { return sinceStartMs(m_firstFrameNs); }
+    double firstDetectionMs() const { return sinceStartMs(m_firstDetectionNs); }
+
+private:
+    uint64_t m_startNs = 0;
+    std::atomic<uint64_t> m_firstFrameNs{ 0 };
+    std::atomic<uint64_t> m_firstDetectionNs{ 0 };
+
+    void mark(std::atomic<uint64_t>& slot);
+    double sinceStartMs(const std::atomic<uint64_t>& slot) const;
+};
@@ -0,0 +1,207 @@
+﻿#include "ObjectTracker.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Начальная неопределённость скорости нового трека, (пикс/с)^2
+const float kInitialVelocityVariance = 1e4f;
+
+// Наименьший размер экстраполированной рамки, пиксели
+const float kMinBoxSize = 1.0f;
+
+float iou(const cv::Rect2f& a, const cv::Rect2f& b) {
+    float left = std::max(a.x, b.x);
+    float top = std::max(a.y, b.y);
+    float right = std::min(a.x + a.width, b.x + b.width);
+    float bottom = std::min(a.y + a.height, b.y + b.height);
+    if (right <= left || bottom <= top) {
+        return 0.0f;
+    }
+    float intersection = (right - left) * (bottom - top);
+    return intersection / (a.area() + b.area() - intersection);
+}
+
+float secondsBetween(int64 from, int64 to) {
+    return static_cast<float>((to - from) / cv::getTickFrequency());
+}
+
+}
+
+ObjectTracker::ObjectTracker(const Options& options) : m_options(options) {
+    m_options.maxMisses = std::max(0, m_options.maxMisses);
+    m_options.minHits = std::max(1, m_options.minHits);
+}
+
+void ObjectTracker::update(const std::vector<Detection>& detections, int64 ticks) {
+    // Треки переводятся на момент кадра детекции
+    for (Track& track : m_tracks) {
+        float dt = secondsBetween(track.ticks, ticks);
+        if (m_options.useKalman && dt > 0.0f) {
+            for (Axis& axis : track.axes) {
+                predictAxis(axis, dt);
+            }
+        }
+        track.ticks = std::max(track.ticks, ticks);
+    }
+
+    // Жадное сопоставление в пределах класса: сначала по убыванию IoU, затем
+    // по возрастанию расстояния центров (объект сместился больше своего размера)
+    m_matches.clear();
+    for (size_t t = 0; t < m_tracks.size(); ++t) {
+        cv::Rect2f predicted = boxAt(m_tracks[t], 0.0f);
+        float size = std::max(predicted.width, predicted.height);
+        for (size_t d = 0; d < detections.size(); ++d) {
+            if (detections[d].classId != m_tracks[t].classId) {
+                continue;
+            }
+            const cv::Rect2f& box = detections[d].box;
+            float overlap = iou(predicted, box);
+            if (overlap >= m_options.iouThreshold) {
+                m_matches.push_back({ overlap, static_cast<int>(t), static_cast<int>(d) });
+                continue;
+            }
+            float dx = (box.x + 0.5f * box.width) - (predicted.x + 0.5f * predicted.width);
+            float dy = (box.y + 0.5f * box.height) - (predicted.y + 0.5f * predicted.height);
+            float distance = std::sqrt(dx * dx + dy * dy) / size;
+            if (distance < m_options.maxCenterDistance) {
+                m_matches.push_back({ -distance, static_cast<int>(t), static_cast<int>(d) });
+            }
+        }
+    }
+    std::sort(m_matches.begin(), m_matches.end(), [](const Match& a, const Match& b) { return a.score > b.score; });
+
+    m_trackMatched.assign(m_tracks.size(), 0);
+    m_detectionMatched.assign(detections.size(), 0);
+    for (const Match& match : m_matches) {
+        if (m_trackMatched[match.track] || m_detectionMatched[match.detection]) {
+            continue;
+        }
+        m_trackMatched[match.track] = 1;
+        m_detectionMatched[match.detection] = 1;
+
+        Track& track = m_tracks[match.track];
+        const Detection& detection = detections[match.detection];
+        const cv::Rect2f& box = detection.box;
+        const float measured[4] = { box.x + 0.5f * box.width, box.y + 0.5f * box.height, box.width, box.height };
+        for (int i = 0; i < 4; ++i) {
+            if (m_options.useKalman) {
+                correctAxis(track.axes[i], measured[i]);
+            }
+            else {
+                track.axes[i].x = measured[i];
+            }
+        }
+        track.confidence = detection.confidence;
+        track.ticks = ticks;
+        track.seenTicks = ticks;
+        ++track.hits;
+        track.misses = 0;
+    }
+
+    // Неподтверждённые треки стареют, лишние удаляются
+    const double tickMs = 1e3 / cv::getTickFrequency();
+    size_t kept = 0;
+    for (size_t t = 0; t < m_tracks.size(); ++t) {
+        Track& track = m_tracks[t];
+        if (!m_trackMatched[t]) {
+            ++track.misses;
+        }
+        bool expired = track.misses > m_options.maxMisses ||
+            (ticks - track.seenTicks) * tickMs > m_options.maxAgeMs;
+        if (!expired) {
+            m_tracks[kept++] = track;
+        }
+    }
+    m_tracks.resize(kept);
+
+    for (size_t d = 0; d < detections.size(); ++d) {
+        if (!m_detectionMatched[d]) {
+            startTrack(detections[d], ticks);
+        }
+    }
+}
+
+void ObjectTracker::predict(int64 ticks, std::vector<TrackedObject>& out) const {
+    out.clear();
+    const double tickMs = 1e3 / cv::getTickFrequency();
+    for (const Track& track : m_tracks) {
+        if (track.hits < m_options.minHits) {
+            continue;
+        }
+        double staleMs = (ticks - track.seenTicks) * tickMs;
+        if (staleMs > m_options.maxAgeMs) {
+            continue;
+        }
+        TrackedObject object;
+        object.id = track.id;
+        object.box = boxAt(track, m_options.useKalman ? secondsBetween(track.ticks, ticks) : 0.0f);
+        object.classId = track.classId;
+        object.confidence = track.confidence;
+        object.hits = track.hits;
+        object.staleMs = std::max(0.0, staleMs);
+        out.push_back(object);
+    }
+}
+
+void ObjectTracker::clear() {
+    m_tracks.clear();
+}
+
+
+
+void ObjectTracker::predictAxis(Axis& axis, float dt) const {
+    // x' = x + v dt; P' = F P F^T + Q, Q - белый шум ускорения
+    const float q = static_cast<float>(m_options.accelNoise * m_options.accelNoise);
+    const float dt2 = dt * dt;
+    axis.x += axis.v * dt;
+    float p00 = axis.p00 + dt * (2.0f * axis.p01 + dt * axis.p11) + q * dt2 * dt2 * 0.25f;
+    float p01 = axis.p01 + dt * axis.p11 + q * dt2 * dt * 0.5f;
+    float p11 = axis.p11 + q * dt2;
+    axis.p00 = p00;
+    axis.p01 = p01;
+    axis.p11 = p11;
+}
+
+void ObjectTracker::correctAxis(Axis& axis, float z) const {
+    const float r = static_cast<float>(m_options.measurementNoise * m_options.measurementNoise);
+    float s = axis.p00 + r;
+    float k0 = axis.p00 / s;
+    float k1 = axis.p01 / s;
+    float residual = z - axis.x;
+    axis.x += k0 * residual;
+    axis.v += k1 * residual;
+    float p00 = (1.0f - k0) * axis.p00;
+    float p01 = (1.0f - k0) * axis.p01;
+    float p11 = axis.p11 - k1 * axis.p01;
+    axis.p00 = p00;
+    axis.p01 = p01;
+    axis.p11 = p11;
+}
+
+void ObjectTracker::startTrack(const Detection& detection, int64 ticks) {
+    Track track;
+    track.id = m_nextId++;
+    track.classId = detection.classId;
+    track.confidence = detection.confidence;
+    track.ticks = ticks;
+    track.seenTicks = ticks;
+    track.hits = 1;
+    const cv::Rect2f& box = detection.box;
+    const float measured[4] = { box.x + 0.5f * box.width, box.y + 0.5f * box.height, box.width, box.height };
+    const float r = static_cast<float>(m_options.measurementNoise * m_options.measurementNoise);
+    for (int i = 0; i < 4; ++i) {
+        track.axes[i].x = measured[i];
+        track.axes[i].p00 = r;
+        track.axes[i].p11 = kInitialVelocityVariance;
+    }
+    m_tracks.push_back(track);
+}
+
+cv::Rect2f ObjectTracker::boxAt(const Track& track, float dt) {
+    float cx = track.axes[0].x + track.axes[0].v * dt;
+    float cy = track.axes[1].x + track.axes[1].v * dt;
+    float w = std::max(kMinBoxSize, track.axes[2].x + track.axes[2].v * dt);
+    float h = std::max(kMinBoxSize, track.axes[3].x + track.axes[3].v * dt);
+    return cv::Rect2f(cx - 0.5f * w, cy - 0.5f * h, w, h);
+}
@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+#include "YoloDecoder.h"
+
+// Сопровождаемый объект в момент показанного кадра
+struct TrackedObject {
+    int id = 0;
+    cv::Rect2f box;
+    int classId = 0;
+    float confidence = 0.0f;
+    int hits = 0;               // Детекций, подтвердивших трек
+    double staleMs = 0.0;       // От кадра последней детекции трека до момента прогноза
+};
+
+// Лёгкий трекер между детекциями: сопоставление по IoU в пределах класса
+// (затем по расстоянию центров для не перекрывшихся рамок) и
+// фильтр Калмана постоянной скорости для центра и размера рамки (четыре
+// независимых фильтра позиция/скорость, без матриц). Детекции приходят с
+// задержкой и относятся к моменту захвата своего кадра: трек обновляется на
+// этот момент, а рамки для показа экстраполируются на время захвата
+// показываемого кадра. Время - в тиках cv::getTickCount.
+// Без Калмана (useKalman = false) рамка трека - последняя детекция.
+// Не потокобезопасен.
+class ObjectTracker {
+public:
+    struct Options {
+        float iouThreshold = 0.3f;      // Минимальное IoU прогноза и детекции
+        float maxCenterDistance = 1.0f; // Без IoU: расстояние центров в размерах рамки трека (быстрые мелкие объекты)
+        int maxMisses = 3;              // Детекций подряд без трека до удаления
+        double maxAgeMs = 1500.0;       // Трек без подтверждения дольше - удаляется и не экстраполируется
+        int minHits = 1;                // Показывать треки с таким числом подтверждений
+        bool useKalman = true;
+        double accelNoise = 400.0;      // Шум ускорения, пикс/с^2 (СКО)
+        double measurementNoise = 4.0;  // Шум координат детекции, пикс (СКО)
+    };
+
+    explicit ObjectTracker(const Options& options);
+
+    // Детекции кадра, захваченного в ticks
+    void update(const std::vector<Detection>& detections, int64 ticks);
+    // Рамки треков на момент ticks
+    void predict(int64 ticks, std::vector<TrackedObject>& out) const;
+    void clear();
+
+    size_t trackCount() const { return m_tracks.size(); }
+    const Options& options() const { return m_options; }
+
+private:
+    // Фильтр одной координаты: позиция, скорость и ковариация 2x2
+    struct Axis {
+        float x = 0.0f;
+        float v = 0.0f;
+        float p00 = 0.0f, p01 = 0.0f, p11 = 0.0f;
+    };
+
+    struct Track {
+        int id = 0;
+        int classId = 0;
+        float confidence = 0.0f;
+        Axis axes[4];           // cx, cy, w, h
+        int64 ticks = 0;        // Момент состояния фильтров
+        int64 seenTicks = 0;    // Кадр последней подтвердившей детекции
+        int hits = 0;
+        int misses = 0;
+    };
+
+    Options m_options;
+    std::vector<Track> m_tracks;
+    int m_nextId = 1;
+
+    // Сопоставление: пары (оценка, трек, детекция), переиспользуются.
+    // Оценка - IoU, для пар по расстоянию центров - минус расстояние
+    struct Match {
+        float score;
+        int track;
+        int detection;
+    };
+    std::vector<Match> m_matches;
+    std::vector<uint8_t> m_trackMatched;
+    std::vector<uint8_t> m_detectionMatched;
+
+    void predictAxis(Axis& axis, float dt) const;
+    void correctAxis(Axis& axis, float z) const;
+    void startTrack(const Detection& detection, int64 ticks);
+    static cv::Rect2f boxAt(const Track& track, float dt);
+};
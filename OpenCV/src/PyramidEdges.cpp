@@ -0,0 +1,126 @@
+﻿#include "PyramidEdges.h"
+#include <algorithm>
+
+namespace {
+// Тайлы уточнения и запас на размытие/Собель/NMS, как в инкрементальном режиме
+const int kRefineTile = 64;
+const int kRefineHalo = 8;
+// Коэффициент экспоненциального сглаживания задержек
+const double kStatsAlpha = 0.1;
+
+double elapsedMs(int64 start, int64 end) {
+    return (end - start) * 1000.0 / cv::getTickFrequency();
+}
+}
+
+void PyramidEdgeRunner::setLevel(int level) {
+    m_level = std::min(std::max(level, 0), kMaxLevel);
+}
+
+int PyramidEdgeRunner::scaleRadius(int radius, int level) {
+    return std::max(1, radius >> level);
+}
+
+int PyramidEdgeRunner::scaleKernel(int size, int level) {
+    int scaled = size >> level;
+    return std::max(3, scaled | 1);
+}
+
+void PyramidEdgeRunner::run(const cv::Mat& frame, const DetectFn& detect, const RefineFn& refine,
+    cv::Mat* edges, BitGrid* grid) {
+    int64 start = cv::getTickCount();
+
+    if (m_level == 0) {
+        cv::Mat& out = edges ? *edges : m_coarse;
+        detect(frame, 0, out);
+        int64 detected = cv::getTickCount();
+        if (grid) {
+            *grid = BitGrid(out);
+        }
+        record(0, 0.0, elapsedMs(start, detected), elapsedMs(detected, cv::getTickCount()), 0.0);
+        return;
+    }
+
+    const int f = factor();
+
+    // 1. Уменьшение кадра
+    cv::Size smallSize(std::max(1, frame.cols / f), std::max(1, frame.rows / f));
+    cv::resize(frame, m_small, smallSize, 0, 0, cv::INTER_AREA);
+    int64 downscaled = cv::getTickCount();
+
+    // 2. Конвейер детектора на уровне пирамиды
+    detect(m_small, m_level, m_coarse);
+    int64 detected = cv::getTickCount();
+
+    // 3. Увеличение повторением: каждый грубый пиксель становится блоком f x f
+    cv::Mat upsampled;
+    if (edges || m_refine) {
+        cv::resize(m_coarse, upsampled, cv::Size(m_coarse.cols * f, m_coarse.rows * f), 0, 0, cv::INTER_NEAREST);
+        if (upsampled.size() != frame.size()) {
+            cv::copyMakeBorder(upsampled, upsampled, 0, frame.rows - upsampled.rows,
+                0, frame.cols - upsampled.cols, cv::BORDER_REPLICATE);
+        }
+    }
+    if (grid && !m_refine) {
+        *grid = BitGrid(m_coarse).upsampled(f, frame.cols, frame.rows);
+    }
+    int64 upscaled = cv::getTickCount();
+
+    // 4. Уточнение полноразмерным Канни внутри полосы вокруг грубых границ
+    if (m_refine) {
+        cv::Mat refined;
+        cv::Mat& out = edges ? *edges : refined;
+        cv::dilate(upsampled, m_band, cv::getStructuringElement(cv::MORPH_RECT,
+            cv::Size(2 * f + 1, 2 * f + 1)));
+        refineEdges(frame, refine, out);
+        if (grid) {
+            *grid = BitGrid(out);
+        }
+    }
+    else if (edges) {
+        *edges = upsampled;
+    }
+    int64 finished = cv::getTickCount();
+
+    record(m_level, elapsedMs(start, downscaled), elapsedMs(downscaled, detected),
+        elapsedMs(detected, upscaled), elapsedMs(upscaled, finished));
+}
+
+void PyramidEdgeRunner::refineEdges(const cv::Mat& frame, const RefineFn& refine, cv::Mat& edges) {
+    edges.create(frame.size(), CV_8UC1);
+    edges.setTo(0);
+
+    cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+    cv::Mat tileEdges;
+
+    for (int y = 0; y < frame.rows; y += kRefineTile) {
+        for (int x = 0; x < frame.cols; x += kRefineTile) {
+            cv::Rect inner = cv::Rect(x, y, kRefineTile, kRefineTile) & frameRect;
+            if (cv::countNonZero(m_band(inner)) == 0) {
+                continue;
+            }
+
+            cv::Rect outer = cv::Rect(inner.x - kRefineHalo, inner.y - kRefineHalo,
+                inner.width + 2 * kRefineHalo, inner.height + 2 * kRefineHalo) & frameRect;
+            refine(frame(outer), tileEdges);
+
+            cv::Rect local(inner.tl() - outer.tl(), inner.size());
+            cv::Mat target = edges(inner);
+            cv::bitwise_and(tileEdges(local), m_band(inner), target);
+        }
+    }
+}
+
+void PyramidEdgeRunner::record(int level, double downscaleMs, double detectMs,
+    double upsampleMs, double refineMs) {
+    LevelStats& s = m_stats[level];
+    double alpha = s.frames == 0 ? 1.0 : kStatsAlpha;
+    double totalMs = downscaleMs + detectMs + upsampleMs + refineMs;
+
+    s.downscaleMs += alpha * (downscaleMs - s.downscaleMs);
+    s.detectMs += alpha * (detectMs - s.detectMs);
+    s.upsampleMs += alpha * (upsampleMs - s.upsampleMs);
+    s.refineMs += alpha * (refineMs - s.refineMs);
+    s.totalMs += alpha * (totalMs - s.totalMs);
+    ++s.frames;
+}
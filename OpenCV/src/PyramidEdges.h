@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <array>
+#include <functional>
+#include "BitGrid.h"
+
+// Режим "уменьшить - найти границы - увеличить" для кадров высокого разрешения.
+// Конвейер детектора запускается на уровне пирамиды (1/2 или 1/4), грубая
+// BitGrid увеличивается повторением битов. Опционально границы уточняются:
+// полноразмерный Канни считается только по тайлам, попавшим в расширенную
+// полосу вокруг грубых границ, и маскируется этой полосой.
+class PyramidEdgeRunner {
+public:
+    static const int kMaxLevel = 2;
+
+    // Задержки одного уровня, мс (экспоненциальное сглаживание)
+    struct LevelStats {
+        double downscaleMs = 0.0;
+        double detectMs = 0.0;
+        double upsampleMs = 0.0;
+        double refineMs = 0.0;
+        double totalMs = 0.0;
+        int frames = 0;
+    };
+
+    // Детекция на уровне: кадр уже уменьшен, level - для масштабирования ядер
+    using DetectFn = std::function<void(const cv::Mat& frame, int level, cv::Mat& edges)>;
+    // Полноразмерный Канни для фрагмента кадра (уточнение)
+    using RefineFn = std::function<void(const cv::Mat& frame, cv::Mat& edges)>;
+
+    void setLevel(int level);
+    int level() const { return m_level; }
+    int factor() const { return 1 << m_level; }
+    void setRefinement(bool enabled) { m_refine = enabled; }
+    bool refinement() const { return m_refine; }
+
+    // edges - полноразмерная карта границ (может быть nullptr, если нужна только сетка),
+    // grid - полноразмерная BitGrid (может быть nullptr)
+    void run(const cv::Mat& frame, const DetectFn& detect, const RefineFn& refine,
+        cv::Mat* edges, BitGrid* grid);
+
+    const LevelStats& stats(int level) const { return m_stats[level]; }
+
+    // Размер ядра морфологии для уровня: радиус делится на 2^level, не меньше 1
+    static int scaleRadius(int radius, int level);
+    // Нечётный размер ядра (например, 15 для закрытия), не меньше 3
+    static int scaleKernel(int size, int level);
+
+private:
+    int m_level = 0;
+    bool m_refine = false;
+    std::array<LevelStats, kMaxLevel + 1> m_stats;
+
+    cv::Mat m_small;
+    cv::Mat m_coarse;
+    cv::Mat m_band;
+
+    void refineEdges(const cv::Mat& frame, const RefineFn& refine, cv::Mat& edges);
+    void record(int level, double downscaleMs, double detectMs, double upsampleMs, double refineMs);
+};
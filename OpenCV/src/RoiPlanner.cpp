@@ -0,0 +1,122 @@
+﻿#include "RoiPlanner.h"
+#include <algorithm>
+
+namespace {
+// Больше областей не рассматривается: слияние квадратично по числу кропов
+const size_t kMaxRegions = 32;
+}
+
+RoiPlanner::RoiPlanner(const Options& options) : m_options(options) {
+    m_options.minPadding = std::max(0, m_options.minPadding);
+    m_options.maxUpscale = std::max(1.0f, m_options.maxUpscale);
+    m_options.maxCrops = std::max(1, m_options.maxCrops);
+}
+
+const std::vector<cv::Rect>& RoiPlanner::plan(const std::vector<cv::Rect>& regions, cv::Size frameSize,
+    cv::Size inputSize) {
+    m_crops.clear();
+    m_coverage = 0.0;
+    const double frameArea = static_cast<double>(frameSize.area());
+    if (frameArea <= 0.0 || inputSize.area() <= 0) {
+        return m_crops;
+    }
+
+    // Крупнейшие области, без шума
+    const double minArea = m_options.minRegionFraction * frameArea;
+    m_regions.clear();
+    for (const cv::Rect& region : regions) {
+        if (region.area() >= minArea) {
+            m_regions.push_back(region);
+        }
+    }
+    if (m_regions.size() > kMaxRegions) {
+        std::partial_sort(m_regions.begin(), m_regions.begin() + kMaxRegions, m_regions.end(),
+            [](const cv::Rect& a, const cv::Rect& b) { return a.area() > b.area(); });
+        m_regions.resize(kMaxRegions);
+    }
+
+    for (const cv::Rect& region : m_regions) {
+        int pad = std::max(m_options.minPadding, cvRound(m_options.padding * std::max(region.width, region.height)));
+        cv::Rect padded(region.x - pad, region.y - pad, region.width + 2 * pad, region.height + 2 * pad);
+        m_crops.push_back(fitCrop(padded, frameSize, inputSize));
+    }
+    mergeOverlapping(frameSize, inputSize);
+    while (static_cast<int>(m_crops.size()) > m_options.maxCrops) {
+        mergeCheapest(frameSize, inputSize);
+        mergeOverlapping(frameSize, inputSize);
+    }
+
+    double covered = 0.0;
+    for (const cv::Rect& crop : m_crops) {
+        covered += crop.area();
+    }
+    m_coverage = covered / frameArea;
+    if (m_coverage > m_options.maxCoverage) {
+        m_crops.clear();
+    }
+    return m_crops;
+}
+
+
+
+cv::Rect RoiPlanner::fitCrop(const cv::Rect& box, cv::Size frameSize, cv::Size inputSize) const {
+    // Не меньше входа / maxUpscale и в пропорциях входа (поля letterbox не тратят вход)
+    const double aspect = inputSize.width / static_cast<double>(inputSize.height);
+    double width = std::max<double>(box.width, inputSize.width / m_options.maxUpscale);
+    double height = std::max<double>(box.height, inputSize.height / m_options.maxUpscale);
+    if (width / height < aspect) {
+        width = height * aspect;
+    }
+    else {
+        height = width / aspect;
+    }
+    int cropWidth = std::min(frameSize.width, cvCeil(width));
+    int cropHeight = std::min(frameSize.height, cvCeil(height));
+
+    // Тот же центр, у края кадра - сдвиг внутрь вместо обрезки
+    int x = cvRound(box.x + 0.5 * box.width - 0.5 * cropWidth);
+    int y = cvRound(box.y + 0.5 * box.height - 0.5 * cropHeight);
+    x = std::min(std::max(x, 0), frameSize.width - cropWidth);
+    y = std::min(std::max(y, 0), frameSize.height - cropHeight);
+    return cv::Rect(x, y, cropWidth, cropHeight);
+}
+
+void RoiPlanner::mergeOverlapping(cv::Size frameSize, cv::Size inputSize) {
+    // Объединение растёт после подгонки, поэтому до отсутствия пересечений
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < m_crops.size() && !merged; ++i) {
+            for (size_t j = i + 1; j < m_crops.size(); ++j) {
+                if ((m_crops[i] & m_crops[j]).area() > 0) {
+                    m_crops[i] = fitCrop(m_crops[i] | m_crops[j], frameSize, inputSize);
+                    m_crops.erase(m_crops.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void RoiPlanner::mergeCheapest(cv::Size frameSize, cv::Size inputSize) {
+    size_t bestI = 0, bestJ = 1;
+    double bestGrowth = 0.0;
+    bool found = false;
+    for (size_t i = 0; i < m_crops.size(); ++i) {
+        for (size_t j = i + 1; j < m_crops.size(); ++j) {
+            cv::Rect joined = fitCrop(m_crops[i] | m_crops[j], frameSize, inputSize);
+            double growth = static_cast<double>(joined.area()) - m_crops[i].area() - m_crops[j].area();
+            if (!found || growth < bestGrowth) {
+                bestI = i;
+                bestJ = j;
+                bestGrowth = growth;
+                found = true;
+            }
+        }
+    }
+    if (found) {
+        m_crops[bestI] = fitCrop(m_crops[bestI] | m_crops[bestJ], frameSize, inputSize);
+        m_crops.erase(m_crops.begin() + bestJ);
+    }
+}
@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Кропы кадра для детекции по областям комбинированного детектора границ.
+// Рамки заполненных областей расширяются полями, доводятся до пропорций
+// входа сети (и до размера, при котором кроп увеличивается не больше чем в
+// maxUpscale раз), пересекающиеся кропы сливаются, а лишние сверх maxCrops -
+// попарно с наименьшим приростом площади. Все кропы идут в сеть одним
+// пакетом в разрешении входа: на кадре высокого разрешения с несколькими
+// небольшими объектами это точнее уменьшения всего кадра при меньшем числе
+// операций. Если областей нет или кропы покрывают больше maxCoverage кадра,
+// план пуст - детекция идёт по всему кадру.
+class RoiPlanner {
+public:
+    struct Options {
+        double minRegionFraction = 0.0005;  // Области меньше этой доли кадра - шум
+        float padding = 0.2f;               // Поле вокруг области, доля её большей стороны
+        int minPadding = 16;                // Поле не меньше, пиксели кадра
+        float maxUpscale = 2.0f;            // Наибольшее увеличение кропа до входа сети
+        int maxCrops = 4;                   // Кропов в пакете
+        double maxCoverage = 0.5;           // Доля кадра, с которой выгоднее весь кадр
+    };
+
+    explicit RoiPlanner(const Options& options);
+
+    // Кропы для сети по рамкам областей; пустой результат - весь кадр
+    const std::vector<cv::Rect>& plan(const std::vector<cv::Rect>& regions, cv::Size frameSize, cv::Size inputSize);
+
+    const std::vector<cv::Rect>& crops() const { return m_crops; }
+    // Доля кадра, покрытая кропами последнего плана
+    double coverage() const { return m_coverage; }
+    const Options& options() const { return m_options; }
+
+private:
+    Options m_options;
+    std::vector<cv::Rect> m_regions;
+    std::vector<cv::Rect> m_crops;
+    double m_coverage = 0.0;
+
+    cv::Rect fitCrop(const cv::Rect& box, cv::Size frameSize, cv::Size inputSize) const;
+    void mergeOverlapping(cv::Size frameSize, cv::Size inputSize);
+    void mergeCheapest(cv::Size frameSize, cv::Size inputSize);
+};
@@ -0,0 +1,224 @@
+﻿#include "SnapshotWriter.h"
+#include "FrameTracer.h"
+#include "StageMetrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+
+namespace {
+// Локальное время без гонок между потоками
+std::tm localTime(std::time_t time) {
+    std::tm result = {};
+#ifdef _WIN32
+    localtime_s(&result, &time);
+#else
+    localtime_r(&time, &result);
+#endif
+    return result;
+}
+}
+
+SnapshotWriter::SnapshotWriter(const Options& options) : m_options(options) {
+    m_options.threads = std::max(1, m_options.threads);
+    m_options.maxPending = std::max(1, m_options.maxPending);
+    m_options.batchSize = std::max(1, m_options.batchSize);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    stop();
+}
+
+void SnapshotWriter::start() {
+    if (!m_threads.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = false;
+    }
+    for (int i = 0; i < m_options.threads; ++i) {
+        m_threads.emplace_back(&SnapshotWriter::workerLoop, this);
+    }
+}
+
+void SnapshotWriter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+}
+
+std::string SnapshotWriter::uniqueName(const std::string& prefix, const std::string& extension) {
+    // Номер задания различает снимки внутри одной миллисекунды
+    return timestampedName(m_options.directory, prefix, m_sequence.fetch_add(1), extension);
+}
+
+std::string SnapshotWriter::timestampedName(const std::string& directory, const std::string& prefix,
+    unsigned sequence, const std::string& extension) {
+    auto now = std::chrono::system_clock::now();
+    std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+    int millis = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        now.time_since_epoch()).count() % 1000);
+    std::tm local = localTime(seconds);
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "_%04d%02d%02d_%02d%02d%02d_%03d_%04u",
+        local.tm_year + 1900, local.tm_mon + 1, local.tm_mday,
+        local.tm_hour, local.tm_min, local.tm_sec, millis, sequence % 10000);
+
+    std::string path = directory;
+    if (!path.empty() && path.back() != '/' && path.back() != '\\') {
+        path += '/';
+    }
+    return path + prefix + name + extension;
+}
+
+std::string SnapshotWriter::submitFrame(const FrameHandle& frame, const std::string& prefix,
+    const std::string& extension) {
+    if (frame.empty()) {
+        return std::string();
+    }
+    Job job;
+    job.path = uniqueName(prefix, extension);
+    job.extension = extension;
+    job.frame = frame;
+    job.bytes = frame.mat().total() * frame.mat().elemSize();
+    std::string path = job.path;
+    return enqueue(job) ? path : std::string();
+}
+
+std::string SnapshotWriter::submitGrid(BitGrid grid, const std::string& prefix, CompressionMethod method) {
+    Job job;
+    job.path = uniqueName(prefix, ".bgrid");
+    job.isGrid = true;
+    job.method = method;
+    job.bytes = grid.byteSize();
+    job.grid = std::move(grid);
+    std::string path = job.path;
+    return enqueue(job) ? path : std::string();
+}
+
+bool SnapshotWriter::enqueue(Job& job) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_stats.submitted;
+        if (m_stop || m_stats.pending >= m_options.maxPending ||
+            (m_stats.pending > 0 && m_stats.pendingBytes + job.bytes > m_options.maxPendingBytes)) {
+            ++m_stats.rejected;
+            return false;
+        }
+        ++m_stats.pending;
+        m_stats.peakPending = std::max(m_stats.peakPending, m_stats.pending);
+        m_stats.pendingBytes += job.bytes;
+        m_queue.push_back(std::move(job));
+    }
+    m_wake.notify_one();
+    return true;
+}
+
+SnapshotWriter::Stats SnapshotWriter::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+
+
+void SnapshotWriter::workerLoop() {
+    FrameTracer::setThreadName("writer");
+
+    // Выход кодирования переиспользуется между заданиями: RLE-сетка пишется в
+    // него без выделений после первых снимков (LZ4, Хаффман и imencode строят
+    // результат во временных буферах)
+    std::vector<Job> batch;
+    std::vector<uchar> encoded;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                break;
+            }
+            while (!m_queue.empty() && static_cast<int>(batch.size()) < m_options.batchSize) {
+                batch.push_back(std::move(m_queue.front()));
+                m_queue.pop_front();
+            }
+        }
+
+        for (Job& job : batch) {
+            double encodeMs = 0.0, writeMs = 0.0;
+            bool ok = writeJob(job, encoded, encodeMs, writeMs);
+            if (!ok) {
+                std::cerr << "Snapshot writer: failed to write " << job.path << std::endl;
+            }
+
+            // Снимок возвращается в пул до учёта, чтобы освободившееся место было реальным
+            size_t bytes = job.bytes;
+            size_t fileBytes = encoded.size();
+            job.frame.release();
+            job.grid = BitGrid();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_stats.pending;
+            m_stats.pendingBytes -= bytes;
+            m_stats.encodeMs += encodeMs;
+            m_stats.writeMs += writeMs;
+            if (ok) {
+                ++m_stats.written;
+                m_stats.bytesWritten += fileBytes;
+            }
+            else {
+                ++m_stats.failed;
+            }
+        }
+        batch.clear();
+    }
+}
+
+bool SnapshotWriter::writeJob(const Job& job, std::vector<uchar>& encoded, double& encodeMs, double& writeMs) {
+    uint64_t start = StageMetrics::nowNs();
+    {
+        ScopedStageTimer timer(METRIC_ENCODE);
+        if (job.isGrid) {
+            job.grid.compress(job.method, encoded);
+        }
+        else {
+            std::vector<int> params;
+            if (job.extension == ".jpg" || job.extension == ".jpeg") {
+                params = { cv::IMWRITE_JPEG_QUALITY, m_options.jpegQuality };
+            }
+            encoded.clear();
+            if (!cv::imencode(job.extension, job.frame.mat(), encoded, params)) {
+                encodeMs = (StageMetrics::nowNs() - start) * 1e-6;
+                return false;
+            }
+        }
+    }
+    uint64_t encodedAt = StageMetrics::nowNs();
+    encodeMs = (encodedAt - start) * 1e-6;
+
+    ScopedStageTimer timer(METRIC_WRITE);
+    std::string partial = job.path + ".part";
+    std::FILE* file = std::fopen(partial.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    // Данные уходят одним fwrite: буферу stdio копировать нечего
+    bool ok = std::fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+    ok = std::fclose(file) == 0 && ok;
+    if (ok) {
+        ok = std::rename(partial.c_str(), job.path.c_str()) == 0;
+    }
+    if (!ok) {
+        std::remove(partial.c_str());
+    }
+    writeMs = (StageMetrics::nowNs() - encodedAt) * 1e-6;
+    return ok;
+}
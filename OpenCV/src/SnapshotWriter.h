@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include "BitGrid.h"
+#include "FramePool.h"
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Фоновая запись снимков кадров и битовых сеток на диск.
+// submitFrame()/submitGrid() только ставят задание в очередь и сразу
+// возвращаются: кадр передаётся ссылкой FrameHandle (копирование при записи
+// защищает снимок от изменений), сетка - перемещением. Кодирование JPEG/PNG,
+// сжатие BitGrid и запись выполняют потоки записи, забирая задания пачками.
+// Файл пишется одним fwrite во временный "*.part" и переименовывается,
+// поэтому недописанный файл не виден под итоговым именем.
+// Очередь ограничена числом заданий и объёмом несжатых данных: при
+// переполнении задание отклоняется (вызывающий поток никогда не ждёт),
+// отказы и глубина очереди видны в stats().
+class SnapshotWriter {
+public:
+    struct Options {
+        int threads = 2;
+        int maxPending = 16;                    // Заданий в очереди и в работе
+        size_t maxPendingBytes = 256u << 20;    // Несжатых данных в очереди
+        int batchSize = 4;                      // Заданий, забираемых потоком за раз
+        int jpegQuality = 95;
+        std::string directory;                  // Каталог файлов (пусто - текущий)
+    };
+
+    struct Stats {
+        uint64_t submitted = 0;
+        uint64_t written = 0;
+        uint64_t rejected = 0;      // Отклонено из-за переполнения очереди
+        uint64_t failed = 0;        // Ошибки кодирования или записи
+        uint64_t bytesWritten = 0;
+        int pending = 0;
+        int peakPending = 0;
+        size_t pendingBytes = 0;
+        double encodeMs = 0.0;      // Суммарное время кодирования и сжатия
+        double writeMs = 0.0;       // Суммарное время записи файлов
+    };
+
+    explicit SnapshotWriter(const Options& options);
+    ~SnapshotWriter();
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    void start();
+    // Дописывает задания из очереди и останавливает потоки
+    void stop();
+
+    // Имя файла задания или пустая строка, если очередь переполнена
+    std::string submitFrame(const FrameHandle& frame, const std::string& prefix,
+        const std::string& extension = ".jpg");
+    std::string submitGrid(BitGrid grid, const std::string& prefix, CompressionMethod method);
+
+    Stats stats() const;
+
+    // Уникальное имя: prefix_ГГГГММДД_ЧЧММСС_мсек_номер.ext
+    std::string uniqueName(const std::string& prefix, const std::string& extension);
+    // То же с заданным каталогом и номером (для других писателей файлов)
+    static std::string timestampedName(const std::string& directory, const std::string& prefix,
+        unsigned sequence, const std::string& extension);
+
+private:
+    struct Job {
+        std::string path;
+        std::string extension;
+        FrameHandle frame;
+        BitGrid grid;
+        bool isGrid = false;
+        CompressionMethod method = COMPRESSION_RLE;
+        size_t bytes = 0;
+    };
+
+    Options m_options;
+    std::vector<std::thread> m_threads;
+    std::atomic<uint32_t> m_sequence{ 0 };
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<Job> m_queue;
+    bool m_stop = false;
+    Stats m_stats;
+
+    bool enqueue(Job& job);
+    void workerLoop();
+    bool writeJob(const Job& job, std::vector<uchar>& encoded, double& encodeMs, double& writeMs);
+};
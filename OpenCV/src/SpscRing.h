@@ -0,0 +1,84 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Ограниченный кольцевой буфер без блокировок для одного писателя и одного читателя.
+// Ёмкость округляется до степени двойки. Индексы head/tail разнесены по разным
+// кэш-линиям, каждый поток кэширует чужой индекс и перечитывает его только
+// когда буфер кажется полным (пустым).
+template <class T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity = 4) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_slots.resize(size);
+        m_mask = size - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const { return m_slots.size(); }
+
+    // Только писатель
+    bool tryPush(T&& value) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_headCache == m_slots.size()) {
+            m_headCache = m_head.load(std::memory_order_acquire);
+            if (tail - m_headCache == m_slots.size()) {
+                return false;
+            }
+        }
+        m_slots[tail & m_mask] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Только читатель
+    bool tryPop(T& value) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tailCache) {
+            m_tailCache = m_tail.load(std::memory_order_acquire);
+            if (head == m_tailCache) {
+                return false;
+            }
+        }
+        value = std::move(m_slots[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Только читатель: первый элемент без извлечения (nullptr, если пусто)
+    T* front() {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tailCache) {
+            m_tailCache = m_tail.load(std::memory_order_acquire);
+            if (head == m_tailCache) {
+                return nullptr;
+            }
+        }
+        return &m_slots[head & m_mask];
+    }
+
+    // Приблизительный размер (точный только для вызывающего потока)
+    size_t size() const {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+private:
+    static const size_t kCacheLine = 64;
+
+    std::vector<T> m_slots;
+    size_t m_mask = 0;
+
+    alignas(kCacheLine) std::atomic<size_t> m_head{ 0 };
+    size_t m_tailCache = 0;
+    alignas(kCacheLine) std::atomic<size_t> m_tail{ 0 };
+    size_t m_headCache = 0;
+};
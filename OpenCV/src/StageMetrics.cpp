@@ -0,0 +1,391 @@
+﻿#include "StageMetrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+int highestBit(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+// Процентили, выводимые во все форматы
+const double kQuantiles[] = { 0.5, 0.95, 0.99 };
+
+// Запись через временный файл и переименование
+template <class Writer>
+void replaceFile(const std::string& path, Writer writer) {
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::trunc);
+        if (!out) {
+            return;
+        }
+        out << std::fixed << std::setprecision(4);
+        writer(out);
+    }
+#if defined(_WIN32)
+    // rename() в Windows не заменяет существующий файл
+    std::remove(path.c_str());
+#endif
+    std::rename(temp.c_str(), path.c_str());
+}
+}
+
+LatencyHistogram::LatencyHistogram() {
+    for (auto& count : m_counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+int LatencyHistogram::bucketIndex(uint64_t ns) {
+    if (ns < static_cast<uint64_t>(kSubBuckets)) {
+        return static_cast<int>(ns);
+    }
+    int exponent = std::min(highestBit(ns), static_cast<int>(kMaxExponent));
+    if (exponent == kMaxExponent && (ns >> kMaxExponent) > 1) {
+        return kBucketCount - 1;
+    }
+    // Старшие kSubBits бит после ведущей единицы - номер подынтервала
+    int sub = static_cast<int>((ns >> (exponent - kSubBits)) & (kSubBuckets - 1));
+    return (exponent - kSubBits + 1) * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::bucketValue(int index) {
+    if (index < kSubBuckets) {
+        return static_cast<uint64_t>(index);
+    }
+    int exponent = index / kSubBuckets + kSubBits - 1;
+    int sub = index % kSubBuckets;
+    uint64_t width = uint64_t(1) << (exponent - kSubBits);
+    return (static_cast<uint64_t>(kSubBuckets + sub) << (exponent - kSubBits)) + width / 2;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    m_counts[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    m_sumNs.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t current = m_maxNs.load(std::memory_order_relaxed);
+    while (ns > current && !m_maxNs.compare_exchange_weak(current, ns, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    // Счётчики читаются не атомарно все вместе: запись, сделанная во время
+    // снимка, может попасть в интервалы, но ещё не в сумму (и наоборот)
+    Snapshot snapshot;
+    snapshot.counts.resize(kBucketCount);
+    uint64_t total = 0;
+    for (int i = 0; i < kBucketCount; ++i) {
+        snapshot.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+        total += snapshot.counts[i];
+    }
+    snapshot.count = total;
+    snapshot.sumNs = m_sumNs.load(std::memory_order_relaxed);
+    snapshot.maxNs = m_maxNs.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+double LatencyHistogram::Snapshot::percentileMs(double p) const {
+    if (count == 0) {
+        return 0.0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::ceil(p * count));
+    rank = std::max<uint64_t>(1, std::min(rank, count));
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            // Середина интервала не больше фактического максимума
+            return std::min(bucketValue(static_cast<int>(i)), maxNs) * 1e-6;
+        }
+    }
+    return maxMs();
+}
+
+double LatencyHistogram::Snapshot::meanMs() const {
+    return count > 0 ? sumNs * 1e-6 / count : 0.0;
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::Snapshot::since(const Snapshot& earlier) const {
+    Snapshot delta;
+    delta.counts.resize(counts.size());
+    for (size_t i = 0; i < counts.size(); ++i) {
+        uint64_t before = i < earlier.counts.size() ? earlier.counts[i] : 0;
+        delta.counts[i] = counts[i] - std::min(before, counts[i]);
+        delta.count += delta.counts[i];
+    }
+    delta.sumNs = sumNs - std::min(earlier.sumNs, sumNs);
+
+    if (maxNs > earlier.maxNs) {
+        delta.maxNs = maxNs;
+    }
+    else {
+        // Общий максимум был раньше - берётся верхний непустой интервал
+        for (size_t i = delta.counts.size(); i-- > 0;) {
+            if (delta.counts[i] > 0) {
+                delta.maxNs = std::min(bucketValue(static_cast<int>(i)), maxNs);
+                break;
+            }
+        }
+    }
+    return delta;
+}
+
+
+
+StageMetrics& StageMetrics::instance() {
+    static StageMetrics metrics;
+    return metrics;
+}
+
+StageMetrics::Report StageMetrics::snapshot() const {
+    Report report;
+    report.reserve(METRIC_STAGE_COUNT);
+    for (const LatencyHistogram& histogram : m_histograms) {
+        report.push_back(histogram.snapshot());
+    }
+    return report;
+}
+
+StageMetrics::Counters StageMetrics::counters() const {
+    Counters counters;
+    counters.reserve(COUNTER_COUNT);
+    for (const std::atomic<uint64_t>& counter : m_counters) {
+        counters.push_back(counter.load(std::memory_order_relaxed));
+    }
+    return counters;
+}
+
+StageMetrics::Report StageMetrics::since(const Report& current, const Report& earlier) {
+    Report window;
+    window.reserve(current.size());
+    for (size_t i = 0; i < current.size(); ++i) {
+        window.push_back(i < earlier.size() ? current[i].since(earlier[i]) : current[i]);
+    }
+    return window;
+}
+
+const char* StageMetrics::stageName(MetricStage stage) {
+    switch (stage) {
+    case METRIC_CAPTURE: return "capture";
+    case METRIC_COLOR: return "color";
+    case METRIC_BLUR: return "blur";
+    case METRIC_CANNY: return "canny";
+    case METRIC_MORPHOLOGY: return "morphology";
+    case METRIC_FLOODFILL: return "floodfill";
+    case METRIC_PACK: return "pack";
+    case METRIC_COMPRESS: return "compress";
+    case METRIC_DECOMPRESS: return "decompress";
+    case METRIC_HUD: return "hud";
+    case METRIC_DISPLAY: return "display";
+    case METRIC_ENCODE: return "encode";
+    case METRIC_WRITE: return "write";
+    case METRIC_DNN_PREPROCESS: return "dnn_pre";
+    case METRIC_DNN_INFERENCE: return "dnn_infer";
+    case METRIC_DNN_POSTPROCESS: return "dnn_post";
+    case METRIC_DNN_LATENCY: return "dnn_latency";
+    case METRIC_DNN_STALENESS: return "dnn_stale";
+    case METRIC_DNN_GATE: return "dnn_gate";
+    default: return "unknown";
+    }
+}
+
+const char* StageMetrics::counterName(MetricCounter counter) {
+    switch (counter) {
+    case COUNTER_GATE_ACTIVITY: return "gate_activity";
+    case COUNTER_GATE_INTERVAL: return "gate_interval";
+    case COUNTER_GATE_SKIP: return "gate_skip";
+    default: return "unknown";
+    }
+}
+
+
+
+uint64_t ScopedStageTimer::stop() {
+    if (!m_metrics && !m_trace) {
+        return 0;
+    }
+    uint64_t elapsed = StageMetrics::nowNs() - m_start;
+    if (m_metrics) {
+        StageMetrics::instance().record(m_stage, elapsed - std::min(m_excluded, elapsed));
+    }
+    if (m_trace) {
+        // На шкале вложенные стадии видны внутри интервала, время не вычитается
+        FrameTracer::instance().record(StageMetrics::stageName(m_stage), m_start, elapsed);
+    }
+    m_metrics = m_trace = false;
+    return elapsed;
+}
+
+
+
+MetricsExporter::MetricsExporter(const std::string& path, int intervalMs)
+    : m_path(path), m_intervalMs(std::max(100, intervalMs)), m_format(formatFor(path)) {
+}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+MetricsFormat MetricsExporter::formatFor(const std::string& path) {
+    auto endsWith = [&path](const char* suffix) {
+        std::string tail(suffix);
+        return path.size() >= tail.size() && path.compare(path.size() - tail.size(), tail.size(), tail) == 0;
+    };
+    if (endsWith(".csv")) return METRICS_CSV;
+    if (endsWith(".prom")) return METRICS_PROMETHEUS;
+    return METRICS_JSON;
+}
+
+void MetricsExporter::start() {
+    stop();
+    StageMetrics::instance().setEnabled(true);
+    m_stop = false;
+    m_startNs = StageMetrics::nowNs();
+    m_previous = StageMetrics::instance().snapshot();
+    m_previousCounters = StageMetrics::instance().counters();
+    m_thread = std::thread(&MetricsExporter::loop, this);
+}
+
+void MetricsExporter::stop() {
+    if (!m_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+    dump();
+}
+
+void MetricsExporter::loop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_wake.wait_for(lock, std::chrono::milliseconds(m_intervalMs), [this] { return m_stop; })) {
+        lock.unlock();
+        dump();
+        lock.lock();
+    }
+}
+
+void MetricsExporter::dump() {
+    StageMetrics::Report total = StageMetrics::instance().snapshot();
+    StageMetrics::Report window = StageMetrics::since(total, m_previous);
+    m_previous = total;
+    StageMetrics::Counters counters = StageMetrics::instance().counters();
+    StageMetrics::Counters windowCounters = counters;
+    for (size_t i = 0; i < windowCounters.size() && i < m_previousCounters.size(); ++i) {
+        windowCounters[i] -= m_previousCounters[i];
+    }
+    m_previousCounters = counters;
+    double uptime = (StageMetrics::nowNs() - m_startNs) * 1e-9;
+
+    switch (m_format) {
+    case METRICS_CSV: {
+        std::ofstream out(m_path, m_csvHeaderWritten ? std::ios::app : std::ios::trunc);
+        if (out) {
+            out << std::fixed << std::setprecision(4);
+            if (!m_csvHeaderWritten) {
+                out << "time_s,stage,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+                m_csvHeaderWritten = true;
+            }
+            writeCsvRows(out, window, windowCounters, uptime);
+        }
+        break;
+    }
+    case METRICS_PROMETHEUS:
+        replaceFile(m_path, [&](std::ostream& out) { writePrometheus(out, total, counters); });
+        break;
+    default:
+        replaceFile(m_path, [&](std::ostream& out) { writeJson(out, window, total, counters, uptime); });
+        break;
+    }
+}
+
+void MetricsExporter::writeJson(std::ostream& out, const StageMetrics::Report& window,
+    const StageMetrics::Report& total, const StageMetrics::Counters& counters, double uptimeSeconds) {
+    auto writeReport = [&out](const StageMetrics::Report& report) {
+        out << "{";
+        for (size_t i = 0; i < report.size(); ++i) {
+            const LatencyHistogram::Snapshot& stage = report[i];
+            out << (i ? "," : "") << "\n    \"" << StageMetrics::stageName(static_cast<MetricStage>(i))
+                << "\": {\"count\": " << stage.count << ", \"mean_ms\": " << stage.meanMs()
+                << ", \"p50_ms\": " << stage.percentileMs(0.5) << ", \"p95_ms\": " << stage.percentileMs(0.95)
+                << ", \"p99_ms\": " << stage.percentileMs(0.99) << ", \"max_ms\": " << stage.maxMs() << "}";
+        }
+        out << "\n  }";
+    };
+
+    out << "{\n  \"uptime_s\": " << uptimeSeconds << ",\n  \"window\": ";
+    writeReport(window);
+    out << ",\n  \"total\": ";
+    writeReport(total);
+    out << ",\n  \"counters\": {";
+    for (size_t i = 0; i < counters.size(); ++i) {
+        out << (i ? ", " : "") << "\"" << StageMetrics::counterName(static_cast<MetricCounter>(i)) << "\": " << counters[i];
+    }
+    out << "}\n}\n";
+}
+
+void MetricsExporter::writeCsvRows(std::ostream& out, const StageMetrics::Report& window,
+    const StageMetrics::Counters& counters, double uptimeSeconds) {
+    for (size_t i = 0; i < window.size(); ++i) {
+        const LatencyHistogram::Snapshot& stage = window[i];
+        if (stage.count == 0) {
+            continue;
+        }
+        out << uptimeSeconds << "," << StageMetrics::stageName(static_cast<MetricStage>(i)) << ","
+            << stage.count << "," << stage.meanMs() << "," << stage.percentileMs(0.5) << ","
+            << stage.percentileMs(0.95) << "," << stage.percentileMs(0.99) << "," << stage.maxMs() << "\n";
+    }
+    for (size_t i = 0; i < counters.size(); ++i) {
+        if (counters[i] == 0) {
+            continue;
+        }
+        out << uptimeSeconds << "," << StageMetrics::counterName(static_cast<MetricCounter>(i)) << ","
+            << counters[i] << ",,,,,\n";
+    }
+}
+
+void MetricsExporter::writePrometheus(std::ostream& out, const StageMetrics::Report& total,
+    const StageMetrics::Counters& counters) {
+    out << "# HELP edge_stage_latency_seconds Per-stage processing latency.\n";
+    out << "# TYPE edge_stage_latency_seconds summary\n";
+    out << std::setprecision(9);
+    for (size_t i = 0; i < total.size(); ++i) {
+        const LatencyHistogram::Snapshot& stage = total[i];
+        const char* name = StageMetrics::stageName(static_cast<MetricStage>(i));
+        for (double q : kQuantiles) {
+            out << "edge_stage_latency_seconds{stage=\"" << name << "\",quantile=\"" << q << "\"} "
+                << stage.percentileMs(q) * 1e-3 << "\n";
+        }
+        out << "edge_stage_latency_seconds_sum{stage=\"" << name << "\"} " << stage.sumNs * 1e-9 << "\n";
+        out << "edge_stage_latency_seconds_count{stage=\"" << name << "\"} " << stage.count << "\n";
+    }
+    out << "# HELP edge_stage_latency_max_seconds Maximum per-stage latency since start.\n";
+    out << "# TYPE edge_stage_latency_max_seconds gauge\n";
+    for (size_t i = 0; i < total.size(); ++i) {
+        out << "edge_stage_latency_max_seconds{stage=\"" << StageMetrics::stageName(static_cast<MetricStage>(i))
+            << "\"} " << total[i].maxNs * 1e-9 << "\n";
+    }
+    out << "# HELP edge_events_total Event counters (detection gate decisions).\n";
+    out << "# TYPE edge_events_total counter\n";
+    for (size_t i = 0; i < counters.size(); ++i) {
+        out << "edge_events_total{event=\"" << StageMetrics::counterName(static_cast<MetricCounter>(i))
+            << "\"} " << counters[i] << "\n";
+    }
+}
@@ -0,0 +1,203 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FrameTracer.h"
+
+// Измеряемые стадии обработки кадра
+enum MetricStage {
+    METRIC_CAPTURE = 0,     // Чтение кадра источником (без ожидания темпа)
+    METRIC_COLOR = 1,       // BGR -> серый
+    METRIC_BLUR = 2,        // Размытие (в SIMD-фронтенде - серый + размытие + Собель)
+    METRIC_CANNY = 3,
+    METRIC_MORPHOLOGY = 4,  // Дилатация, закрытие, эрозия и вычитание
+    METRIC_FLOODFILL = 5,
+    METRIC_PACK = 6,        // Упаковка карты в BitGrid
+    METRIC_COMPRESS = 7,
+    METRIC_DECOMPRESS = 8,
+    METRIC_HUD = 9,         // Текст и подсказки поверх кадра
+    METRIC_DISPLAY = 10,    // Вывод кадра приёмником
+    METRIC_ENCODE = 11,     // Кодирование снимка в потоке записи
+    METRIC_WRITE = 12,      // Запись файла снимка
+    METRIC_DNN_PREPROCESS = 13,     // Letterbox и блоб входа сети
+    METRIC_DNN_INFERENCE = 14,      // Прямой проход сети
+    METRIC_DNN_POSTPROCESS = 15,    // Разбор выхода и NMS
+    METRIC_DNN_LATENCY = 16,        // Захват кадра -> готовые рамки (асинхронная детекция)
+    METRIC_DNN_STALENESS = 17,      // Возраст показанных рамок: кадр детекции -> показанный кадр
+    METRIC_DNN_GATE = 18,           // Сравнение сетки границ с сеткой последней детекции
+    METRIC_STAGE_COUNT = 19
+};
+
+// Счётчики событий (выгружаются вместе с гистограммами)
+enum MetricCounter {
+    COUNTER_GATE_ACTIVITY = 0,  // Детекция запущена: изменилось достаточно тайлов сетки границ
+    COUNTER_GATE_INTERVAL = 1,  // Детекция запущена: истёк наибольший интервал
+    COUNTER_GATE_SKIP = 2,      // Детекция пропущена, рамки прошлой детекции
+    COUNTER_COUNT = 3
+};
+
+// Гистограмма задержек в стиле HDR: логарифмические интервалы по степеням
+// двойки, каждый разбит на 32 линейных подынтервала (погрешность ~3%).
+// Диапазон от 1 нс до ~70 минут, запись - несколько атомарных инкрементов
+// без блокировок, писать можно из любого числа потоков.
+class LatencyHistogram {
+public:
+    static const int kSubBits = 5;
+    static const int kSubBuckets = 1 << kSubBits;
+    static const int kMaxExponent = 41;
+    static const int kBucketCount = (kMaxExponent - kSubBits + 2) * kSubBuckets;
+
+    // Копия счётчиков на момент снимка
+    struct Snapshot {
+        std::vector<uint64_t> counts;
+        uint64_t count = 0;
+        uint64_t sumNs = 0;
+        uint64_t maxNs = 0;
+
+        // Процентиль p в [0, 1], миллисекунды
+        double percentileMs(double p) const;
+        double meanMs() const;
+        double maxMs() const { return maxNs * 1e-6; }
+
+        // Разность двух снимков - задержки за интервал между ними.
+        // Максимум интервала известен с точностью до интервала гистограммы
+        Snapshot since(const Snapshot& earlier) const;
+    };
+
+    LatencyHistogram();
+
+    void record(uint64_t ns);
+    Snapshot snapshot() const;
+
+    static int bucketIndex(uint64_t ns);
+    // Середина интервала
+    static uint64_t bucketValue(int index);
+
+private:
+    std::atomic<uint64_t> m_counts[kBucketCount];
+    std::atomic<uint64_t> m_sumNs{ 0 };
+    std::atomic<uint64_t> m_maxNs{ 0 };
+};
+
+// Гистограммы всех стадий. Выключенный сбор стоит одной проверки флага
+class StageMetrics {
+public:
+    using Report = std::vector<LatencyHistogram::Snapshot>;
+    using Counters = std::vector<uint64_t>;
+
+    static StageMetrics& instance();
+
+    void setEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    void record(MetricStage stage, uint64_t ns) { m_histograms[stage].record(ns); }
+    // Снимки всех стадий в порядке MetricStage
+    Report snapshot() const;
+    static Report since(const Report& current, const Report& earlier);
+
+    void count(MetricCounter counter, uint64_t n = 1) { m_counters[counter].fetch_add(n, std::memory_order_relaxed); }
+    // Значения счётчиков в порядке MetricCounter
+    Counters counters() const;
+
+    static const char* stageName(MetricStage stage);
+    static const char* counterName(MetricCounter counter);
+    static uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    StageMetrics() = default;
+
+    std::atomic<bool> m_enabled{ false };
+    LatencyHistogram m_histograms[METRIC_STAGE_COUNT];
+    std::atomic<uint64_t> m_counters[COUNTER_COUNT] = {};
+};
+
+// Замер области видимости: в гистограмму стадии и (при записи трассы) на
+// временную шкалу FrameTracer. Флаги читаются один раз при создании
+class ScopedStageTimer {
+public:
+    explicit ScopedStageTimer(MetricStage stage)
+        : m_stage(stage), m_metrics(StageMetrics::instance().enabled()),
+        m_trace(FrameTracer::instance().enabled()) {
+        if (m_metrics || m_trace) {
+            m_start = StageMetrics::nowNs();
+        }
+    }
+    ~ScopedStageTimer() { stop(); }
+
+    ScopedStageTimer(const ScopedStageTimer&) = delete;
+    ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+
+    // Завершить замер раньше конца области, возвращает длительность
+    uint64_t stop();
+    // Не учитывать время вложенной стадии, измеренной отдельно
+    void exclude(uint64_t ns) { m_excluded += ns; }
+
+private:
+    MetricStage m_stage;
+    bool m_metrics;
+    bool m_trace;
+    uint64_t m_start = 0;
+    uint64_t m_excluded = 0;
+};
+
+// Формат выгрузки определяется расширением файла
+enum MetricsFormat {
+    METRICS_JSON = 0,       // .json - последний интервал и накопленные значения (перезапись)
+    METRICS_CSV = 1,        // .csv  - строка на стадию за каждый интервал (дозапись)
+    METRICS_PROMETHEUS = 2  // .prom - текстовый формат Prometheus (textfile collector)
+};
+
+// Периодическая выгрузка снимков гистограмм в файл из фонового потока.
+// JSON и .prom пишутся во временный файл и переименовываются, поэтому
+// читатель никогда не видит файл наполовину
+class MetricsExporter {
+public:
+    MetricsExporter(const std::string& path, int intervalMs);
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    void start();
+    // Останавливает поток и выгружает последний интервал
+    void stop();
+
+    MetricsFormat format() const { return m_format; }
+    static MetricsFormat formatFor(const std::string& path);
+
+    static void writeJson(std::ostream& out, const StageMetrics::Report& window,
+        const StageMetrics::Report& total, const StageMetrics::Counters& counters, double uptimeSeconds);
+    // Счётчики - строки с числом событий за интервал в поле count
+    static void writeCsvRows(std::ostream& out, const StageMetrics::Report& window,
+        const StageMetrics::Counters& counters, double uptimeSeconds);
+    static void writePrometheus(std::ostream& out, const StageMetrics::Report& total,
+        const StageMetrics::Counters& counters);
+
+private:
+    std::string m_path;
+    int m_intervalMs;
+    MetricsFormat m_format;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+
+    StageMetrics::Report m_previous;
+    StageMetrics::Counters m_previousCounters;
+    uint64_t m_startNs = 0;
+    bool m_csvHeaderWritten = false;
+
+    void loop();
+    void dump();
+};
@@ -0,0 +1,245 @@
+﻿#include "StreamScheduler.h"
+#include "FrameTracer.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+// Ожидание при полной очереди потока (DROP_BLOCK)
+void idle() {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+void updateMax(std::atomic<uint64_t>& target, uint64_t value) {
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+WorkStealingPool::Options poolOptions(const StreamScheduler::Options& options) {
+    WorkStealingPool::Options pool;
+    pool.threads = options.threads;
+    pool.pinThreads = options.pinThreads;
+    return pool;
+}
+}
+
+StreamScheduler::StreamScheduler(const Options& options)
+    : m_options(options), m_pool(poolOptions(options)) {
+    m_options.framesPerJob = std::max(1, m_options.framesPerJob);
+    m_options.queueCapacity = std::max<size_t>(1, m_options.queueCapacity);
+}
+
+StreamScheduler::~StreamScheduler() {
+    stop();
+}
+
+int StreamScheduler::addStream(std::unique_ptr<FrameSource> source, const std::string& name) {
+    std::unique_ptr<Stream> stream(new Stream(m_options.queueCapacity));
+    stream->name = name;
+    stream->source = std::move(source);
+    m_streams.push_back(std::move(stream));
+    return streamCount() - 1;
+}
+
+void StreamScheduler::start(ProcessFn process) {
+    stop();
+
+    m_process = std::move(process);
+    m_stop = false;
+    m_running = true;
+    m_startTicks = cv::getTickCount();
+
+    if (m_options.opencvThreads >= 0) {
+        m_savedOpencvThreads = cv::getNumThreads();
+        cv::setNumThreads(m_options.opencvThreads);
+    }
+
+    m_pool.start();
+    for (auto& stream : m_streams) {
+        // Кадры, оставшиеся от прошлого запуска, отбрасываются
+        FramePacket stale;
+        while (stream->queue.tryPop(stale)) {
+        }
+        stream->pending = 0;
+        stream->captureDone = false;
+    }
+    for (int i = 0; i < streamCount(); ++i) {
+        m_streams[i]->captureThread = std::thread(&StreamScheduler::captureLoop, this, i);
+    }
+}
+
+void StreamScheduler::stop() {
+    if (!m_running) {
+        return;
+    }
+    m_stop = true;
+    for (auto& stream : m_streams) {
+        if (stream->captureThread.joinable()) {
+            stream->captureThread.join();
+        }
+    }
+    // Выполняющиеся задания дорабатывают текущий кадр, остальные отбрасываются
+    m_pool.stop();
+    m_running = false;
+
+    if (m_savedOpencvThreads >= 0) {
+        cv::setNumThreads(m_savedOpencvThreads);
+        m_savedOpencvThreads = -1;
+    }
+}
+
+bool StreamScheduler::finished() const {
+    for (const auto& stream : m_streams) {
+        if (!stream->captureDone || stream->pending > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+StreamScheduler::Stats StreamScheduler::stats() const {
+    Stats stats;
+    StreamStats& total = stats.total;
+    total.name = "total";
+    total.finished = true;
+
+    for (const auto& stream : m_streams) {
+        StreamStats current;
+        current.name = stream->name;
+        current.captured = stream->captured;
+        current.processed = stream->processed;
+        current.droppedQueue = stream->droppedQueue;
+        current.droppedDeadline = stream->droppedDeadline;
+        current.missedDeadline = stream->missedDeadline;
+        current.latencySumMs = stream->latencySumUs * 1e-3;
+        current.latencyMaxMs = stream->latencyMaxUs * 1e-3;
+        current.processSumMs = stream->processSumUs * 1e-3;
+        current.finished = stream->captureDone && stream->pending <= 0;
+
+        total.captured += current.captured;
+        total.processed += current.processed;
+        total.droppedQueue += current.droppedQueue;
+        total.droppedDeadline += current.droppedDeadline;
+        total.missedDeadline += current.missedDeadline;
+        total.latencySumMs += current.latencySumMs;
+        total.latencyMaxMs = std::max(total.latencyMaxMs, current.latencyMaxMs);
+        total.processSumMs += current.processSumMs;
+        total.finished = total.finished && current.finished;
+        stats.streams.push_back(current);
+    }
+
+    stats.pool = m_pool.stats();
+    if (m_startTicks != 0) {
+        stats.seconds = (cv::getTickCount() - m_startTicks) / cv::getTickFrequency();
+    }
+    return stats;
+}
+
+
+
+void StreamScheduler::captureLoop(int index) {
+    Stream& stream = *m_streams[index];
+    FrameTracer::setThreadName("capture " + stream.name);
+    uint64_t nextId = 0;
+    cv::Size frameSize;
+    int frameType = 0;
+
+    while (!m_stop) {
+        FramePacket packet;
+        cv::Mat target;
+        if (frameSize.area() > 0) {
+            packet.frame = stream.pool.acquire(frameSize, frameType);
+            target = packet.frame.writable();
+        }
+        if (!stream.source->read(target)) {
+            break;
+        }
+
+        // Первый кадр или смена разрешения: источник выделил свой буфер
+        if (target.data != packet.frame.data()) {
+            frameSize = target.size();
+            frameType = target.type();
+            packet.frame = stream.pool.copyOf(target);
+        }
+
+        packet.id = nextId++;
+        packet.captureTicks = cv::getTickCount();
+        ++stream.captured;
+
+        bool pushed = stream.queue.tryPush(std::move(packet));
+        if (m_options.queuePolicy == DROP_BLOCK) {
+            while (!pushed && !m_stop) {
+                idle();
+                pushed = stream.queue.tryPush(std::move(packet));
+            }
+        }
+        else if (!pushed) {
+            ++stream.droppedQueue;
+        }
+        if (pushed && stream.pending.fetch_add(1) == 0) {
+            schedule(index);
+        }
+    }
+
+    stream.captureDone = true;
+}
+
+void StreamScheduler::schedule(int index) {
+    m_pool.submit([this, index] { runJob(index); });
+}
+
+void StreamScheduler::runJob(int index) {
+    Stream& stream = *m_streams[index];
+    const double tickUs = 1e6 / cv::getTickFrequency();
+    const double deadlineUs = m_options.deadlineMs * 1e3;
+
+    FramePacket packet;
+    int budget = m_options.framesPerJob;
+    int consumed = 0;
+    while (budget > 0 && !m_stop && stream.queue.tryPop(packet)) {
+        ++consumed;
+        // Устаревшие кадры пропускаются, остаётся самый свежий
+        if (m_options.queuePolicy == DROP_LATEST_ONLY) {
+            while (stream.queue.tryPop(packet)) {
+                ++consumed;
+                ++stream.droppedQueue;
+            }
+        }
+
+        int64 startTicks = cv::getTickCount();
+        if (deadlineUs > 0.0 && (startTicks - packet.captureTicks) * tickUs > deadlineUs) {
+            ++stream.droppedDeadline;
+            continue;
+        }
+
+        FrameTracer::setCurrentFrame(packet.id);
+        {
+            TraceScope trace("process");
+            m_process(index, packet);
+        }
+        int64 endTicks = cv::getTickCount();
+
+        uint64_t latencyUs = static_cast<uint64_t>((endTicks - packet.captureTicks) * tickUs);
+        stream.latencySumUs += latencyUs;
+        updateMax(stream.latencyMaxUs, latencyUs);
+        stream.processSumUs += static_cast<uint64_t>((endTicks - startTicks) * tickUs);
+        if (deadlineUs > 0.0 && latencyUs > deadlineUs) {
+            ++stream.missedDeadline;
+        }
+        ++stream.processed;
+
+        // Буферы кадра возвращаются в пул до следующего кадра
+        packet = FramePacket();
+        --budget;
+    }
+
+    if (m_stop) {
+        return;
+    }
+    // Кадры остались (или пришли во время обработки): задание встаёт в конец
+    // очереди пула за другими потоками. Счётчик может уйти в минус, если кадр
+    // извлечён раньше, чем захват его учёл, - тогда захват не ставит задание
+    if (stream.pending.fetch_sub(consumed) - consumed > 0) {
+        schedule(index);
+    }
+}
@@ -0,0 +1,123 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FramePipeline.h"
+#include "FramePool.h"
+#include "FrameSource.h"
+#include "SpscRing.h"
+#include "WorkStealingPool.h"
+
+// Обработка многих потоков (камер, файлов) в одном процессе на общем пуле.
+// У каждого потока свой источник, свой поток захвата (он почти всё время ждёт
+// камеру или темп файла), своя очередь кадров и свой пул буферов. Обработка
+// кадра - задание общего WorkStealingPool; у потока не больше одного задания
+// в работе, поэтому его состояние (детекторы) используется без блокировок и
+// кадры обрабатываются по порядку. Задание обрабатывает до framesPerJob кадров
+// и встаёт в конец очереди, если кадры остались: при framesPerJob = 1 потоки
+// обслуживаются по кругу и частый поток не вытесняет остальные.
+// Кадр, прождавший в очереди дольше deadlineMs, пропускается без обработки;
+// кадр, обработанный позже срока, учитывается в missedDeadline.
+// Внутренние потоки OpenCV на время работы ограничиваются opencvThreads:
+// параллелизм даёт пул, а вложенный parallel_for_ в каждом задании только
+// перегружал бы ядра.
+class StreamScheduler {
+public:
+    // Обработка кадра потока stream (поток пула, по одному заданию на поток)
+    using ProcessFn = std::function<void(int stream, FramePacket& packet)>;
+
+    struct Options {
+        int threads = 0;                        // Потоков пула, 0 - по числу ядер
+        bool pinThreads = false;                // Привязать потоки пула к ядрам
+        int opencvThreads = 1;                  // cv::setNumThreads на время работы (<0 - не менять)
+        int framesPerJob = 1;                   // Кадров потока за одно задание (справедливость)
+        double deadlineMs = 0.0;                // Допустимая задержка захват -> обработка, 0 - без срока
+        size_t queueCapacity = 2;               // Кадров в очереди потока
+        DropPolicy queuePolicy = DROP_LATEST_ONLY;
+    };
+
+    struct StreamStats {
+        std::string name;
+        uint64_t captured = 0;
+        uint64_t processed = 0;
+        uint64_t droppedQueue = 0;      // Очередь потока переполнена или кадр заменён более свежим
+        uint64_t droppedDeadline = 0;   // Пропущены: срок истёк до начала обработки
+        uint64_t missedDeadline = 0;    // Обработаны позже срока
+        double latencySumMs = 0.0;      // Захват -> конец обработки
+        double latencyMaxMs = 0.0;
+        double processSumMs = 0.0;      // Время обработки в пуле
+        bool finished = false;
+    };
+
+    struct Stats {
+        std::vector<StreamStats> streams;
+        StreamStats total;              // Сумма по потокам (максимум - по всем)
+        WorkStealingPool::Stats pool;
+        double seconds = 0.0;           // С запуска
+    };
+
+    explicit StreamScheduler(const Options& options);
+    ~StreamScheduler();
+
+    StreamScheduler(const StreamScheduler&) = delete;
+    StreamScheduler& operator=(const StreamScheduler&) = delete;
+
+    // Добавить поток до start(); возвращает его номер
+    int addStream(std::unique_ptr<FrameSource> source, const std::string& name);
+
+    void start(ProcessFn process);
+    void stop();
+
+    // Все источники закончились и все кадры обработаны или пропущены
+    bool finished() const;
+
+    int streamCount() const { return static_cast<int>(m_streams.size()); }
+    // Пул буферов потока (для результатов обработки)
+    FramePool& pool(int stream) { return m_streams[stream]->pool; }
+    const Options& options() const { return m_options; }
+    Stats stats() const;
+
+private:
+    struct Stream {
+        explicit Stream(size_t capacity) : queue(capacity) {}
+
+        std::string name;
+        std::unique_ptr<FrameSource> source;
+        // Пул объявлен раньше очереди: кадры в очереди возвращаются в него при уничтожении
+        FramePool pool;
+        SpscRing<FramePacket> queue;
+        std::thread captureThread;
+        // Кадров в очереди, не учтённых заданием; переход 0 -> 1 ставит задание в пул,
+        // задание снимается, когда учитывает последний кадр
+        std::atomic<int> pending{ 0 };
+        std::atomic<bool> captureDone{ false };
+
+        std::atomic<uint64_t> captured{ 0 };
+        std::atomic<uint64_t> processed{ 0 };
+        std::atomic<uint64_t> droppedQueue{ 0 };
+        std::atomic<uint64_t> droppedDeadline{ 0 };
+        std::atomic<uint64_t> missedDeadline{ 0 };
+        std::atomic<uint64_t> latencySumUs{ 0 };
+        std::atomic<uint64_t> latencyMaxUs{ 0 };
+        std::atomic<uint64_t> processSumUs{ 0 };
+    };
+
+    Options m_options;
+    WorkStealingPool m_pool;
+    ProcessFn m_process;
+    std::vector<std::unique_ptr<Stream>> m_streams;
+    std::atomic<bool> m_stop{ false };
+    bool m_running = false;
+    int m_savedOpencvThreads = -1;
+    int64 m_startTicks = 0;
+
+    void captureLoop(int index);
+    void schedule(int index);
+    void runJob(int index);
+};
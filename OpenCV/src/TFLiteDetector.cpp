@@ -1,7 +1,16 @@
 ﻿#include "TFLiteDetector.h"
+#include "ModelCache.h"
+#include "StageMetrics.h"
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
+namespace {
+double elapsedMs(uint64_t startNs, uint64_t endNs) {
+    return (endNs - startNs) * 1e-6;
+}
+}
+
 TFLiteDetector::TFLiteDetector(const std::string& modelPath,
     const std::string& labelsPath,
     int inputWidth, int inputHeight)
@@ -9,71 +18,257 @@ TFLiteDetector::TFLiteDetector(const std::string& modelPath,
     inputWidth_(inputWidth), inputHeight_(inputHeight) {
 }
 
+TFLiteDetector::~TFLiteDetector() {
+    // Интерпретатор ссылается на делегат - освобождается первым
+    interpreter_.reset();
+}
+
 bool TFLiteDetector::initialize() {
-    // 1. Загрузка модели
-    model_ = tflite::FlatBufferModel::BuildFromFile(modelPath_.c_str());
+    // 1. Загрузка модели: плоский буфер читается прямо из отображённого файла
+    modelFile_ = ModelCache::instance().map(modelPath_);
+    if (modelFile_) {
+        model_ = tflite::FlatBufferModel::BuildFromBuffer(modelFile_->data(), modelFile_->size());
+    }
     if (!model_) {
         std::cerr << "❌ Не удалось загрузить модель: " << modelPath_ << std::endl;
         return false;
     }
 
-    // 2. Создание интерпретатора
-    tflite::ops::builtin::BuiltinOpResolver resolver;
-    tflite::InterpreterBuilder(*model_, resolver)(&interpreter_);
+    // 2. Создание интерпретатора без делегатов по умолчанию: XNNPACK ставится
+    // ниже явно, с нашим числом потоков и квантованными ядрами
+    numThreads_ = numThreads_ > 0 ? numThreads_ : std::max(1, cv::getNumberOfCPUs());
+    tflite::ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+    tflite::InterpreterBuilder builder(*model_, resolver);
+    builder.SetNumThreads(numThreads_);
+    builder(&interpreter_);
     if (!interpreter_) {
         std::cerr << "❌ Не удалось создать интерпретатор TFLite." << std::endl;
         return false;
     }
 
-    // 3. (ОПЦИОНАЛЬНО) Настройка GPU делегата для ускорения
-    if (useGPUDelegate_) {
-        // Попробуйте создать и применить GPU Delegate (OpenCL)
-        // Важно: это экспериментальный шаг для AMD
-        // Вам может потребоваться TfLiteGpuDelegateV2Create
-        // delegate_.reset(TfLiteGpuDelegateV2Create(&options));
-        // if (interpreter_->ModifyGraphWithDelegate(delegate_.get()) != kTfLiteOk) {
-        //     std::cerr << "⚠️ GPU делегат не сработал, используется CPU." << std::endl;
-        //     delegate_.reset();
-        // }
+    // 3. Делегат XNNPACK: граф float и int8/uint8 на SIMD-ядрах и своём пуле потоков
+    if (useXnnpack_) {
+        TfLiteXNNPackDelegateOptions options = TfLiteXNNPackDelegateOptionsDefault();
+        options.num_threads = numThreads_;
+        options.flags |= TFLITE_XNNPACK_DELEGATE_FLAG_QS8 | TFLITE_XNNPACK_DELEGATE_FLAG_QU8;
+        delegate_ = std::unique_ptr<TfLiteDelegate, void(*)(TfLiteDelegate*)>(
+            TfLiteXNNPackDelegateCreate(&options), TfLiteXNNPackDelegateDelete);
+        if (!delegate_ || interpreter_->ModifyGraphWithDelegate(delegate_.get()) != kTfLiteOk) {
+            std::cerr << "⚠️ XNNPACK не принял граф, используются встроенные ядра." << std::endl;
+            delegate_.reset();
+        }
     }
 
-    // 4. Выделение памяти для тензоров
+    // 4. Арена тензоров: выделяется один раз, кадры работают в ней без выделений
     if (interpreter_->AllocateTensors() != kTfLiteOk) {
         std::cerr << "❌ Ошибка выделения памяти для тензоров." << std::endl;
         return false;
     }
 
-    // 5. Загрузка меток классов
+    // 5. Предобработка под форму и тип входного тензора, проверка выхода
+    if (!configureInput()) {
+        return false;
+    }
+    const TfLiteTensor* output = interpreter_->output_tensor(0);
+    if (output->type != kTfLiteFloat32 && output->type != kTfLiteUInt8 && output->type != kTfLiteInt8) {
+        std::cerr << "❌ Неподдерживаемый тип выходного тензора: " << TfLiteTypeGetName(output->type) << std::endl;
+        return false;
+    }
+
+    // 6. Загрузка меток классов
     loadLabels(labelsPath_);
+    setClassAllowlist(classAllowlist_);
 
-    std::cout << "✅ TFLite детектор инициализирован." << std::endl;
+    std::cout << "✅ TFLite детектор инициализирован: " << describe() << std::endl;
     return true;
 }
 
-void TFLiteDetector::detectAndDraw(cv::Mat& frame) {
-    cv::Mat processed;
-    preprocess(frame, processed); // Масштабирование, нормализация
+const std::vector<Detection>& TFLiteDetector::detect(const cv::Mat& frame) {
+    detections_.clear();
+    if (!interpreter_ || frame.empty()) {
+        return detections_;
+    }
 
-    // 1. Копирование данных в входной тензор
-    float* inputTensor = interpreter_->typed_input_tensor<float>(0);
-    // Пример для модели с входом [1, height, width, 3]
-    // Необходимо скопировать данные processed.data в inputTensor
-    // Возможно, потребуется преобразование формата (например, BGR -> RGB)
+    // 1. Кадр сразу пишется во входной тензор, без промежуточных Mat
+    uint64_t startNs = StageMetrics::nowNs();
+    if (!preprocess(frame)) {
+        return detections_;
+    }
 
     // 2. Запуск инференса
+    uint64_t inferenceNs = StageMetrics::nowNs();
     if (interpreter_->Invoke() != kTfLiteOk) {
         std::cerr << "❌ Ошибка при выполнении модели." << std::endl;
+        return detections_;
+    }
+
+    // 3. Выход во float и разбор
+    uint64_t postprocessNs = StageMetrics::nowNs();
+    postprocess(outputData());
+    uint64_t endNs = StageMetrics::nowNs();
+
+    timings_.preprocessMs = elapsedMs(startNs, inferenceNs);
+    timings_.inferenceMs = elapsedMs(inferenceNs, postprocessNs);
+    timings_.postprocessMs = elapsedMs(postprocessNs, endNs);
+    return detections_;
+}
+
+void TFLiteDetector::detectAndDraw(cv::Mat& frame) {
+    for (const Detection& detection : detect(frame)) {
+        cv::Rect box(cvRound(detection.box.x), cvRound(detection.box.y),
+            cvRound(detection.box.width), cvRound(detection.box.height));
+        std::string name = detection.classId < static_cast<int>(labels_.size()) ?
+            labels_[detection.classId] : std::to_string(detection.classId);
+        drawBox(box, name + " " + std::to_string(cvRound(detection.confidence * 100.0f)) + "%", frame);
+    }
+}
+
+std::string TFLiteDetector::describe() const {
+    std::string text = modelPath_ + " " + std::to_string(inputWidth_) + "x" + std::to_string(inputHeight_);
+    if (interpreter_) {
+        text += std::string(", ") + TfLiteTypeGetName(interpreter_->tensor(interpreter_->inputs()[0])->type);
+    }
+    return text + ", " + (delegate_ ? "XNNPACK" : "builtin kernels") + ", " + std::to_string(numThreads_) + " thread(s)";
+}
+
+bool TFLiteDetector::configureInput() {
+    const TfLiteTensor* input = interpreter_->tensor(interpreter_->inputs()[0]);
+    // Ожидается [1, H, W, 3]
+    if (!input->dims || input->dims->size != 4 || input->dims->data[3] != 3) {
+        std::cerr << "❌ Неподдерживаемая форма входного тензора." << std::endl;
+        return false;
+    }
+
+    LetterboxPreprocessor::Options options;
+    options.inputSize = cv::Size(input->dims->data[2], input->dims->data[1]);
+    options.layout = TENSOR_NHWC;
+    switch (input->type) {
+    case kTfLiteFloat32:
+        options.type = TENSOR_FLOAT32;
+        break;
+    case kTfLiteUInt8:
+        options.type = TENSOR_UINT8;
+        break;
+    case kTfLiteInt8:
+        options.type = TENSOR_INT8;
+        break;
+    default:
+        std::cerr << "❌ Неподдерживаемый тип входного тензора: " << TfLiteTypeGetName(input->type) << std::endl;
+        return false;
+    }
+    if (options.type != TENSOR_FLOAT32) {
+        options.quantScale = input->params.scale;
+        options.quantZeroPoint = input->params.zero_point;
+    }
+
+    inputWidth_ = options.inputSize.width;
+    inputHeight_ = options.inputSize.height;
+    preprocessor_.reset(new LetterboxPreprocessor(options));
+    return true;
+}
+
+bool TFLiteDetector::preprocess(const cv::Mat& input) {
+    // Масштабирование с сохранением пропорций, поля, BGR -> RGB, нормализация
+    // в [0, 1] и квантование за один проход по кадру
+    TfLiteTensor* tensor = interpreter_->tensor(interpreter_->inputs()[0]);
+    if (!preprocessor_ || !tensor->data.raw || tensor->bytes < preprocessor_->tensorBytes()) {
+        std::cerr << "❌ Входной тензор не подготовлен." << std::endl;
+        return false;
+    }
+    preprocessor_->run(input, tensor->data.raw);
+    return true;
+}
+
+void TFLiteDetector::setClassAllowlist(const std::vector<std::string>& names) {
+    classAllowlist_ = names;
+    if (labels_.empty()) {
+        return;
+    }
+    for (const std::string& name : decoder_.setClassAllowlist(classAllowlist_, labels_)) {
+        std::cerr << "⚠️ Неизвестный класс в списке: " << name << std::endl;
+    }
+}
+
+void TFLiteDetector::setThresholds(float confThreshold, float nmsThreshold) {
+    decoder_.setThresholds(confThreshold, nmsThreshold);
+}
+
+void TFLiteDetector::loadLabels(const std::string& filename) {
+    labels_.clear();
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        labels_.push_back(line);
+    }
+    if (labels_.empty()) {
+        std::cerr << "⚠️ Не удалось загрузить метки: " << filename << std::endl;
+    }
+}
+
+const float* TFLiteDetector::outputData() {
+    const TfLiteTensor* output = interpreter_->output_tensor(0);
+    if (output->type == kTfLiteFloat32) {
+        return output->data.f;
+    }
+    // int8/uint8: (q - zero_point) * scale за один проход в буфер между кадрами
+    cv::Mat quantized(1, static_cast<int>(output->bytes), output->type == kTfLiteUInt8 ? CV_8U : CV_8S,
+        output->data.raw);
+    const double scale = output->params.scale;
+    quantized.convertTo(outputFloat_, CV_32F, scale, -scale * output->params.zero_point);
+    return outputFloat_.ptr<float>();
+}
+
+void TFLiteDetector::postprocess(const float* outputData) {
+    detections_.clear();
+    const TfLiteTensor* output = interpreter_->output_tensor(0);
+    // YOLOv8: [1, 4 + C, N] или [1, N, 4 + C]
+    if (!outputData || !output->dims || output->dims->size != 3) {
+        return;
+    }
+    const int rows = output->dims->data[1];
+    const int cols = output->dims->data[2];
+    const bool channelMajor = rows < cols;
+    const int anchors = channelMajor ? cols : rows;
+    const int classes = (channelMajor ? rows : cols) - 4;
+    if (classes <= 0) {
         return;
     }
 
-    // 3. Получение выходных данных
-    float* outputTensor = interpreter_->typed_output_tensor<float>(0);
-    postprocess(frame, outputTensor);
+    // Экспорт Ultralytics в TFLite нормирует координаты на размер входа
+    if (outputNormalized_ < 0) {
+        float maxCoord = 0.0f;
+        for (int i = 0; i < anchors; ++i) {
+            maxCoord = std::max(maxCoord, channelMajor ? outputData[i] : outputData[static_cast<size_t>(i) * cols]);
+        }
+        outputNormalized_ = maxCoord <= 2.0f ? 1 : 0;
+    }
+    cv::Point2f coordScale(1.0f, 1.0f);
+    if (outputNormalized_) {
+        coordScale = cv::Point2f(static_cast<float>(inputWidth_), static_cast<float>(inputHeight_));
+    }
+
+    const LetterboxGeometry& geometry = preprocessor_->geometry();
+    if (channelMajor) {
+        decoder_.decodeChannelMajor(outputData, classes, anchors, coordScale, geometry, detections_);
+    }
+    else {
+        decoder_.decodeAnchorMajor(outputData, classes, anchors, coordScale, geometry, detections_);
+    }
+    decoder_.nms(detections_);
 }
 
-void TFLiteDetector::preprocess(const cv::Mat& input, cv::Mat& output) {
-    // Преобразование входного кадра под формат модели:
-    // 1. Изменение размера до inputWidth_ x inputHeight_
-    // 2. Нормализация значений пикселей (например, в диапазон [0,1] или [-1,1])
-    // 3. Преобразование цветового пространства (BGR -> RGB)
-}
\ No newline at end of file
+void TFLiteDetector::drawBox(const cv::Rect& box, const std::string& label, cv::Mat& frame) {
+    const cv::Scalar color(0, 255, 0);
+    cv::rectangle(frame, box, color, 2);
+
+    int baseline = 0;
+    cv::Size text = cv::getTextSize(label, cv::FONT_HERSHEY_SIMPLEX, 0.5, 1, &baseline);
+    int top = std::max(box.y, text.height + baseline);
+    cv::rectangle(frame, cv::Point(box.x, top - text.height - baseline),
+        cv::Point(box.x + text.width, top), color, cv::FILLED);
+    cv::putText(frame, label, cv::Point(box.x, top - baseline), cv::FONT_HERSHEY_SIMPLEX, 0.5,
+        cv::Scalar(0, 0, 0), 1);
+}
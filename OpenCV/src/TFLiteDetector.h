@@ -3,27 +3,65 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include "Letterbox.h"
+#include "YoloDecoder.h"
+#include "ModelCache.h"
 
 //    TensorFlow Lite
 #include "tensorflow/lite/interpreter.h"
 #include "tensorflow/lite/model.h"
 #include "tensorflow/lite/kernels/register.h"
+#include "tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h"
 
+//  YOLOv8  TensorFlow Lite  CPU (  WITH_TFLITE).
+//    XNNPACK    ;   (
+//     ) -   TFLite    .
+//  float32   int8/uint8:     
+//     ,    float  .
+//       initialize():   
+//   ,      .
 class TFLiteDetector {
 public:
+    //    
+    struct Timings {
+        double preprocessMs = 0.0;      // Letterbox    
+        double inferenceMs = 0.0;       // Invoke()
+        double postprocessMs = 0.0;     // ,    NMS
+    };
+
     TFLiteDetector(const std::string& modelPath,
         const std::string& labelsPath,
         int inputWidth = 320,
         int inputHeight = 320);
     ~TFLiteDetector();
 
+    //    XNNPACK (0 -   )   ;  initialize()
+    void setNumThreads(int threads) { numThreads_ = threads; }
+    void setUseXnnpack(bool enabled) { useXnnpack_ = enabled; }
+
     bool initialize();
+    //   BGR (    )
+    const std::vector<Detection>& detect(const cv::Mat& frame);
     void detectAndDraw(cv::Mat& frame);
 
+    //       ( - );    initialize()
+    void setClassAllowlist(const std::vector<std::string>& names);
+    void setThresholds(float confThreshold, float nmsThreshold);
+    const std::vector<Detection>& detections() const { return detections_; }
+    const Timings& timings() const { return timings_; }
+    //   ( initialize())
+    cv::Size inputSize() const { return cv::Size(inputWidth_, inputHeight_); }
+    // ,  ,   
+    std::string describe() const;
+
 private:
     void loadLabels(const std::string& filename);
-    void preprocess(const cv::Mat& input, cv::Mat& output);
-    void postprocess(cv::Mat& frame, const float* outputData);
+    //  ->    (letterbox, RGB, , )
+    bool preprocess(const cv::Mat& input);
+    bool configureInput();
+    //  0  float:       outputFloat_
+    const float* outputData();
+    void postprocess(const float* outputData);
     void drawBox(const cv::Rect& box, const std::string& label, cv::Mat& frame);
 
     std::string modelPath_;
@@ -32,10 +70,20 @@ private:
     int inputHeight_;
 
     std::vector<std::string> labels_;
+    //   : FlatBufferModel   ,   model_
+    std::shared_ptr<const MappedFile> modelFile_;
     std::unique_ptr<tflite::FlatBufferModel> model_;
     std::unique_ptr<tflite::Interpreter> interpreter_;
+    std::unique_ptr<LetterboxPreprocessor> preprocessor_;
+    YoloDecoder decoder_{ YoloDecoder::Options() };
+    std::vector<std::string> classAllowlist_;
+    std::vector<Detection> detections_;
+    int outputNormalized_ = -1;  //      ( Ultralytics); -1 -   
+    cv::Mat outputFloat_;        //  ,  
+    Timings timings_;
 
-    //    
-    bool useGPUDelegate_ = true; //    AMD
-    std::unique_ptr<tflite::TfLiteDelegate, void(*)(tflite::TfLiteDelegate*)> delegate_{ nullptr, nullptr };
+    int numThreads_ = 0;
+    bool useXnnpack_ = true;
+    //  XNNPACK (nullptr -  );    
+    std::unique_ptr<TfLiteDelegate, void(*)(TfLiteDelegate*)> delegate_{ nullptr, nullptr };
 };
\ No newline at end of file
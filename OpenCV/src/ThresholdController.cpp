@@ -0,0 +1,159 @@
+﻿#include "ThresholdController.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+// Модуль градиента L1 оператора Собеля 3x3 для 8U не превышает 2040
+const int kHistogramBins = 2048;
+// Гистограмма строится по кадру, уменьшенному в 4 раза
+const int kHistogramDownscale = 4;
+// Доля логарифмической ошибки, исправляемая за один кадр
+const double kFeedbackGain = 0.5;
+}
+
+ThresholdController::ThresholdController()
+    : m_histogram(kHistogramBins, 0) {
+}
+
+void ThresholdController::setMode(Mode mode) {
+    m_mode = mode;
+    m_adapting = false;
+    m_measured = -1.0f;
+}
+
+const char* ThresholdController::modeName(Mode mode) {
+    switch (mode) {
+    case ADAPTIVE_HISTOGRAM: return "HISTOGRAM";
+    case ADAPTIVE_DENSITY: return "DENSITY";
+    case ADAPTIVE_BYTES: return "BYTES";
+    default: return "OFF";
+    }
+}
+
+void ThresholdController::setHysteresis(float enter, float exit) {
+    m_enterBand = std::max(enter, exit);
+    m_exitBand = std::min(enter, exit);
+}
+
+void ThresholdController::setThresholdRange(double minHigh, double maxHigh) {
+    m_minHigh = std::min(minHigh, maxHigh);
+    m_maxHigh = std::max(minHigh, maxHigh);
+}
+
+void ThresholdController::observeDensity(float density) {
+    if (m_mode == ADAPTIVE_DENSITY) {
+        m_measured = density;
+    }
+}
+
+void ThresholdController::observeCompressedSize(int bytes) {
+    if (m_mode == ADAPTIVE_BYTES) {
+        m_measured = static_cast<float>(bytes);
+    }
+}
+
+bool ThresholdController::update(const cv::Mat& frame, double& threshold1, double& threshold2) {
+    if (m_mode == ADAPTIVE_OFF || threshold2 <= 0.0) {
+        return false;
+    }
+
+    // Нижний порог следует за верхним с сохранением текущего соотношения
+    double ratio = threshold1 / threshold2;
+    double high = threshold2;
+    bool changed = false;
+
+    switch (m_mode) {
+    case ADAPTIVE_HISTOGRAM:
+        changed = feedbackStep(static_cast<float>(histogramHigh(frame)),
+            static_cast<float>(high), high);
+        break;
+    case ADAPTIVE_DENSITY:
+        changed = feedbackStep(m_measured, m_targetDensity, high);
+        break;
+    case ADAPTIVE_BYTES:
+        changed = feedbackStep(m_measured, static_cast<float>(m_byteBudget), high);
+        break;
+    default:
+        break;
+    }
+    // Измерение используется один раз: без нового (например, сжатие
+    // выключено) пороги не уходят к границе по устаревшему значению
+    m_measured = -1.0f;
+
+    if (changed) {
+        threshold2 = high;
+        threshold1 = high * ratio;
+    }
+    return changed;
+}
+
+bool ThresholdController::feedbackStep(float measured, float target, double& high) {
+    if (measured < 0.0f || target <= 0.0f) {
+        return false;
+    }
+
+    // Гистерезис: начинаем подстройку за внешней полосой, заканчиваем во внутренней
+    float error = std::fabs(measured / target - 1.0f);
+    if (!m_adapting && error > m_enterBand) {
+        m_adapting = true;
+    }
+    else if (m_adapting && error < m_exitBand) {
+        m_adapting = false;
+    }
+    if (!m_adapting) {
+        return false;
+    }
+
+    // Больше границ (или байт), чем нужно, - пороги поднимаются, и наоборот
+    double maxLogStep = std::log(1.0 + m_maxStep);
+    double logError = std::log(std::max(measured, 1e-6f) / target);
+    double step = std::min(std::max(logError * kFeedbackGain, -maxLogStep), maxLogStep);
+
+    double newHigh = std::min(std::max(high * std::exp(step), m_minHigh), m_maxHigh);
+    if (std::fabs(newHigh - high) < 0.5) {
+        return false;
+    }
+
+    high = newHigh;
+    return true;
+}
+
+double ThresholdController::histogramHigh(const cv::Mat& frame) {
+    if (frame.channels() == 3) {
+        cv::cvtColor(frame, m_gray, cv::COLOR_BGR2GRAY);
+    }
+    else {
+        m_gray = frame;
+    }
+
+    cv::Size smallSize(std::max(1, m_gray.cols / kHistogramDownscale),
+        std::max(1, m_gray.rows / kHistogramDownscale));
+    cv::resize(m_gray, m_small, smallSize, 0, 0, cv::INTER_AREA);
+    cv::Sobel(m_small, m_dx, CV_16S, 1, 0, 3);
+    cv::Sobel(m_small, m_dy, CV_16S, 0, 1, 3);
+
+    std::fill(m_histogram.begin(), m_histogram.end(), 0);
+    for (int y = 0; y < m_small.rows; ++y) {
+        const int16_t* dx = m_dx.ptr<int16_t>(y);
+        const int16_t* dy = m_dy.ptr<int16_t>(y);
+        for (int x = 0; x < m_small.cols; ++x) {
+            int magnitude = std::min(std::abs(dx[x]) + std::abs(dy[x]), kHistogramBins - 1);
+            ++m_histogram[magnitude];
+        }
+    }
+
+    // Верхний порог - процентиль распределения модуля градиента
+    int total = m_small.rows * m_small.cols;
+    int limit = static_cast<int>(total * m_percentile);
+    int accumulated = 0;
+    int bin = 0;
+    for (; bin < kHistogramBins - 1; ++bin) {
+        accumulated += m_histogram[bin];
+        if (accumulated >= limit) {
+            break;
+        }
+    }
+
+    return std::min(std::max(static_cast<double>(bin), m_minHigh), m_maxHigh);
+}
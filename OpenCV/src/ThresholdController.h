@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Автоматический подбор порогов Канни.
+// HISTOGRAM - верхний порог берётся как процентиль гистограммы модуля градиента
+//             уменьшенного кадра, нижний сохраняет текущее соотношение порогов.
+// DENSITY   - обратная связь по плотности границ предыдущего кадра.
+// BYTES     - обратная связь по размеру сжатой BitGrid (бюджет канала).
+// Обновление гистерезисное: подстройка начинается, когда ошибка выходит за
+// внешнюю полосу, и прекращается после возврата во внутреннюю.
+class ThresholdController {
+public:
+    enum Mode {
+        ADAPTIVE_OFF = 0,
+        ADAPTIVE_HISTOGRAM = 1,
+        ADAPTIVE_DENSITY = 2,
+        ADAPTIVE_BYTES = 3
+    };
+
+    ThresholdController();
+
+    void setMode(Mode mode);
+    Mode mode() const { return m_mode; }
+    bool enabled() const { return m_mode != ADAPTIVE_OFF; }
+    static const char* modeName(Mode mode);
+
+    void setTargetDensity(float density) { m_targetDensity = density; }
+    float targetDensity() const { return m_targetDensity; }
+    void setByteBudget(int bytes) { m_byteBudget = bytes; }
+    int byteBudget() const { return m_byteBudget; }
+
+    // Относительные полосы гистерезиса: enter > exit, например 0.25 и 0.10
+    void setHysteresis(float enter, float exit);
+    void setHistogramPercentile(float percentile) { m_percentile = percentile; }
+    void setThresholdRange(double minHigh, double maxHigh);
+
+    // Вызывается перед детекцией. Возвращает true, если пороги нужно изменить
+    bool update(const cv::Mat& frame, double& threshold1, double& threshold2);
+
+    // Измерения выхода после детекции; каждое действует на один update()
+    void observeDensity(float density);
+    void observeCompressedSize(int bytes);
+
+private:
+    Mode m_mode = ADAPTIVE_OFF;
+    float m_targetDensity = 0.05f;
+    int m_byteBudget = 4096;
+
+    float m_enterBand = 0.25f;
+    float m_exitBand = 0.10f;
+    float m_maxStep = 0.10f;
+    float m_percentile = 0.90f;
+    double m_minHigh = 20.0;
+    double m_maxHigh = 600.0;
+
+    bool m_adapting = false;
+    float m_measured = -1.0f;
+
+    cv::Mat m_gray, m_small, m_dx, m_dy;
+    std::vector<int> m_histogram;
+
+    bool feedbackStep(float measured, float target, double& high);
+    double histogramHigh(const cv::Mat& frame);
+};
@@ -0,0 +1,131 @@
+﻿#include "TileChangeTracker.h"
+#include <algorithm>
+
+TileChangeTracker::TileChangeTracker(int tileSize, int downscale, double sadThreshold)
+    : m_tileSize(std::max(tileSize, 8)),
+    m_downscale(std::max(downscale, 1)),
+    m_sadThreshold(sadThreshold) {
+}
+
+int TileChangeTracker::update(const cv::Mat& gray) {
+    if (gray.size() != m_frameSize) {
+        m_frameSize = gray.size();
+        m_tilesX = (gray.cols + m_tileSize - 1) / m_tileSize;
+        m_tilesY = (gray.rows + m_tileSize - 1) / m_tileSize;
+        m_dirty.assign(static_cast<size_t>(m_tilesX) * m_tilesY, 1);
+        m_reference.release();
+        m_forceFull = true;
+    }
+
+    if (m_keyframeInterval > 0 && ++m_framesSinceKeyframe >= m_keyframeInterval) {
+        m_forceFull = true;
+    }
+
+    // Уменьшенный кадр: сравнение по блокам downscale x downscale подавляет шум сенсора
+    cv::Size smallSize(std::max(1, gray.cols / m_downscale), std::max(1, gray.rows / m_downscale));
+    cv::resize(gray, m_small, smallSize, 0, 0, cv::INTER_AREA);
+
+    if (m_forceFull || m_reference.size() != m_small.size()) {
+        m_small.copyTo(m_reference);
+        std::fill(m_dirty.begin(), m_dirty.end(), 1);
+        m_dirtyCount = tileCount();
+        m_forceFull = false;
+        m_framesSinceKeyframe = 0;
+        return m_dirtyCount;
+    }
+
+    const int smallTile = std::max(1, m_tileSize / m_downscale);
+    m_dirtyCount = 0;
+
+    for (int ty = 0; ty < m_tilesY; ++ty) {
+        for (int tx = 0; tx < m_tilesX; ++tx) {
+            cv::Rect tile = cv::Rect(tx * smallTile, ty * smallTile, smallTile, smallTile) &
+                cv::Rect(0, 0, m_small.cols, m_small.rows);
+
+            bool dirty = false;
+            if (tile.area() > 0) {
+                double sad = cv::norm(m_small(tile), m_reference(tile), cv::NORM_L1);
+                dirty = sad > m_sadThreshold * tile.area();
+                if (dirty) {
+                    m_small(tile).copyTo(m_reference(tile));
+                }
+            }
+
+            m_dirty[ty * m_tilesX + tx] = dirty ? 1 : 0;
+            if (dirty) {
+                ++m_dirtyCount;
+            }
+        }
+    }
+
+    return m_dirtyCount;
+}
+
+std::vector<TileChangeTracker::DirtyRegion> TileChangeTracker::dirtyRegions(int halo) const {
+    std::vector<DirtyRegion> regions;
+    cv::Rect frameRect(0, 0, m_frameSize.width, m_frameSize.height);
+
+    for (int ty = 0; ty < m_tilesY; ++ty) {
+        int tx = 0;
+        while (tx < m_tilesX) {
+            if (!isDirty(tx, ty)) {
+                ++tx;
+                continue;
+            }
+
+            // Соседние изменившиеся тайлы строки объединяются, чтобы не платить за запас дважды
+            int runStart = tx;
+            while (tx < m_tilesX && isDirty(tx, ty)) {
+                ++tx;
+            }
+
+            DirtyRegion region;
+            region.inner = cv::Rect(runStart * m_tileSize, ty * m_tileSize,
+                (tx - runStart) * m_tileSize, m_tileSize) & frameRect;
+            region.outer = cv::Rect(region.inner.x - halo, region.inner.y - halo,
+                region.inner.width + 2 * halo, region.inner.height + 2 * halo) & frameRect;
+            regions.push_back(region);
+        }
+    }
+
+    return regions;
+}
+
+float TileChangeTracker::dirtyFraction() const {
+    int total = tileCount();
+    return total > 0 ? static_cast<float>(m_dirtyCount) / total : 0.0f;
+}
+
+bool IncrementalEdgeCache::update(const cv::Mat& frame, const RegionFn& compute) {
+    if (frame.channels() == 3) {
+        cv::cvtColor(frame, m_gray, cv::COLOR_BGR2GRAY);
+    }
+    else {
+        m_gray = frame;
+    }
+
+    int dirty = m_tracker.update(m_gray);
+    if (dirty == 0) {
+        m_recomputed = 0.0f;
+        return false;
+    }
+
+    m_recomputed = m_tracker.dirtyFraction();
+
+    if (m_edges.size() != frame.size() || m_recomputed > kFullRecomputeFraction) {
+        compute(frame, m_edges);
+        m_grid = BitGrid(m_edges);
+        return true;
+    }
+
+    cv::Mat roiEdges;
+    for (const auto& region : m_tracker.dirtyRegions(m_halo)) {
+        compute(frame(region.outer), roiEdges);
+
+        cv::Rect local(region.inner.tl() - region.outer.tl(), region.inner.size());
+        roiEdges(local).copyTo(m_edges(region.inner));
+        m_grid.setRegion(m_edges, region.inner);
+    }
+
+    return true;
+}
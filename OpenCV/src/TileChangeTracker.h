@@ -0,0 +1,94 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <vector>
+#include "BitGrid.h"
+
+// Поиск изменившихся тайлов между соседними кадрами.
+// Серый кадр уменьшается в downscale раз (INTER_AREA), затем для каждого тайла
+// считается средняя абсолютная разность (SAD / площадь) с опорным кадром.
+// Опорные данные тайла обновляются только когда он признан изменившимся,
+// поэтому медленный дрейф освещения со временем тоже приводит к пересчёту.
+class TileChangeTracker {
+public:
+    // Область пересчёта: сам тайл (inner) и тайл с запасом по краям (outer)
+    struct DirtyRegion {
+        cv::Rect inner;
+        cv::Rect outer;
+    };
+
+    TileChangeTracker(int tileSize = 64, int downscale = 4, double sadThreshold = 4.0);
+
+    // Возвращает число изменившихся тайлов. Первый кадр, смена размера
+    // и вызов invalidate() помечают изменившимися все тайлы
+    int update(const cv::Mat& gray);
+    void invalidate() { m_forceFull = true; }
+
+    // Изменившиеся тайлы, объединённые в горизонтальные полосы, с запасом halo
+    std::vector<DirtyRegion> dirtyRegions(int halo) const;
+
+    int tileCount() const { return m_tilesX * m_tilesY; }
+    int dirtyCount() const { return m_dirtyCount; }
+    float dirtyFraction() const;
+    bool isDirty(int tx, int ty) const { return m_dirty[ty * m_tilesX + tx] != 0; }
+
+    // Принудительный полный пересчёт раз в N кадров (0 - отключено)
+    void setKeyframeInterval(int frames) { m_keyframeInterval = frames; }
+    void setSadThreshold(double threshold) { m_sadThreshold = threshold; }
+
+private:
+    int m_tileSize;
+    int m_downscale;
+    double m_sadThreshold;
+    int m_keyframeInterval = 0;
+    int m_framesSinceKeyframe = 0;
+    bool m_forceFull = true;
+
+    cv::Size m_frameSize;
+    int m_tilesX = 0;
+    int m_tilesY = 0;
+    int m_dirtyCount = 0;
+    std::vector<uint8_t> m_dirty;
+
+    cv::Mat m_small;
+    cv::Mat m_reference;
+};
+
+// Кэш границ для инкрементального режима детекторов.
+// Пересчитывает границы только в изменившихся тайлах (с запасом на размытие,
+// Собель и подавление немаксимумов) и обновляет соответствующие биты BitGrid,
+// остальная часть берётся из предыдущего кадра.
+class IncrementalEdgeCache {
+public:
+    // Вычисление границ для фрагмента кадра
+    using RegionFn = std::function<void(const cv::Mat& frame, cv::Mat& edges)>;
+
+    // Запас вокруг тайла: 2 (размытие 5x5) + 1 (Собель) + 1 (NMS) + гистерезис
+    static const int kHalo = 8;
+    // При большей доле изменившихся тайлов выгоднее посчитать кадр целиком
+    static constexpr float kFullRecomputeFraction = 0.5f;
+
+    // halo - запас конкретного конвейера (сумма запасов его локальных стадий)
+    IncrementalEdgeCache(int tileSize = 64, int halo = kHalo)
+        : m_tracker(tileSize), m_halo(halo) {}
+
+    // Возвращает true, если хотя бы часть кадра была пересчитана
+    bool update(const cv::Mat& frame, const RegionFn& compute);
+    void invalidate() { m_tracker.invalidate(); }
+
+    const cv::Mat& edges() const { return m_edges; }
+    const BitGrid& grid() const { return m_grid; }
+    TileChangeTracker& tracker() { return m_tracker; }
+
+    // Доля тайлов, пересчитанных на последнем кадре
+    float recomputedFraction() const { return m_recomputed; }
+
+private:
+    TileChangeTracker m_tracker;
+    int m_halo;
+    cv::Mat m_gray;
+    cv::Mat m_edges;
+    BitGrid m_grid;
+    float m_recomputed = 1.0f;
+};
@@ -0,0 +1,196 @@
+﻿#include "TiledDetector.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Наибольшее число копий сети
+const int kMaxInstances = 16;
+// Рамка ближе этого (пикселей) к краю тайла считается обрезанной им
+const float kSeamMargin = 2.0f;
+
+float iou(const cv::Rect2f& a, const cv::Rect2f& b) {
+    float left = std::max(a.x, b.x);
+    float top = std::max(a.y, b.y);
+    float right = std::min(a.x + a.width, b.x + b.width);
+    float bottom = std::min(a.y + a.height, b.y + b.height);
+    if (right <= left || bottom <= top) {
+        return 0.0f;
+    }
+    float intersection = (right - left) * (bottom - top);
+    return intersection / (a.area() + b.area() - intersection);
+}
+
+// Пересечение, отнесённое к площади меньшей рамки: часть объекта у края тайла
+// целиком лежит внутри рамки всего объекта, хотя IoU у них мало
+float intersectionOverSmaller(const cv::Rect2f& a, const cv::Rect2f& b) {
+    float left = std::max(a.x, b.x);
+    float top = std::max(a.y, b.y);
+    float right = std::min(a.x + a.width, b.x + b.width);
+    float bottom = std::min(a.y + a.height, b.y + b.height);
+    if (right <= left || bottom <= top) {
+        return 0.0f;
+    }
+    return (right - left) * (bottom - top) / std::max(1e-6f, std::min(a.area(), b.area()));
+}
+
+cv::Rect2f unite(const cv::Rect2f& a, const cv::Rect2f& b) {
+    float left = std::min(a.x, b.x);
+    float top = std::min(a.y, b.y);
+    float right = std::max(a.x + a.width, b.x + b.width);
+    float bottom = std::max(a.y + a.height, b.y + b.height);
+    return cv::Rect2f(left, top, right - left, bottom - top);
+}
+
+// Начала тайлов длины tile вдоль отрезка length: первый у начала, последний у конца
+void tileStarts(int length, int tile, float overlap, std::vector<int>& starts) {
+    starts.clear();
+    if (length <= tile) {
+        starts.push_back(0);
+        return;
+    }
+    int step = std::max(1, cvRound(tile * (1.0f - overlap)));
+    int count = 1 + (length - tile + step - 1) / step;
+    for (int i = 0; i < count; ++i) {
+        starts.push_back(static_cast<int>(static_cast<int64_t>(length - tile) * i / (count - 1)));
+    }
+}
+}
+
+TiledDetector::TiledDetector(const YoloDetector::Options& detectorOptions, const Options& options)
+    : m_options(options), m_nmsThreshold(detectorOptions.nmsThreshold) {
+    m_options.instances = std::min(kMaxInstances, std::max(1, m_options.instances));
+    m_options.overlap = std::min(0.9f, std::max(0.0f, m_options.overlap));
+    if (m_options.tileSize.area() <= 0) {
+        m_options.tileSize = detectorOptions.inputSize;
+    }
+    for (int i = 0; i < m_options.instances; ++i) {
+        m_detectors.emplace_back(new YoloDetector(detectorOptions));
+    }
+    m_parts.resize(m_options.instances);
+    m_partial.resize(m_options.instances);
+}
+
+bool TiledDetector::load() {
+    for (auto& detector : m_detectors) {
+        if (!detector->load()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const std::vector<Detection>& TiledDetector::detect(const cv::Mat& frame) {
+    m_detections.clear();
+    if (frame.empty()) {
+        return m_detections;
+    }
+    int64 startTicks = cv::getTickCount();
+    m_frameSize = frame.size();
+
+    // Тайлы и весь кадр (если кадр больше одного тайла) - по копиям сети через одну
+    tileGrid(frame.size(), m_options.tileSize, m_options.overlap, m_tiles);
+    if (m_options.fullFrame && m_tiles.size() > 1) {
+        m_tiles.push_back(cv::Rect(0, 0, frame.cols, frame.rows));
+    }
+    const int instances = std::min(m_options.instances, static_cast<int>(m_tiles.size()));
+    for (int i = 0; i < m_options.instances; ++i) {
+        m_parts[i].clear();
+        m_partial[i].clear();
+    }
+    for (size_t i = 0; i < m_tiles.size(); ++i) {
+        m_parts[i % instances].push_back(m_tiles[i]);
+    }
+
+    cv::parallel_for_(cv::Range(0, instances), [this, &frame](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            m_partial[i] = m_detectors[i]->detectRegions(frame, m_parts[i]);
+        }
+    });
+
+    // Номер области копии сети -> номер тайла кадра (тайлы раздавались через одну)
+    m_candidates.clear();
+    for (int i = 0; i < instances; ++i) {
+        for (Detection detection : m_partial[i]) {
+            detection.region = i + detection.region * instances;
+            m_candidates.push_back(detection);
+        }
+    }
+    mergeDetections();
+
+    double ms = (cv::getTickCount() - startTicks) * 1e3 / cv::getTickFrequency();
+    ++m_stats.frames;
+    m_stats.tiles += m_tiles.size();
+    m_stats.lastTiles = static_cast<int>(m_tiles.size());
+    m_stats.lastMs = ms;
+    m_stats.totalMs += ms;
+    return m_detections;
+}
+
+void TiledDetector::draw(cv::Mat& frame, const std::vector<Detection>& detections) const {
+    m_detectors[0]->draw(frame, detections);
+}
+
+void TiledDetector::tileGrid(cv::Size frameSize, cv::Size tileSize, float overlap, std::vector<cv::Rect>& tiles) {
+    tiles.clear();
+    std::vector<int> xs, ys;
+    tileStarts(frameSize.width, tileSize.width, overlap, xs);
+    tileStarts(frameSize.height, tileSize.height, overlap, ys);
+    const int width = std::min(frameSize.width, tileSize.width);
+    const int height = std::min(frameSize.height, tileSize.height);
+    for (int y : ys) {
+        for (int x : xs) {
+            tiles.push_back(cv::Rect(x, y, width, height));
+        }
+    }
+}
+
+std::string TiledDetector::describe() const {
+    return m_detectors[0]->describe() + ", tiles " + std::to_string(m_options.tileSize.width) + "x" +
+        std::to_string(m_options.tileSize.height) + " overlap " + std::to_string(cvRound(m_options.overlap * 100.0f)) +
+        "%, " + std::to_string(m_options.instances) + " net(s)" + (m_options.fullFrame ? " + full frame" : "");
+}
+
+
+
+void TiledDetector::mergeDetections() {
+    // Жадно по убыванию уверенности: рамка объединяется с частями того же
+    // объекта из соседних тайлов и подавляет дубликаты по IoU
+    std::sort(m_candidates.begin(), m_candidates.end(),
+        [](const Detection& a, const Detection& b) { return a.confidence > b.confidence; });
+    m_merged.assign(m_candidates.size(), 0);
+    for (size_t i = 0; i < m_candidates.size(); ++i) {
+        if (m_merged[i]) {
+            continue;
+        }
+        Detection detection = m_candidates[i];
+        const cv::Rect2f seed = detection.box;
+        const bool seedCut = cutBySeam(detection);
+        for (size_t j = i + 1; j < m_candidates.size(); ++j) {
+            const Detection& other = m_candidates[j];
+            if (m_merged[j] || other.classId != detection.classId) {
+                continue;
+            }
+            bool acrossSeam = other.region != detection.region && (seedCut || cutBySeam(other));
+            if (acrossSeam && intersectionOverSmaller(seed, other.box) >= m_options.mergeThreshold) {
+                detection.box = unite(detection.box, other.box);
+                m_merged[j] = 1;
+            }
+            else if (iou(seed, other.box) > m_nmsThreshold) {
+                m_merged[j] = 1;
+            }
+        }
+        m_detections.push_back(detection);
+    }
+}
+
+bool TiledDetector::cutBySeam(const Detection& detection) const {
+    if (detection.region < 0 || detection.region >= static_cast<int>(m_tiles.size())) {
+        return false;
+    }
+    const cv::Rect& tile = m_tiles[detection.region];
+    const cv::Rect2f& box = detection.box;
+    return (tile.x > 0 && box.x <= tile.x + kSeamMargin) ||
+        (tile.y > 0 && box.y <= tile.y + kSeamMargin) ||
+        (tile.x + tile.width < m_frameSize.width && box.x + box.width >= tile.x + tile.width - kSeamMargin) ||
+        (tile.y + tile.height < m_frameSize.height && box.y + box.height >= tile.y + tile.height - kSeamMargin);
+}
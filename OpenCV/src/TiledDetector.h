@@ -0,0 +1,75 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "yolo.h"
+
+// Нарезанная (sliced) детекция для кадров высокого разрешения: кадр режется
+// на перекрывающиеся тайлы размера входа сети (объекты не уменьшаются), к
+// ним добавляется весь кадр в разрешении входа для крупных объектов. Тайлы
+// делятся между instances копиями сети и идут в каждую одним пакетом
+// (YoloDetector::detectRegions); копии работают параллельно, каждая на своём
+// ядре (cv::parallel_for_, вложенный параллелизм dnn при этом не дробит ядра).
+// Рамки одного класса из разных тайлов, хотя бы одна из которых упирается в
+// край своего тайла внутри кадра (объект разрезан швом перекрытия), при
+// пересечении не меньше mergeThreshold площади меньшей объединяются в одну.
+// Остальные пары - обычный NMS по IoU: перекрывающиеся разные объекты
+// (толпа, заслонённый человек) не сливаются.
+class TiledDetector {
+public:
+    struct Options {
+        cv::Size tileSize;              // Пусто - вход сети (без масштабирования)
+        float overlap = 0.2f;           // Перекрытие соседних тайлов, доля тайла
+        int instances = 1;              // Копий сети, работающих параллельно
+        bool fullFrame = true;          // Плюс весь кадр, вписанный во вход
+        float mergeThreshold = 0.5f;    // Пересечение / площадь меньшей рамки для слияния
+    };
+
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t tiles = 0;             // Изображений через сеть, с целыми кадрами
+        int lastTiles = 0;
+        double lastMs = 0.0;
+        double totalMs = 0.0;
+    };
+
+    TiledDetector(const YoloDetector::Options& detectorOptions, const Options& options);
+
+    bool load();
+
+    // Объекты кадра BGR (вектор переиспользуется до следующего вызова)
+    const std::vector<Detection>& detect(const cv::Mat& frame);
+    const std::vector<Detection>& detections() const { return m_detections; }
+    void draw(cv::Mat& frame, const std::vector<Detection>& detections) const;
+
+    // Перекрывающиеся тайлы tileSize, равномерно покрывающие кадр
+    static void tileGrid(cv::Size frameSize, cv::Size tileSize, float overlap, std::vector<cv::Rect>& tiles);
+
+    const Stats& stats() const { return m_stats; }
+    const Options& options() const { return m_options; }
+    const YoloDetector& detector() const { return *m_detectors[0]; }
+    std::string describe() const;
+
+private:
+    Options m_options;
+    std::vector<std::unique_ptr<YoloDetector>> m_detectors;
+
+    // Буферы между кадрами: тайлы, их доли по копиям сети и рамки копий
+    std::vector<cv::Rect> m_tiles;
+    std::vector<std::vector<cv::Rect>> m_parts;
+    std::vector<std::vector<Detection>> m_partial;
+    std::vector<Detection> m_candidates;
+    std::vector<uint8_t> m_merged;
+    std::vector<Detection> m_detections;
+    cv::Size m_frameSize;
+    float m_nmsThreshold;
+
+    Stats m_stats;
+
+    void mergeDetections();
+    // Рамка касается края своего тайла, не совпадающего с краем кадра
+    bool cutBySeam(const Detection& detection) const;
+};
@@ -0,0 +1,159 @@
+﻿#include "WorkStealingPool.h"
+#include "FrameTracer.h"
+#include <algorithm>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+thread_local int t_threadIndex = -1;
+
+// Привязка потока к ядру: планировщик ОС не переносит поток между ядрами,
+// кэш ядра остаётся за его заданиями
+void pinToCore(std::thread& thread, int core) {
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    core %= static_cast<int>(cores);
+#ifdef _WIN32
+    SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << (core % (8 * sizeof(DWORD_PTR))));
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+    (void)thread;
+    (void)core;
+#endif
+}
+}
+
+WorkStealingPool::WorkStealingPool(const Options& options) : m_options(options) {
+    if (m_options.threads <= 0) {
+        m_options.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < m_options.threads; ++i) {
+        m_queues.emplace_back(new Queue());
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    stop();
+}
+
+void WorkStealingPool::start() {
+    if (!m_threads.empty()) {
+        return;
+    }
+    m_stop = false;
+    for (int i = 0; i < threadCount(); ++i) {
+        m_threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+        if (m_options.pinThreads) {
+            pinToCore(m_threads.back(), i);
+        }
+    }
+}
+
+void WorkStealingPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+
+    for (auto& queue : m_queues) {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        m_pending -= static_cast<int>(queue->tasks.size());
+        queue->tasks.clear();
+    }
+}
+
+void WorkStealingPool::submit(Task task) {
+    int index = t_threadIndex;
+    if (index < 0 || index >= threadCount()) {
+        index = static_cast<int>(m_nextQueue++ % m_queues.size());
+    }
+    {
+        Queue& queue = *m_queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    ++m_pending;
+
+    // Пустая блокировка: поток, проверивший счётчик, успевает уснуть до оповещения
+    { std::lock_guard<std::mutex> lock(m_sleepMutex); }
+    m_wake.notify_one();
+}
+
+WorkStealingPool::Stats WorkStealingPool::stats() const {
+    Stats stats;
+    for (const auto& queue : m_queues) {
+        stats.perThread.push_back(queue->executed);
+        stats.executed += queue->executed;
+    }
+    stats.stolen = m_stolen;
+    return stats;
+}
+
+int WorkStealingPool::currentThread() {
+    return t_threadIndex;
+}
+
+
+
+bool WorkStealingPool::take(int index, Task& task) {
+    {
+        Queue& own = *m_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            --m_pending;
+            return true;
+        }
+    }
+
+    // Своя очередь пуста: кража из конца чужих, начиная с соседней
+    int count = threadCount();
+    for (int offset = 1; offset < count; ++offset) {
+        Queue& victim = *m_queues[(index + offset) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            --m_pending;
+            ++m_stolen;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(int index) {
+    t_threadIndex = index;
+    FrameTracer::setThreadName("pool " + std::to_string(index));
+    Queue& own = *m_queues[index];
+
+    while (true) {
+        Task task;
+        if (take(index, task)) {
+            task();
+            ++own.executed;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [this] { return m_stop || m_pending > 0; });
+        if (m_stop) {
+            break;
+        }
+    }
+}
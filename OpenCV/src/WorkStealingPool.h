@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул потоков с собственной очередью у каждого потока и кражей заданий.
+// Задание, поставленное из потока пула, попадает в его очередь (данные
+// задания уже в кэше этого ядра); задания извне раздаются очередям по кругу.
+// Поток берёт задания из начала своей очереди (FIFO - порядок постановки
+// сохраняется), а опустевший поток крадёт из конца чужой. Очереди защищены
+// отдельными мьютексами, поэтому потоки не соревнуются за одну блокировку.
+// Спящие потоки будятся общим счётчиком заданий.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    struct Options {
+        int threads = 0;            // 0 - по числу ядер
+        bool pinThreads = false;    // Привязать поток i к ядру i (Linux, Windows)
+    };
+
+    struct Stats {
+        uint64_t executed = 0;
+        uint64_t stolen = 0;        // Выполнено потоком, который не ставил задание
+        std::vector<uint64_t> perThread;
+    };
+
+    explicit WorkStealingPool(const Options& options);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void start();
+    // Невыполненные задания отбрасываются
+    void stop();
+
+    void submit(Task task);
+
+    int threadCount() const { return static_cast<int>(m_queues.size()); }
+    Stats stats() const;
+
+    // Номер потока пула, вызвавшего функцию (-1 - поток не из пула)
+    static int currentThread();
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::atomic<uint64_t> executed{ 0 };
+    };
+
+    Options m_options;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<unsigned> m_nextQueue{ 0 };
+    std::atomic<uint64_t> m_stolen{ 0 };
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    std::atomic<int> m_pending{ 0 };
+    std::atomic<bool> m_stop{ false };
+
+    bool take(int index, Task& task);
+    void workerLoop(int index);
+};
@@ -0,0 +1,424 @@
+﻿#include "YoloDecoder.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define YDC_X86 1
+#include <immintrin.h>
+#endif
+
+// Как в FastFrontEnd: GCC/Clang разрешают AVX2 только для отдельных функций
+#if defined(YDC_X86) && (defined(__GNUC__) || defined(__clang__))
+#define YDC_TARGET(isa) __attribute__((target(isa)))
+#else
+#define YDC_TARGET(isa)
+#endif
+
+namespace {
+
+// Якорей в блоке столбцового просмотра: лучшие оценки блока остаются в L1
+const int kAnchorBlock = 512;
+
+// Предел сетки NMS по каждой оси
+const int kMaxGridCells = 64;
+
+// Указатели на ядра выбранного уровня SIMD
+struct DecodeKernels {
+    // Строка оценок класса classId по count якорям: обновление лучших оценок и классов
+    void (*scanClass)(const float* scores, int classId, int count, float* best, int* bestClass);
+    // Максимум оценок одного якоря по всем классам
+    float (*rowMax)(const float* scores, int count);
+};
+
+// === Скалярные ядра (также обрабатывают хвосты SIMD-версий) ===
+
+void scanClassScalar(const float* scores, int classId, int count, float* best, int* bestClass) {
+    for (int i = 0; i < count; ++i) {
+        if (scores[i] > best[i]) {
+            best[i] = scores[i];
+            bestClass[i] = classId;
+        }
+    }
+}
+
+float rowMaxScalar(const float* scores, int count) {
+    float result = -std::numeric_limits<float>::infinity();
+    for (int i = 0; i < count; ++i) {
+        result = std::max(result, scores[i]);
+    }
+    return result;
+}
+
+#ifdef YDC_X86
+
+YDC_TARGET("avx2") void scanClassAVX2(const float* scores, int classId, int count, float* best, int* bestClass) {
+    const __m256i id = _mm256_set1_epi32(classId);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 score = _mm256_loadu_ps(scores + i);
+        __m256 current = _mm256_loadu_ps(best + i);
+        // Строго больше: при равенстве остаётся первый класс, как у std::max_element
+        __m256 greater = _mm256_cmp_ps(score, current, _CMP_GT_OQ);
+        if (_mm256_movemask_ps(greater) == 0) {
+            continue;
+        }
+        _mm256_storeu_ps(best + i, _mm256_blendv_ps(current, score, greater));
+        __m256i classes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bestClass + i));
+        classes = _mm256_blendv_epi8(classes, id, _mm256_castps_si256(greater));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(bestClass + i), classes);
+    }
+    scanClassScalar(scores + i, classId, count - i, best + i, bestClass + i);
+}
+
+YDC_TARGET("avx2") float rowMaxAVX2(const float* scores, int count) {
+    int i = 0;
+    float result = -std::numeric_limits<float>::infinity();
+    if (count >= 8) {
+        __m256 acc = _mm256_loadu_ps(scores);
+        for (i = 8; i + 8 <= count; i += 8) {
+            acc = _mm256_max_ps(acc, _mm256_loadu_ps(scores + i));
+        }
+        __m128 half = _mm_max_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        half = _mm_max_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_max_ss(half, _mm_shuffle_ps(half, half, 1));
+        result = _mm_cvtss_f32(half);
+    }
+    return std::max(result, rowMaxScalar(scores + i, count - i));
+}
+
+#endif // YDC_X86
+
+const DecodeKernels& kernelsFor(SimdLevel level) {
+    static const DecodeKernels scalar = { scanClassScalar, rowMaxScalar };
+#ifdef YDC_X86
+    static const DecodeKernels avx2 = { scanClassAVX2, rowMaxAVX2 };
+    if (level >= SIMD_AVX2) {
+        return avx2;
+    }
+#endif
+    (void)level;
+    return scalar;
+}
+
+float iou(const cv::Rect2f& a, const cv::Rect2f& b) {
+    float left = std::max(a.x, b.x);
+    float top = std::max(a.y, b.y);
+    float right = std::min(a.x + a.width, b.x + b.width);
+    float bottom = std::min(a.y + a.height, b.y + b.height);
+    if (right <= left || bottom <= top) {
+        return 0.0f;
+    }
+    float intersection = (right - left) * (bottom - top);
+    return intersection / (a.area() + b.area() - intersection);
+}
+
+}
+
+YoloDecoder::YoloDecoder(const Options& options)
+    : m_options(options), m_level(FastFrontEnd::detectSimdLevel()) {
+    m_options.maxDetections = std::max(1, m_options.maxDetections);
+}
+
+std::vector<std::string> YoloDecoder::setClassAllowlist(const std::vector<std::string>& allowlist,
+    const std::vector<std::string>& classNames) {
+    std::vector<std::string> unknown;
+    std::vector<int> classIds;
+    for (const std::string& name : allowlist) {
+        auto found = std::find(classNames.begin(), classNames.end(), name);
+        if (found == classNames.end()) {
+            unknown.push_back(name);
+            continue;
+        }
+        classIds.push_back(static_cast<int>(found - classNames.begin()));
+    }
+    // Ни одного известного имени - разрешены все классы, а не ни одного
+    if (classIds.empty()) {
+        setAllowedClasses(classIds, 0);
+    }
+    else {
+        setAllowedClasses(classIds, static_cast<int>(classNames.size()));
+    }
+    return unknown;
+}
+
+void YoloDecoder::setAllowedClasses(const std::vector<int>& classIds, int classCount) {
+    m_allowMask.clear();
+    if (!classIds.empty()) {
+        m_allowMask.assign(std::max(classCount, *std::max_element(classIds.begin(), classIds.end()) + 1), 0);
+        for (int classId : classIds) {
+            if (classId >= 0) {
+                m_allowMask[classId] = 1;
+            }
+        }
+    }
+    m_allowedCount = -1;
+}
+
+bool YoloDecoder::allowed(int classId) const {
+    if (m_allowMask.empty()) {
+        return true;
+    }
+    return classId >= 0 && classId < static_cast<int>(m_allowMask.size()) && m_allowMask[classId];
+}
+
+void YoloDecoder::setThresholds(float confThreshold, float nmsThreshold) {
+    m_options.confThreshold = confThreshold;
+    m_options.nmsThreshold = nmsThreshold;
+}
+
+void YoloDecoder::setSimdLevel(SimdLevel level) {
+    m_level = std::min(level, FastFrontEnd::detectSimdLevel());
+}
+
+void YoloDecoder::decodeChannelMajor(const float* data, int classes, int anchors, cv::Point2f coordScale,
+    const LetterboxGeometry& geometry, std::vector<Detection>& out) {
+    const std::vector<int>& classIds = allowedClasses(classes);
+    if (classIds.empty() || anchors <= 0) {
+        return;
+    }
+    const DecodeKernels& kernels = kernelsFor(m_level);
+    // Оценка, равная порогу, ещё проходит (как score < threshold -> отказ)
+    const float start = std::nextafter(m_options.confThreshold, -std::numeric_limits<float>::infinity());
+    const float* scores = data + static_cast<size_t>(4) * anchors;
+
+    m_bestScore.resize(kAnchorBlock);
+    m_bestClass.resize(kAnchorBlock);
+    for (int first = 0; first < anchors; first += kAnchorBlock) {
+        const int count = std::min(kAnchorBlock, anchors - first);
+        std::fill(m_bestScore.begin(), m_bestScore.begin() + count, start);
+        std::fill(m_bestClass.begin(), m_bestClass.begin() + count, -1);
+        for (int classId : classIds) {
+            kernels.scanClass(scores + static_cast<size_t>(classId) * anchors + first, classId, count,
+                m_bestScore.data(), m_bestClass.data());
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (m_bestClass[i] < 0) {
+                continue;
+            }
+            const size_t anchor = static_cast<size_t>(first + i);
+            addBox(data[anchor], data[anchors + anchor], data[2 * anchors + anchor], data[3 * anchors + anchor],
+                m_bestScore[i], m_bestClass[i], coordScale, geometry, out);
+        }
+    }
+}
+
+void YoloDecoder::decodeAnchorMajor(const float* data, int classes, int anchors, cv::Point2f coordScale,
+    const LetterboxGeometry& geometry, std::vector<Detection>& out) {
+    const std::vector<int>& classIds = allowedClasses(classes);
+    if (classIds.empty()) {
+        return;
+    }
+    const DecodeKernels& kernels = kernelsFor(m_level);
+    const bool allClasses = static_cast<int>(classIds.size()) == classes;
+    const float threshold = m_options.confThreshold;
+    const size_t stride = static_cast<size_t>(4 + classes);
+
+    for (int anchor = 0; anchor < anchors; ++anchor) {
+        const float* row = data + anchor * stride;
+        const float* scores = row + 4;
+        // Векторный максимум отсекает якоря ниже порога до поиска класса
+        if (allClasses && kernels.rowMax(scores, classes) < threshold) {
+            continue;
+        }
+        int best = classIds[0];
+        for (int classId : classIds) {
+            if (scores[classId] > scores[best]) {
+                best = classId;
+            }
+        }
+        if (scores[best] < threshold) {
+            continue;
+        }
+        addBox(row[0], row[1], row[2], row[3], scores[best], best, coordScale, geometry, out);
+    }
+}
+
+void YoloDecoder::decodeDarknet(const float* data, int classes, int anchors, cv::Point2f coordScale,
+    const LetterboxGeometry& geometry, std::vector<Detection>& out) {
+    const std::vector<int>& classIds = allowedClasses(classes);
+    if (classIds.empty()) {
+        return;
+    }
+    const DecodeKernels& kernels = kernelsFor(m_level);
+    const bool allClasses = static_cast<int>(classIds.size()) == classes;
+    const float threshold = m_options.confThreshold;
+    const size_t stride = static_cast<size_t>(5 + classes);
+
+    for (int anchor = 0; anchor < anchors; ++anchor) {
+        const float* row = data + anchor * stride;
+        // Оценки классов уже умножены на объектность (слой region): объектность
+        // не меньше любой из них и дёшево отсекает большинство строк
+        if (row[4] < threshold) {
+            continue;
+        }
+        const float* scores = row + 5;
+        if (allClasses && kernels.rowMax(scores, classes) < threshold) {
+            continue;
+        }
+        int best = classIds[0];
+        for (int classId : classIds) {
+            if (scores[classId] > scores[best]) {
+                best = classId;
+            }
+        }
+        if (scores[best] < threshold) {
+            continue;
+        }
+        addBox(row[0], row[1], row[2], row[3], scores[best], best, coordScale, geometry, out);
+    }
+}
+
+void YoloDecoder::nms(std::vector<Detection>& detections) {
+    const int count = static_cast<int>(detections.size());
+    if (count == 0) {
+        return;
+    }
+
+    // Корзины классов подсчётом, внутри корзины - по убыванию уверенности
+    int maxClass = 0;
+    for (const Detection& detection : detections) {
+        maxClass = std::max(maxClass, detection.classId);
+    }
+    m_bucketStart.assign(maxClass + 2, 0);
+    for (const Detection& detection : detections) {
+        ++m_bucketStart[detection.classId + 1];
+    }
+    for (int c = 0; c <= maxClass; ++c) {
+        m_bucketStart[c + 1] += m_bucketStart[c];
+    }
+    m_order.resize(count);
+    m_bucketNext.assign(m_bucketStart.begin(), m_bucketStart.end() - 1);
+    for (int i = 0; i < count; ++i) {
+        m_order[m_bucketNext[detections[i].classId]++] = i;
+    }
+
+    m_kept.clear();
+    for (int c = 0; c <= maxClass; ++c) {
+        auto begin = m_order.begin() + m_bucketStart[c];
+        auto end = m_order.begin() + m_bucketStart[c + 1];
+        if (begin == end) {
+            continue;
+        }
+        std::sort(begin, end, [&detections](int a, int b) {
+            return detections[a].confidence > detections[b].confidence ||
+                (detections[a].confidence == detections[b].confidence && a < b);
+        });
+        if (end - begin == 1) {
+            m_kept.push_back(detections[*begin]);
+            continue;
+        }
+
+        // Сетка по области рамок класса, ячейка - средний размер рамки:
+        // рамка занимает несколько ячеек, пересекающиеся рамки делят хотя бы одну
+        float left = std::numeric_limits<float>::max(), top = left;
+        float right = std::numeric_limits<float>::lowest(), bottom = right;
+        float sideSum = 0.0f;
+        for (auto it = begin; it != end; ++it) {
+            const cv::Rect2f& box = detections[*it].box;
+            left = std::min(left, box.x);
+            top = std::min(top, box.y);
+            right = std::max(right, box.x + box.width);
+            bottom = std::max(bottom, box.y + box.height);
+            sideSum += std::max(box.width, box.height);
+        }
+        float cell = std::max(1.0f, sideSum / static_cast<float>(end - begin));
+        cell = std::max(cell, std::max(right - left, bottom - top) / kMaxGridCells);
+        const int cols = std::min(kMaxGridCells, static_cast<int>((right - left) / cell) + 1);
+        const int rows = std::min(kMaxGridCells, static_cast<int>((bottom - top) / cell) + 1);
+        if (m_cells.size() < static_cast<size_t>(cols * rows)) {
+            m_cells.resize(cols * rows);
+        }
+
+        for (auto it = begin; it != end; ++it) {
+            const Detection& candidate = detections[*it];
+            const cv::Rect2f& box = candidate.box;
+            const int x0 = std::min(cols - 1, static_cast<int>((box.x - left) / cell));
+            const int x1 = std::min(cols - 1, static_cast<int>((box.x + box.width - left) / cell));
+            const int y0 = std::min(rows - 1, static_cast<int>((box.y - top) / cell));
+            const int y1 = std::min(rows - 1, static_cast<int>((box.y + box.height - top) / cell));
+
+            bool suppressed = false;
+            for (int y = y0; y <= y1 && !suppressed; ++y) {
+                for (int x = x0; x <= x1 && !suppressed; ++x) {
+                    for (int kept : m_cells[y * cols + x]) {
+                        if (iou(m_kept[kept].box, box) > m_options.nmsThreshold) {
+                            suppressed = true;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (suppressed) {
+                continue;
+            }
+
+            const int kept = static_cast<int>(m_kept.size());
+            m_kept.push_back(candidate);
+            for (int y = y0; y <= y1; ++y) {
+                for (int x = x0; x <= x1; ++x) {
+                    std::vector<int>& cellKept = m_cells[y * cols + x];
+                    if (cellKept.empty()) {
+                        m_touchedCells.push_back(y * cols + x);
+                    }
+                    cellKept.push_back(kept);
+                }
+            }
+        }
+        for (int index : m_touchedCells) {
+            m_cells[index].clear();
+        }
+        m_touchedCells.clear();
+    }
+
+    // Самые уверенные рамки всех классов
+    auto byConfidence = [](const Detection& a, const Detection& b) { return a.confidence > b.confidence; };
+    if (static_cast<int>(m_kept.size()) > m_options.maxDetections) {
+        std::partial_sort(m_kept.begin(), m_kept.begin() + m_options.maxDetections, m_kept.end(), byConfidence);
+        m_kept.resize(m_options.maxDetections);
+    }
+    else {
+        std::sort(m_kept.begin(), m_kept.end(), byConfidence);
+    }
+    detections.swap(m_kept);
+}
+
+
+
+const std::vector<int>& YoloDecoder::allowedClasses(int classes) {
+    if (m_allowedCount == classes) {
+        return m_allowed;
+    }
+    m_allowed.clear();
+    for (int classId = 0; classId < classes; ++classId) {
+        if (allowed(classId)) {
+            m_allowed.push_back(classId);
+        }
+    }
+    m_allowedCount = classes;
+    return m_allowed;
+}
+
+void YoloDecoder::addBox(float cx, float cy, float w, float h, float score, int classId, cv::Point2f coordScale,
+    const LetterboxGeometry& geometry, std::vector<Detection>& out) const {
+    // Координаты входа сети -> координаты кадра (обратный letterbox)
+    cx *= coordScale.x;
+    w *= coordScale.x;
+    cy *= coordScale.y;
+    h *= coordScale.y;
+    cv::Point2f topLeft = geometry.toFrame(cx - 0.5f * w, cy - 0.5f * h);
+    cv::Point2f bottomRight = geometry.toFrame(cx + 0.5f * w, cy + 0.5f * h);
+    float left = std::max(0.0f, topLeft.x);
+    float top = std::max(0.0f, topLeft.y);
+    float right = std::min(static_cast<float>(geometry.frameSize.width), bottomRight.x);
+    float bottom = std::min(static_cast<float>(geometry.frameSize.height), bottomRight.y);
+    if (right <= left || bottom <= top) {
+        return;
+    }
+    Detection detection;
+    detection.box = cv::Rect2f(left, top, right - left, bottom - top);
+    detection.classId = classId;
+    detection.confidence = score;
+    out.push_back(detection);
+}
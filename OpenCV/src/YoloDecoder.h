@@ -0,0 +1,92 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "FastFrontEnd.h"
+#include "Letterbox.h"
+
+// Обнаруженный объект в координатах исходного кадра
+struct Detection {
+    cv::Rect2f box;
+    int classId = 0;
+    float confidence = 0.0f;
+    int region = -1;            // Область YoloDetector::detectRegions, -1 - весь кадр
+};
+
+// Разбор выхода YOLO и NMS по классам.
+// Оценки классов просматриваются по столбцам: для раскладки [4 + C, N]
+// строка класса - непрерывный массив по всем якорям, AVX2 обновляет лучший
+// класс сразу восьми якорей без транспонирования. Начальный максимум равен
+// порогу уверенности, поэтому якоря ниже порога не порождают кандидатов, а
+// строки [N, 4 + C] отсекаются по векторному максимуму до поиска класса.
+// Классы вне списка разрешённых не просматриваются вовсе. Рамки сразу
+// переводятся в координаты кадра (обратный letterbox).
+// NMS раскладывает кандидатов по корзинам классов, сортирует каждую по
+// уверенности и сравнивает рамку только с оставленными рамками своего класса
+// из тех же ячеек пространственной сетки, а не со всеми (O(n^2)).
+class YoloDecoder {
+public:
+    struct Options {
+        float confThreshold = 0.25f;
+        float nmsThreshold = 0.45f;
+        int maxDetections = 300;        // После NMS, самые уверенные
+    };
+
+    explicit YoloDecoder(const Options& options);
+
+    // Разрешённые классы по именам из файла классов (coco.names); пустой
+    // список - все классы. Возвращает имена, которых нет среди classNames
+    std::vector<std::string> setClassAllowlist(const std::vector<std::string>& allowlist,
+        const std::vector<std::string>& classNames);
+    void setAllowedClasses(const std::vector<int>& classIds, int classCount);
+    bool allowed(int classId) const;
+
+    // Декодеры дописывают кандидатов в out. coordScale переводит координаты
+    // выхода в пиксели входа сети (1 - уже пиксели, размер входа - доли)
+
+    // [4 + C, N]: cx, cy, w, h и оценки классов строками по N якорям (YOLOv8)
+    void decodeChannelMajor(const float* data, int classes, int anchors, cv::Point2f coordScale,
+        const LetterboxGeometry& geometry, std::vector<Detection>& out);
+    // [N, 4 + C]: якорь на строку (экспорт YOLOv8 в TFLite, транспонированный ONNX)
+    void decodeAnchorMajor(const float* data, int classes, int anchors, cv::Point2f coordScale,
+        const LetterboxGeometry& geometry, std::vector<Detection>& out);
+    // [N, 5 + C]: Darknet, оценка - вероятность класса (уже с объектностью)
+    void decodeDarknet(const float* data, int classes, int anchors, cv::Point2f coordScale,
+        const LetterboxGeometry& geometry, std::vector<Detection>& out);
+
+    // NMS по классам на месте: остаются самые уверенные рамки, по убыванию уверенности
+    void nms(std::vector<Detection>& detections);
+
+    const Options& options() const { return m_options; }
+    void setThresholds(float confThreshold, float nmsThreshold);
+
+    SimdLevel simdLevel() const { return m_level; }
+    void setSimdLevel(SimdLevel level);
+
+private:
+    Options m_options;
+    SimdLevel m_level;
+
+    // Разрешённые классы: маска по номеру и список номеров для обхода
+    std::vector<uint8_t> m_allowMask;
+    std::vector<int> m_allowed;
+    int m_allowedCount = -1;            // Число классов, для которого построен m_allowed
+
+    // Лучший класс блока якорей (столбцовый просмотр)
+    std::vector<float> m_bestScore;
+    std::vector<int> m_bestClass;
+
+    // NMS: корзины классов, сетка оставленных рамок
+    std::vector<int> m_order;
+    std::vector<int> m_bucketStart;
+    std::vector<int> m_bucketNext;
+    std::vector<std::vector<int>> m_cells;
+    std::vector<int> m_touchedCells;
+    std::vector<Detection> m_kept;
+
+    const std::vector<int>& allowedClasses(int classes);
+    void addBox(float cx, float cy, float w, float h, float score, int classId, cv::Point2f coordScale,
+        const LetterboxGeometry& geometry, std::vector<Detection>& out) const;
+};
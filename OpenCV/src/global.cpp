@@ -1,17 +1,3 @@
-#include <string>
+#include "global.h"
 
-
-//  YOLOv3
-inline std::string YOLOv3CONF = "../models/yolov3.cfg";
-inline std::string YOLOv3WEIGHT = "../models/yolov3.weights";
-
-//  YOLOv8
-inline std::string YOLOv8n = "../models/yolov8n.onnx";
-inline std::string YOLOv8m = "../models/yolov8m.onnx";
-
-//  YOLOv26
-inline std::string YOLOv26n = "../models/yolov26n.onnx";
-inline std::string YOLOv26m = "../models/yolov26m.onnx";
-
-//  
-inline std::string CLASSES = "../models/coco.names";
\ No newline at end of file
+//      global.h,      main
\ No newline at end of file
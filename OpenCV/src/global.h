@@ -0,0 +1,20 @@
+﻿#pragma once
+
+#include <string>
+
+// Пути к моделям и классам (относительно каталога запуска)
+
+// Для YOLOv3
+inline std::string YOLOv3CONF = "../models/yolov3.cfg";
+inline std::string YOLOv3WEIGHT = "../models/yolov3.weights";
+
+// Для YOLOv8
+inline std::string YOLOv8n = "../models/yolov8n.onnx";
+inline std::string YOLOv8m = "../models/yolov8m.onnx";
+
+// Для YOLOv26
+inline std::string YOLOv26n = "../models/yolov26n.onnx";
+inline std::string YOLOv26m = "../models/yolov26m.onnx";
+
+// Для классов
+inline std::string CLASSES = "../models/coco.names";
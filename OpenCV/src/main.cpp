@@ -1,9 +1,37 @@
 ﻿#include <opencv2/opencv.hpp>
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
 #include "EdgeDetector.h"
 #include "BitGrid.h"
+#include "FramePipeline.h"
+#include "FrameSource.h"
+#include "DisplaySink.h"
+#include "StageMetrics.h"
+#include "HudLayer.h"
+#include "SnapshotWriter.h"
+#include "GridRecorder.h"
+#include "GridStream.h"
+#include "StreamScheduler.h"
+#include "yolo.h"
+#include "AsyncDetector.h"
+#include "DetectionGate.h"
+#include "RoiPlanner.h"
+#include "TiledDetector.h"
+#include "DetectorSelector.h"
+#include "ModelCache.h"
+#ifdef HAVE_TFLITE
+#include "TFLiteDetector.h"
+#endif
 
 // Вспомогательная функция для отображения информации о сжатии
 std::string getCompressionMethodName(CompressionMethod method) {
@@ -16,384 +44,1965 @@ std::string getCompressionMethodName(CompressionMethod method) {
     }
 }
 
-int main() {
-    setlocale(LC_ALL, "Russian");
+// Детекторы обработчика, загруженные в фоне (--lazy-load)
+struct LoadedDetectors {
+    std::unique_ptr<YoloDetector> detector;
+    std::unique_ptr<TiledDetector> tiledDetector;
+    std::unique_ptr<DetectorSelector> selector;
+};
+
+// Детекторы и режимы одного обработчика конвейера
+struct ViewerState {
+    CannyEdgeDetector cannyDetector;
+    CombinedEdgeDetector combinedDetector;
+
+    // Параметры по умолчанию
+    bool useCombinedDetector = false;
+    bool showOnlyEdges = false;
+    bool useBitGridMode = false;
+    bool useCompressedMode = false;
+    bool useFastFrontEnd = false;
+    bool useIncremental = false;
+    int pyramidLevel = 0;
+    bool usePyramidRefinement = false;
+    CompressionMethod compressionMethod = COMPRESSION_RLE;
+
+    int dilateSize = 2, erodeSize = 2;
+
+    // Буферы режима BitGrid, переиспользуются между кадрами
+    BitGrid edgeGrid;
+    uint64_t edgeGridFrame = ~uint64_t(0);  // Кадр, по которому построена edgeGrid
+    BitGrid decompressedGrid;
+    cv::Mat edgeImage;
+
+    // Кэшированный слой HUD обработчика
+    HudLayer hud;
+
+    // Детектор объектов (свой у каждого обработчика, nullptr - не задан --detect)
+    std::unique_ptr<YoloDetector> detector;
+    // Нарезанная детекция вместо detector (--detect-tiles), тоже своя у обработчика
+    std::unique_ptr<TiledDetector> tiledDetector;
+    // Пул моделей и размеров входа под бюджет задержки вместо detector (--detect-budget)
+    std::unique_ptr<DetectorSelector> selector;
+    bool useDetector = false;
+    // Фоновая загрузка детекторов (nullptr - без --lazy-load или уже вступили в работу)
+    std::shared_ptr<LoadedDetectors> pendingDetectors;
+    std::unique_ptr<BackgroundLoader> loader;
+    // Асинхронная детекция (общая для обработчиков, nullptr - выключена) и треки кадра
+    AsyncDetector* asyncDetector = nullptr;
+    std::vector<TrackedObject> tracks;
+    // Ворота детекции по активности границ (nullptr - без --detect-gate) и решение для последнего кадра
+    std::unique_ptr<DetectionGate> gate;
+    bool useGate = false;
+    GateDecision gateDecision = GATE_FIRST;
+    // Детекция по кропам областей комбинированного детектора (nullptr - без --detect-roi);
+    // пустые crops - весь кадр
+    std::unique_ptr<RoiPlanner> roiPlanner;
+    bool useRoi = false;
+    std::vector<cv::Rect> regions;
+    std::vector<cv::Rect> crops;
+
+    // Регистратор предзаписи и сетевой поток (общие для обработчиков, nullptr - выключены)
+    GridRecorder* recorder = nullptr;
+    GridStreamSender* sender = nullptr;
+    // Сжатая сетка кадра; после отправки в поток сюда возвращается свободный буфер
+    std::vector<uint8_t> compressedData;
+
+    ViewerState() {
+        cannyDetector.setThresholds(50.0, 150.0);
+        combinedDetector.setThresholds(50.0, 150.0);
+        combinedDetector.setMorphology(dilateSize, erodeSize);
+    }
+};
+
+// Загруженные детекторы вступают в работу у обработчика
+void installDetectors(ViewerState& state, LoadedDetectors& loaded) {
+    state.detector = std::move(loaded.detector);
+    state.tiledDetector = std::move(loaded.tiledDetector);
+    state.selector = std::move(loaded.selector);
+    state.useDetector = true;
+}
 
-    try {
-        // === Инициализация камеры ===
-        cv::VideoCapture cap(0);
-        cap.set(cv::CAP_PROP_FRAME_WIDTH, 640);
-        cap.set(cv::CAP_PROP_FRAME_HEIGHT, 480);
-        cap.set(cv::CAP_PROP_FPS, 30);
-
-        if (!cap.isOpened()) {
-            std::cerr << "Error: Could not open camera!" << std::endl;
-            return -1;
+std::string detectorDescription(const ViewerState& state) {
+    if (state.loader) {
+        return "loading in background";
+    }
+    if (state.selector) {
+        return state.selector->describe();
+    }
+    return state.tiledDetector ? state.tiledDetector->describe() : state.detector->describe();
+}
+
+// Обработка кадра и отрисовка HUD (поток обработчика).
+// packet.frame не изменяется, результат пишется в буфер пула packet.output
+void processFrame(ViewerState& state, FramePacket& packet, FramePool& pool) {
+    const cv::Mat& originalFrame = packet.frame.mat();
+    packet.output = pool.acquire(originalFrame.size(), CV_8UC3);
+    cv::Mat& frame = packet.output.writable();
+    HudLayer& hud = state.hud;
+    hud.begin(frame.size());
+    StartupTimer::instance().markFirstFrame();
+
+    // Фоновая загрузка закончилась - детектор вступает в работу с этого кадра
+    if (state.loader && state.loader->ready()) {
+        if (state.loader->succeeded()) {
+            installDetectors(state, *state.pendingDetectors);
         }
+        std::cout << "Detector " << (state.loader->succeeded() ? "ready" : "failed to load") << " after "
+            << state.loader->elapsedMs() << " ms in background" << std::endl;
+        state.loader.reset();
+        state.pendingDetectors.reset();
+        if (state.detector || state.tiledDetector || state.selector) {
+            std::cout << "Detector: " << detectorDescription(state) << std::endl;
+        }
+    }
 
-        // === Создание детекторов ===
-        CannyEdgeDetector cannyDetector(50.0, 150.0);
-        CombinedEdgeDetector combinedDetector(50.0, 150.0, 2, 2);
+    // Сетка этого кадра сжата (режим сжатия, запись или поток) - есть измерение для BYTES
+    bool gridCompressed = false;
 
-        // Параметры по умолчанию
-        bool useCombinedDetector = false;
-        bool showOnlyEdges = false;
-        bool useBitGridMode = false;
-        bool useCompressedMode = false;
-        CompressionMethod compressionMethod = COMPRESSION_RLE;
+    // Обработка в зависимости от режима
+    if (state.useBitGridMode) {
+        // Получаем битовую сетку в зависимости от выбранного детектора
+        BitGrid& edgeGrid = state.edgeGrid;
 
-        double cannyThresh1 = 50.0, cannyThresh2 = 150.0;
-        double combinedThresh1 = 50.0, combinedThresh2 = 150.0;
-        int dilateSize = 2, erodeSize = 2;
+        if (state.useCombinedDetector) {
+            edgeGrid = state.combinedDetector.getEdgeBitGrid(originalFrame);
+        }
+        else {
+            edgeGrid = state.cannyDetector.getEdgeBitGrid(originalFrame);
+        }
+        state.edgeGridFrame = packet.id;
 
-        // Для измерения FPS
-        auto lastTime = std::chrono::high_resolution_clock::now();
-        int frameCount = 0;
-        float fps = 0.0f;
+        if (state.useCompressedMode) {
+            // Режим сжатой битовой сетки
+            // Сжимаем битовую сетку
+            std::vector<uint8_t>& compressedData = state.compressedData;
+            edgeGrid.compress(state.compressionMethod, compressedData);
+            gridCompressed = true;
+            auto compInfo = edgeGrid.getCompressionInfo(compressedData);
 
-        cv::namedWindow("Edge Detector", cv::WINDOW_AUTOSIZE);
+            // Распаковываем для отображения
+            BitGrid& decompressedGrid = state.decompressedGrid;
+            decompressedGrid.decompress(compressedData);
 
-        cv::Mat frame;
+            // Конвертируем в изображение
+            decompressedGrid.toImage(state.edgeImage);
+            cv::cvtColor(state.edgeImage, frame, cv::COLOR_GRAY2BGR);
 
-        std::cout << "\n═══════════════════════════════════════════════════\n";
-        std::cout << "       Детекция границ с битовой сеткой\n";
-        std::cout << "═══════════════════════════════════════════════════\n";
-        std::cout << "Управление:\n";
-        std::cout << "  [1/2] - Переключить детектор (Canny/Combined)\n";
-        std::cout << "  [+/-] - Изменить пороги Канни\n";
-        std::cout << "  [c/C] - Переключить режим отображения (overlay/edges only)\n";
-        std::cout << "  [b/B] - Включить/выключить режим BitGrid\n";
-        std::cout << "  [z/Z] - Включить/выключить сжатие BitGrid\n";
-        std::cout << "  [m/M] - Сменить метод сжатия\n";
-        std::cout << "  [d/D] - Увеличить/уменьшить дилатацию (Combined)\n";
-        std::cout << "  [e/E] - Увеличить/уменьшить эрозию (Combined)\n";
-        std::cout << "  [r/R] - Сбросить параметры\n";
-        std::cout << "  [s/S] - Сохранить текущий кадр/битовую сетку\n";
-        std::cout << "  [ESC/Q] - Выход\n";
-        std::cout << "═══════════════════════════════════════════════════\n\n";
+            // Отображаем информацию о сжатии
+            hud.format(cv::Point(10, 30), 0.7, cv::Scalar(0, 255, 255), 2,
+                "COMPRESSED BITGRID [%s]", getCompressionMethodName(state.compressionMethod).c_str());
 
-        // === Главный цикл обработки ===
-        while (true) {
-            if (!cap.read(frame)) {
-                std::cerr << "Failed to grab frame!" << std::endl;
-                break;
+            hud.format(cv::Point(10, 60), 0.6, cv::Scalar(0, 200, 255), 1,
+                "Original: %d B", static_cast<int>(compInfo.originalSize));
+
+            hud.format(cv::Point(10, 85), 0.6, cv::Scalar(0, 200, 255), 1,
+                "Compressed: %d B", static_cast<int>(compInfo.compressedSize));
+
+            hud.format(cv::Point(10, 110), 0.6, cv::Scalar(0, 200, 255), 1,
+                "Ratio: %.1f%%", compInfo.ratio * 100.0f);
+
+            // Статистика границ
+            int edgesCount = edgeGrid.countTrue();
+            float edgesDensity = edgeGrid.density() * 100.0f;
+
+            hud.format(cv::Point(10, 135), 0.6, cv::Scalar(255, 200, 0), 1,
+                "Edges: %d", edgesCount);
+
+            hud.format(cv::Point(10, 160), 0.6, cv::Scalar(255, 200, 0), 1,
+                "Density: %.2f%%", edgesDensity);
+
+        }
+        else {
+            // Режим обычной битовой сетки (без сжатия)
+            // Конвертируем в изображение
+            edgeGrid.toImage(state.edgeImage);
+            cv::cvtColor(state.edgeImage, frame, cv::COLOR_GRAY2BGR);
+
+            // Отображаем информацию
+            hud.text("BITGRID MODE", cv::Point(10, 30), 0.7, cv::Scalar(0, 255, 255), 2);
+
+            hud.format(cv::Point(10, 60), 0.6, cv::Scalar(0, 200, 255), 1,
+                "Memory: %d bytes", static_cast<int>(edgeGrid.byteSize()));
+
+            // Статистика границ
+            int edgesCount = edgeGrid.countTrue();
+            float edgesDensity = edgeGrid.density() * 100.0f;
+
+            hud.format(cv::Point(10, 85), 0.6, cv::Scalar(255, 200, 0), 1,
+                "Edges: %d", edgesCount);
+
+            hud.format(cv::Point(10, 110), 0.6, cv::Scalar(255, 200, 0), 1,
+                "Density: %.2f%%", edgesDensity);
+        }
+
+    }
+    else {
+        // Обычный режим (без BitGrid); для записи и потока сетка упаковывается тем же проходом
+        bool needGrid = state.recorder || state.sender || (state.gate && state.useGate && state.useDetector);
+        BitGrid* recordGrid = needGrid ? &state.edgeGrid : nullptr;
+        if (state.useCombinedDetector) {
+            if (state.showOnlyEdges) {
+                state.combinedDetector.detectOnlyEdges(originalFrame, frame, recordGrid);
+                hud.text("Mode: Edges Only (Combined Method)", cv::Point(10, 30),
+                    0.7, cv::Scalar(255, 255, 255), 2);
+            }
+            else {
+                state.combinedDetector.detectAndDraw(originalFrame, frame, hud, recordGrid);
+            }
+        }
+        else {
+            if (state.showOnlyEdges) {
+                state.cannyDetector.detectOnlyEdges(originalFrame, frame, recordGrid);
+                hud.text("Mode: Edges Only (Canny)", cv::Point(10, 30),
+                    0.7, cv::Scalar(255, 255, 255), 2);
             }
+            else {
+                state.cannyDetector.detectAndDraw(originalFrame, frame, hud, recordGrid);
+            }
+        }
+        if (recordGrid) {
+            state.edgeGridFrame = packet.id;
+        }
 
-            // Измерение FPS
-            frameCount++;
-            auto currentTime = std::chrono::high_resolution_clock::now();
-            auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - lastTime);
+        // Отображаем информацию о детекторе
+        const char* detectorName = state.useCombinedDetector ?
+            "Combined Edge Detector" : "Canny Edge Detector";
 
-            if (elapsedTime.count() >= 1000) {
-                fps = frameCount * 1000.0f / elapsedTime.count();
-                frameCount = 0;
-                lastTime = currentTime;
+        hud.format(cv::Point(10, frame.rows - 100), 0.6, cv::Scalar(255, 200, 0), 2,
+            "Detector: %s", detectorName);
+    }
+
+    // Ворота: сеть нужна, только если сетка границ заметно изменилась с последней детекции
+    bool gated = state.gate && state.useGate && state.useDetector && state.edgeGridFrame == packet.id;
+    bool runDetector = true;
+    if (gated) {
+        state.gateDecision = state.gate->check(state.edgeGrid, packet.captureTicks);
+        runDetector = DetectionGate::runs(state.gateDecision);
+    }
+
+    // Сеть в потоке обработчика: своя или активная конфигурация бюджета
+    YoloDetector* yolo = state.selector ? &state.selector->active() : state.detector.get();
+
+    // Кропы по заполненным областям комбинированного детектора (построены на этом кадре)
+    bool roi = state.roiPlanner && state.useRoi && state.useDetector && state.useCombinedDetector &&
+        (yolo || state.asyncDetector);
+    state.crops.clear();
+    if (roi && runDetector) {
+        const YoloDetector& model = yolo ? *yolo : state.asyncDetector->detector();
+        state.combinedDetector.regionBoxes(originalFrame.size(), 1, state.regions);
+        state.crops = state.roiPlanner->plan(state.regions, originalFrame.size(), model.options().inputSize);
+    }
+
+    // Объекты YOLO поверх результата; время стадий - в строке HUD
+    if (yolo && state.useDetector) {
+        // Пропуск воротами - рамки прошлой детекции
+        const std::vector<Detection>& detections = runDetector ?
+            yolo->detectRegions(originalFrame, state.crops) : yolo->detections();
+        if (runDetector) {
+            StartupTimer::instance().markFirstDetection();
+        }
+        if (gated && runDetector) {
+            state.gate->accept(state.edgeGrid, packet.captureTicks);
+        }
+        yolo->draw(frame, detections);
+        const YoloDetector::Timings& timings = yolo->timings();
+        // Время кадра - в окно бюджета; после него активной может стать другая конфигурация
+        if (state.selector && runDetector) {
+            DetectorSelector& selector = *state.selector;
+            const int active = selector.activeIndex();
+            selector.record(timings.preprocessMs + timings.inferenceMs + timings.postprocessMs);
+            // У новой конфигурации рамки от пробного кадра или давнего прохода - пропуск
+            // воротами показал бы их, поэтому следующий кадр идёт в сеть
+            if (selector.activeIndex() != active && state.gate) {
+                state.gate->invalidate();
             }
+            hud.format(cv::Point(10, frame.rows - 200), 0.5, cv::Scalar(0, 200, 255), 1,
+                "Budget %.0f ms: %s, p95 %.1f ms, load x%.2f, %d switches", selector.options().budgetMs,
+                selector.candidate(selector.activeIndex()).name.c_str(), selector.activeP95(), selector.loadFactor(),
+                static_cast<int>(selector.switches().size()) - 1);
+        }
+        hud.format(cv::Point(10, frame.rows - 125), 0.5, cv::Scalar(0, 255, 0), 1,
+            "YOLO %d obj, batch %d: pre %.1f, infer %.1f, post %.1f ms", static_cast<int>(detections.size()),
+            timings.batch, timings.preprocessMs, timings.inferenceMs, timings.postprocessMs);
+    }
+    // Тайлы размера входа по всему кадру, параллельно на нескольких копиях сети
+    else if (state.tiledDetector && state.useDetector) {
+        TiledDetector& detector = *state.tiledDetector;
+        const std::vector<Detection>& detections = runDetector ? detector.detect(originalFrame) : detector.detections();
+        if (runDetector) {
+            StartupTimer::instance().markFirstDetection();
+        }
+        if (gated && runDetector) {
+            state.gate->accept(state.edgeGrid, packet.captureTicks);
+        }
+        detector.draw(frame, detections);
+        const TiledDetector::Stats& stats = detector.stats();
+        hud.format(cv::Point(10, frame.rows - 125), 0.5, cv::Scalar(0, 255, 0), 1,
+            "YOLO tiled %d obj: %d tiles on %d net(s), %.1f ms", static_cast<int>(detections.size()),
+            stats.lastTiles, detector.options().instances, stats.lastMs);
+    }
+    // Модель ещё загружается - кадры идут без детекции
+    else if (state.loader || (state.asyncDetector && state.useDetector && !state.asyncDetector->ready())) {
+        hud.format(cv::Point(10, frame.rows - 125), 0.5, cv::Scalar(0, 200, 255), 1,
+            "YOLO: loading model, %.1f s since start", StartupTimer::instance().elapsedMs() * 1e-3);
+    }
+    // Асинхронно: кадр уходит в сеть, только если она свободна; рамки - от трекера
+    else if (state.asyncDetector && state.useDetector) {
+        AsyncDetector& detector = *state.asyncDetector;
+        bool submitted = runDetector && detector.submit(originalFrame, packet.id, packet.captureTicks, state.crops);
+        if (gated && submitted) {
+            state.gate->accept(state.edgeGrid, packet.captureTicks);
+        }
+        detector.tracks(packet.captureTicks, state.tracks);
+        detector.draw(frame, state.tracks);
+        double staleMs = 0.0;
+        for (const TrackedObject& object : state.tracks) {
+            staleMs = std::max(staleMs, object.staleMs);
+        }
+        AsyncDetector::Stats stats = detector.stats();
+        hud.format(cv::Point(10, frame.rows - 125), 0.5, cv::Scalar(0, 255, 0), 1,
+            "YOLO async %d tracks: latency %.0f ms, stale %.0f ms, infer %.0f ms, every %.0f ms",
+            static_cast<int>(state.tracks.size()), stats.lastLatencyMs, staleMs, stats.lastInferenceMs,
+            std::max(stats.intervalMs, stats.lastInferenceMs));
+    }
+    if (roi && runDetector) {
+        for (const cv::Rect& crop : state.crops) {
+            cv::rectangle(frame, crop, cv::Scalar(160, 160, 160), 1);
+        }
+        hud.format(cv::Point(10, frame.rows - 175), 0.5, cv::Scalar(0, 200, 255), 1,
+            "ROI: %d regions -> %s", static_cast<int>(state.regions.size()),
+            state.crops.empty() ? "full frame" : (std::to_string(state.crops.size()) + " crops, " +
+                std::to_string(cvRound(state.roiPlanner->coverage() * 100.0)) + "% of frame").c_str());
+    }
+    if (gated) {
+        const DetectionGate::Stats& gateStats = state.gate->stats();
+        hud.format(cv::Point(10, frame.rows - 150), 0.5, cv::Scalar(0, 200, 255), 1,
+            "Gate: %s, changed tiles %d/%d, skipped %.0f%%", DetectionGate::decisionName(state.gateDecision),
+            gateStats.lastChangedTiles, gateStats.tileCount, gateStats.skipRate() * 100.0);
+    }
 
-            cv::Mat originalFrame = frame.clone();
+    // Сетка кадра сжимается один раз (в режиме сжатия - уже сжата) для предзаписи и потока
+    if ((state.recorder || state.sender) && state.edgeGridFrame == packet.id) {
+        if (!gridCompressed) {
+            state.edgeGrid.compress(state.compressionMethod, state.compressedData);
+            gridCompressed = true;
+        }
+        double tickNs = 1e9 / cv::getTickFrequency();
+        if (state.recorder) {
+            state.recorder->record(state.compressedData.data(), state.compressedData.size(), packet.id,
+                static_cast<uint64_t>(packet.captureTicks * tickNs));
+        }
+        if (state.sender) {
+            uint64_t captureAgeNs = static_cast<uint64_t>((cv::getTickCount() - packet.captureTicks) * tickNs);
+            state.sender->submit(state.compressedData, packet.id, GridStreamSender::wallClockNs() - captureAgeNs);
+        }
+    }
 
-            // Обработка в зависимости от режима
-            if (useBitGridMode) {
-                // Получаем битовую сетку в зависимости от выбранного детектора
-                BitGrid edgeGrid;
+    // Обратная связь для удержания бюджета канала. Без сжатой сетки измерения
+    // нет, и BYTES держит пороги (см. подсказку ниже)
+    ThresholdController& activeController = state.useCombinedDetector ?
+        state.combinedDetector.thresholdController() : state.cannyDetector.thresholdController();
+    if (gridCompressed) {
+        activeController.observeCompressedSize(static_cast<int>(state.compressedData.size()));
+    }
 
-                if (useCombinedDetector) {
-                    edgeGrid = combinedDetector.getEdgeBitGrid(frame);
-                }
-                else {
-                    edgeGrid = cannyDetector.getEdgeBitGrid(frame);
-                }
+    ScopedStageTimer hudTimer(METRIC_HUD);
 
-                if (useCompressedMode) {
-                    // Режим сжатой битовой сетки
-                    // Сжимаем битовую сетку
-                    auto compressedData = edgeGrid.compress(compressionMethod);
-                    auto compInfo = edgeGrid.getCompressionInfo(compressedData);
+    // Отображение информации о режиме и FPS
+    const char* modeInfo;
+    if (state.useBitGridMode) {
+        modeInfo = state.useCompressedMode ? "[Compressed BitGrid]" : "[BitGrid]";
+    }
+    else {
+        modeInfo = state.showOnlyEdges ? "[Edges Only]" : "[Overlay]";
+    }
 
-                    // Распаковываем для отображения
-                    BitGrid decompressedGrid;
-                    decompressedGrid.decompress(compressedData);
+    hud.format(cv::Point(frame.cols - 200, 30), 0.7, cv::Scalar(255, 100, 0), 2, "%s", modeInfo);
+
+    // Отображение подсказок управления
+    hud.text("[ESC/Q] - Exit", cv::Point(10, frame.rows - 70),
+        0.6, cv::Scalar(0, 255, 255), 2);
+    hud.text("[1/2] - Switch Detector", cv::Point(10, frame.rows - 45),
+        0.5, cv::Scalar(200, 200, 200), 1);
+    hud.text("[b] - BitGrid, [z] - Compress", cv::Point(10, frame.rows - 25),
+        0.5, cv::Scalar(200, 200, 200), 1);
+
+    // Текущие пороги при автоподборе
+    if (activeController.enabled()) {
+        double low = state.useCombinedDetector ? state.combinedDetector.lowThreshold() : state.cannyDetector.lowThreshold();
+        double high = state.useCombinedDetector ? state.combinedDetector.highThreshold() : state.cannyDetector.highThreshold();
+        hud.format(cv::Point(frame.cols - 200, 140), 0.5, cv::Scalar(0, 255, 0), 1,
+            "Auto %s: %d/%d", ThresholdController::modeName(activeController.mode()),
+            static_cast<int>(low), static_cast<int>(high));
+        if (activeController.mode() == ThresholdController::ADAPTIVE_BYTES && !gridCompressed) {
+            hud.text("BYTES: no compressed grid, [b]+[z]", cv::Point(frame.cols - 260, 190),
+                0.5, cv::Scalar(0, 0, 255), 1);
+        }
+    }
 
-                    // Конвертируем в изображение
-                    cv::Mat edgeImage = decompressedGrid.toImage();
-                    cv::cvtColor(edgeImage, frame, cv::COLOR_GRAY2BGR);
+    // Задержка текущего уровня пирамиды
+    if (state.pyramidLevel > 0) {
+        const PyramidEdgeRunner& runner = state.useCombinedDetector ?
+            state.combinedDetector.pyramidRunner() : state.cannyDetector.pyramidRunner();
+        hud.format(cv::Point(frame.cols - 200, 165), 0.5, cv::Scalar(0, 255, 0), 1,
+            "Level 1/%d%s %.2f ms", 1 << state.pyramidLevel, state.usePyramidRefinement ? "+R:" : ":",
+            runner.stats(state.pyramidLevel).totalMs);
+    }
 
-                    // Отображаем информацию о сжатии
-                    std::string compressionInfo = "COMPRESSED BITGRID [" +
-                        getCompressionMethodName(compressionMethod) + "]";
+    // Доля тайлов, пересчитанных в инкрементальном режиме
+    if (state.useIncremental) {
+        float recomputed = state.useCombinedDetector ?
+            state.combinedDetector.recomputedFraction() : state.cannyDetector.recomputedFraction();
+        hud.format(cv::Point(frame.cols - 150, 115), 0.5, cv::Scalar(0, 255, 0), 1,
+            "Tiles: %d%%", static_cast<int>(recomputed * 100.0f));
+    }
 
-                    cv::putText(frame, compressionInfo, cv::Point(10, 30),
-                        cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 255), 2);
+    // Если включен режим сжатия, показываем текущий метод
+    if (state.useCompressedMode) {
+        hud.format(cv::Point(frame.cols - 200, 90), 0.5, cv::Scalar(200, 200, 0), 1,
+            "Compression: %s", getCompressionMethodName(state.compressionMethod).c_str());
+    }
 
-                    cv::putText(frame, "Original: " + std::to_string(compInfo.originalSize) + " B",
-                        cv::Point(10, 60), cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0, 200, 255), 1);
+    hud.compose(frame);
+}
 
-                    cv::putText(frame, "Compressed: " + std::to_string(compInfo.compressedSize) + " B",
-                        cv::Point(10, 85), cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0, 200, 255), 1);
+// Обработка клавиши (поток обработчика, после обработки кадра).
+// Сообщения и сохранение файлов - только у основного обработчика
+void handleKey(ViewerState& state, int key, FramePacket& packet, bool primary, SnapshotWriter& writer) {
+    std::ostream out(primary ? std::cout.rdbuf() : nullptr);
+    const cv::Mat& originalFrame = packet.frame.mat();
 
-                    cv::putText(frame, "Ratio: " + std::to_string(compInfo.ratio * 100.0f).substr(0, 4) + "%",
-                        cv::Point(10, 110), cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0, 200, 255), 1);
+    // Переключение детекторов
+    if (key == '1') {
+        state.useCombinedDetector = false;
+        out << "Switched to Canny Edge Detector" << std::endl;
+    }
 
-                    // Статистика границ
-                    int edgesCount = edgeGrid.countTrue();
-                    float edgesDensity = edgeGrid.density() * 100.0f;
+    if (key == '2') {
+        state.useCombinedDetector = true;
+        out << "Switched to Combined Edge Detector" << std::endl;
+    }
 
-                    cv::putText(frame, "Edges: " + std::to_string(edgesCount),
-                        cv::Point(10, 135), cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(255, 200, 0), 1);
+    // Переключение режима отображения
+    if (key == 'c' || key == 'C') {
+        state.showOnlyEdges = !state.showOnlyEdges;
+        out << "Mode switched: "
+            << (state.showOnlyEdges ? "edges only" : "overlay mode")
+            << std::endl;
+    }
 
-                    cv::putText(frame, "Density: " + std::to_string(edgesDensity).substr(0, 4) + "%",
-                        cv::Point(10, 160), cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(255, 200, 0), 1);
+    // Включение/выключение режима BitGrid
+    if (key == 'b' || key == 'B') {
+        state.useBitGridMode = !state.useBitGridMode;
+        out << "BitGrid mode: " << (state.useBitGridMode ? "ON" : "OFF") << std::endl;
+    }
 
-                }
-                else {
-                    // Режим обычной битовой сетки (без сжатия)
-                    // Конвертируем в изображение
-                    cv::Mat edgeImage = edgeGrid.toImage();
-                    cv::cvtColor(edgeImage, frame, cv::COLOR_GRAY2BGR);
+    // Включение/выключение режима сжатия
+    if (key == 'z' || key == 'Z') {
+        state.useCompressedMode = !state.useCompressedMode;
+        out << "Compressed BitGrid mode: " <<
+            (state.useCompressedMode ? "ON" : "OFF") << std::endl;
+    }
 
-                    // Отображаем информацию
-                    cv::putText(frame, "BITGRID MODE", cv::Point(10, 30),
-                        cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 255), 2);
+    // Смена метода сжатия
+    if (key == 'm' || key == 'M') {
+        int currentMethod = static_cast<int>(state.compressionMethod);
+        currentMethod = (currentMethod + 1) % 4;
+        state.compressionMethod = static_cast<CompressionMethod>(currentMethod);
+        out << "Compression method: " <<
+            getCompressionMethodName(state.compressionMethod) << std::endl;
+    }
 
-                    cv::putText(frame, "Memory: " + std::to_string(edgeGrid.byteSize()) + " bytes",
-                        cv::Point(10, 60), cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0, 200, 255), 1);
+    // Включение/выключение инкрементального режима
+    if (key == 'i' || key == 'I') {
+        state.useIncremental = !state.useIncremental;
+        state.cannyDetector.setIncremental(state.useIncremental);
+        state.combinedDetector.setIncremental(state.useIncremental);
+        out << "Incremental mode: " << (state.useIncremental ? "ON" : "OFF") << std::endl;
+    }
 
-                    // Статистика границ
-                    int edgesCount = edgeGrid.countTrue();
-                    float edgesDensity = edgeGrid.density() * 100.0f;
+    // Смена уровня пирамиды и уточнения границ
+    if (key == 'p' || key == 'P') {
+        if (key == 'p') {
+            state.pyramidLevel = (state.pyramidLevel + 1) % (PyramidEdgeRunner::kMaxLevel + 1);
+        }
+        else {
+            state.usePyramidRefinement = !state.usePyramidRefinement;
+        }
+        state.cannyDetector.setPyramidLevel(state.pyramidLevel);
+        state.combinedDetector.setPyramidLevel(state.pyramidLevel);
+        state.cannyDetector.setPyramidRefinement(state.usePyramidRefinement);
+        state.combinedDetector.setPyramidRefinement(state.usePyramidRefinement);
+
+        out << "Pyramid level: 1/" << (1 << state.pyramidLevel)
+            << ", refinement " << (state.usePyramidRefinement ? "ON" : "OFF") << std::endl;
+
+        // Задержки всех уровней, на которых уже работал текущий детектор
+        const PyramidEdgeRunner& runner = state.useCombinedDetector ?
+            state.combinedDetector.pyramidRunner() : state.cannyDetector.pyramidRunner();
+        for (int level = 0; level <= PyramidEdgeRunner::kMaxLevel; ++level) {
+            const PyramidEdgeRunner::LevelStats& stats = runner.stats(level);
+            if (stats.frames == 0) continue;
+            out << "  1/" << (1 << level) << ": total " << std::fixed << std::setprecision(2)
+                << stats.totalMs << " ms (downscale " << stats.downscaleMs
+                << ", detect " << stats.detectMs << ", upsample " << stats.upsampleMs
+                << ", refine " << stats.refineMs << ")" << std::endl;
+        }
+        out.unsetf(std::ios::fixed);
+    }
 
-                    cv::putText(frame, "Edges: " + std::to_string(edgesCount),
-                        cv::Point(10, 85), cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(255, 200, 0), 1);
+    // Включение/выключение детекции объектов YOLO
+    if ((key == 'y' || key == 'Y') && (state.detector || state.tiledDetector || state.selector || state.asyncDetector)) {
+        state.useDetector = !state.useDetector;
+        if (primary) {
+            out << "Object detection: " << (state.useDetector ? "ON" : "OFF") << std::endl;
+        }
+    }
 
-                    cv::putText(frame, "Density: " + std::to_string(edgesDensity).substr(0, 4) + "%",
-                        cv::Point(10, 110), cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(255, 200, 0), 1);
-                }
+    // Детекция по кропам областей / по всему кадру
+    if ((key == 'o' || key == 'O') && state.roiPlanner) {
+        state.useRoi = !state.useRoi;
+        if (primary) {
+            out << "ROI detection: " << (state.useRoi ? "ON" : "OFF") << std::endl;
+        }
+    }
 
-            }
-            else {
-                // Обычный режим (без BitGrid)
-                if (useCombinedDetector) {
-                    if (showOnlyEdges) {
-                        combinedDetector.detectOnlyEdges(frame);
-                        cv::putText(frame, "Mode: Edges Only (Combined Method)", cv::Point(10, 30),
-                            cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(255, 255, 255), 2);
-                    }
-                    else {
-                        combinedDetector.detectAndDraw(frame);
-                    }
-                }
-                else {
-                    if (showOnlyEdges) {
-                        cannyDetector.detectOnlyEdges(frame);
-                        cv::putText(frame, "Mode: Edges Only (Canny)", cv::Point(10, 30),
-                            cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(255, 255, 255), 2);
-                    }
-                    else {
-                        cannyDetector.detectAndDraw(frame);
-                    }
-                }
+    // Ворота детекции: при включении первый кадр всегда идёт в сеть
+    if ((key == 'g' || key == 'G') && state.gate) {
+        state.useGate = !state.useGate;
+        state.gate->invalidate();
+        if (primary) {
+            out << "Detection gate: " << (state.useGate ? "ON" : "OFF") << std::endl;
+        }
+    }
 
-                // Отображаем информацию о детекторе
-                std::string detectorName = useCombinedDetector ?
-                    "Combined Edge Detector" : "Canny Edge Detector";
+    // Включение/выключение совмещённого SIMD-фронтенда
+    if (key == 'f' || key == 'F') {
+        state.useFastFrontEnd = !state.useFastFrontEnd;
+        state.cannyDetector.setFastFrontEnd(state.useFastFrontEnd);
+        state.combinedDetector.setFastFrontEnd(state.useFastFrontEnd);
+
+        FastFrontEnd& frontEnd = state.cannyDetector.frontEnd();
+        out << "Fast front end: " << (state.useFastFrontEnd ? "ON" : "OFF")
+            << " [" << FastFrontEnd::simdLevelName(frontEnd.simdLevel()) << "]" << std::endl;
+        if (state.useFastFrontEnd && primary) {
+            int deviation = frontEnd.compareWithReference(originalFrame);
+            out << "Gradient deviation from OpenCV path: " << deviation
+                << " (tolerance " << FastFrontEnd::kMaxGradientDeviation << ")" << std::endl;
+        }
+    }
 
-                cv::putText(frame, "Detector: " + detectorName,
-                    cv::Point(10, frame.rows - 100), cv::FONT_HERSHEY_SIMPLEX,
-                    0.6, cv::Scalar(255, 200, 0), 2);
-            }
+    // Сброс параметров для текущего детектора
+    if (key == 'r' || key == 'R') {
+        if (state.useCombinedDetector) {
+            state.dilateSize = 2; state.erodeSize = 2;
+            state.combinedDetector.setThresholds(50.0, 150.0);
+            state.combinedDetector.setMorphology(state.dilateSize, state.erodeSize);
+            out << "Combined detector parameters reset: thresholds " << state.combinedDetector.lowThreshold()
+                << ", " << state.combinedDetector.highThreshold()
+                << ", dilation " << state.dilateSize << ", erosion " << state.erodeSize << std::endl;
+        }
+        else {
+            state.cannyDetector.setThresholds(50.0, 150.0);
+            out << "Canny detector parameters reset: " << state.cannyDetector.lowThreshold()
+                << ", " << state.cannyDetector.highThreshold() << std::endl;
+        }
+    }
+
+    // Изменение порогов Канни для текущего детектора (без пересоздания)
+    if (key == '+' || key == '=') {
+        if (state.useCombinedDetector) {
+            state.combinedDetector.setThresholds(state.combinedDetector.lowThreshold() + 10,
+                state.combinedDetector.highThreshold() + 20);
+            out << "Combined Canny thresholds increased: " << state.combinedDetector.lowThreshold()
+                << ", " << state.combinedDetector.highThreshold() << std::endl;
+        }
+        else {
+            state.cannyDetector.setThresholds(state.cannyDetector.lowThreshold() + 10,
+                state.cannyDetector.highThreshold() + 20);
+            out << "Canny thresholds increased: " << state.cannyDetector.lowThreshold()
+                << ", " << state.cannyDetector.highThreshold() << std::endl;
+        }
+    }
+
+    if (key == '-' || key == '_') {
+        if (state.useCombinedDetector) {
+            state.combinedDetector.setThresholds(std::max(10.0, state.combinedDetector.lowThreshold() - 10),
+                std::max(30.0, state.combinedDetector.highThreshold() - 20));
+            out << "Combined Canny thresholds decreased: " << state.combinedDetector.lowThreshold()
+                << ", " << state.combinedDetector.highThreshold() << std::endl;
+        }
+        else {
+            state.cannyDetector.setThresholds(std::max(10.0, state.cannyDetector.lowThreshold() - 10),
+                std::max(30.0, state.cannyDetector.highThreshold() - 20));
+            out << "Canny thresholds decreased: " << state.cannyDetector.lowThreshold()
+                << ", " << state.cannyDetector.highThreshold() << std::endl;
+        }
+    }
 
-            // Отображение информации о режиме и FPS
-            std::string modeInfo;
-            if (useBitGridMode) {
-                modeInfo = useCompressedMode ? "[Compressed BitGrid]" : "[BitGrid]";
+    // Переключение автоматического подбора порогов
+    if (key == 'a' || key == 'A') {
+        ThresholdController& controller = state.useCombinedDetector ?
+            state.combinedDetector.thresholdController() : state.cannyDetector.thresholdController();
+        int mode = (static_cast<int>(controller.mode()) + 1) % 4;
+        controller.setMode(static_cast<ThresholdController::Mode>(mode));
+        out << "Adaptive thresholds: " << ThresholdController::modeName(controller.mode())
+            << " (target density " << controller.targetDensity() * 100.0f << "%, byte budget "
+            << controller.byteBudget() << " B)" << std::endl;
+        // Бюджет измеряется по сжатой сетке: без неё пороги не меняются
+        bool compressing = (state.useBitGridMode && state.useCompressedMode) || state.recorder || state.sender;
+        if (controller.mode() == ThresholdController::ADAPTIVE_BYTES && !compressing) {
+            out << "Note: BYTES mode needs a compressed grid - press 'b' and 'z' (or use --record/--stream)"
+                << std::endl;
+        }
+    }
+
+    // Изменение параметров дилатации/эрозии только для Combined детектора
+    if (state.useCombinedDetector) {
+        if (key == 'd') {
+            state.dilateSize = std::min(10, state.dilateSize + 1);
+            state.combinedDetector.setMorphology(state.dilateSize, state.erodeSize);
+            out << "Dilation size increased: " << state.dilateSize << std::endl;
+        }
+
+        if (key == 'D') {
+            state.dilateSize = std::max(1, state.dilateSize - 1);
+            state.combinedDetector.setMorphology(state.dilateSize, state.erodeSize);
+            out << "Dilation size decreased: " << state.dilateSize << std::endl;
+        }
+
+        if (key == 'e') {
+            state.erodeSize = std::min(10, state.erodeSize + 1);
+            state.combinedDetector.setMorphology(state.dilateSize, state.erodeSize);
+            out << "Erosion size increased: " << state.erodeSize << std::endl;
+        }
+
+        if (key == 'E') {
+            state.erodeSize = std::max(1, state.erodeSize - 1);
+            state.combinedDetector.setMorphology(state.dilateSize, state.erodeSize);
+            out << "Erosion size decreased: " << state.erodeSize << std::endl;
+        }
+    }
+
+    // Сохранение текущего кадра: кодирование и запись в фоновом потоке
+    if ((key == 's' || key == 'S') && primary) {
+        std::string filename;
+        if (state.useBitGridMode) {
+            // Сетка этого кадра уже построена в processFrame
+            BitGrid edgeGrid;
+            if (state.edgeGridFrame == packet.id) {
+                edgeGrid = state.edgeGrid;
+            }
+            else if (state.useCombinedDetector) {
+                edgeGrid = state.combinedDetector.getEdgeBitGrid(originalFrame);
             }
             else {
-                modeInfo = showOnlyEdges ? "[Edges Only]" : "[Overlay]";
+                edgeGrid = state.cannyDetector.getEdgeBitGrid(originalFrame);
             }
 
-            cv::putText(frame, modeInfo, cv::Point(frame.cols - 200, 30),
-                cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(255, 100, 0), 2);
-
-            // Отображение FPS
-            std::string fpsText = "FPS: " + std::to_string(static_cast<int>(fps));
-            cv::putText(frame, fpsText, cv::Point(frame.cols - 150, 60),
-                cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0, 255, 0), 2);
+            if (state.useCompressedMode) {
+                filename = writer.submitGrid(std::move(edgeGrid), "compressed_bitgrid", state.compressionMethod);
+                if (!filename.empty()) {
+                    out << "Saving compressed bitgrid to: " << filename << std::endl;
+                }
+            }
+            else {
+                filename = writer.submitGrid(std::move(edgeGrid), "bitgrid", COMPRESSION_RLE);
+                if (!filename.empty()) {
+                    out << "Saving bitgrid to: " << filename << std::endl;
+                }
+            }
+        }
+        else {
+            // Снимок буфера пула: поток отображения при записи HUD получит копию
+            filename = writer.submitFrame(packet.output, "frame", ".jpg");
+            if (!filename.empty()) {
+                out << "Saving frame to: " << filename << std::endl;
+            }
+        }
 
-            // Отображение подсказок управления
-            cv::putText(frame, "[ESC/Q] - Exit", cv::Point(10, frame.rows - 70),
-                cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0, 255, 255), 2);
-            cv::putText(frame, "[1/2] - Switch Detector", cv::Point(10, frame.rows - 45),
-                cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(200, 200, 200), 1);
-            cv::putText(frame, "[b] - BitGrid, [z] - Compress", cv::Point(10, frame.rows - 25),
-                cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(200, 200, 200), 1);
+        if (filename.empty()) {
+            out << "Snapshot writer is busy (" << writer.stats().pending << " pending), snapshot skipped" << std::endl;
+        }
 
-            // Если включен режим сжатия, показываем текущий метод
-            if (useCompressedMode) {
-                cv::putText(frame, "Compression: " + getCompressionMethodName(compressionMethod),
-                    cv::Point(frame.cols - 200, 90), cv::FONT_HERSHEY_SIMPLEX,
-                    0.5, cv::Scalar(200, 200, 0), 1);
+        // Окно предзаписи до нажатия сохраняется вместе со снимком
+        if (state.recorder) {
+            GridRecorder::Stats window = state.recorder->stats();
+            std::string windowFile = state.recorder->trigger();
+            if (!windowFile.empty()) {
+                out << "Saving " << window.frames << " frames (" << std::fixed << std::setprecision(1)
+                    << window.seconds << " s) before trigger to: " << windowFile << std::endl;
             }
+        }
+    }
+}
 
-            cv::imshow("Edge Detector", frame);
+// Политика очереди из аргумента командной строки
+DropPolicy parseDropPolicy(const char* name) {
+    if (std::strcmp(name, "block") == 0) return DROP_BLOCK;
+    if (std::strcmp(name, "newest") == 0) return DROP_NEWEST;
+    return DROP_LATEST_ONLY;
+}
 
-            // Обработка нажатий клавиш
-            int key = cv::waitKey(1);
+// Темп источника из аргумента командной строки
+SourcePacing parsePacing(const char* name) {
+    if (std::strcmp(name, "fixed") == 0) return PACING_FIXED;
+    if (std::strcmp(name, "unlimited") == 0) return PACING_UNLIMITED;
+    return PACING_NATIVE;
+}
 
-            // Выход
-            if (key == 27 || key == 'q' || key == 'Q') break;
+// Разбивка задержек по стадиям за последнюю секунду (поток отображения)
+void drawMetricsBreakdown(HudLayer& hud, cv::Size frameSize, const StageMetrics::Report& window) {
+    int x = frameSize.width - 250, y = 215;
+    hud.text("ms: p50 / p95 / p99 / max", cv::Point(x, y), 0.4, cv::Scalar(0, 255, 255), 1);
 
-            // Переключение детекторов
-            if (key == '1') {
-                useCombinedDetector = false;
-                std::cout << "Switched to Canny Edge Detector" << std::endl;
-            }
+    for (size_t i = 0; i < window.size(); ++i) {
+        const LatencyHistogram::Snapshot& stage = window[i];
+        if (stage.count == 0) {
+            continue;
+        }
+        y += 16;
+        hud.format(cv::Point(x, y), 0.4, cv::Scalar(0, 255, 255), 1, "%-10s %5.2f %5.2f %5.2f %6.2f",
+            StageMetrics::stageName(static_cast<MetricStage>(i)), stage.percentileMs(0.5),
+            stage.percentileMs(0.95), stage.percentileMs(0.99), stage.maxMs());
+    }
+}
 
-            if (key == '2') {
-                useCombinedDetector = true;
-                std::cout << "Switched to Combined Edge Detector" << std::endl;
+// Режим приёмника: сжатые сетки из сети отображаются и (с --prerecord или
+// --record-continuous) записываются. Раз в секунду - поток кадров, полоса
+// и задержка захват -> приём по меткам времени отправителя
+int runReceiver(const StreamEndpoint& endpoint, bool headless, bool hudEnabled, uint64_t maxFrames,
+    GridRecorder* recorder) {
+    GridStreamReceiver receiver(endpoint);
+    if (!receiver.open()) {
+        std::cerr << "Error: Could not listen on " << endpoint.describe() << "!" << std::endl;
+        return -1;
+    }
+    std::cout << "Receiving BitGrid stream on " << endpoint.describe() << std::endl;
+
+    std::unique_ptr<DisplaySink> display = DisplaySink::create(headless, "Edge Stream");
+    HudLayer hud;
+    hud.setEnabled(hudEnabled);
+
+    LatencyHistogram latency;
+    LatencyHistogram::Snapshot latencyTotal;
+    GridStreamReceiver::Stats lastStats;
+    GridStreamReceiver::Frame frame;
+    BitGrid grid;
+    cv::Mat edgeImage, view;
+
+    auto lastReport = std::chrono::steady_clock::now();
+    int fps = 0;
+    double mbps = 0.0, latencyP50 = 0.0, latencyP95 = 0.0;
+
+    while (maxFrames == 0 || receiver.stats().frames < maxFrames) {
+        if (receiver.receive(frame, 100)) {
+            if (frame.receivedNs > frame.timestampNs) {
+                latency.record(frame.receivedNs - frame.timestampNs);
+            }
+            if (recorder) {
+                recorder->record(frame.data.data(), frame.data.size(), frame.frameId, frame.timestampNs);
             }
 
-            // Переключение режима отображения
-            if (key == 'c' || key == 'C') {
-                showOnlyEdges = !showOnlyEdges;
-                std::cout << "Mode switched: "
-                    << (showOnlyEdges ? "edges only" : "overlay mode")
-                    << std::endl;
+            if (display->visible() && grid.decompress(frame.data)) {
+                grid.toImage(edgeImage);
+                cv::cvtColor(edgeImage, view, cv::COLOR_GRAY2BGR);
+
+                hud.begin(view.size());
+                hud.format(cv::Point(10, 30), 0.6, cv::Scalar(0, 255, 255), 2,
+                    "STREAM %d FPS, %.2f Mbit/s", fps, mbps);
+                hud.format(cv::Point(10, 55), 0.5, cv::Scalar(0, 200, 255), 1,
+                    "Latency p50 %.2f / p95 %.2f ms", latencyP50, latencyP95);
+                hud.format(cv::Point(10, 80), 0.5, cv::Scalar(0, 200, 255), 1,
+                    "Frame %llu, lost %llu", static_cast<unsigned long long>(frame.frameId),
+                    static_cast<unsigned long long>(receiver.stats().lost));
+                hud.compose(view);
+                display->show(view);
             }
+        }
 
-            // Включение/выключение режима BitGrid
-            if (key == 'b' || key == 'B') {
-                useBitGridMode = !useBitGridMode;
-                std::cout << "BitGrid mode: " << (useBitGridMode ? "ON" : "OFF") << std::endl;
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastReport).count();
+        if (elapsed >= 1.0) {
+            GridStreamReceiver::Stats stats = receiver.stats();
+            LatencyHistogram::Snapshot current = latency.snapshot();
+            LatencyHistogram::Snapshot window = current.since(latencyTotal);
+            latencyTotal = current;
+
+            fps = static_cast<int>((stats.frames - lastStats.frames) / elapsed + 0.5);
+            mbps = (stats.bytes - lastStats.bytes) * 8e-6 / elapsed;
+            latencyP50 = window.percentileMs(0.5);
+            latencyP95 = window.percentileMs(0.95);
+            if (!display->visible()) {
+                std::cout << "Stream: " << fps << " FPS, " << std::fixed << std::setprecision(2) << mbps
+                    << " Mbit/s, latency p50 " << latencyP50 << " / p95 " << latencyP95 << " / max "
+                    << window.maxMs() << " ms, lost " << stats.lost << std::endl;
             }
+            lastStats = stats;
+            lastReport = now;
+        }
 
-            // Включение/выключение режима сжатия
-            if (key == 'z' || key == 'Z') {
-                useCompressedMode = !useCompressedMode;
-                std::cout << "Compressed BitGrid mode: " <<
-                    (useCompressedMode ? "ON" : "OFF") << std::endl;
+        int key = display->pollKey(1);
+        if (key == 27 || key == 'q' || key == 'Q' || display->closed()) {
+            break;
+        }
+        if ((key == 's' || key == 'S') && recorder) {
+            std::string file = recorder->trigger();
+            if (!file.empty()) {
+                std::cout << "Saving stream window to: " << file << std::endl;
             }
+        }
+    }
+
+    GridStreamReceiver::Stats stats = receiver.stats();
+    LatencyHistogram::Snapshot total = latency.snapshot();
+    std::cout << "Received " << stats.frames << " frames (" << stats.bytes / 1024 << " KB), lost " << stats.lost
+        << ", errors " << stats.errors << ", connections " << stats.connections << std::endl;
+    if (total.count > 0) {
+        std::cout << "Latency capture -> receive, ms: p50 " << std::fixed << std::setprecision(2)
+            << total.percentileMs(0.5) << ", p95 " << total.percentileMs(0.95) << ", p99 "
+            << total.percentileMs(0.99) << ", max " << total.maxMs() << std::endl;
+    }
+    return 0;
+}
+
+// Детекция объектов из командной строки (nullptr - выключено)
+struct DetectionSetup {
+    const YoloDetector::Options* detector = nullptr;
+    const TiledDetector::Options* tiling = nullptr;
+    const DetectorSelector::Options* budget = nullptr;
+    const DetectionGate::Options* gate = nullptr;
+    const RoiPlanner::Options* roi = nullptr;
+    bool lazy = false;                  // Загрузка в фоне, кадры идут сразу (--lazy-load)
+};
+
+// Загрузка детектора YOLO (--detect): пул бюджета, нарезанный или обычный
+bool loadDetectors(const DetectionSetup& setup, LoadedDetectors& loaded) {
+    const YoloDetector::Options& options = *setup.detector;
+    if (setup.budget) {
+        loaded.selector.reset(new DetectorSelector(*setup.budget));
+        if (!loaded.selector->load()) {
+            loaded.selector.reset();
+            return false;
+        }
+    }
+    else if (setup.tiling) {
+        loaded.tiledDetector.reset(new TiledDetector(options, *setup.tiling));
+        if (!loaded.tiledDetector->load()) {
+            loaded.tiledDetector.reset();
+            return false;
+        }
+    }
+    else {
+        loaded.detector.reset(new YoloDetector(options));
+        if (!loaded.detector->load()) {
+            loaded.detector.reset();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Детектор в состояние обработчика: сразу или (lazy) в фоновом потоке, тогда
+// обработчик подхватит его на первом кадре после загрузки
+bool attachDetector(ViewerState& state, const DetectionSetup& setup) {
+    if (setup.lazy) {
+        std::shared_ptr<LoadedDetectors> pending = std::make_shared<LoadedDetectors>();
+        state.pendingDetectors = pending;
+        // Настройки, на которые указывает setup, живут до конца main
+        state.loader.reset(new BackgroundLoader([setup, pending]() { return loadDetectors(setup, *pending); }));
+        return true;
+    }
+    LoadedDetectors loaded;
+    if (!loadDetectors(setup, loaded)) {
+        return false;
+    }
+    installDetectors(state, loaded);
+    return true;
+}
+
+// Ворота детекции в состояние обработчика (--detect-gate)
+void attachGate(ViewerState& state, const DetectionGate::Options& options) {
+    state.gate.reset(new DetectionGate(options));
+    state.useGate = true;
+}
+
+// Детекция по кропам областей (--detect-roi): области строит комбинированный детектор
+void attachRoi(ViewerState& state, const RoiPlanner::Options& options) {
+    state.roiPlanner.reset(new RoiPlanner(options));
+    state.useRoi = true;
+    state.useCombinedDetector = true;
+}
+
+// Детектор, ворота и кропы в состояние обработчика; inlineDetector = false -
+// сеть общая (асинхронная) и здесь не создаётся
+bool attachDetection(ViewerState& state, const DetectionSetup& setup, bool inlineDetector) {
+    if (!setup.detector) {
+        return true;
+    }
+    if (inlineDetector && !attachDetector(state, setup)) {
+        return false;
+    }
+    if (setup.gate) {
+        attachGate(state, *setup.gate);
+    }
+    if (setup.roi) {
+        attachRoi(state, *setup.roi);
+    }
+    return true;
+}
+
+// Итог переключений бюджета задержки по обработчикам
+void printBudgetSummary(const std::vector<std::unique_ptr<ViewerState>>& states) {
+    for (size_t i = 0; i < states.size(); ++i) {
+        const DetectorSelector* selector = states[i]->selector.get();
+        if (!selector) {
+            continue;
+        }
+        std::cout << "Latency budget " << i << ": " << selector->switches().size() - 1 << " switch(es), ends on "
+            << selector->candidate(selector->activeIndex()).name << ", p95 " << selector->activeP95() << " ms of "
+            << selector->options().budgetMs << " ms" << std::endl;
+    }
+}
+
+// Время до первого кадра и первой детекции и работа кэша моделей
+void printStartupSummary() {
+    const StartupTimer& timer = StartupTimer::instance();
+    if (timer.firstFrameMs() < 0.0) {
+        return;
+    }
+    std::cout << "Startup: first frame " << timer.firstFrameMs() << " ms";
+    if (timer.firstDetectionMs() >= 0.0) {
+        std::cout << ", first detection " << timer.firstDetectionMs() << " ms";
+    }
+    std::cout << std::endl;
+    ModelCache::Stats cache = ModelCache::instance().stats();
+    if (cache.files > 0) {
+        std::cout << "Model cache: " << cache.files << " file(s) mapped (" << cache.bytes / (1024 * 1024) << " MB), "
+            << cache.hits << " reuse(s), " << cache.backendHits << " load(s) with a stored backend" << std::endl;
+    }
+}
+
+// Итог ворот детекции по всем обработчикам
+void printGateSummary(const std::vector<std::unique_ptr<ViewerState>>& states) {
+    DetectionGate::Stats total;
+    for (const auto& state : states) {
+        if (state->gate) {
+            const DetectionGate::Stats& stats = state->gate->stats();
+            total.decisions += stats.decisions;
+            total.activity += stats.activity;
+            total.interval += stats.interval;
+            total.skipped += stats.skipped;
+        }
+    }
+    if (total.decisions == 0) {
+        return;
+    }
+    std::cout << "Detection gate: " << total.decisions - total.skipped << " of " << total.decisions
+        << " frames to the net (activity " << total.activity << ", interval " << total.interval << "), skipped "
+        << total.skipped << " (" << static_cast<int>(total.skipRate() * 100.0 + 0.5) << "%)" << std::endl;
+}
+
+// Итог нарезанной детекции по всем обработчикам
+void printTiledSummary(const std::vector<std::unique_ptr<ViewerState>>& states) {
+    TiledDetector::Stats total;
+    for (const auto& state : states) {
+        if (state->tiledDetector) {
+            const TiledDetector::Stats& stats = state->tiledDetector->stats();
+            total.frames += stats.frames;
+            total.tiles += stats.tiles;
+            total.totalMs += stats.totalMs;
+        }
+    }
+    if (total.frames == 0) {
+        return;
+    }
+    std::cout << "Tiled detection: " << total.frames << " frames, " << static_cast<double>(total.tiles) / total.frames
+        << " tiles per frame, " << total.totalMs / total.frames << " ms per frame ("
+        << total.tiles * 1e3 / std::max(total.totalMs, 1e-3) << " tiles/s per worker)" << std::endl;
+}
 
-            // Смена метода сжатия
-            if (key == 'm' || key == 'M') {
-                int currentMethod = static_cast<int>(compressionMethod);
-                currentMethod = (currentMethod + 1) % 4;
-                compressionMethod = static_cast<CompressionMethod>(currentMethod);
-                std::cout << "Compression method: " <<
-                    getCompressionMethodName(compressionMethod) << std::endl;
+// Замер детекции на синтетических кадрах 1080p и 4K (--detect-bench): весь
+// кадр, вписанный во вход сети, против нарезки на тайлы. Вывод вместе с
+// заголовком (сборка OpenCV, потоки, ядра) готов для вставки в отчёт, например
+//   WebcamViewer --detect v8n --tile-nets 4 --detect-bench 50
+int runDetectBench(const YoloDetector::Options& detectorOptions, const TiledDetector::Options& tiling, int runs) {
+    YoloDetector full(detectorOptions);
+    TiledDetector tiled(detectorOptions, tiling);
+    if (!full.load() || !tiled.load()) {
+        return -1;
+    }
+    std::cout << "OpenCV " << CV_VERSION << ", " << cv::getNumThreads() << " thread(s), "
+        << std::thread::hardware_concurrency() << " CPU(s), " << runs << " runs per row" << std::endl;
+    std::cout << "Full frame: " << full.describe() << "\nTiled: " << tiled.describe() << "\n" << std::endl;
+    const cv::Size sizes[] = { cv::Size(1920, 1080), cv::Size(3840, 2160) };
+    std::cout << "Frame        mode    tiles  objects    ms/frame      FPS" << std::endl;
+    for (const cv::Size& size : sizes) {
+        cv::Mat frame(size, CV_8UC3);
+        cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+        double modeMs[2] = { 0.0, 0.0 };
+        for (int mode = 0; mode < 2; ++mode) {
+            // Первый проход - прогрев (выделение памяти под новую форму входа)
+            size_t objects = mode ? tiled.detect(frame).size() : full.detect(frame).size();
+            int64 startTicks = cv::getTickCount();
+            for (int run = 0; run < runs; ++run) {
+                objects = mode ? tiled.detect(frame).size() : full.detect(frame).size();
             }
+            double ms = (cv::getTickCount() - startTicks) * 1e3 / cv::getTickFrequency() / runs;
+            modeMs[mode] = ms;
+            std::cout << std::left << std::setw(13) << (std::to_string(size.width) + "x" + std::to_string(size.height))
+                << std::setw(8) << (mode ? "tiled" : "full") << std::right << std::setw(5)
+                << (mode ? tiled.stats().lastTiles : 1) << std::setw(9) << objects << std::fixed << std::setprecision(1)
+                << std::setw(12) << ms << std::setw(9) << 1e3 / ms << std::endl;
+        }
+        std::cout << std::setw(13) << "" << "tiled/full " << std::setprecision(2) << modeMs[1] / std::max(modeMs[0], 1e-3)
+            << "x time" << std::endl;
+    }
+    return 0;
+}
+
+#ifdef HAVE_TFLITE
+// Строка замера: p50/p95 полного detect(), p50 самой сети и кадров в секунду
+void benchDetector(const std::string& name, int runs, const std::function<double()>& detectOnce) {
+    std::vector<double> totalMs, inferenceMs;
+    // Первый проход - прогрев
+    detectOnce();
+    for (int run = 0; run < runs; ++run) {
+        uint64_t startNs = StageMetrics::nowNs();
+        inferenceMs.push_back(detectOnce());
+        totalMs.push_back((StageMetrics::nowNs() - startNs) * 1e-6);
+    }
+    std::sort(totalMs.begin(), totalMs.end());
+    std::sort(inferenceMs.begin(), inferenceMs.end());
+    const size_t p50 = (totalMs.size() - 1) / 2;
+    const size_t p95 = (totalMs.size() * 95 + 99) / 100 - 1;
+    std::cout << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(1)
+        << std::setw(9) << totalMs[p50] << std::setw(9) << totalMs[p95] << std::setw(9) << inferenceMs[p50]
+        << std::setw(9) << 1e3 / totalMs[p50] << std::endl;
+}
+
+// Одна модель на cv::dnn и на TFLite (--tflite-bench): кадр 720p, вход TFLite;
+// TFLite - встроенные ядра, XNNPACK на одном потоке и на threads потоках
+int runTFLiteBench(YoloDetector::Options dnnOptions, const std::string& tflitePath, int threads, int runs) {
+    const int cores = std::max(1, cv::getNumberOfCPUs());
+    threads = threads > 0 ? threads : cores;
+    struct Variant {
+        const char* name;
+        bool xnnpack;
+        int threads;
+    };
+    std::vector<Variant> variants = { { "builtin kernels", false, threads }, { "XNNPACK", true, 1 } };
+    if (threads > 1) {
+        variants.push_back({ "XNNPACK", true, threads });
+    }
+
+    std::vector<std::unique_ptr<TFLiteDetector>> tflite;
+    for (const Variant& variant : variants) {
+        tflite.emplace_back(new TFLiteDetector(tflitePath, dnnOptions.classes));
+        tflite.back()->setNumThreads(variant.threads);
+        tflite.back()->setUseXnnpack(variant.xnnpack);
+        tflite.back()->setThresholds(dnnOptions.confThreshold, dnnOptions.nmsThreshold);
+        if (!tflite.back()->initialize()) {
+            return -1;
+        }
+    }
+    // Тот же размер входа у cv::dnn
+    dnnOptions.inputSize = tflite[0]->inputSize();
+    YoloDetector dnn(dnnOptions);
+    if (!dnn.load()) {
+        return -1;
+    }
+
+    cv::Mat frame(cv::Size(1280, 720), CV_8UC3);
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    std::cout << "\nOpenCV DNN: " << dnn.describe() << "\nTFLite: " << tflite[0]->describe() << "\n" << runs
+        << " runs on 1280x720, ms\n" << std::endl;
+    std::cout << "Runtime                               p50      p95    infer      FPS" << std::endl;
+    benchDetector("OpenCV DNN", runs, [&dnn, &frame]() {
+        dnn.detect(frame);
+        return dnn.timings().inferenceMs;
+    });
+    for (size_t i = 0; i < variants.size(); ++i) {
+        TFLiteDetector& detector = *tflite[i];
+        benchDetector(std::string("TFLite ") + variants[i].name + ", " + std::to_string(variants[i].threads) +
+            " thread(s)", runs, [&detector, &frame]() {
+            detector.detect(frame);
+            return detector.timings().inferenceMs;
+        });
+    }
+    return 0;
+}
+#endif
+
+// Служебных потоков, пишущих в трассу: отображение, захват, снимки, запись,
+// отправка, асинхронный детектор, загрузчики моделей, экспорт метрик
+const int kTraceServiceThreads = 8;
+
+// Останавливает трассу и сохраняет файл; печатается и число потоков без буфера,
+// чтобы неполная трасса не выглядела полной
+void saveTrace(FrameTracer& tracer, const std::string& path) {
+    tracer.stop();
+    size_t events = tracer.write(path);
+    std::cout << "Saved trace (" << events << " events, " << tracer.overwritten() << " overwritten, "
+        << tracer.droppedThreads() << " thread(s) dropped) to: " << path << std::endl;
+}
+
+// Режим многих потоков (--streams): каждый источник обрабатывается со своими
+// детекторами на общем пуле StreamScheduler, без окна. Раз в секунду - общий
+// поток кадров и по потокам, в конце - итог по каждому потоку
+int runStreams(const std::vector<std::string>& specs, const FrameSource::Options& sourceOptions,
+    const StreamScheduler::Options& schedulerOptions, const std::string& startKeys, bool hudEnabled,
+    const DetectionSetup& detection, const std::string& tracePath) {
+    StreamScheduler scheduler(schedulerOptions);
+    std::vector<std::unique_ptr<ViewerState>> states;
+    for (const std::string& spec : specs) {
+        std::unique_ptr<FrameSource> source = FrameSource::create(spec, sourceOptions);
+        if (!source) {
+            std::cerr << "Error: Could not open source " << spec << "!" << std::endl;
+            return -1;
+        }
+        std::cout << "Stream " << states.size() << ": " << source->describe() << std::endl;
+        scheduler.addStream(std::move(source), spec);
+        states.emplace_back(new ViewerState());
+        states.back()->hud.setEnabled(hudEnabled);
+        if (!attachDetection(*states.back(), detection, true)) {
+            return -1;
+        }
+    }
+
+    if (detection.detector) {
+        std::cout << "Detector: " << detectorDescription(*states[0]) << std::endl;
+    }
+
+    // Режимы задаются до запуска; снимки в этом режиме не сохраняются
+    SnapshotWriter::Options writerOptions;
+    SnapshotWriter writer(writerOptions);
+    FramePacket noFrame;
+    for (char key : startKeys) {
+        if (key == 's' || key == 'S') {
+            continue;
+        }
+        for (size_t i = 0; i < states.size(); ++i) {
+            handleKey(*states[i], key, noFrame, i == 0, writer);
+        }
+    }
+
+    const StreamScheduler::Options& options = scheduler.options();
+    std::cout << "Scheduler: " << specs.size() << " stream(s), " << options.framesPerJob << " frame(s) per job, queue "
+        << options.queueCapacity << " " << FramePipeline::policyName(options.queuePolicy) << ", deadline "
+        << (options.deadlineMs > 0.0 ? std::to_string(options.deadlineMs) + " ms" : std::string("none"))
+        << ", OpenCV threads " << options.opencvThreads << (options.pinThreads ? ", pinned" : "") << "\n\n";
+
+    // Трасса: потоки пула, захват каждого потока и служебные
+    FrameTracer& tracer = FrameTracer::instance();
+    if (!tracePath.empty()) {
+        int poolThreads = options.threads > 0 ? options.threads : static_cast<int>(std::thread::hardware_concurrency());
+        tracer.start(FrameTracer::kDefaultEventsPerThread,
+            poolThreads + static_cast<int>(specs.size()) + kTraceServiceThreads);
+    }
+
+    scheduler.start([&states, &scheduler](int stream, FramePacket& packet) {
+        processFrame(*states[stream], packet, scheduler.pool(stream));
+    });
+
+    StreamScheduler::Stats last = scheduler.stats();
+    auto lastReport = std::chrono::steady_clock::now();
+    while (!scheduler.finished()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastReport).count();
+        if (elapsed < 1.0) {
+            continue;
+        }
+
+        StreamScheduler::Stats current = scheduler.stats();
+        std::ostringstream perStream;
+        perStream << std::fixed << std::setprecision(1);
+        for (size_t i = 0; i < current.streams.size(); ++i) {
+            perStream << (i ? " " : "") << (current.streams[i].processed - last.streams[i].processed) / elapsed;
+        }
+        uint64_t processed = current.total.processed - last.total.processed;
+        uint64_t dropped = current.total.droppedQueue + current.total.droppedDeadline -
+            last.total.droppedQueue - last.total.droppedDeadline;
+        double latencyMs = (current.total.latencySumMs - last.total.latencySumMs) / std::max<uint64_t>(processed, 1);
+        std::cout << "Total: " << std::fixed << std::setprecision(1) << processed / elapsed << " FPS, dropped "
+            << dropped << ", latency avg " << latencyMs << " ms, missed deadline "
+            << current.total.missedDeadline - last.total.missedDeadline << "; per stream: " << perStream.str() << std::endl;
+        last = current;
+        lastReport = now;
+    }
+
+    scheduler.stop();
+    if (tracer.enabled()) {
+        saveTrace(tracer, tracePath);
+    }
+    StreamScheduler::Stats stats = scheduler.stats();
+    double seconds = std::max(stats.seconds, 1e-3);
+    std::cout << "\nStream            FPS  captured processed  queue  deadline  missed  latency avg/max, ms" << std::endl;
+    std::vector<StreamScheduler::StreamStats> rows = stats.streams;
+    rows.push_back(stats.total);
+    for (const StreamScheduler::StreamStats& row : rows) {
+        std::cout << std::left << std::setw(14) << row.name.substr(0, 14) << std::right << std::fixed
+            << std::setprecision(1) << std::setw(7) << row.processed / seconds << std::setw(10) << row.captured
+            << std::setw(10) << row.processed << std::setw(7) << row.droppedQueue << std::setw(10)
+            << row.droppedDeadline << std::setw(8) << row.missedDeadline << std::setw(10)
+            << row.latencySumMs / std::max<uint64_t>(row.processed, 1) << " / " << row.latencyMaxMs << std::endl;
+    }
+
+    std::ostringstream perThread;
+    for (size_t i = 0; i < stats.pool.perThread.size(); ++i) {
+        perThread << (i ? " " : "") << stats.pool.perThread[i];
+    }
+    std::cout << "Pool: " << stats.pool.perThread.size() << " threads, " << stats.pool.executed << " jobs ("
+        << perThread.str() << "), stolen " << stats.pool.stolen << "; busy "
+        << std::setprecision(0) << 100.0 * stats.total.processSumMs / (seconds * 1e3 * stats.pool.perThread.size())
+        << "% over " << std::setprecision(1) << seconds << " s" << std::endl;
+    printGateSummary(states);
+    printTiledSummary(states);
+    printBudgetSummary(states);
+    printStartupSummary();
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    StartupTimer::instance().start();
+    setlocale(LC_ALL, "Russian");
 
-            // Сброс параметров для текущего детектора
-            if (key == 'r' || key == 'R') {
-                if (useCombinedDetector) {
-                    combinedThresh1 = 50.0; combinedThresh2 = 150.0;
-                    dilateSize = 2; erodeSize = 2;
-                    combinedDetector = CombinedEdgeDetector(combinedThresh1, combinedThresh2, dilateSize, erodeSize);
-                    std::cout << "Combined detector parameters reset: thresholds " << combinedThresh1 << ", " << combinedThresh2
-                        << ", dilation " << dilateSize << ", erosion " << erodeSize << std::endl;
+    try {
+        // === Параметры конвейера ===
+        FramePipeline::Options pipelineOptions;
+        FrameSource::Options sourceOptions;
+        SnapshotWriter::Options writerOptions;
+        GridRecorder::Options recorderOptions;
+        bool recorderEnabled = false;
+        GridStreamSender::Options streamOptions;
+        bool streamEnabled = false;
+        std::string receiveUrl;
+        StreamScheduler::Options schedulerOptions;
+        std::vector<std::string> streamSpecs;
+        int streamCopies = 1;
+        std::string detectModel;
+        cv::Size detectSize;
+        float detectConf = 0.0f;
+        std::vector<std::string> detectClasses;
+        bool detectAsync = false;
+        AsyncDetector::Options asyncOptions;
+        bool detectGate = false;
+        DetectionGate::Options gateOptions;
+        bool detectRoi = false;
+        RoiPlanner::Options roiOptions;
+        bool detectTiles = false;
+        TiledDetector::Options tileOptions;
+        int detectBenchRuns = 0;
+        double budgetMs = 0.0;
+        std::vector<std::string> budgetModels;
+        std::vector<int> budgetSizes;
+        DetectorSelector::Options budgetOptions;
+        bool lazyLoad = false;
+        std::string tfliteBenchModel;
+        int tfliteThreads = 0;
+        std::string sourceSpec = "camera:0";
+        std::string startKeys;
+        bool headless = false;
+        bool hudEnabled = true;
+        std::string metricsPath;
+        std::string tracePath;
+        int metricsIntervalMs = 1000;
+        for (int i = 1; i < argc; ++i) {
+            if (std::strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+                pipelineOptions.workers = std::max(1, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--queue") == 0 && i + 1 < argc) {
+                pipelineOptions.queueCapacity = std::max(1, std::atoi(argv[++i]));
+                schedulerOptions.queueCapacity = pipelineOptions.queueCapacity;
+            }
+            else if (std::strcmp(argv[i], "--input-drop") == 0 && i + 1 < argc) {
+                pipelineOptions.inputPolicy = parseDropPolicy(argv[++i]);
+                schedulerOptions.queuePolicy = pipelineOptions.inputPolicy;
+            }
+            else if (std::strcmp(argv[i], "--output-drop") == 0 && i + 1 < argc) {
+                pipelineOptions.outputPolicy = parseDropPolicy(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--source") == 0 && i + 1 < argc) {
+                sourceSpec = argv[++i];
+            }
+            else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+                int width = 0, height = 0;
+                if (std::sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+                    sourceOptions.size = cv::Size(width, height);
                 }
-                else {
-                    cannyThresh1 = 50.0; cannyThresh2 = 150.0;
-                    cannyDetector = CannyEdgeDetector(cannyThresh1, cannyThresh2);
-                    std::cout << "Canny detector parameters reset: " << cannyThresh1 << ", " << cannyThresh2 << std::endl;
+            }
+            else if (std::strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+                sourceOptions.fps = std::atof(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--pacing") == 0 && i + 1 < argc) {
+                sourceOptions.pacing = parsePacing(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--loop") == 0) {
+                sourceOptions.loop = true;
+            }
+            else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+                sourceOptions.maxFrames = std::strtoull(argv[++i], nullptr, 10);
+            }
+            else if (std::strcmp(argv[i], "--keys") == 0 && i + 1 < argc) {
+                startKeys = argv[++i];
+            }
+            else if (std::strcmp(argv[i], "--headless") == 0) {
+                headless = true;
+            }
+            else if (std::strcmp(argv[i], "--save-dir") == 0 && i + 1 < argc) {
+                writerOptions.directory = argv[++i];
+            }
+            else if (std::strcmp(argv[i], "--save-threads") == 0 && i + 1 < argc) {
+                writerOptions.threads = std::max(1, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--prerecord") == 0 && i + 1 < argc) {
+                recorderOptions.seconds = std::max(1.0, std::atof(argv[++i]));
+                recorderEnabled = true;
+            }
+            else if (std::strcmp(argv[i], "--prerecord-mb") == 0 && i + 1 < argc) {
+                recorderOptions.arenaBytes = static_cast<size_t>(std::max(1, std::atoi(argv[++i]))) << 20;
+                recorderEnabled = true;
+            }
+            else if (std::strcmp(argv[i], "--record-continuous") == 0) {
+                recorderOptions.continuous = true;
+                recorderEnabled = true;
+            }
+            else if (std::strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+                if (!StreamEndpoint::parse(argv[++i], streamOptions.endpoint)) {
+                    std::cerr << "Error: Stream address must be tcp://HOST:PORT or udp://HOST:PORT" << std::endl;
+                    return -1;
                 }
+                streamEnabled = true;
             }
-
-            // Изменение порогов Канни для текущего детектора
-            if (key == '+' || key == '=') {
-                if (useCombinedDetector) {
-                    combinedThresh1 += 10; combinedThresh2 += 20;
-                    combinedDetector = CombinedEdgeDetector(combinedThresh1, combinedThresh2, dilateSize, erodeSize);
-                    std::cout << "Combined Canny thresholds increased: " << combinedThresh1 << ", " << combinedThresh2 << std::endl;
+            else if (std::strcmp(argv[i], "--stream-mtu") == 0 && i + 1 < argc) {
+                streamOptions.mtu = std::atoi(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--receive") == 0 && i + 1 < argc) {
+                receiveUrl = argv[++i];
+            }
+            else if (std::strcmp(argv[i], "--streams") == 0 && i + 1 < argc) {
+                std::istringstream list(argv[++i]);
+                std::string spec;
+                while (std::getline(list, spec, ',')) {
+                    if (!spec.empty()) {
+                        streamSpecs.push_back(spec);
+                    }
                 }
-                else {
-                    cannyThresh1 += 10; cannyThresh2 += 20;
-                    cannyDetector = CannyEdgeDetector(cannyThresh1, cannyThresh2);
-                    std::cout << "Canny thresholds increased: " << cannyThresh1 << ", " << cannyThresh2 << std::endl;
+            }
+            else if (std::strcmp(argv[i], "--stream-copies") == 0 && i + 1 < argc) {
+                streamCopies = std::max(1, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--pool-threads") == 0 && i + 1 < argc) {
+                schedulerOptions.threads = std::max(0, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--pin-threads") == 0) {
+                schedulerOptions.pinThreads = true;
+            }
+            else if (std::strcmp(argv[i], "--cv-threads") == 0 && i + 1 < argc) {
+                schedulerOptions.opencvThreads = std::atoi(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--frames-per-job") == 0 && i + 1 < argc) {
+                schedulerOptions.framesPerJob = std::max(1, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--deadline") == 0 && i + 1 < argc) {
+                schedulerOptions.deadlineMs = std::max(0.0, std::atof(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--detect") == 0 && i + 1 < argc) {
+                detectModel = argv[++i];
+            }
+            else if (std::strcmp(argv[i], "--detect-size") == 0 && i + 1 < argc) {
+                int width = 0, height = 0;
+                if (std::sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+                    detectSize = cv::Size(width, height);
                 }
             }
-
-            if (key == '-' || key == '_') {
-                if (useCombinedDetector) {
-                    combinedThresh1 = std::max(10.0, combinedThresh1 - 10);
-                    combinedThresh2 = std::max(30.0, combinedThresh2 - 20);
-                    combinedDetector = CombinedEdgeDetector(combinedThresh1, combinedThresh2, dilateSize, erodeSize);
-                    std::cout << "Combined Canny thresholds decreased: " << combinedThresh1 << ", " << combinedThresh2 << std::endl;
+            else if (std::strcmp(argv[i], "--conf") == 0 && i + 1 < argc) {
+                detectConf = static_cast<float>(std::atof(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--detect-classes") == 0 && i + 1 < argc) {
+                std::istringstream list(argv[++i]);
+                std::string name;
+                while (std::getline(list, name, ',')) {
+                    if (!name.empty()) {
+                        detectClasses.push_back(name);
+                    }
                 }
-                else {
-                    cannyThresh1 = std::max(10.0, cannyThresh1 - 10);
-                    cannyThresh2 = std::max(30.0, cannyThresh2 - 20);
-                    cannyDetector = CannyEdgeDetector(cannyThresh1, cannyThresh2);
-                    std::cout << "Canny thresholds decreased: " << cannyThresh1 << ", " << cannyThresh2 << std::endl;
+            }
+            else if (std::strcmp(argv[i], "--detect-async") == 0) {
+                detectAsync = true;
+            }
+            else if (std::strcmp(argv[i], "--detect-interval") == 0 && i + 1 < argc) {
+                const char* value = argv[++i];
+                asyncOptions.adaptive = std::strcmp(value, "auto") == 0;
+                asyncOptions.intervalMs = asyncOptions.adaptive ? 0.0 : std::max(0.0, std::atof(value));
+            }
+            else if (std::strcmp(argv[i], "--detect-gate") == 0) {
+                detectGate = true;
+            }
+            else if (std::strcmp(argv[i], "--gate-tile") == 0 && i + 1 < argc) {
+                gateOptions.tileSize = std::atoi(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--gate-min-tiles") == 0 && i + 1 < argc) {
+                gateOptions.minChangedTiles = std::atoi(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--gate-interval") == 0 && i + 1 < argc) {
+                gateOptions.maxIntervalMs = std::atof(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--detect-roi") == 0) {
+                detectRoi = true;
+            }
+            else if (std::strcmp(argv[i], "--roi-crops") == 0 && i + 1 < argc) {
+                roiOptions.maxCrops = std::atoi(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--roi-padding") == 0 && i + 1 < argc) {
+                roiOptions.padding = static_cast<float>(std::atof(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--detect-tiles") == 0) {
+                detectTiles = true;
+            }
+            else if (std::strcmp(argv[i], "--tile-size") == 0 && i + 1 < argc) {
+                int width = 0, height = 0;
+                if (std::sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+                    tileOptions.tileSize = cv::Size(width, height);
+                }
+            }
+            else if (std::strcmp(argv[i], "--tile-overlap") == 0 && i + 1 < argc) {
+                tileOptions.overlap = static_cast<float>(std::atof(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--tile-nets") == 0 && i + 1 < argc) {
+                tileOptions.instances = std::atoi(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--tile-no-full") == 0) {
+                tileOptions.fullFrame = false;
+            }
+            else if (std::strcmp(argv[i], "--detect-bench") == 0 && i + 1 < argc) {
+                detectBenchRuns = std::max(1, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--detect-budget") == 0 && i + 1 < argc) {
+                budgetMs = std::atof(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--budget-models") == 0 && i + 1 < argc) {
+                std::stringstream list(argv[++i]);
+                std::string name;
+                while (std::getline(list, name, ',')) {
+                    if (!name.empty()) {
+                        budgetModels.push_back(name);
+                    }
+                }
+            }
+            else if (std::strcmp(argv[i], "--budget-sizes") == 0 && i + 1 < argc) {
+                std::stringstream list(argv[++i]);
+                std::string size;
+                while (std::getline(list, size, ',')) {
+                    if (std::atoi(size.c_str()) > 0) {
+                        budgetSizes.push_back(std::atoi(size.c_str()));
+                    }
                 }
             }
+            else if (std::strcmp(argv[i], "--budget-log") == 0 && i + 1 < argc) {
+                budgetOptions.logPath = argv[++i];
+            }
+            else if (std::strcmp(argv[i], "--tflite-bench") == 0 && i + 1 < argc) {
+                tfliteBenchModel = argv[++i];
+            }
+            else if (std::strcmp(argv[i], "--tflite-threads") == 0 && i + 1 < argc) {
+                tfliteThreads = std::max(0, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--lazy-load") == 0) {
+                lazyLoad = true;
+            }
+            else if (std::strcmp(argv[i], "--model-cache") == 0 && i + 1 < argc) {
+                ModelCache::instance().setDirectory(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--no-hud") == 0) {
+                hudEnabled = false;
+            }
+            else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+                metricsPath = argv[++i];
+            }
+            else if (std::strcmp(argv[i], "--metrics-interval") == 0 && i + 1 < argc) {
+                metricsIntervalMs = std::atoi(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+                tracePath = argv[++i];
+            }
+            else {
+                std::cout << "Usage: " << argv[0] << " [--workers N] [--queue N]"
+                    << " [--input-drop block|newest|latest] [--output-drop block|newest|latest]\n"
+                    << "    [--source camera:N|video:PATH|images:GLOB|synthetic[:SEED]] [--size WxH] [--fps N]\n"
+                    << "    [--pacing native|fixed|unlimited] [--loop] [--frames N] [--keys KEYS] [--headless] [--no-hud]\n"
+                    << "    [--metrics FILE.json|FILE.csv|FILE.prom] [--metrics-interval MS] [--trace FILE.json]\n"
+                    << "    [--save-dir DIR] [--save-threads N] [--prerecord SECONDS] [--prerecord-mb MB] [--record-continuous]\n"
+                    << "    [--stream tcp://HOST:PORT|udp://HOST:PORT] [--stream-mtu BYTES] [--receive tcp://*:PORT|udp://*:PORT]\n"
+                    << "    [--streams SOURCE,SOURCE,...] [--stream-copies N] [--pool-threads N] [--pin-threads] [--cv-threads N]\n"
+                    << "    [--frames-per-job N] [--deadline MS]\n"
+                    << "    [--detect v3|v8n|v8m|v26n|v26m|MODEL.onnx|MODEL.cfg] [--detect-size WxH] [--conf THRESHOLD]\n"
+                    << "    [--detect-classes NAME,NAME,...] [--detect-async] [--detect-interval MS|auto]\n"
+                    << "    [--detect-gate] [--gate-tile PX] [--gate-min-tiles N] [--gate-interval MS]\n"
+                    << "    [--detect-roi] [--roi-crops N] [--roi-padding FRACTION]\n"
+                    << "    [--detect-tiles] [--tile-size WxH] [--tile-overlap FRACTION] [--tile-nets N] [--tile-no-full]\n"
+                    << "    [--detect-bench RUNS] [--detect-budget MS] [--budget-models NAME,NAME,...]"
+                    << " [--budget-sizes N,N,...] [--budget-log FILE]\n"
+                    << "    [--lazy-load] [--model-cache DIR] [--tflite-bench MODEL.tflite] [--tflite-threads N]"
+                    << std::endl;
+                return 0;
+            }
+        }
+
+        // === Приёмник сетевого потока вместо источника кадров ===
+        if (!receiveUrl.empty()) {
+            StreamEndpoint endpoint;
+            if (!StreamEndpoint::parse(receiveUrl, endpoint)) {
+                std::cerr << "Error: Receive address must be tcp://HOST:PORT or udp://HOST:PORT" << std::endl;
+                return -1;
+            }
+            std::unique_ptr<GridRecorder> recorder;
+            if (recorderEnabled) {
+                recorderOptions.directory = writerOptions.directory;
+                recorder.reset(new GridRecorder(recorderOptions));
+                recorder->start();
+            }
+            return runReceiver(endpoint, headless, hudEnabled, sourceOptions.maxFrames, recorder.get());
+        }
+
+        // === Детектор объектов: модель из global.h или путь ===
+        YoloDetector::Options detectorOptions = YoloDetector::preset(detectModel);
+        if (detectSize.area() > 0) {
+            detectorOptions.inputSize = detectSize;
+        }
+        if (detectConf > 0.0f) {
+            detectorOptions.confThreshold = detectConf;
+        }
+        detectorOptions.classAllowlist = detectClasses;
+        const YoloDetector::Options* detector = detectModel.empty() ? nullptr : &detectorOptions;
+        const DetectionGate::Options* gate = detector && detectGate ? &gateOptions : nullptr;
+        if (gate) {
+            std::cout << "Detection gate: " << gateOptions.tileSize << " px tiles, net on " << gateOptions.minChangedTiles
+                << "+ changed tiles or every " << gateOptions.maxIntervalMs << " ms" << std::endl;
+        }
+        // cv::dnn против TFLite: модель --detect (тот же граф в ONNX) или сам .tflite
+        if (!tfliteBenchModel.empty()) {
+#ifdef HAVE_TFLITE
+            YoloDetector::Options dnnOptions = detector ? detectorOptions : YoloDetector::preset(tfliteBenchModel);
+            dnnOptions.confThreshold = detectorOptions.confThreshold;
+            return runTFLiteBench(dnnOptions, tfliteBenchModel, tfliteThreads, detectBenchRuns > 0 ? detectBenchRuns : 50);
+#else
+            (void)tfliteThreads;
+            std::cerr << "Error: --tflite-bench needs a build with -DWITH_TFLITE=ON" << std::endl;
+            return -1;
+#endif
+        }
+        if (detector && detectBenchRuns > 0) {
+            return runDetectBench(detectorOptions, tileOptions, detectBenchRuns);
+        }
+        const TiledDetector::Options* tiling = detector && detectTiles ? &tileOptions : nullptr;
+        if (tiling && detectAsync) {
+            std::cout << "Note: --detect-tiles is ignored with --detect-async" << std::endl;
+            tiling = nullptr;
+        }
+        const RoiPlanner::Options* roi = detector && detectRoi ? &roiOptions : nullptr;
+        if (roi) {
+            std::cout << "ROI detection: up to " << roiOptions.maxCrops << " crops of Combined detector regions, padding "
+                << roiOptions.padding << ", full frame above " << roiOptions.maxCoverage * 100.0 << "% coverage" << std::endl;
+        }
 
-            // Изменение параметров дилатации/эрозии только для Combined детектора
-            if (useCombinedDetector) {
-                if (key == 'd') {
-                    dilateSize = std::min(10, dilateSize + 1);
-                    combinedDetector = CombinedEdgeDetector(combinedThresh1, combinedThresh2, dilateSize, erodeSize);
-                    std::cout << "Dilation size increased: " << dilateSize << std::endl;
+        // Пул бюджета: модели по возрастанию точности, внутри модели - размеры входа по возрастанию
+        const DetectorSelector::Options* budget = nullptr;
+        if (detector && budgetMs > 0.0) {
+            if (budgetModels.empty()) {
+                budgetModels.push_back(detectModel);
+            }
+            if (budgetSizes.empty()) {
+                budgetSizes = detectSize.area() > 0 ? std::vector<int>{ detectSize.width } : std::vector<int>{ 320, 480, 640 };
+            }
+            std::sort(budgetSizes.begin(), budgetSizes.end());
+            for (const std::string& model : budgetModels) {
+                for (int size : budgetSizes) {
+                    DetectorSelector::Candidate candidate;
+                    candidate.name = model + "@" + std::to_string(size);
+                    candidate.options = YoloDetector::preset(model);
+                    candidate.options.inputSize = cv::Size(size, size);
+                    candidate.options.confThreshold = detectorOptions.confThreshold;
+                    candidate.options.classAllowlist = detectClasses;
+                    budgetOptions.candidates.push_back(candidate);
                 }
+            }
+            budgetOptions.budgetMs = budgetMs;
+            budget = &budgetOptions;
+            if (detectAsync || tiling) {
+                std::cout << "Note: --detect-budget is ignored with --detect-async and --detect-tiles" << std::endl;
+                budget = nullptr;
+            }
+        }
+        DetectionSetup detection;
+        detection.detector = detector;
+        detection.tiling = tiling;
+        detection.budget = budget;
+        detection.gate = gate;
+        detection.roi = roi;
+        detection.lazy = lazyLoad;
+
+        // === Много потоков на общем пуле вместо одного конвейера ===
+        if (!streamSpecs.empty()) {
+            std::vector<std::string> specs;
+            for (int copy = 0; copy < streamCopies; ++copy) {
+                specs.insert(specs.end(), streamSpecs.begin(), streamSpecs.end());
+            }
+            if (detectAsync) {
+                std::cout << "Note: --detect-async is ignored with --streams, detection runs inline" << std::endl;
+            }
+            return runStreams(specs, sourceOptions, schedulerOptions, startKeys, hudEnabled, detection, tracePath);
+        }
+
+        // === Инициализация источника кадров ===
+        std::unique_ptr<FrameSource> source = FrameSource::create(sourceSpec, sourceOptions);
+        if (!source) {
+            std::cerr << "Error: Could not open source " << sourceSpec << "!" << std::endl;
+            return -1;
+        }
+
+        // === Создание детекторов (свои у каждого обработчика) ===
+        std::vector<std::unique_ptr<ViewerState>> states;
+        for (int i = 0; i < pipelineOptions.workers; ++i) {
+            states.emplace_back(new ViewerState());
+            states.back()->hud.setEnabled(hudEnabled);
+            if (!attachDetection(*states.back(), detection, !detectAsync)) {
+                return -1;
+            }
+        }
+        if (detector && !detectAsync) {
+            std::cout << "Detector: " << detectorDescription(*states[0]) << "\n";
+        }
+
+        // Асинхронная детекция: одна сеть в своём потоке на все обработчики
+        std::unique_ptr<AsyncDetector> asyncDetector;
+        if (detector && detectAsync) {
+            // С --lazy-load модель загружается в потоке сети после start()
+            std::unique_ptr<YoloDetector> yolo(new YoloDetector(*detector));
+            if (!lazyLoad && !yolo->load()) {
+                return -1;
+            }
+            asyncDetector.reset(new AsyncDetector(std::move(yolo), asyncOptions));
+            asyncDetector->start();
+            for (auto& state : states) {
+                state->asyncDetector = asyncDetector.get();
+                state->useDetector = true;
+            }
+            std::cout << "Detector: " << (lazyLoad ? std::string("loading in background") :
+                asyncDetector->detector().describe()) << ", async, interval "
+                << (asyncOptions.adaptive ? "auto" : std::to_string(static_cast<int>(asyncOptions.intervalMs)) + " ms")
+                << "\n";
+        }
+
+        // HUD потока отображения: FPS, потери, разбивка задержек
+        HudLayer displayHud;
+        displayHud.setEnabled(hudEnabled);
+
+        // Для измерения FPS
+        auto lastTime = std::chrono::high_resolution_clock::now();
+        int frameCount = 0;
+        float fps = 0.0f;
+
+        // Сквозная задержка захват -> отображение
+        double latencySumMs = 0.0, latencyMaxMs = 0.0;
+        double windowLatencySumMs = 0.0, windowLatencyMaxMs = 0.0;
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        std::unique_ptr<DisplaySink> display = DisplaySink::create(headless, "Edge Detector");
+
+        // Гистограммы задержек: выгрузка в файл и разбивка на экране
+        std::unique_ptr<MetricsExporter> metricsExporter;
+        if (!metricsPath.empty()) {
+            metricsExporter.reset(new MetricsExporter(metricsPath, metricsIntervalMs));
+            metricsExporter->start();
+        }
+        bool showMetrics = false;
+        StageMetrics::Report metricsTotal, metricsWindow;
+
+        // Трасса кадров: с запуска (--trace) или по клавише t
+        FrameTracer& tracer = FrameTracer::instance();
+        FrameTracer::setThreadName("display");
+        // Буферы трассы: обработчики, их загрузчики и служебные потоки
+        const int traceThreads = 2 * pipelineOptions.workers + kTraceServiceThreads;
+        if (!tracePath.empty()) {
+            tracer.start(FrameTracer::kDefaultEventsPerThread, traceThreads);
+        }
+        auto writeTrace = [&tracer](const std::string& path) { saveTrace(tracer, path); };
+
+        std::cout << "\n═══════════════════════════════════════════════════\n";
+        std::cout << "       Детекция границ с битовой сеткой\n";
+        std::cout << "═══════════════════════════════════════════════════\n";
+        std::cout << "Управление:\n";
+        std::cout << "  [1/2] - Переключить детектор (Canny/Combined)\n";
+        std::cout << "  [+/-] - Изменить пороги Канни\n";
+        std::cout << "  [a/A] - Автоподбор порогов (OFF/HISTOGRAM/DENSITY/BYTES)\n";
+        std::cout << "  [c/C] - Переключить режим отображения (overlay/edges only)\n";
+        std::cout << "  [b/B] - Включить/выключить режим BitGrid\n";
+        std::cout << "  [z/Z] - Включить/выключить сжатие BitGrid\n";
+        std::cout << "  [m/M] - Сменить метод сжатия\n";
+        std::cout << "  [d/D] - Увеличить/уменьшить дилатацию (Combined)\n";
+        std::cout << "  [e/E] - Увеличить/уменьшить эрозию (Combined)\n";
+        std::cout << "  [f/F] - Включить/выключить SIMD-фронтенд (серый+размытие+Собель)\n";
+        std::cout << "  [i/I] - Инкрементальный режим (пересчёт только изменившихся тайлов)\n";
+        std::cout << "  [p]   - Уровень пирамиды (1, 1/2, 1/4)\n";
+        std::cout << "  [P]   - Уточнение границ полноразмерным Канни\n";
+        std::cout << "  [r/R] - Сбросить параметры\n";
+        std::cout << "  [s/S] - Сохранить текущий кадр/битовую сетку (и окно предзаписи)\n";
+        std::cout << "  [y/Y] - Детекция объектов YOLO (с --detect)\n";
+        std::cout << "  [g/G] - Ворота детекции: сеть только при изменении сетки (с --detect-gate)\n";
+        std::cout << "  [o/O] - Детекция по кропам областей границ вместо всего кадра (с --detect-roi)\n";
+        std::cout << "  [h/H] - Задержки стадий (p50/p95/p99/max)\n";
+        std::cout << "  [t/T] - Запись трассы кадров (Chrome trace_event)\n";
+        std::cout << "  [ESC/Q] - Выход\n";
+        std::cout << "═══════════════════════════════════════════════════\n\n";
+        std::cout << "Pipeline: " << pipelineOptions.workers << " worker(s), queue "
+            << pipelineOptions.queueCapacity << ", input " << FramePipeline::policyName(pipelineOptions.inputPolicy)
+            << ", output " << FramePipeline::policyName(pipelineOptions.outputPolicy) << "\n";
+        std::cout << "Source: " << source->describe() << ", pacing " << FrameSource::pacingName(sourceOptions.pacing)
+            << (sourceOptions.loop ? ", loop" : "") << (headless ? ", headless" : "") << "\n\n";
+
+        // === Конвейер: захват -> обработка -> отображение ===
+        FramePipeline pipeline(pipelineOptions);
+
+        // Фоновая запись снимков (держит буферы пула, останавливается до конвейера)
+        SnapshotWriter writer(writerOptions);
+        writer.start();
+
+        // Предзапись сжатых сеток: окно сбрасывается в файл по клавише s
+        std::unique_ptr<GridRecorder> recorder;
+        if (recorderEnabled) {
+            recorderOptions.directory = writerOptions.directory;
+            recorder.reset(new GridRecorder(recorderOptions));
+            recorder->start();
+            for (auto& state : states) {
+                state->recorder = recorder.get();
+            }
+            std::cout << "Pre-trigger recorder: " << recorderOptions.seconds << " s window, "
+                << recorder->stats().memoryBytes / (1 << 20) << " MB reserved"
+                << (recorderOptions.continuous ? ", continuous" : "") << "\n\n";
+        }
+
+        // Отправка сжатых сеток по сети (поток отправки не задерживает обработчики)
+        std::unique_ptr<GridStreamSender> sender;
+        if (streamEnabled) {
+            sender.reset(new GridStreamSender(streamOptions));
+            if (!sender->start()) {
+                std::cerr << "Error: Could not open stream " << streamOptions.endpoint.describe() << "!" << std::endl;
+                return -1;
+            }
+            for (auto& state : states) {
+                state->sender = sender.get();
+            }
+            std::cout << "Streaming BitGrids to " << streamOptions.endpoint.describe() << "\n\n";
+        }
+        pipeline.start(
+            [&source](cv::Mat& frame) {
+                return source->read(frame);
+            },
+            [&states, &pipeline](int worker, FramePacket& packet) {
+                processFrame(*states[worker], packet, pipeline.pool());
+            },
+            [&states, &writer](int worker, int key, FramePacket& packet) {
+                handleKey(*states[worker], key, packet, worker == 0, writer);
+            });
+
+        // Режимы для запуска без клавиатуры (например, "2b" - Combined + BitGrid)
+        for (char key : startKeys) {
+            pipeline.broadcast(key);
+        }
 
-                if (key == 'D') {
-                    dilateSize = std::max(1, dilateSize - 1);
-                    combinedDetector = CombinedEdgeDetector(combinedThresh1, combinedThresh2, dilateSize, erodeSize);
-                    std::cout << "Dilation size decreased: " << dilateSize << std::endl;
+        FramePacket packet;
+
+        // === Главный цикл отображения ===
+        while (!pipeline.finished()) {
+            bool shown = false;
+            if (pipeline.nextOutput(packet)) {
+                shown = true;
+                FrameTracer::setCurrentFrame(packet.id);
+                double latencyMs = (cv::getTickCount() - packet.captureTicks) * 1000.0 / cv::getTickFrequency();
+                latencySumMs += latencyMs;
+                latencyMaxMs = std::max(latencyMaxMs, latencyMs);
+                windowLatencySumMs += latencyMs;
+                windowLatencyMaxMs = std::max(windowLatencyMaxMs, latencyMs);
+
+                // Измерение FPS
+                frameCount++;
+                auto currentTime = std::chrono::high_resolution_clock::now();
+                auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - lastTime);
+
+                if (elapsedTime.count() >= 1000) {
+                    fps = frameCount * 1000.0f / elapsedTime.count();
+                    if (!display->visible()) {
+                        std::cout << "FPS: " << std::fixed << std::setprecision(1) << fps
+                            << ", latency avg " << windowLatencySumMs / frameCount
+                            << " ms, max " << windowLatencyMaxMs << " ms" << std::endl;
+                    }
+                    if (StageMetrics::instance().enabled()) {
+                        StageMetrics::Report current = StageMetrics::instance().snapshot();
+                        metricsWindow = StageMetrics::since(current, metricsTotal);
+                        metricsTotal = current;
+                    }
+                    frameCount = 0;
+                    windowLatencySumMs = 0.0;
+                    windowLatencyMaxMs = 0.0;
+                    lastTime = currentTime;
                 }
+            }
 
-                if (key == 'e') {
-                    erodeSize = std::min(10, erodeSize + 1);
-                    combinedDetector = CombinedEdgeDetector(combinedThresh1, combinedThresh2, dilateSize, erodeSize);
-                    std::cout << "Erosion size increased: " << erodeSize << std::endl;
+            if (shown && display->visible()) {
+                // Кадр показан только здесь, запись без копирования
+                cv::Mat& frame = packet.output.writable();
+                ScopedStageTimer hud(METRIC_HUD);
+                displayHud.begin(frame.size());
+
+                // Отображение FPS
+                displayHud.format(cv::Point(frame.cols - 150, 60), 0.6, cv::Scalar(0, 255, 0), 2,
+                    "FPS: %d", static_cast<int>(fps));
+
+                // Потерянные кадры на входе и выходе обработчиков
+                FramePipeline::Counters counters = pipeline.counters();
+                uint64_t droppedOutput = counters.droppedOutput + counters.droppedLate;
+                if (counters.droppedInput + droppedOutput > 0) {
+                    displayHud.format(cv::Point(frame.cols - 200, 190), 0.5, cv::Scalar(0, 200, 255), 1,
+                        "Drop: %llu/%llu", static_cast<unsigned long long>(counters.droppedInput),
+                        static_cast<unsigned long long>(droppedOutput));
                 }
 
-                if (key == 'E') {
-                    erodeSize = std::max(1, erodeSize - 1);
-                    combinedDetector = CombinedEdgeDetector(combinedThresh1, combinedThresh2, dilateSize, erodeSize);
-                    std::cout << "Erosion size decreased: " << erodeSize << std::endl;
+                if (showMetrics) {
+                    drawMetricsBreakdown(displayHud, frame.size(), metricsWindow);
                 }
+                displayHud.compose(frame);
+                hud.stop();
+
+                ScopedStageTimer timer(METRIC_DISPLAY);
+                display->show(frame);
             }
 
-            // Сохранение текущего кадра
-            if (key == 's' || key == 'S') {
-                std::string filename;
-                if (useBitGridMode) {
-                    BitGrid edgeGrid;
-                    if (useCombinedDetector) {
-                        edgeGrid = combinedDetector.getEdgeBitGrid(originalFrame);
-                    }
-                    else {
-                        edgeGrid = cannyDetector.getEdgeBitGrid(originalFrame);
-                    }
+            // Обработка нажатий клавиш
+            int key = display->pollKey(1);
 
-                    if (useCompressedMode) {
-                        filename = "compressed_bitgrid_" + std::to_string(time(nullptr)) + ".bgrid";
-                        edgeGrid.save(filename, compressionMethod);
-                        std::cout << "Saved compressed bitgrid to: " << filename << std::endl;
-                    }
-                    else {
-                        filename = "bitgrid_" + std::to_string(time(nullptr)) + ".bgrid";
-                        edgeGrid.save(filename);
-                        std::cout << "Saved bitgrid to: " << filename << std::endl;
-                    }
+            // Выход
+            if (key == 27 || key == 'q' || key == 'Q') break;
+
+            // Разбивка задержек - только поток отображения, сбор включается вместе с ней
+            if (key == 'h' || key == 'H') {
+                showMetrics = !showMetrics;
+                StageMetrics::instance().setEnabled(showMetrics || metricsExporter);
+                std::cout << "Stage latency breakdown: " << (showMetrics ? "ON" : "OFF") << std::endl;
+                continue;
+            }
+
+            // Трасса: первое нажатие начинает запись, второе сохраняет файл
+            if (key == 't' || key == 'T') {
+                if (tracer.enabled()) {
+                    writeTrace(tracePath.empty() ? "trace_" + std::to_string(time(nullptr)) + ".json" : tracePath);
                 }
                 else {
-                    filename = "frame_" + std::to_string(time(nullptr)) + ".jpg";
-                    cv::imwrite(filename, frame);
-                    std::cout << "Saved frame to: " << filename << std::endl;
+                    tracer.start(FrameTracer::kDefaultEventsPerThread, traceThreads);
+                    std::cout << "Trace recording started" << std::endl;
                 }
+                continue;
+            }
+
+            // Остальные клавиши применяются обработчиками после очередного кадра
+            if (key >= 0) {
+                pipeline.broadcast(key);
             }
 
             // Проверка, закрыто ли окно
-            if (cv::getWindowProperty("Edge Detector", cv::WND_PROP_VISIBLE) < 1) {
+            if (display->closed()) {
                 std::cout << "Window closed. Terminating program." << std::endl;
                 break;
             }
         }
 
-        cap.release();
-        cv::destroyAllWindows();
+        pipeline.stop();
+        writer.stop();
+        if (asyncDetector) {
+            asyncDetector->stop();
+        }
+        if (recorder) {
+            recorder->stop();
+        }
+        if (sender) {
+            sender->stop();
+        }
+        if (metricsExporter) {
+            metricsExporter->stop();
+        }
+        if (tracer.enabled()) {
+            writeTrace(tracePath.empty() ? "trace_" + std::to_string(time(nullptr)) + ".json" : tracePath);
+        }
+        double totalSeconds = std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - startTime).count();
+        display.reset();
+        source.reset();
+
+        FramePipeline::Counters counters = pipeline.counters();
+        std::cout << "Frames: captured " << counters.captured << ", processed " << counters.processed
+            << ", displayed " << counters.displayed << "; dropped: input " << counters.droppedInput
+            << ", output " << counters.droppedOutput << ", late " << counters.droppedLate << std::endl;
+        if (counters.displayed > 0) {
+            std::cout << "Throughput: " << std::fixed << std::setprecision(1)
+                << counters.displayed / std::max(totalSeconds, 1e-3) << " FPS over " << totalSeconds
+                << " s; latency avg " << latencySumMs / counters.displayed << " ms, max " << latencyMaxMs
+                << " ms" << std::endl;
+        }
+        std::cout << "Frame pool: " << pipeline.pool().bufferCount() << " buffers, "
+            << pipeline.pool().allocations() << " allocations" << std::endl;
+
+        SnapshotWriter::Stats saves = writer.stats();
+        if (saves.submitted > 0) {
+            std::cout << "Snapshots: written " << saves.written << " (" << saves.bytesWritten / 1024 << " KB), rejected "
+                << saves.rejected << ", failed " << saves.failed << ", peak queue " << saves.peakPending
+                << "; encode " << saves.encodeMs / std::max<uint64_t>(saves.written + saves.failed, 1)
+                << " ms, write " << saves.writeMs / std::max<uint64_t>(saves.written + saves.failed, 1)
+                << " ms per file" << std::endl;
+        }
+        if (recorder) {
+            GridRecorder::Stats recorded = recorder->stats();
+            std::cout << "Pre-trigger recorder: " << recorded.frames << " frames / " << recorded.seconds << " s held, "
+                << recorded.usedBytes / 1024 << " of " << recorderOptions.arenaBytes / 1024 << " KB arena used ("
+                << recorded.memoryBytes / 1024 << " KB total); recorded " << recorded.recorded << ", evicted "
+                << recorded.evicted << ", oversized " << recorded.oversized << "; flushed " << recorded.flushedFrames
+                << " frames in " << recorded.flushes << " files, failed " << recorded.failed << std::endl;
+        }
+        if (sender) {
+            GridStreamSender::Stats streamed = sender->stats();
+            std::cout << "Stream: sent " << streamed.sent << " frames (" << streamed.bytes / 1024 << " KB"
+                << (streamOptions.endpoint.udp ? ", " + std::to_string(streamed.datagrams) + " datagrams" : "")
+                << "), replaced before sending " << streamed.dropped << ", failed " << streamed.failed << std::endl;
+        }
+
+        if (asyncDetector) {
+            AsyncDetector::Stats detected = asyncDetector->stats();
+            std::cout << "Async detection: " << detected.completed << " of " << detected.offered << " frames through the net";
+            if (detected.completed > 0) {
+                std::cout << "; box latency avg " << detected.latencySumMs / detected.completed << " ms, max "
+                    << detected.latencyMaxMs << " ms; last interval " << detected.intervalMs << " ms";
+            }
+            std::cout << std::endl;
+        }
+        printGateSummary(states);
+        printTiledSummary(states);
+        printBudgetSummary(states);
+        printStartupSummary();
+
+        if (StageMetrics::instance().enabled()) {
+            StageMetrics::Report total = StageMetrics::instance().snapshot();
+            std::cout << "Stage latency, ms (p50 / p95 / p99 / max, count):" << std::endl;
+            for (size_t i = 0; i < total.size(); ++i) {
+                if (total[i].count == 0) {
+                    continue;
+                }
+                std::cout << "  " << std::left << std::setw(11) << StageMetrics::stageName(static_cast<MetricStage>(i))
+                    << std::right << std::setprecision(2) << std::setw(7) << total[i].percentileMs(0.5)
+                    << std::setw(7) << total[i].percentileMs(0.95) << std::setw(7) << total[i].percentileMs(0.99)
+                    << std::setw(8) << total[i].maxMs() << "  " << total[i].count << std::endl;
+            }
+        }
 
         std::cout << "\n═══════════════════════════════════════════════════\n";
         std::cout << "           Программа завершена\n";
@@ -0,0 +1,524 @@
+﻿#include "yolo.h"
+#include "global.h"
+#include "StageMetrics.h"
+#include "ModelCache.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace {
+// Цвет заливки полей letterbox (как при обучении моделей Ultralytics)
+const int kPadValue = 114;
+
+double elapsedMs(uint64_t startNs, uint64_t endNs) {
+    return (endNs - startNs) * 1e-6;
+}
+
+LetterboxPreprocessor::Options preprocessorOptions(const YoloDetector::Options& options) {
+    LetterboxPreprocessor::Options preprocessor;
+    preprocessor.inputSize = options.inputSize;
+    preprocessor.layout = TENSOR_NCHW;
+    preprocessor.type = TENSOR_FLOAT32;
+    preprocessor.padValue = kPadValue;
+    return preprocessor;
+}
+
+YoloDecoder::Options decoderOptions(const YoloDetector::Options& options) {
+    YoloDecoder::Options decoder;
+    decoder.confThreshold = options.confThreshold;
+    decoder.nmsThreshold = options.nmsThreshold;
+    return decoder;
+}
+
+bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+const char* backendName(int backend) {
+    switch (backend) {
+    case cv::dnn::DNN_BACKEND_OPENCV: return "OpenCV";
+    case cv::dnn::DNN_BACKEND_INFERENCE_ENGINE: return "OpenVINO";
+    default: return "other";
+    }
+}
+
+const char* targetName(int target) {
+    switch (target) {
+    case cv::dnn::DNN_TARGET_CPU: return "CPU";
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 8)
+    case cv::dnn::DNN_TARGET_CPU_FP16: return "CPU FP16";
+#endif
+    default: return "other";
+    }
+}
+
+bool isCpuTarget(int target) {
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 8)
+    if (target == cv::dnn::DNN_TARGET_CPU_FP16) {
+        return true;
+    }
+#endif
+    return target == cv::dnn::DNN_TARGET_CPU;
+}
+
+cv::Scalar classColor(int classId) {
+    return cv::Scalar((37 * classId + 60) % 256, (17 * classId + 140) % 256, (29 * classId + 200) % 256);
+}
+}
+
+YoloDetector::YoloDetector(const Options& options)
+    : m_options(options), m_preprocessor(preprocessorOptions(options)), m_decoder(decoderOptions(options)) {
+    m_options.probeRuns = std::max(1, m_options.probeRuns);
+}
+
+YoloDetector::Options YoloDetector::preset(const std::string& name) {
+    Options options;
+    options.classes = CLASSES;
+    if (name == "v3") {
+        options.model = YOLOv3CONF;
+        options.weights = YOLOv3WEIGHT;
+        options.inputSize = cv::Size(416, 416);
+    }
+    else if (name == "v8n") {
+        options.model = YOLOv8n;
+    }
+    else if (name == "v8m") {
+        options.model = YOLOv8m;
+    }
+    else if (name == "v26n") {
+        options.model = YOLOv26n;
+    }
+    else if (name == "v26m") {
+        options.model = YOLOv26m;
+    }
+    else {
+        options.model = name;
+        if (endsWith(name, ".cfg")) {
+            options.weights = name.substr(0, name.size() - 4) + ".weights";
+            options.inputSize = cv::Size(416, 416);
+        }
+    }
+    return options;
+}
+
+bool YoloDetector::load() {
+    uint64_t startNs = StageMetrics::nowNs();
+    // Файлы модели отображаются в память и разбираются прямо из неё; повторная
+    // загрузка той же модели (копии сети, другие обработчики) диск не читает
+    ModelCache& cache = ModelCache::instance();
+    std::shared_ptr<const MappedFile> model = cache.map(m_options.model);
+    try {
+        if (endsWith(m_options.model, ".cfg")) {
+            std::shared_ptr<const MappedFile> weights = cache.map(m_options.weights);
+            m_net = model && weights
+                ? cv::dnn::readNetFromDarknet(model->data(), model->size(), weights->data(), weights->size())
+                : cv::dnn::readNetFromDarknet(m_options.model, m_options.weights);
+        }
+        else if (model && endsWith(m_options.model, ".onnx")) {
+            m_net = cv::dnn::readNetFromONNX(model->data(), model->size());
+        }
+        else {
+            m_net = cv::dnn::readNet(m_options.model);
+        }
+    }
+    catch (const cv::Exception& e) {
+        std::cerr << "YOLO: could not load " << m_options.model << ": " << e.what() << std::endl;
+        m_net = cv::dnn::Net();
+        return false;
+    }
+    if (m_net.empty()) {
+        std::cerr << "YOLO: could not load " << m_options.model << std::endl;
+        return false;
+    }
+
+    m_outputNames = m_net.getUnconnectedOutLayersNames();
+    m_layout = m_options.layout;
+    loadClassNames();
+    if (!m_options.classAllowlist.empty()) {
+        for (const std::string& name : m_decoder.setClassAllowlist(m_options.classAllowlist, m_classNames)) {
+            std::cerr << "YOLO: unknown class '" << name << "' in allowlist" << std::endl;
+        }
+    }
+
+    // Бэкенд, выбранный в прошлый раз для той же модели и сборки OpenCV,
+    // только прогревается; иначе - перебор пробными прогонами
+    const std::string key = backendKey(model ? model->size() : 0);
+    bool cached = cache.findBackend(key, m_backend, m_target);
+    if (cached) {
+        m_net.setPreferableBackend(m_backend);
+        m_net.setPreferableTarget(m_target);
+    }
+    if (!cached || !warmUp()) {
+        // Неработающий выбор не сохраняется: следующий запуск переберёт бэкенды заново
+        if (!selectBackend()) {
+            std::cerr << "YOLO: no working backend/target for " << m_options.model << std::endl;
+            m_net = cv::dnn::Net();
+            return false;
+        }
+        cache.storeBackend(key, m_backend, m_target);
+    }
+    std::cout << "YOLO: loaded " << m_options.model << " in " << elapsedMs(startNs, StageMetrics::nowNs())
+        << " ms" << std::endl;
+    return true;
+}
+
+std::string YoloDetector::className(int classId) const {
+    if (classId >= 0 && classId < static_cast<int>(m_classNames.size())) {
+        return m_classNames[classId];
+    }
+    return "class " + std::to_string(classId);
+}
+
+std::string YoloDetector::describe() const {
+    return m_options.model + " " + std::to_string(m_options.inputSize.width) + "x" +
+        std::to_string(m_options.inputSize.height) + ", " + layoutName(m_layout) + ", " +
+        backendName(m_backend) + "/" + targetName(m_target);
+}
+
+const char* YoloDetector::layoutName(YoloLayout layout) {
+    switch (layout) {
+    case YOLO_LAYOUT_AUTO: return "AUTO";
+    case YOLO_LAYOUT_DARKNET: return "DARKNET";
+    case YOLO_LAYOUT_ANCHOR_FREE: return "ANCHOR_FREE";
+    case YOLO_LAYOUT_END2END: return "END2END";
+    default: return "UNKNOWN";
+    }
+}
+
+const std::vector<Detection>& YoloDetector::detect(const cv::Mat& frame) {
+    m_detections.clear();
+    if (!loaded() || frame.empty()) {
+        return m_detections;
+    }
+
+    uint64_t startNs = StageMetrics::nowNs();
+    {
+        ScopedStageTimer timer(METRIC_DNN_PREPROCESS);
+        preprocess(frame);
+    }
+    uint64_t preprocessedNs = StageMetrics::nowNs();
+    {
+        ScopedStageTimer timer(METRIC_DNN_INFERENCE);
+        m_net.setInput(m_blob);
+        m_net.forward(m_outputs, m_outputNames);
+    }
+    uint64_t inferredNs = StageMetrics::nowNs();
+
+    {
+        ScopedStageTimer timer(METRIC_DNN_POSTPROCESS);
+        decodeOutputs(0, 1, m_preprocessor.geometry());
+        m_timings.candidates = static_cast<int>(m_detections.size());
+
+        // Модели END2END уже выполнили NMS внутри сети
+        if (m_layout != YOLO_LAYOUT_END2END) {
+            m_decoder.nms(m_detections);
+        }
+    }
+    uint64_t endNs = StageMetrics::nowNs();
+
+    m_timings.preprocessMs = elapsedMs(startNs, preprocessedNs);
+    m_timings.inferenceMs = elapsedMs(preprocessedNs, inferredNs);
+    m_timings.postprocessMs = elapsedMs(inferredNs, endNs);
+    m_timings.batch = 1;
+    return m_detections;
+}
+
+const std::vector<Detection>& YoloDetector::detectRegions(const cv::Mat& frame, const std::vector<cv::Rect>& regions) {
+    if (regions.empty()) {
+        return detect(frame);
+    }
+    m_detections.clear();
+    if (!loaded() || frame.empty()) {
+        return m_detections;
+    }
+
+    // Кропы вписываются каждый в свой слот пакета
+    const int batch = static_cast<int>(regions.size());
+    uint64_t startNs = StageMetrics::nowNs();
+    {
+        ScopedStageTimer timer(METRIC_DNN_PREPROCESS);
+        const int sizes[] = { batch, 3, m_options.inputSize.height, m_options.inputSize.width };
+        m_batchBlob.create(4, sizes, CV_32F);
+        m_cropGeometry.resize(batch);
+        for (int i = 0; i < batch; ++i) {
+            m_preprocessor.run(frame(regions[i]), m_batchBlob.ptr<float>(i));
+            m_cropGeometry[i] = m_preprocessor.geometry();
+        }
+    }
+    uint64_t preprocessedNs = StageMetrics::nowNs();
+
+    // Рамки кропа сдвигаются в координаты кадра
+    double inferenceMs = 0.0;
+    auto decodeCrop = [this, &regions](int crop, int slot, int batchSize) {
+        size_t first = m_detections.size();
+        decodeOutputs(slot, batchSize, m_cropGeometry[crop]);
+        for (size_t i = first; i < m_detections.size(); ++i) {
+            m_detections[i].box.x += regions[crop].x;
+            m_detections[i].box.y += regions[crop].y;
+            m_detections[i].region = crop;
+        }
+    };
+
+    bool batched = false;
+    if (m_batchSupported && batch > 1) {
+        try {
+            uint64_t forwardNs = StageMetrics::nowNs();
+            {
+                ScopedStageTimer timer(METRIC_DNN_INFERENCE);
+                m_net.setInput(m_batchBlob);
+                m_net.forward(m_outputs, m_outputNames);
+            }
+            inferenceMs += elapsedMs(forwardNs, StageMetrics::nowNs());
+            ScopedStageTimer timer(METRIC_DNN_POSTPROCESS);
+            for (int i = 0; i < batch; ++i) {
+                decodeCrop(i, i, batch);
+            }
+            batched = true;
+        }
+        catch (const cv::Exception& e) {
+            std::cerr << "YOLO: model does not accept batch " << batch << ", crops run one by one: " << e.what()
+                << std::endl;
+            m_batchSupported = false;
+            m_detections.clear();
+        }
+    }
+    if (!batched) {
+        const int sizes[] = { 1, 3, m_options.inputSize.height, m_options.inputSize.width };
+        for (int i = 0; i < batch; ++i) {
+            cv::Mat slot(4, sizes, CV_32F, m_batchBlob.ptr<float>(i));
+            uint64_t forwardNs = StageMetrics::nowNs();
+            {
+                ScopedStageTimer timer(METRIC_DNN_INFERENCE);
+                m_net.setInput(slot);
+                m_net.forward(m_outputs, m_outputNames);
+            }
+            inferenceMs += elapsedMs(forwardNs, StageMetrics::nowNs());
+            ScopedStageTimer timer(METRIC_DNN_POSTPROCESS);
+            decodeCrop(i, 0, 1);
+        }
+    }
+
+    // Один объект может попасть в несколько кропов - общий NMS и для END2END
+    uint64_t nmsNs = StageMetrics::nowNs();
+    m_timings.candidates = static_cast<int>(m_detections.size());
+    {
+        ScopedStageTimer timer(METRIC_DNN_POSTPROCESS);
+        m_decoder.nms(m_detections);
+    }
+    uint64_t endNs = StageMetrics::nowNs();
+
+    m_timings.preprocessMs = elapsedMs(startNs, preprocessedNs);
+    m_timings.inferenceMs = inferenceMs;
+    m_timings.postprocessMs = elapsedMs(preprocessedNs, nmsNs) - inferenceMs + elapsedMs(nmsNs, endNs);
+    m_timings.batch = batch;
+    return m_detections;
+}
+
+void YoloDetector::draw(cv::Mat& frame, const std::vector<Detection>& detections) const {
+    for (const Detection& detection : detections) {
+        cv::Rect box(cvRound(detection.box.x), cvRound(detection.box.y),
+            cvRound(detection.box.width), cvRound(detection.box.height));
+        cv::Scalar color = classColor(detection.classId);
+        cv::rectangle(frame, box, color, 2);
+
+        char label[96];
+        std::snprintf(label, sizeof(label), "%s %.2f", className(detection.classId).c_str(), detection.confidence);
+        int baseline = 0;
+        cv::Size textSize = cv::getTextSize(label, cv::FONT_HERSHEY_SIMPLEX, 0.5, 1, &baseline);
+        int top = std::max(box.y, textSize.height + baseline);
+        cv::rectangle(frame, cv::Point(box.x, top - textSize.height - baseline),
+            cv::Point(box.x + textSize.width, top), color, cv::FILLED);
+        cv::putText(frame, label, cv::Point(box.x, top - baseline), cv::FONT_HERSHEY_SIMPLEX,
+            0.5, cv::Scalar(0, 0, 0), 1);
+    }
+}
+
+
+
+void YoloDetector::loadClassNames() {
+    m_classNames.clear();
+    std::ifstream file(m_options.classes);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        m_classNames.push_back(line);
+    }
+    if (m_classNames.empty()) {
+        std::cerr << "YOLO: no class names in " << m_options.classes << ", using class numbers" << std::endl;
+    }
+}
+
+bool YoloDetector::selectBackend() {
+    std::vector<std::pair<int, int>> candidates;
+    if (m_options.backend >= 0) {
+        candidates.emplace_back(m_options.backend, m_options.target >= 0 ? m_options.target : cv::dnn::DNN_TARGET_CPU);
+    }
+    else {
+        for (const auto& available : cv::dnn::getAvailableBackends()) {
+            bool cpuBackend = available.first == cv::dnn::DNN_BACKEND_OPENCV ||
+                available.first == cv::dnn::DNN_BACKEND_INFERENCE_ENGINE;
+            if (cpuBackend && isCpuTarget(available.second)) {
+                candidates.emplace_back(available.first, available.second);
+            }
+        }
+        if (candidates.empty()) {
+            candidates.emplace_back(cv::dnn::DNN_BACKEND_OPENCV, cv::dnn::DNN_TARGET_CPU);
+        }
+    }
+
+    // Каждый вариант прогревается и замеряется на сером кадре размера входа;
+    // заодно первый настоящий кадр не платит за слияние слоёв и выделение памяти
+    cv::Mat probe(m_options.inputSize, CV_8UC3, cv::Scalar::all(kPadValue));
+    double bestMs = 0.0;
+    int best = -1;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        try {
+            m_net.setPreferableBackend(candidates[i].first);
+            m_net.setPreferableTarget(candidates[i].second);
+            preprocess(probe);
+            m_net.setInput(m_blob);
+            m_net.forward(m_outputs, m_outputNames);
+
+            double totalMs = 0.0;
+            for (int run = 0; run < m_options.probeRuns; ++run) {
+                uint64_t startNs = StageMetrics::nowNs();
+                m_net.setInput(m_blob);
+                m_net.forward(m_outputs, m_outputNames);
+                totalMs += elapsedMs(startNs, StageMetrics::nowNs());
+            }
+            double ms = totalMs / m_options.probeRuns;
+            std::cout << "YOLO: " << backendName(candidates[i].first) << "/" << targetName(candidates[i].second)
+                << " " << ms << " ms" << std::endl;
+            if (best < 0 || ms < bestMs) {
+                best = static_cast<int>(i);
+                bestMs = ms;
+            }
+        }
+        catch (const cv::Exception& e) {
+            std::cerr << "YOLO: " << backendName(candidates[i].first) << "/" << targetName(candidates[i].second)
+                << " unavailable: " << e.what() << std::endl;
+        }
+    }
+    if (best < 0) {
+        return false;
+    }
+
+    m_backend = candidates[best].first;
+    m_target = candidates[best].second;
+    m_net.setPreferableBackend(m_backend);
+    m_net.setPreferableTarget(m_target);
+    // Смена бэкенда после последнего замера сбрасывает сеть - прогрев заново
+    if (best != static_cast<int>(candidates.size()) - 1) {
+        return warmUp();
+    }
+    return true;
+}
+
+bool YoloDetector::warmUp() {
+    cv::Mat probe(m_options.inputSize, CV_8UC3, cv::Scalar::all(kPadValue));
+    try {
+        preprocess(probe);
+        m_net.setInput(m_blob);
+        m_net.forward(m_outputs, m_outputNames);
+    }
+    catch (const cv::Exception& e) {
+        std::cerr << "YOLO: " << backendName(m_backend) << "/" << targetName(m_target)
+            << " warm-up failed: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string YoloDetector::backendKey(size_t modelBytes) const {
+    // Выбор действителен для той же модели, размера входа, запроса бэкенда и сборки OpenCV
+    return m_options.model + (m_options.weights.empty() ? "" : "+" + m_options.weights) + " " +
+        std::to_string(modelBytes) + " bytes " + std::to_string(m_options.inputSize.width) + "x" +
+        std::to_string(m_options.inputSize.height) + " request " + std::to_string(m_options.backend) + "/" +
+        std::to_string(m_options.target) + " opencv " + CV_VERSION;
+}
+
+void YoloDetector::preprocess(const cv::Mat& frame) {
+    // Масштабирование, поля, BGR -> RGB и нормализация за один проход прямо в блоб
+    m_preprocessor.run(frame, m_blob);
+}
+
+void YoloDetector::detectLayout() {
+    const cv::Mat& output = m_outputs[0];
+    if (m_outputs.size() > 1 || output.dims == 2) {
+        m_layout = YOLO_LAYOUT_DARKNET;
+    }
+    else if (output.dims == 3 && output.size[2] == 6 && output.size[1] > 6) {
+        m_layout = YOLO_LAYOUT_END2END;
+    }
+    else {
+        m_layout = YOLO_LAYOUT_ANCHOR_FREE;
+    }
+    std::cout << "YOLO: output layout " << layoutName(m_layout) << std::endl;
+}
+
+void YoloDetector::decodeOutputs(int batch, int batchSize, const LetterboxGeometry& geometry) {
+    if (m_layout == YOLO_LAYOUT_AUTO) {
+        detectLayout();
+    }
+    switch (m_layout) {
+    case YOLO_LAYOUT_DARKNET: decodeDarknet(batch, batchSize, geometry); break;
+    case YOLO_LAYOUT_END2END: decodeEnd2End(batch, geometry); break;
+    default: decodeAnchorFree(batch, geometry); break;
+    }
+}
+
+void YoloDetector::decodeDarknet(int batch, int batchSize, const LetterboxGeometry& geometry) {
+    // Координаты Darknet - доли входа; строки пакета идут подряд по изображениям
+    const cv::Point2f scale(static_cast<float>(m_options.inputSize.width), static_cast<float>(m_options.inputSize.height));
+    for (const cv::Mat& output : m_outputs) {
+        int rows = output.rows / batchSize;
+        m_decoder.decodeDarknet(output.ptr<float>(batch * rows), output.cols - 5, rows, scale,
+            geometry, m_detections);
+    }
+}
+
+void YoloDetector::decodeAnchorFree(int batch, const LetterboxGeometry& geometry) {
+    const cv::Mat& output = m_outputs[0];
+    int rows = output.size[1], cols = output.size[2];
+
+    // [1, 4 + C, N] разбирается по столбцам без транспонирования
+    if (rows < cols) {
+        m_decoder.decodeChannelMajor(output.ptr<float>(batch), rows - 4, cols, cv::Point2f(1.0f, 1.0f),
+            geometry, m_detections);
+    }
+    else {
+        m_decoder.decodeAnchorMajor(output.ptr<float>(batch), cols - 4, rows, cv::Point2f(1.0f, 1.0f),
+            geometry, m_detections);
+    }
+}
+
+void YoloDetector::decodeEnd2End(int batch, const LetterboxGeometry& geometry) {
+    const cv::Mat& output = m_outputs[0];
+    const int count = output.size[1];
+    const float* data = output.ptr<float>(batch);
+    for (int i = 0; i < count; ++i) {
+        const float* row = data + i * 6;
+        int classId = static_cast<int>(row[5]);
+        if (row[4] < m_options.confThreshold || classId < 0 || !m_decoder.allowed(classId)) {
+            continue;
+        }
+        // Координаты входа сети -> координаты кадра (обратный letterbox)
+        cv::Point2f topLeft = geometry.toFrame(row[0], row[1]);
+        cv::Point2f bottomRight = geometry.toFrame(row[2], row[3]);
+        float left = std::max(0.0f, topLeft.x);
+        float top = std::max(0.0f, topLeft.y);
+        float right = std::min(static_cast<float>(geometry.frameSize.width), bottomRight.x);
+        float bottom = std::min(static_cast<float>(geometry.frameSize.height), bottomRight.y);
+        if (right <= left || bottom <= top) {
+            continue;
+        }
+        Detection detection;
+        detection.box = cv::Rect2f(left, top, right - left, bottom - top);
+        detection.classId = classId;
+        detection.confidence = row[4];
+        m_detections.push_back(detection);
+    }
+}
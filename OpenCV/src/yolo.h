@@ -0,0 +1,122 @@
+﻿#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/dnn.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Letterbox.h"
+#include "YoloDecoder.h"
+
+// Раскладка выхода сети YOLO
+enum YoloLayout {
+    YOLO_LAYOUT_AUTO = 0,       // По форме выхода при первом кадре
+    YOLO_LAYOUT_DARKNET = 1,    // [N, 5 + C] на каждый выходной слой: cx, cy, w, h (доли входа), объектность,
+                                // вероятности классов (слой region уже умножил их на объектность)
+    YOLO_LAYOUT_ANCHOR_FREE = 2,// [1, 4 + C, N] (YOLOv8) или [1, N, 4 + C]: cx, cy, w, h (пиксели входа), классы
+    YOLO_LAYOUT_END2END = 3     // [1, K, 6] без NMS (YOLO26): x1, y1, x2, y2 (пиксели входа), уверенность, класс
+};
+
+// Детектор YOLO на cv::dnn для моделей из global.h: Darknet (yolov3.cfg +
+// weights) и ONNX (YOLOv8, YOLO26). Кадр вписывается во вход с сохранением
+// пропорций (letterbox), рамки возвращаются в координатах кадра.
+// Блоб входа и выходы сети живут между кадрами, после
+// первого кадра память не выделяется (кроме внутренних буферов dnn).
+// Бэкенд и цель выбираются при загрузке: из доступных CPU-вариантов
+// (OpenVINO, OpenCV, OpenCV FP16) берётся самый быстрый по пробным прогонам.
+// Выбор запоминается в ModelCache: следующая загрузка той же модели (и
+// перезапуск с каталогом кэша) только прогревает сеть на нём.
+class YoloDetector {
+public:
+    struct Options {
+        std::string model;                  // .onnx или .cfg Darknet
+        std::string weights;                // Веса Darknet (для .onnx не нужны)
+        std::string classes;                // Имена классов, по одному в строке
+        cv::Size inputSize = cv::Size(640, 640);
+        float confThreshold = 0.25f;
+        float nmsThreshold = 0.45f;
+        std::vector<std::string> classAllowlist;    // Имена из файла классов, пусто - все
+        YoloLayout layout = YOLO_LAYOUT_AUTO;
+        int backend = -1;                   // cv::dnn::DNN_BACKEND_*, -1 - выбрать самый быстрый
+        int target = -1;                    // cv::dnn::DNN_TARGET_*, -1 - вместе с бэкендом
+        int probeRuns = 3;                  // Пробных прогонов на вариант при выборе бэкенда
+    };
+
+    // Время стадий последнего кадра
+    struct Timings {
+        double preprocessMs = 0.0;          // Letterbox и блоб
+        double inferenceMs = 0.0;           // forward()
+        double postprocessMs = 0.0;         // Разбор выхода и NMS
+        int candidates = 0;                 // Рамок до NMS
+        int batch = 1;                      // Изображений (кропов) в кадре
+    };
+
+    explicit YoloDetector(const Options& options);
+
+    // Настройки для модели из global.h: v3, v8n, v8m, v26n, v26m;
+    // иначе name - путь к .onnx (или .cfg, рядом .weights)
+    static Options preset(const std::string& name);
+
+    // Разбор модели из отображённых файлов, выбор бэкенда и прогрев
+    bool load();
+    bool loaded() const { return !m_net.empty(); }
+
+    // Объекты кадра BGR (вектор переиспользуется до следующего вызова)
+    const std::vector<Detection>& detect(const cv::Mat& frame);
+    // Объекты в кропах regions кадра: кропы идут в сеть одним пакетом [N, 3, H, W]
+    // (модель с фиксированным пакетом 1 - по одному), рамки в координатах кадра
+    // после общего NMS. Пустой regions - весь кадр, как detect()
+    const std::vector<Detection>& detectRegions(const cv::Mat& frame, const std::vector<cv::Rect>& regions);
+    // Рамки и подписи поверх кадра
+    void draw(cv::Mat& frame, const std::vector<Detection>& detections) const;
+
+    // Объекты последнего detect()
+    const std::vector<Detection>& detections() const { return m_detections; }
+    const Timings& timings() const { return m_timings; }
+    const std::vector<std::string>& classNames() const { return m_classNames; }
+    std::string className(int classId) const;
+    YoloLayout layout() const { return m_layout; }
+    const Options& options() const { return m_options; }
+    // Модель, бэкенд и цель
+    std::string describe() const;
+
+    static const char* layoutName(YoloLayout layout);
+
+private:
+    Options m_options;
+    cv::dnn::Net m_net;
+    std::vector<cv::String> m_outputNames;
+    std::vector<std::string> m_classNames;
+    YoloLayout m_layout = YOLO_LAYOUT_AUTO;
+    int m_backend = 0;
+    int m_target = 0;
+
+    // Буферы между кадрами
+    LetterboxPreprocessor m_preprocessor;
+    cv::Mat m_blob;
+    std::vector<cv::Mat> m_outputs;
+    // Пакет кропов и геометрия каждого; false - модель не принимает пакет больше 1
+    cv::Mat m_batchBlob;
+    std::vector<LetterboxGeometry> m_cropGeometry;
+    bool m_batchSupported = true;
+
+    // Разбор выхода и NMS; кандидаты до NMS, после - результат кадра
+    YoloDecoder m_decoder;
+    std::vector<Detection> m_detections;
+
+    Timings m_timings;
+
+    void loadClassNames();
+    // Перебор бэкендов пробными прогонами; false - ни один не работает
+    bool selectBackend();
+    // Прогон серого кадра на текущем бэкенде; false - бэкенд не работает
+    bool warmUp();
+    std::string backendKey(size_t modelBytes) const;
+    void preprocess(const cv::Mat& frame);
+    void detectLayout();
+    // Разбор изображения batch из пакета batchSize в m_detections
+    void decodeOutputs(int batch, int batchSize, const LetterboxGeometry& geometry);
+    void decodeDarknet(int batch, int batchSize, const LetterboxGeometry& geometry);
+    void decodeAnchorFree(int batch, const LetterboxGeometry& geometry);
+    void decodeEnd2End(int batch, const LetterboxGeometry& geometry);
+};
@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include <iostream>
+
+// Проверки тестов: провал печатается с местом, тест продолжается, код
+// выхода main - testResult()
+inline int& testFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+inline int testResult() {
+    if (testFailures() > 0) {
+        std::cerr << testFailures() << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "OK" << std::endl;
+    return 0;
+}
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed"    \
+                << std::endl;                                                               \
+            ++testFailures();                                                               \
+        }                                                                                   \
+    } while (0)
@@ -0,0 +1,72 @@
+﻿#include "FastFrontEnd.h"
+#include "TestCheck.h"
+
+// Совмещённый фронтенд на всех доступных уровнях SIMD против эталона OpenCV
+namespace {
+// Синтетический кадр: градиент, прямоугольники, окружность и шум - резкие
+// и плавные перепады, значения у границ диапазона 0..255
+cv::Mat syntheticFrame(cv::Size size, int type, uint64_t seed) {
+    cv::Mat frame(size, CV_8UC3);
+    for (int y = 0; y < size.height; ++y) {
+        cv::Vec3b* row = frame.ptr<cv::Vec3b>(y);
+        for (int x = 0; x < size.width; ++x) {
+            row[x] = cv::Vec3b(static_cast<uchar>(x * 255 / std::max(size.width - 1, 1)),
+                static_cast<uchar>(y * 255 / std::max(size.height - 1, 1)), static_cast<uchar>((x + y) & 0xFF));
+        }
+    }
+    cv::rectangle(frame, cv::Rect(size.width / 4, size.height / 4, size.width / 2, size.height / 3),
+        cv::Scalar(255, 255, 255), cv::FILLED);
+    cv::rectangle(frame, cv::Rect(size.width / 3, size.height / 2, size.width / 5, size.height / 4),
+        cv::Scalar(0, 0, 0), cv::FILLED);
+    cv::circle(frame, cv::Point(size.width * 2 / 3, size.height / 3), std::min(size.width, size.height) / 5,
+        cv::Scalar(0, 128, 255), cv::FILLED);
+
+    cv::Mat noise(size, CV_8UC3);
+    cv::RNG rng(seed);
+    rng.fill(noise, cv::RNG::UNIFORM, 0, 48);
+    cv::add(frame, noise, frame);
+    if (type == CV_8UC1) {
+        cv::cvtColor(frame, frame, cv::COLOR_BGR2GRAY);
+    }
+    return frame;
+}
+
+void testLevel(SimdLevel level) {
+    const cv::Size sizes[] = { cv::Size(640, 480), cv::Size(1280, 720), cv::Size(97, 61), cv::Size(33, 9) };
+    const int types[] = { CV_8UC3, CV_8UC1 };
+    FastFrontEnd frontEnd;
+    frontEnd.setSimdLevel(level);
+    CHECK(frontEnd.simdLevel() == level);
+
+    uint64_t seed = 1;
+    for (const cv::Size& size : sizes) {
+        for (int type : types) {
+            cv::Mat frame = syntheticFrame(size, type, seed++);
+            // Кэш по умолчанию и маленький: много полос и их стыков на кадр
+            for (size_t l2 : { size_t(1) << 20, size_t(16) << 10 }) {
+                frontEnd.setL2CacheSize(l2);
+                cv::Mat dx, dy;
+                frontEnd.process(frame, dx, dy);
+                CHECK(dx.type() == CV_16SC1 && dy.type() == CV_16SC1);
+                CHECK(dx.size() == size && dy.size() == size);
+
+                int deviation = frontEnd.compareWithReference(frame);
+                if (deviation > FastFrontEnd::kMaxGradientDeviation) {
+                    std::cerr << FastFrontEnd::simdLevelName(level) << " " << size.width << "x" << size.height
+                        << ", channels " << frame.channels() << ", L2 " << l2 << ": deviation " << deviation << std::endl;
+                }
+                CHECK(deviation <= FastFrontEnd::kMaxGradientDeviation);
+            }
+        }
+    }
+}
+}
+
+int main() {
+    SimdLevel best = FastFrontEnd::detectSimdLevel();
+    for (int level = SIMD_SCALAR; level <= best; ++level) {
+        std::cout << "Checking " << FastFrontEnd::simdLevelName(static_cast<SimdLevel>(level)) << std::endl;
+        testLevel(static_cast<SimdLevel>(level));
+    }
+    return testResult();
+}
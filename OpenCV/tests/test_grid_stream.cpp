@@ -0,0 +1,190 @@
+﻿#include "GridStream.h"
+#include "TestCheck.h"
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// Передача кадров по loopback (TCP и UDP) и сборка UDP при повреждённых датаграммах
+namespace {
+const int kTcpPort = 47811;
+const int kUdpPort = 47812;
+const int kRawPort = 47813;
+const int kStallPort = 47814;
+const int kTimeoutMs = 2000;
+
+StreamEndpoint endpoint(const std::string& url) {
+    StreamEndpoint result;
+    CHECK(StreamEndpoint::parse(url, result));
+    return result;
+}
+
+std::vector<uint8_t> pattern(size_t size, uint32_t seed) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        data[i] = static_cast<uint8_t>(seed >> 24);
+    }
+    return data;
+}
+
+// Кадры разных размеров (включая пустой и много фрагментов) доходят без изменений
+void testLoopback(const std::string& protocol, int port) {
+    GridStreamReceiver receiver(endpoint(protocol + "://127.0.0.1:" + std::to_string(port)));
+    CHECK(receiver.open());
+    GridStreamSender::Options options;
+    options.endpoint = endpoint(protocol + "://127.0.0.1:" + std::to_string(port));
+    options.mtu = 1000;
+    GridStreamSender sender(options);
+    CHECK(sender.start());
+
+    const size_t sizes[] = { 1, 0, 963, 964, 5000, 200000 };
+    uint64_t frameId = 0;
+    for (size_t size : sizes) {
+        std::vector<uint8_t> expected = pattern(size, static_cast<uint32_t>(size) + 7);
+        std::vector<uint8_t> data = expected;
+        sender.submit(data, ++frameId, GridStreamSender::wallClockNs());
+
+        GridStreamReceiver::Frame frame;
+        CHECK(receiver.receive(frame, kTimeoutMs));
+        CHECK(frame.frameId == frameId);
+        CHECK(frame.data == expected);
+    }
+    sender.stop();
+    GridStreamReceiver::Stats stats = receiver.stats();
+    CHECK(stats.frames == frameId);
+    CHECK(stats.errors == 0);
+    CHECK(stats.lost == 0);
+}
+
+#ifdef _WIN32
+using RawSocket = SOCKET;
+void closeRaw(RawSocket socket) { closesocket(socket); }
+#else
+using RawSocket = int;
+void closeRaw(RawSocket socket) { ::close(socket); }
+#endif
+
+void put(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+// Датаграмма формата GridStream: заголовок 36 байт и payload
+std::vector<uint8_t> datagram(uint32_t sequence, int fragment, int fragments, uint32_t total, uint32_t offset,
+    const uint8_t* payload, size_t size) {
+    std::vector<uint8_t> out;
+    put(out, 0x31554742, 4);
+    put(out, sequence, 4);
+    put(out, fragment, 2);
+    put(out, fragments, 2);
+    put(out, total, 4);
+    put(out, offset, 4);
+    put(out, 42, 8);
+    put(out, 0, 8);
+    out.insert(out.end(), payload, payload + size);
+    return out;
+}
+
+// Датаграммы с тем же номером кадра, но другим числом фрагментов, номером
+// за пределами сборки или чужим смещением отбрасываются и не портят кадр
+void testMalformedDatagrams() {
+    GridStreamReceiver receiver(endpoint("udp://127.0.0.1:" + std::to_string(kRawPort)));
+    CHECK(receiver.open());
+    RawSocket socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(kRawPort));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    auto send = [&](const std::vector<uint8_t>& data) {
+        ::sendto(socket, reinterpret_cast<const char*>(data.data()), static_cast<int>(data.size()), 0,
+            reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    };
+
+    // Кадр 300 байт из трёх фрагментов по 100
+    const std::vector<uint8_t> expected = pattern(300, 3);
+    const std::vector<uint8_t> garbage(100, 0xEE);
+    const uint32_t sequence = 1000;
+    send(datagram(sequence, 0, 3, 300, 0, expected.data(), 100));
+    // Номер фрагмента за пределами сборки (раньше - запись за m_fragmentSeen)
+    send(datagram(sequence, 50000, 60000, 300, 200, garbage.data(), 100));
+    send(datagram(sequence, 7, 9, 300, 200, garbage.data(), 100));
+    // Тот же номер, но смещение не по шагу фрагментов или неполный средний фрагмент
+    send(datagram(sequence, 1, 3, 300, 150, garbage.data(), 100));
+    send(datagram(sequence, 1, 3, 300, 100, garbage.data(), 50));
+    // Последний фрагмент, не доходящий до конца кадра
+    send(datagram(sequence, 2, 3, 300, 200, garbage.data(), 60));
+    // Другой размер кадра
+    send(datagram(sequence, 2, 3, 400, 200, garbage.data(), 100));
+    send(datagram(sequence, 1, 3, 300, 100, expected.data() + 100, 100));
+    send(datagram(sequence, 2, 3, 300, 200, expected.data() + 200, 100));
+
+    GridStreamReceiver::Frame frame;
+    CHECK(receiver.receive(frame, kTimeoutMs));
+    CHECK(frame.data == expected);
+    GridStreamReceiver::Stats stats = receiver.stats();
+    CHECK(stats.frames == 1);
+    CHECK(stats.errors == 6);
+    closeRaw(socket);
+}
+
+// Отправитель TCP замолкает посреди кадра: приём не висит, соединение
+// закрывается, следующий отправитель принимается
+void testStalledTcpSender() {
+    GridStreamReceiver receiver(endpoint("tcp://127.0.0.1:" + std::to_string(kStallPort)));
+    CHECK(receiver.open());
+    RawSocket socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(kStallPort));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(::connect(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+
+    // Заголовок кадра 1000 байт и только 10 байт данных
+    std::vector<uint8_t> partial;
+    put(partial, 0x31534742, 4);
+    put(partial, 1000, 4);
+    put(partial, 1, 8);
+    put(partial, 0, 8);
+    partial.insert(partial.end(), 10, 0x55);
+    ::send(socket, reinterpret_cast<const char*>(partial.data()), static_cast<int>(partial.size()), 0);
+
+    GridStreamReceiver::Frame frame;
+    auto start = std::chrono::steady_clock::now();
+    CHECK(!receiver.receive(frame, 100));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    CHECK(seconds < 5.0);
+    CHECK(receiver.stats().errors == 1);
+    closeRaw(socket);
+
+    GridStreamSender::Options options;
+    options.endpoint = endpoint("tcp://127.0.0.1:" + std::to_string(kStallPort));
+    GridStreamSender sender(options);
+    CHECK(sender.start());
+    std::vector<uint8_t> expected = pattern(3000, 11);
+    std::vector<uint8_t> data = expected;
+    sender.submit(data, 2, GridStreamSender::wallClockNs());
+    CHECK(receiver.receive(frame, kTimeoutMs));
+    CHECK(frame.frameId == 2);
+    CHECK(frame.data == expected);
+    sender.stop();
+    CHECK(receiver.stats().connections == 2);
+}
+}
+
+int main() {
+    testLoopback("tcp", kTcpPort);
+    testLoopback("udp", kUdpPort);
+    testMalformedDatagrams();
+    testStalledTcpSender();
+    return testResult();
+}
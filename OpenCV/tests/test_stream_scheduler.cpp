@@ -0,0 +1,135 @@
+﻿#include "StreamScheduler.h"
+#include "TestCheck.h"
+#include <chrono>
+#include <filesystem>
+
+// Несколько источников (синтетика и последовательность изображений) на общем
+// пуле без окна: каждый захваченный кадр обработан или учтён как пропущенный
+namespace {
+const int kImages = 6;
+const double kTimeoutSeconds = 20.0;
+
+// Последовательность кадров для источника images:
+std::string writeImages() {
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "test_stream_scheduler";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    for (int i = 0; i < kImages; ++i) {
+        cv::Mat image(cv::Size(160, 120), CV_8UC3, cv::Scalar(i * 40, 255 - i * 40, 128));
+        cv::rectangle(image, cv::Rect(10 + i * 10, 20, 40, 30), cv::Scalar(255, 255, 255), cv::FILLED);
+        CHECK(cv::imwrite((directory / ("frame" + std::to_string(i) + ".png")).string(), image));
+    }
+    return "images:" + (directory / "*.png").string();
+}
+
+struct StreamLog {
+    std::atomic<int> inFlight{ 0 };
+    bool overlapped = false;        // Два задания одного потока одновременно
+    bool outOfOrder = false;        // Номера кадров не возрастают
+    int64_t lastId = -1;
+    uint64_t calls = 0;
+};
+
+void testScheduler(const StreamScheduler::Options& options, const std::string& images, int processDelayMs,
+    bool lossless) {
+    const uint64_t maxFrames[] = { 40, 25 };
+    FrameSource::Options sourceOptions;
+    sourceOptions.size = cv::Size(160, 120);
+    sourceOptions.pacing = PACING_UNLIMITED;
+
+    StreamScheduler scheduler(options);
+    std::vector<uint64_t> expected;
+    for (int i = 0; i < 2; ++i) {
+        sourceOptions.maxFrames = maxFrames[i];
+        std::unique_ptr<FrameSource> source = FrameSource::create("synthetic:" + std::to_string(i + 1), sourceOptions);
+        CHECK(source != nullptr);
+        scheduler.addStream(std::move(source), "synthetic " + std::to_string(i + 1));
+        expected.push_back(maxFrames[i]);
+    }
+    // Последовательность без ограничения кадров заканчивается сама
+    sourceOptions.maxFrames = 0;
+    std::unique_ptr<FrameSource> sequence = FrameSource::create(images, sourceOptions);
+    CHECK(sequence != nullptr);
+    if (!sequence) {
+        return;
+    }
+    scheduler.addStream(std::move(sequence), "images");
+    expected.push_back(kImages);
+
+    std::vector<std::unique_ptr<StreamLog>> logs;
+    for (int i = 0; i < scheduler.streamCount(); ++i) {
+        logs.emplace_back(new StreamLog());
+    }
+    scheduler.start([&logs, processDelayMs](int stream, FramePacket& packet) {
+        StreamLog& log = *logs[stream];
+        if (log.inFlight.fetch_add(1) != 0) {
+            log.overlapped = true;
+        }
+        if (static_cast<int64_t>(packet.id) <= log.lastId) {
+            log.outOfOrder = true;
+        }
+        log.lastId = static_cast<int64_t>(packet.id);
+        ++log.calls;
+
+        cv::Mat gray;
+        cv::cvtColor(packet.frame.mat(), gray, cv::COLOR_BGR2GRAY);
+        if (processDelayMs > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(processDelayMs));
+        }
+        log.inFlight.fetch_sub(1);
+    });
+
+    auto begin = std::chrono::steady_clock::now();
+    while (!scheduler.finished() &&
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() < kTimeoutSeconds) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    CHECK(scheduler.finished());
+    scheduler.stop();
+
+    StreamScheduler::Stats stats = scheduler.stats();
+    CHECK(stats.streams.size() == expected.size());
+    CHECK(stats.total.finished);
+    for (size_t i = 0; i < stats.streams.size() && i < expected.size(); ++i) {
+        const StreamScheduler::StreamStats& stream = stats.streams[i];
+        CHECK(stream.finished);
+        CHECK(stream.captured == expected[i]);
+        CHECK(stream.processed + stream.droppedQueue + stream.droppedDeadline == stream.captured);
+        CHECK(stream.processed == logs[i]->calls);
+        CHECK(stream.processed > 0);
+        CHECK(!logs[i]->overlapped);
+        CHECK(!logs[i]->outOfOrder);
+        if (lossless) {
+            CHECK(stream.processed == stream.captured);
+        }
+    }
+    CHECK(stats.total.processed + stats.total.droppedQueue + stats.total.droppedDeadline == stats.total.captured);
+}
+}
+
+int main() {
+    const std::string images = writeImages();
+
+    // Без потерь: очередь ждёт обработку, срока нет
+    StreamScheduler::Options blocking;
+    blocking.threads = 2;
+    blocking.queuePolicy = DROP_BLOCK;
+    testScheduler(blocking, images, 0, true);
+
+    // Медленная обработка: кадры вытесняются свежими и пропускаются по сроку
+    StreamScheduler::Options latest;
+    latest.threads = 2;
+    latest.queueCapacity = 1;
+    latest.queuePolicy = DROP_LATEST_ONLY;
+    latest.deadlineMs = 20.0;
+    testScheduler(latest, images, 5, false);
+
+    StreamScheduler::Options newest;
+    newest.threads = 3;
+    newest.framesPerJob = 4;
+    newest.queuePolicy = DROP_NEWEST;
+    testScheduler(newest, images, 1, false);
+
+    std::filesystem::remove_all(std::filesystem::temp_directory_path() / "test_stream_scheduler");
+    return testResult();
+}